@@ -51,7 +51,6 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
     '''
 
     def run_test(self):
-        print "Warning: this test will take about 70 seconds in the best case. Be patient."
         self.nodes[0].generate(10)
         templat = self.nodes[0].getblocktemplate()
         longpollid = templat['longpollid']
@@ -84,10 +83,16 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
         thr.start()
         # generate a random transaction and submit it
         (txid, txhex, fee) = random_transaction(self.nodes, Decimal("1.1"), Decimal("0.0"), Decimal("0.001"), 20)
-        # after one minute, every 10 seconds the mempool is probed, so in 80 seconds it should have returned
-        thr.join(60 + 20)
+        # the longpoll is woken up by the mempool update itself
+        thr.join(5)
         assert(not thr.is_alive())
 
+        # the template served afterwards has been updated with the new transaction instead of being rebuilt
+        templat = self.nodes[0].getblocktemplate()
+        assert(txid in [tx['hash'] for tx in templat['transactions']])
+        stats = self.nodes[0].getmininginfo()['blocktemplate']
+        assert(stats['deltaupdates'] > 0)
+
 if __name__ == '__main__':
     GetBlockTemplateLPTest().main()
 
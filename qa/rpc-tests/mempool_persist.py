@@ -0,0 +1,96 @@
+#!/usr/bin/env python2
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the mempool is saved on shutdown and reloaded on startup:
+# - node0 gets some transactions, spending each other, from node1's wallet
+#   (so that node0's wallet does not resubmit them by itself on restart)
+# - after a restart node0 has them again, with the same entry times
+# - a restart with -persistmempool=0 neither loads nor overwrites mempool.dat
+# - savemempool writes mempool.dat on request
+#
+
+import os
+import time
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, start_node, stop_node, \
+    initialize_chain
+
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory " + self.options.tmpdir)
+        initialize_chain(self.options.tmpdir)
+
+    def setup_network(self):
+        # nodes are not connected, node0 only knows the transactions submitted to it
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=mempool"]))
+        self.nodes.append(start_node(1, self.options.tmpdir))
+        self.is_network_split = False
+
+    def spend(self, txid, vout, amount):
+        inputs = [{"txid": txid, "vout": vout}]
+        outputs = {self.nodes[1].getnewaddress(): amount}
+        rawtx = self.nodes[1].createrawtransaction(inputs, outputs)
+        signed = self.nodes[1].signrawtransaction(rawtx)
+        assert_equal(signed["complete"], True)
+        return self.nodes[0].sendrawtransaction(signed["hex"])
+
+    def restart_node0(self, extra_args=[]):
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-debug=mempool"] + extra_args)
+
+    def wait_for_mempool_size(self, size, timeout=60):
+        deadline = time.time() + timeout
+        while len(self.nodes[0].getrawmempool()) != size and time.time() < deadline:
+            time.sleep(0.5)
+        assert_equal(len(self.nodes[0].getrawmempool()), size)
+
+    def run_test(self):
+        mempool_dat = os.path.join(self.options.tmpdir, "node0", "regtest", "mempool.dat")
+
+        # two chains of three transactions each, children spending their parent's output
+        txids = []
+        for utxo in self.nodes[1].listunspent()[:2]:
+            txid, vout, amount = utxo["txid"], utxo["vout"], utxo["amount"]
+            for i in range(3):
+                amount -= Decimal('0.0001')
+                txid = self.spend(txid, vout, amount)
+                vout = 0
+                txids.append(txid)
+        self.nodes[0].prioritisetransaction(txids[0], 0, 1000)
+
+        mempool_before = self.nodes[0].getrawmempool(True)
+        assert_equal(set(mempool_before.keys()), set(txids))
+
+        print("Restart node0, its mempool is reloaded")
+        self.restart_node0()
+        self.wait_for_mempool_size(len(txids))
+        mempool_after = self.nodes[0].getrawmempool(True)
+        for txid in txids:
+            assert_equal(mempool_after[txid]["time"], mempool_before[txid]["time"])
+            assert_equal(mempool_after[txid]["fee"], mempool_before[txid]["fee"])
+
+        print("Restart node0 with -persistmempool=0, the mempool is not reloaded")
+        self.restart_node0(["-persistmempool=0"])
+        time.sleep(2)
+        assert_equal(len(self.nodes[0].getrawmempool()), 0)
+
+        print("Restart node0 again, mempool.dat was left untouched")
+        self.restart_node0()
+        self.wait_for_mempool_size(len(txids))
+
+        print("savemempool writes mempool.dat")
+        os.remove(mempool_dat)
+        self.nodes[0].savemempool()
+        assert(os.path.isfile(mempool_dat))
+
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
@@ -516,4 +516,33 @@ private:
     void SetTip(CBlockIndex *pindex);
 };
 
+/**
+ * The chain ending at a given block, whose entries are looked up through the block index skip list. Block index
+ * entries are never freed and their ancestry never changes, so it can be used without cs_main while chainActive
+ * moves on, e.g. to check scripts against a snapshot of the tip.
+ */
+class CTipChain : public CChain {
+private:
+    CBlockIndex* pindexTip;
+
+public:
+    CTipChain() = delete;
+    explicit CTipChain(CBlockIndex* pindexTipIn) : pindexTip(pindexTipIn) { }
+
+    CBlockIndex *operator[](int nHeight) const {
+        if (nHeight < 0 || nHeight > Height()) {
+            return NULL;
+        }
+        return pindexTip->GetAncestor(nHeight);
+    }
+
+    int Height() const {
+        return pindexTip ? pindexTip->nHeight : -1;
+    }
+
+    void SetTip(CBlockIndex *pindex) {
+        pindexTip = pindex;
+    }
+};
+
 #endif // BITCOIN_CHAIN_H
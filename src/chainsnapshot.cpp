@@ -0,0 +1,129 @@
+#include "chainsnapshot.h"
+
+#include "chain.h"
+#include "main.h"
+#include "sync.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <leveldb/db.h>
+
+CChainSnapshot::CChainSnapshot()
+{
+    LOCK(cs_main);
+    pindexTip = chainActive.Tip();
+
+#ifdef ENABLE_ADDRESS_INDEXING
+    // the indexes are written while connecting the block that becomes the tip, under cs_main
+    addressIndexSnapshot = paddressindexdb ? paddressindexdb->GetSnapshot() : NULL;
+    timestampIndexSnapshot = ptimestampindexdb ? ptimestampindexdb->GetSnapshot() : NULL;
+    spentIndexSnapshot = pspentindexdb ? pspentindexdb->GetSnapshot() : NULL;
+#endif // ENABLE_ADDRESS_INDEXING
+}
+
+CChainSnapshot::~CChainSnapshot()
+{
+#ifdef ENABLE_ADDRESS_INDEXING
+    if (addressIndexSnapshot)
+        paddressindexdb->ReleaseSnapshot(addressIndexSnapshot);
+    if (timestampIndexSnapshot)
+        ptimestampindexdb->ReleaseSnapshot(timestampIndexSnapshot);
+    if (spentIndexSnapshot)
+        pspentindexdb->ReleaseSnapshot(spentIndexSnapshot);
+#endif // ENABLE_ADDRESS_INDEXING
+}
+
+int CChainSnapshot::Height() const
+{
+    return pindexTip ? pindexTip->nHeight : -1;
+}
+
+const CBlockIndex* CChainSnapshot::operator[](int nHeight) const
+{
+    if (nHeight < 0 || nHeight > Height())
+        return NULL;
+    return pindexTip->GetAncestor(nHeight);
+}
+
+bool CChainSnapshot::Contains(const CBlockIndex* pindex) const
+{
+    return pindex != NULL && (*this)[pindex->nHeight] == pindex;
+}
+
+const CBlockIndex* CChainSnapshot::Next(const CBlockIndex* pindex) const
+{
+    if (Contains(pindex))
+        return (*this)[pindex->nHeight + 1];
+    return NULL;
+}
+
+const CBlockIndex* CChainSnapshot::LookupBlockIndex(const uint256& hash)
+{
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it != mapBlockIndex.end() ? it->second : NULL;
+}
+
+bool CChainSnapshot::HaveBlockData(const CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    return !(fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0);
+}
+
+#ifdef ENABLE_ADDRESS_INDEXING
+bool CChainSnapshot::GetAddressIndexBatch(const std::vector<std::pair<uint160, int> >& addresses,
+                                          std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > >& addressIndexes,
+                                          int start, int end) const
+{
+    if (!addressIndexSnapshot)
+        return error("address index not enabled");
+
+    if (!paddressindexdb->ReadAddressIndexBatch(addresses, addressIndexes, start, end, addressIndexSnapshot))
+        return error("unable to get txids for addresses");
+
+    return true;
+}
+
+bool CChainSnapshot::GetAddressUnspentBatch(const std::vector<std::pair<uint160, int> >& addresses,
+                                            std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > >& unspentOutputs) const
+{
+    if (!addressIndexSnapshot)
+        return error("address index not enabled");
+
+    if (!paddressindexdb->ReadAddressUnspentIndexBatch(addresses, unspentOutputs, addressIndexSnapshot))
+        return error("unable to get txids for addresses");
+
+    return true;
+}
+
+bool CChainSnapshot::GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value) const
+{
+    if (!spentIndexSnapshot)
+        return false;
+
+    if (mempool.getSpentIndex(key, value))
+        return true;
+
+    return pspentindexdb->ReadSpentIndex(key, value, spentIndexSnapshot);
+}
+
+bool CChainSnapshot::GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly, const CTimestampIndexScan& scan,
+                                       std::vector<std::pair<uint256, unsigned int> >& hashes, CTimestampIndexKey& lastKey, bool& fMore) const
+{
+    if (!timestampIndexSnapshot)
+        return error("Timestamp index not enabled");
+
+    std::function<bool(const uint256&, int)> filter;
+    if (fActiveOnly) {
+        filter = [this](const uint256& hash, int nHeight) {
+            const CBlockIndex* pindex = (*this)[nHeight];
+            return pindex != NULL && pindex->GetBlockHash() == hash;
+        };
+    }
+
+    if (!ptimestampindexdb->ReadTimestampIndex(high, low, scan, filter, hashes, lastKey, fMore, timestampIndexSnapshot))
+        return error("Unable to get hashes for timestamps");
+
+    return true;
+}
+#endif // ENABLE_ADDRESS_INDEXING
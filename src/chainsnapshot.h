@@ -0,0 +1,88 @@
+#ifndef BITCOIN_CHAINSNAPSHOT_H
+#define BITCOIN_CHAINSNAPSHOT_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#ifdef ENABLE_ADDRESS_INDEXING
+#include "addressindex.h"
+#include "spentindex.h"
+#include "timestampindex.h"
+#endif // ENABLE_ADDRESS_INDEXING
+
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+namespace leveldb {
+class Snapshot;
+}
+
+/**
+ * Consistent read-only view of the active chain, for read-only RPC calls.
+ *
+ * Taking the snapshot holds cs_main just long enough to read the tip and to open LevelDB snapshots of
+ * the explorer indexes; afterwards it is used without any lock. This is safe because block index entries
+ * are never freed while the node runs and their height and ancestry never change, so the active chain
+ * of the snapshot is fully described by its tip, and the indexes are read as they were at that tip.
+ *
+ * Later blocks connected (or disconnected) by the node are not visible through the snapshot.
+ */
+class CChainSnapshot
+{
+public:
+    CChainSnapshot();
+    ~CChainSnapshot();
+
+    const CBlockIndex* Tip() const { return pindexTip; }
+    int Height() const;
+
+    /** Index entry at the given height of the snapshot chain, or NULL if there is no such height */
+    const CBlockIndex* operator[](int nHeight) const;
+    bool Contains(const CBlockIndex* pindex) const;
+    /** Successor of pindex in the snapshot chain, NULL if it is not in the chain or is the tip */
+    const CBlockIndex* Next(const CBlockIndex* pindex) const;
+
+    /** Index entry of a block, NULL if unknown. Takes cs_main for the lookup only. */
+    static const CBlockIndex* LookupBlockIndex(const uint256& hash);
+    /** Whether the data of the block is stored on disk (i.e. not pruned). Takes cs_main for the check only. */
+    static bool HaveBlockData(const CBlockIndex* pindex);
+
+#ifdef ENABLE_ADDRESS_INDEXING
+    /** GetAddressIndex() of each requested address, in request order, read at the snapshot tip */
+    bool GetAddressIndexBatch(const std::vector<std::pair<uint160, int> >& addresses,
+                              std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > >& addressIndexes,
+                              int start = 0, int end = 0) const;
+    /** GetAddressUnspent() of each requested address, in request order, read at the snapshot tip */
+    bool GetAddressUnspentBatch(const std::vector<std::pair<uint160, int> >& addresses,
+                                std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > >& unspentOutputs) const;
+    /** Same as GetSpentIndex(): the mempool first, then the spent index read at the snapshot tip */
+    bool GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value) const;
+    /**
+     * Paged scan of the timestamp index, see CTimestampIndexDB::ReadTimestampIndex(). With fActiveOnly only
+     * blocks of the snapshot chain are returned, checked against it by height without any block index lookup.
+     */
+    bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly, const CTimestampIndexScan& scan,
+                           std::vector<std::pair<uint256, unsigned int> >& hashes, CTimestampIndexKey& lastKey, bool& fMore) const;
+#endif // ENABLE_ADDRESS_INDEXING
+
+private:
+    const CBlockIndex* pindexTip;
+
+#ifdef ENABLE_ADDRESS_INDEXING
+    //! NULL when the corresponding index is not enabled
+    const leveldb::Snapshot* addressIndexSnapshot;
+    const leveldb::Snapshot* timestampIndexSnapshot;
+    const leveldb::Snapshot* spentIndexSnapshot;
+#endif // ENABLE_ADDRESS_INDEXING
+
+    CChainSnapshot(const CChainSnapshot&);
+    void operator=(const CChainSnapshot&);
+};
+
+#endif // BITCOIN_CHAINSNAPSHOT_H
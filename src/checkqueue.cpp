@@ -0,0 +1,134 @@
+// Copyright (c) 2012-2014 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+void PinCurrentThread(int nCpu)
+{
+#if defined(__linux__)
+    unsigned int nCpus = boost::thread::hardware_concurrency();
+    if (nCpus == 0)
+        return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(nCpu % nCpus, &cpuset);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (ret != 0)
+        LogPrintf("%s: cannot pin thread to CPU %u: error %d\n", __func__, nCpu % nCpus, ret);
+#endif
+}
+
+}
+
+CCheckExecutor::CCheckExecutor() : nWorkers(0), fPin(false), nNextDeque(0), nQueued(0), nIdle(0)
+{
+    vDeques.emplace_back(new WorkerDeque());
+}
+
+void CCheckExecutor::Start(boost::thread_group& threadGroup, int nWorkersIn, bool fPinThreads)
+{
+    assert(nQueued.load() == 0);
+    nWorkers = std::max(0, nWorkersIn);
+    fPin = fPinThreads;
+    nIdle = 0;
+    vDeques.clear();
+    for (int i = 0; i < std::max(1, nWorkers); i++)
+        vDeques.emplace_back(new WorkerDeque());
+    for (int i = 0; i < nWorkers; i++)
+        threadGroup.create_thread(boost::bind(&CCheckExecutor::Thread, this, i));
+}
+
+void CCheckExecutor::Submit(const std::vector<Task>& vTasks)
+{
+    if (vTasks.empty())
+        return;
+
+    // consecutive tasks go to different deques, so that idle workers take them without stealing
+    for (const Task& task : vTasks) {
+        WorkerDeque& deque = *vDeques[nNextDeque++ % vDeques.size()];
+        boost::lock_guard<boost::mutex> lock(deque.mutex);
+        deque.tasks.push_back(task);
+    }
+    nQueued += vTasks.size();
+
+    boost::lock_guard<boost::mutex> lock(mutexIdle);
+    if (nIdle > 0) {
+        if (vTasks.size() == 1)
+            condIdle.notify_one();
+        else
+            condIdle.notify_all();
+    }
+}
+
+bool CCheckExecutor::PopTask(int nWorker, Task& task)
+{
+    if (nQueued.load(std::memory_order_relaxed) <= 0)
+        return false;
+
+    // the most recent task of the own deque, whose data is the most likely to be in cache
+    if (nWorker >= 0) {
+        WorkerDeque& own = *vDeques[nWorker];
+        boost::lock_guard<boost::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            nQueued--;
+            return true;
+        }
+    }
+
+    // otherwise the oldest task of another deque, starting from a different one for each thief
+    size_t nStart = nWorker >= 0 ? nWorker + 1 : nNextDeque.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < vDeques.size(); i++) {
+        WorkerDeque& victim = *vDeques[(nStart + i) % vDeques.size()];
+        boost::lock_guard<boost::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            nQueued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CCheckExecutor::RunTask(int nWorker)
+{
+    Task task;
+    if (!PopTask(nWorker, task))
+        return false;
+    task.pgroup->RunBatch(task.pbatch);
+    return true;
+}
+
+void CCheckExecutor::Thread(int nWorker)
+{
+    RenameThread("horizen-check");
+    if (fPin)
+        PinCurrentThread(nWorker);
+
+    while (true) {
+        if (RunTask(nWorker))
+            continue;
+
+        // the interruption point at shutdown
+        boost::unique_lock<boost::mutex> lock(mutexIdle);
+        while (nQueued.load() <= 0) {
+            nIdle++;
+            condIdle.wait(lock);
+            nIdle--;
+        }
+    }
+}
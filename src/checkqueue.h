@@ -6,209 +6,226 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <memory>
 #include <vector>
 
-#include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
-
-template <typename T>
-class CCheckQueueControl;
-
-/** 
- * Queue for verifications that have to be performed.
-  * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
-  *
-  * One thread (the master) is assumed to push batches of verifications
-  * onto the queue, where they are processed by N-1 worker threads. When
-  * the master is done adding work, it temporarily joins the worker pool
-  * as an N'th worker, until all jobs are done.
-  */
-template <typename T>
-class CCheckQueue
+#include <boost/thread/thread.hpp>
+
+class CCheckGroupBase;
+
+/**
+ * Pool of worker threads running the verifications of CCheckGroups, shared by all
+ * the validation workloads.
+ *
+ * A task is a batch of verifications of one group. Each worker owns a deque of
+ * tasks, protected by its own mutex: submitted tasks are spread over the deques,
+ * a worker pops the most recent task of its own deque and, once it is empty,
+ * steals the oldest task of the others. Workers thus only contend when they take
+ * from the same deque, instead of on a single queue. A thread waiting for a group
+ * runs tasks too, so that groups complete even without workers.
+ */
+class CCheckExecutor
 {
-private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+public:
+    struct Task
+    {
+        CCheckGroupBase* pgroup;
+        //! batch of verifications, owned by pgroup
+        void* pbatch;
+    };
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    CCheckExecutor();
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+    /**
+     * Create nWorkers threads in threadGroup, running until interrupted. With fPinThreads
+     * worker i only runs on CPU i (modulo the CPU count), where supported. Call before
+     * submitting any task, and again only once the threads of the previous call have
+     * been interrupted and joined.
+     */
+    void Start(boost::thread_group& threadGroup, int nWorkers, bool fPinThreads);
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    int GetWorkerCount() const { return nWorkers; }
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    void Submit(const std::vector<Task>& vTasks);
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Run one task, from the deque of nWorker (-1 for other threads) or stolen; false if none is queued
+    bool RunTask(int nWorker);
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+private:
+    struct WorkerDeque
+    {
+        boost::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    //! one per worker, and at least one for the tasks submitted when there are no workers
+    std::vector<std::unique_ptr<WorkerDeque>> vDeques;
+    int nWorkers;
+    bool fPin;
+
+    //! where Submit() and external threads start, spreading tasks and thefts over the deques
+    std::atomic<unsigned int> nNextDeque;
+    //! tasks in all deques, possibly lagging behind them
+    std::atomic<int> nQueued;
+
+    //! idle workers wait on condIdle, until nQueued is positive
+    boost::mutex mutexIdle;
+    boost::condition_variable condIdle;
+    int nIdle;
 
-    /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
-     */
-    unsigned int nTodo;
+    bool PopTask(int nWorker, Task& task);
+    void Thread(int nWorker);
+};
 
-    //! Whether we're shutting down.
-    bool fQuit;
+/** Type-independent part of CCheckGroup, run by the executor */
+class CCheckGroupBase
+{
+    friend class CCheckExecutor;
 
-    //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
+protected:
+    CCheckExecutor* pexecutor;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
-    {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
-            }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
-    }
+    //! tasks submitted and not completed yet
+    std::atomic<int> nPending;
+    //! cleared by the first failed verification, after which the remaining ones are skipped
+    std::atomic<bool> fAllOk;
+    //! whether tasks were submitted since the last Wait(); only used by the owner
+    bool fSubmitted;
 
-public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! set, with the mutex held, by the thread completing the last pending task
+    boost::mutex mutex;
+    boost::condition_variable condDone;
+    bool fDone;
 
-    //! Worker thread
-    void Thread()
-    {
-        Loop();
-    }
+    explicit CCheckGroupBase(CCheckExecutor* pexecutorIn) :
+        pexecutor(pexecutorIn), nPending(0), fAllOk(true), fSubmitted(false), fDone(false) {}
+    virtual ~CCheckGroupBase() {}
 
-    //! Wait until execution finishes, and return whether all evaluations were successful.
-    bool Wait()
-    {
-        return Loop(true);
-    }
+    virtual void RunBatch(void* pbatch) = 0;
 
-    //! Add a batch of checks to the queue
-    void Add(std::vector<T>& vChecks)
+    void TaskDone()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (nPending.fetch_sub(1) == 1) {
+            // the owner may destroy the group as soon as it sees fDone: nothing is touched afterwards
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fDone = true;
+            condDone.notify_one();
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
-    ~CCheckQueue()
+    //! Run queued tasks until the ones of this group are all taken, then wait for their completion
+    bool Join()
     {
+        if (fSubmitted) {
+            // the group must not be left behind with tasks referencing it
+            boost::this_thread::disable_interruption di;
+            while (nPending.load() > 0 && pexecutor->RunTask(-1)) {}
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fDone)
+                condDone.wait(lock);
+            fDone = false;
+            fSubmitted = false;
+        }
+        bool fRet = fAllOk.load();
+        fAllOk = true;
+        return fRet;
     }
-
-    bool IsIdle()
-    {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
-    }
-
 };
 
-/** 
- * RAII-style controller object for a CCheckQueue that guarantees the passed
- * queue is finished before continuing.
+/**
+ * Run the verifications of vChecks in order, until one fails or fContinue is cleared, and
+ * return false if one failed. Specialized for verifications that are cheaper run together.
  */
 template <typename T>
-class CCheckQueueControl
+bool RunCheckBatch(std::vector<T>& vChecks, const std::atomic<bool>& fContinue)
+{
+    for (T& check : vChecks) {
+        if (!fContinue.load(std::memory_order_relaxed))
+            break;
+        if (!check())
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Group of verifications of type T, which must provide a swap() and an operator()
+ * returning a bool, run by a CCheckExecutor. The owner thread adds batches of them,
+ * then joins the group with Wait(), which returns whether all were successful. The
+ * destructor waits too, so that verifications referencing data of the owner never
+ * outlive the group. Without an executor, verifications run when added.
+ */
+template <typename T>
+class CCheckGroup : private CCheckGroupBase
 {
 private:
-    CCheckQueue<T>* pqueue;
-    bool fDone;
+    //! the largest number of verifications of a task
+    unsigned int nBatchSize;
 
-public:
-    CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
+    //! not reallocated while tasks run, only accessed by the task owning each of them
+    std::list<std::vector<T>> batches;
+
+    void RunBatch(void* pbatch)
     {
-        // passed queue is supposed to be unused, or NULL
-        if (pqueue != NULL) {
-            bool isIdle = pqueue->IsIdle();
-            assert(isIdle);
-        }
+        std::vector<T>& vChecks = *static_cast<std::vector<T>*>(pbatch);
+        if (!RunCheckBatch(vChecks, fAllOk))
+            fAllOk = false;
+        // release what the verifications hold as soon as they are done
+        std::vector<T>().swap(vChecks);
+        TaskDone();
     }
 
-    bool Wait()
+public:
+    explicit CCheckGroup(CCheckExecutor* pexecutorIn, unsigned int nBatchSizeIn = 16) :
+        CCheckGroupBase(pexecutorIn), nBatchSize(std::max(1U, nBatchSizeIn)) {}
+
+    ~CCheckGroup()
     {
-        if (pqueue == NULL)
-            return true;
-        bool fRet = pqueue->Wait();
-        fDone = true;
-        return fRet;
+        Wait();
     }
 
+    //! Add a batch of verifications, split into tasks of at most nBatchSize; vChecks is left with default values
     void Add(std::vector<T>& vChecks)
     {
-        if (pqueue != NULL)
-            pqueue->Add(vChecks);
+        if (vChecks.empty())
+            return;
+
+        if (pexecutor == NULL) {
+            if (!RunCheckBatch(vChecks, fAllOk))
+                fAllOk = false;
+            return;
+        }
+
+        std::vector<CCheckExecutor::Task> vTasks;
+        vTasks.reserve((vChecks.size() + nBatchSize - 1) / nBatchSize);
+        for (size_t nBegin = 0; nBegin < vChecks.size(); nBegin += nBatchSize) {
+            size_t nEnd = std::min<size_t>(nBegin + nBatchSize, vChecks.size());
+            batches.push_back(std::vector<T>(nEnd - nBegin));
+            std::vector<T>& batch = batches.back();
+            for (size_t i = nBegin; i < nEnd; i++)
+                batch[i - nBegin].swap(vChecks[i]);
+            CCheckExecutor::Task task = {this, &batch};
+            vTasks.push_back(task);
+        }
+
+        nPending += vTasks.size();
+        fSubmitted = true;
+        pexecutor->Submit(vTasks);
     }
 
-    ~CCheckQueueControl()
+    //! Wait until all the verifications added so far are done, and return whether they were all successful
+    bool Wait()
     {
-        if (!fDone)
-            Wait();
+        bool fRet = Join();
+        batches.clear();
+        return fRet;
     }
 };
 
@@ -261,6 +261,18 @@ size_t CCswNullifiersKeyHasher::operator()(const std::pair<uint256, CFieldElemen
     return CalculateHash(buf, BUF_LEN, salt);
 }
 
+CFieldElementKeyHasher::CFieldElementKeyHasher() : salt() {GetRandBytes(reinterpret_cast<unsigned char*>(salt), sizeof(salt));}
+
+size_t CFieldElementKeyHasher::operator()(const CFieldElement& key) const {
+    uint32_t buf[BUF_LEN];
+
+    // nullifiers are already checked by the caller, but let's assert it too
+    assert(!key.IsNull());
+
+    memcpy(buf, &(key.GetByteArray()[0]), CFieldElement::ByteSize());
+    return CalculateHash(buf, BUF_LEN, salt);
+}
+
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
@@ -312,6 +312,18 @@ public:
     size_t operator()(const std::pair<uint256, CFieldElement>& key) const;
 };
 
+class CFieldElementKeyHasher
+{
+private:
+    static const size_t BUF_LEN = CFieldElement::ByteSize()/sizeof(uint32_t);
+    uint32_t salt[BUF_LEN];
+public:
+    CFieldElementKeyHasher();
+
+    // must return size_t, see CCswNullifiersKeyHasher
+    size_t operator()(const CFieldElement& key) const;
+};
+
 struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
@@ -38,18 +38,19 @@ extern void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue&
 template<typename Stream>
 void makeSerializedTxObj(Stream& is, int objVer, std::unique_ptr<CTransactionBase>& pTxBase, int nType, int nVersion)
 {
+    // deserialized in place, the object is not copied afterwards
     if (CTransactionBase::IsTransaction(objVer) )
     {
-        CTransaction tx(objVer);
-        tx.SerializationOpInternal(is, CSerActionUnserialize(), nType, nVersion);
-        pTxBase.reset(new CTransaction(tx));
+        std::unique_ptr<CTransaction> ptx(new CTransaction(objVer));
+        ptx->SerializationOpInternal(is, CSerActionUnserialize(), nType, nVersion);
+        pTxBase = std::move(ptx);
     }
     else
     if (CTransactionBase::IsCertificate(objVer) )
     {
-        CScCertificate cert(objVer);
-        cert.SerializationOpInternal(is, CSerActionUnserialize(), nType, nVersion);
-        pTxBase.reset(new CScCertificate(cert));
+        std::unique_ptr<CScCertificate> pcert(new CScCertificate(objVer));
+        pcert->SerializationOpInternal(is, CSerActionUnserialize(), nType, nVersion);
+        pTxBase = std::move(pcert);
     }
     else
     {
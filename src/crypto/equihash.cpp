@@ -17,6 +17,7 @@
 #endif
 
 #include "compat/endian.h"
+#include "crypto/common.h"
 #include "crypto/equihash.h"
 #include "util.h"
 
@@ -26,6 +27,25 @@
 
 #include <boost/optional.hpp>
 
+// the consensus library is built without the implementations using instruction set extensions
+#if defined(BUILD_BITCOIN_INTERNAL)
+#undef ENABLE_AVX2
+#endif
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_AVX2)
+#include <cpuid.h>
+#define USE_CPUID 1
+#endif
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace eh200_9_avx2
+{
+void FinalCompress_4way(uint64_t (*out)[8], const uint64_t* h, const uint64_t (*m)[16], uint64_t t);
+}
+#endif
+
 EhSolverCancelledException solver_cancelled;
 
 template<unsigned int N, unsigned int K>
@@ -767,6 +787,355 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln)
+{
+    eh_HashState state;
+    InitialiseState(state);
+    crypto_generichash_blake2b_update(&state, input, inputLen);
+    return IsValidSolution(state, soln);
+}
+
+// Verification of Equihash<200,9> solutions, the parameters of the main chains.
+//
+// A leaf hash is the BLAKE2b of the input followed by the index of the hash: all the
+// blocks but the last are the same for every leaf, so they are compressed once, and
+// only the last block is compressed for each leaf, several at a time where the CPU
+// supports it. The index tree is then checked in place, in fixed-size arrays.
+namespace eh200_9 {
+
+const size_t INDICES = 1 << 9;
+const size_t HASH_BYTES = 200/8;
+const size_t COLLISION_BITS = 200/10;
+
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+const uint8_t SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+uint64_t inline RotR(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = RotR(d ^ a, 32);
+    c = c + d;
+    b = RotR(b ^ c, 24);
+    a = a + b + y;
+    d = RotR(d ^ a, 16);
+    c = c + d;
+    b = RotR(b ^ c, 63);
+}
+
+/** Compress the block m, ending at byte t of the message, into the state h. */
+void Compress(uint64_t* h, const uint64_t* m, uint64_t t, bool fLast)
+{
+    uint64_t v[16];
+    for (int i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = IV[i];
+    }
+    v[12] ^= t;
+    if (fLast)
+        v[14] = ~v[14];
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++)
+        h[i] ^= v[i] ^ v[i + 8];
+}
+
+void FinalCompress_1way(uint64_t (*out)[8], const uint64_t* h, const uint64_t (*m)[16], uint64_t t)
+{
+    for (int i = 0; i < 8; i++)
+        out[0][i] = h[i];
+    Compress(out[0], m[0], t, true);
+}
+
+typedef void (*FinalCompressType)(uint64_t (*out)[8], const uint64_t* h, const uint64_t (*m)[16], uint64_t t);
+
+FinalCompressType FinalCompress_4way = NULL;
+
+} // namespace eh200_9
+
+EhIndexHasher200_9::EhIndexHasher200_9(const unsigned char* input, size_t inputLen)
+{
+    assert(Supports(inputLen));
+    unsigned char personalization[16] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    WriteLE32(personalization + 8, 200);
+    WriteLE32(personalization + 12, 9);
+    for (int i = 0; i < 8; i++)
+        h[i] = eh200_9::IV[i];
+    h[0] ^= 0x01010000 | OUTPUT_BYTES;
+    h[6] ^= ReadLE64(personalization);
+    h[7] ^= ReadLE64(personalization + 8);
+
+    // BLAKE2b never compresses the last block before it is complete
+    size_t nLastBlock = (inputLen + 3) / 128 * 128;
+    for (t = 0; t < nLastBlock; t += 128) {
+        for (int i = 0; i < 16; i++)
+            m[i] = ReadLE64(input + t + 8 * i);
+        eh200_9::Compress(h, m, t + 128, false);
+    }
+
+    unsigned char block[128] = {};
+    memcpy(block, input + nLastBlock, inputLen - nLastBlock);
+    for (int i = 0; i < 16; i++)
+        m[i] = ReadLE64(block + 8 * i);
+    nIndexPos = inputLen - nLastBlock;
+    t = inputLen + sizeof(eh_index);
+}
+
+void EhIndexHasher200_9::SetIndex(uint64_t* block, uint32_t g) const
+{
+    for (int i = 0; i < 16; i++)
+        block[i] = m[i];
+    size_t nShift = 8 * (nIndexPos % 8);
+    block[nIndexPos / 8] |= (uint64_t)g << nShift;
+    if (nShift > 32)
+        block[nIndexPos / 8 + 1] |= (uint64_t)g >> (64 - nShift);
+}
+
+void EhIndexHasher200_9::Hash(const uint32_t* g, size_t n, unsigned char* out) const
+{
+    uint64_t blocks[4][16];
+    uint64_t states[4][8];
+    unsigned char hash[64];
+    while (n > 0) {
+        size_t nWays = 1;
+        eh200_9::FinalCompressType compress = eh200_9::FinalCompress_1way;
+        if (n >= 4 && eh200_9::FinalCompress_4way) {
+            nWays = 4;
+            compress = eh200_9::FinalCompress_4way;
+        }
+        for (size_t l = 0; l < nWays; l++)
+            SetIndex(blocks[l], g[l]);
+        compress(states, h, blocks, t);
+        for (size_t l = 0; l < nWays; l++) {
+            for (int i = 0; i < 8; i++)
+                WriteLE64(hash + 8 * i, states[l][i]);
+            memcpy(out, hash, OUTPUT_BYTES);
+            out += OUTPUT_BYTES;
+        }
+        g += nWays;
+        n -= nWays;
+    }
+}
+
+namespace eh200_9 {
+
+/** Bit masks of the first COLLISION_BITS*(l+1) bits of the hashes, as read into 4 words. */
+struct CollisionMasks
+{
+    uint64_t masks[9][4];
+
+    CollisionMasks()
+    {
+        for (size_t l = 0; l < 9; l++) {
+            unsigned char bytes[32] = {};
+            for (size_t b = 0; b < COLLISION_BITS * (l + 1); b++)
+                bytes[b / 8] |= 0x80 >> (b % 8);
+            memcpy(masks[l], bytes, sizeof(masks[l]));
+        }
+    }
+};
+
+const CollisionMasks collisionMasks;
+
+/** Whether the leaf hashes of the indices, of an input hashed by hasher, form a valid solution. */
+bool IsValidIndexTree(const EhIndexHasher200_9& hasher, const uint32_t (&indices)[INDICES])
+{
+    // the hashes are computed by pairs of leaves
+    uint32_t g[INDICES];
+    for (size_t i = 0; i < INDICES; i++)
+        g[i] = indices[i] / 2;
+    unsigned char hashes[INDICES][2 * HASH_BYTES];
+    hasher.Hash(g, INDICES, hashes[0]);
+
+    // the nodes of each level overwrite the ones of the previous level
+    uint64_t nodes[INDICES][4];
+    for (size_t i = 0; i < INDICES; i++) {
+        nodes[i][3] = 0;
+        memcpy(nodes[i], hashes[i] + (indices[i] % 2) * HASH_BYTES, HASH_BYTES);
+    }
+
+    for (size_t l = 0; l < 9; l++) {
+        const uint64_t* mask = collisionMasks.masks[l];
+        for (size_t j = 0; j < (INDICES >> (l + 1)); j++) {
+            const uint64_t* a = nodes[2 * j];
+            const uint64_t* b = nodes[2 * j + 1];
+            uint64_t x[4] = {a[0] ^ b[0], a[1] ^ b[1], a[2] ^ b[2], a[3] ^ b[3]};
+            if ((x[0] & mask[0]) | (x[1] & mask[1]) | (x[2] & mask[2]) | (x[3] & mask[3])) {
+                LogPrint("pow", "Invalid solution: invalid collision length between StepRows\n");
+                return false;
+            }
+            // the subtrees are ordered by their first indices, which the duplicate check below tells apart
+            if (indices[(2 * j + 1) << l] < indices[(2 * j) << l]) {
+                LogPrint("pow", "Invalid solution: Index tree incorrectly ordered\n");
+                return false;
+            }
+            memcpy(nodes[j], x, sizeof(x));
+        }
+    }
+
+    if (nodes[0][0] | nodes[0][1] | nodes[0][2] | nodes[0][3]) {
+        LogPrint("pow", "Invalid solution: non-zero final hash\n");
+        return false;
+    }
+
+    uint32_t sorted[INDICES];
+    std::copy(indices, indices + INDICES, sorted);
+    std::sort(sorted, sorted + INDICES);
+    if (std::adjacent_find(sorted, sorted + INDICES) != sorted + INDICES) {
+        LogPrint("pow", "Invalid solution: duplicate indices\n");
+        return false;
+    }
+    return true;
+}
+
+#if defined(USE_CPUID)
+/** Whether the leaf hashes of the current implementation match the ones of libsodium. */
+bool SelfTest()
+{
+    unsigned char input[300];
+    for (size_t i = 0; i < sizeof(input); i++)
+        input[i] = i * 7 + 1;
+    uint32_t g[9];
+    for (size_t i = 0; i < 9; i++)
+        g[i] = 0x9e3779b9U * i;
+
+    // the header inputs, and inputs whose last blocks hold more or fewer bytes
+    const size_t vInputLen[] = {140, 0, 3, 124, 128, 252, 300};
+    for (size_t inputLen : vInputLen) {
+        EhIndexHasher200_9 hasher(input, inputLen);
+        unsigned char hashes[9][2 * HASH_BYTES];
+        hasher.Hash(g, 9, hashes[0]);
+
+        eh_HashState base_state;
+        Eh200_9.InitialiseState(base_state);
+        crypto_generichash_blake2b_update(&base_state, input, inputLen);
+        for (size_t i = 0; i < 9; i++) {
+            unsigned char expected[2 * HASH_BYTES];
+            GenerateHash(base_state, g[i], expected, sizeof(expected));
+            if (memcmp(hashes[i], expected, sizeof(expected)))
+                return false;
+        }
+    }
+    return true;
+}
+
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+}
+
+/** Whether the OS saves the AVX registers on context switches. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace eh200_9
+
+template<>
+bool Equihash<200,9>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln)
+{
+    if (soln.size() != SolutionWidth) {
+        LogPrint("pow", "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+    if (!EhIndexHasher200_9::Supports(inputLen)) {
+        eh_HashState state;
+        InitialiseState(state);
+        crypto_generichash_blake2b_update(&state, input, inputLen);
+        return IsValidSolution(state, soln);
+    }
+
+    // the indices, of CollisionBitLength+1 bits each, in big-endian order
+    uint32_t indices[eh200_9::INDICES];
+    uint32_t acc_value = 0;
+    size_t acc_bits = 0;
+    size_t j = 0;
+    for (unsigned char c : soln) {
+        acc_value = (acc_value << 8) | c;
+        acc_bits += 8;
+        if (acc_bits >= CollisionBitLength + 1) {
+            acc_bits -= CollisionBitLength + 1;
+            indices[j++] = (acc_value >> acc_bits) & ((1U << (CollisionBitLength + 1)) - 1);
+        }
+    }
+    assert(j == eh200_9::INDICES);
+
+    EhIndexHasher200_9 hasher(input, inputLen);
+    return eh200_9::IsValidIndexTree(hasher, indices);
+}
+
+std::string EhAutoDetect()
+{
+    std::string ret = "standard";
+    eh200_9::FinalCompress_4way = NULL;
+
+#if defined(USE_CPUID)
+    uint32_t eax, ebx, ecx, edx;
+    eh200_9::cpuid(0, 0, eax, ebx, ecx, edx);
+    uint32_t max_leaf = eax;
+    eh200_9::cpuid(1, 0, eax, ebx, ecx, edx);
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    bool have_avx2 = false;
+    if (max_leaf >= 7) {
+        eh200_9::cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+    }
+
+#if defined(ENABLE_AVX2)
+    if (have_xsave && have_avx && have_avx2 && eh200_9::AVXEnabled()) {
+        eh200_9::FinalCompress_4way = eh200_9_avx2::FinalCompress_4way;
+        if (eh200_9::SelfTest()) {
+            ret += ",avx2(4way)";
+        } else {
+            eh200_9::FinalCompress_4way = NULL;
+            ret += " (avx2 self-test failed)";
+        }
+    }
+#else
+    (void)have_xsave;
+    (void)have_avx;
+    (void)have_avx2;
+#endif
+#endif // USE_CPUID
+
+    return ret;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state);
 #ifdef ENABLE_MINING
@@ -778,6 +1147,7 @@ template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,3>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state);
@@ -802,6 +1172,7 @@ template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,5>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
@@ -814,3 +1185,4 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
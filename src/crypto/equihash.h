@@ -16,6 +16,7 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 #include <stdexcept>
 #include <boost/static_assert.hpp>
@@ -191,8 +192,59 @@ public:
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    //! Whether soln is a valid solution for the inputLen bytes of input
+    bool IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 };
 
+/**
+ * Specialised verifier for the parameters of the main chains: the leaf hashes share the
+ * compression of the input blocks, and are computed several at a time where the CPU
+ * supports it, then the index tree is checked in place, without allocations.
+ */
+template<>
+bool Equihash<200,9>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
+
+/**
+ * The Equihash<200,9> hashes of an input followed by the index of each hash, as used by the
+ * specialised verifier and by the round 0 of the solvers. All the blocks of the input but the
+ * last one are compressed once, then the last block is compressed for each index, several
+ * indices at a time where the CPU supports it.
+ */
+class EhIndexHasher200_9
+{
+public:
+    //! the bytes written for each index: the two hashes of a BLAKE2b output
+    static const size_t OUTPUT_BYTES = 2 * 200/8;
+
+    //! Whether the index of the hashes of inputs of inputLen bytes fits in their last block
+    static bool Supports(size_t inputLen)
+    {
+        return inputLen % 128 <= 124;
+    }
+
+    EhIndexHasher200_9() : t(0), nIndexPos(0) {}
+    EhIndexHasher200_9(const unsigned char* input, size_t inputLen);
+
+    /** Write the hashes of the n indices g, OUTPUT_BYTES bytes each, to out. */
+    void Hash(const uint32_t* g, size_t n, unsigned char* out) const;
+
+private:
+    //! the state after the blocks of the input but the last one, and that last one
+    uint64_t h[8];
+    uint64_t m[16];
+    uint64_t t;
+    //! where the index of the hash starts in m
+    size_t nIndexPos;
+
+    void SetIndex(uint64_t* block, uint32_t g) const;
+};
+
+/**
+ * Select the fastest implementation of the Equihash<200,9> hashes supported by the CPU,
+ * after checking them against the generic ones, and return its description.
+ */
+std::string EhAutoDetect();
+
 #include "equihash.tcc"
 
 static Equihash<96,3> Eh96_3;
@@ -276,4 +328,20 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
 
+inline bool EhIsValidSolutionForInput(unsigned int n, unsigned int k, const unsigned char* input, size_t inputLen,
+                                      const std::vector<unsigned char>& soln)
+{
+    if (n == 96 && k == 3) {
+        return Eh96_3.IsValidSolution(input, inputLen, soln);
+    } else if (n == 200 && k == 9) {
+        return Eh200_9.IsValidSolution(input, inputLen, soln);
+    } else if (n == 96 && k == 5) {
+        return Eh96_5.IsValidSolution(input, inputLen, soln);
+    } else if (n == 48 && k == 5) {
+        return Eh48_5.IsValidSolution(input, inputLen, soln);
+    } else {
+        throw std::invalid_argument("Unsupported Equihash parameters");
+    }
+}
+
 #endif // BITCOIN_EQUIHASH_H
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace eh200_9_avx2 {
+namespace {
+
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+const uint8_t SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+
+/** Rotations of the 64-bit words right by 32, 24, 16 and 63 bits. */
+__m256i inline RotR32(__m256i x) { return _mm256_shuffle_epi32(x, 0xB1); }
+__m256i inline RotR24(__m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                                   3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10));
+}
+__m256i inline RotR16(__m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                                   2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+}
+__m256i inline RotR63(__m256i x) { return Xor(Add(x, x), _mm256_srli_epi64(x, 63)); }
+
+/** The mixing function of BLAKE2b, in each lane. */
+void inline __attribute__((always_inline)) G(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y)
+{
+    a = Add(a, b, x);
+    d = RotR32(Xor(d, a));
+    c = Add(c, d);
+    b = RotR24(Xor(b, c));
+    a = Add(a, b, y);
+    d = RotR16(Xor(d, a));
+    c = Add(c, d);
+    b = RotR63(Xor(b, c));
+}
+
+}
+
+/**
+ * Compress the last blocks m of 4 messages, of t bytes, into copies of the state h, and
+ * store the 4 resulting states in out.
+ */
+void FinalCompress_4way(uint64_t (*out)[8], const uint64_t* h, const uint64_t (*m)[16], uint64_t t)
+{
+    __m256i w[16], v[16];
+    for (int i = 0; i < 16; i++)
+        w[i] = _mm256_set_epi64x(m[3][i], m[2][i], m[1][i], m[0][i]);
+    for (int i = 0; i < 8; i++) {
+        v[i] = K(h[i]);
+        v[i + 8] = K(IV[i]);
+    }
+    v[12] = Xor(v[12], K(t));
+    v[14] = Xor(v[14], K(~0ULL));
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], w[s[0]], w[s[1]]);
+        G(v[1], v[5], v[9], v[13], w[s[2]], w[s[3]]);
+        G(v[2], v[6], v[10], v[14], w[s[4]], w[s[5]]);
+        G(v[3], v[7], v[11], v[15], w[s[6]], w[s[7]]);
+        G(v[0], v[5], v[10], v[15], w[s[8]], w[s[9]]);
+        G(v[1], v[6], v[11], v[12], w[s[10]], w[s[11]]);
+        G(v[2], v[7], v[8], v[13], w[s[12]], w[s[13]]);
+        G(v[3], v[4], v[9], v[14], w[s[14]], w[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256((__m256i*)lanes, Xor(K(h[i]), v[i], v[i + 8]));
+        for (int l = 0; l < 4; l++)
+            out[l][i] = lanes[l];
+    }
+}
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -29,4 +30,24 @@ private:
     void FinalizeNoPadding(unsigned char hash[OUTPUT_SIZE], bool enforce_compression);
 };
 
+/** Implementations that SHA256AutoDetect() may select, when the CPU supports them */
+enum
+{
+    SHA256_USE_STANDARD = 0,
+    SHA256_USE_SSE41 = 1 << 0,
+    SHA256_USE_AVX2 = 1 << 1,
+    SHA256_USE_SHANI = 1 << 2,
+    SHA256_USE_ALL = SHA256_USE_SSE41 | SHA256_USE_AVX2 | SHA256_USE_SHANI,
+};
+
+/**
+ * Select the fastest of the allowed SHA-256 implementations supported by the CPU, after
+ * checking that it computes the same hashes as the standard one, and return a description
+ * of the selection. Call once at startup, before other threads hash anything.
+ */
+std::string SHA256AutoDetect(int nUse = SHA256_USE_ALL);
+
+/** Compute the double SHA-256 of blocks 64-byte inputs, each hash being written to 32 bytes of output. */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,180 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Based on https://github.com/noloader/SHA-Intrinsics/blob/master/sha256-x86.c,
+// Written and placed in public domain by Jeffrey Walton.
+// Based on code from Intel, and by Sean Gulley for the miTLS project.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace {
+
+alignas(16) const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** The message schedules of the padding blocks of 64-byte and 32-byte messages. */
+alignas(16) const uint32_t PADDING64[16] = {0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x200};
+alignas(16) const uint32_t PADDING32[8] = {0x80000000, 0, 0, 0, 0, 0, 0, 0x100};
+
+alignas(16) const uint32_t INIT[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+/** Swaps the bytes of each 32-bit word. */
+__m128i inline ByteSwap(__m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull));
+}
+
+/** Four rounds, of the message words m, from round i. */
+void inline __attribute__((always_inline)) QuadRound(__m128i& s0, __m128i& s1, __m128i m, int i)
+{
+    const __m128i msg = _mm_add_epi32(m, _mm_load_si128((const __m128i*)(K256 + i)));
+    s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** m0 becomes the next message words, from the 16 previous ones in m0..m3. */
+void inline __attribute__((always_inline)) NextMessage(__m128i& m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3);
+}
+
+/**
+ * Compress one block, whose message words are m[0..3] (4 words each, in host order),
+ * into the states of the lanes, in the (ABEF, CDGH) layout of the SHA instructions.
+ */
+template <int N>
+void inline __attribute__((always_inline)) Compress(__m128i (&s0)[N], __m128i (&s1)[N], __m128i (&m)[N][4])
+{
+    __m128i so0[N], so1[N];
+    for (int l = 0; l < N; l++) {
+        so0[l] = s0[l];
+        so1[l] = s1[l];
+    }
+    for (int i = 0; i < 64; i += 16) {
+        for (int j = 0; j < 4; j++) {
+            if (i > 0) {
+                for (int l = 0; l < N; l++)
+                    NextMessage(m[l][j], m[l][(j + 1) & 3], m[l][(j + 2) & 3], m[l][(j + 3) & 3]);
+            }
+            for (int l = 0; l < N; l++)
+                QuadRound(s0[l], s1[l], m[l][j], i + 4 * j);
+        }
+    }
+    for (int l = 0; l < N; l++) {
+        s0[l] = _mm_add_epi32(s0[l], so0[l]);
+        s1[l] = _mm_add_epi32(s1[l], so1[l]);
+    }
+}
+
+/** Converts states between the (A..D, E..H) layout and the (ABEF, CDGH) one of the SHA instructions. */
+void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+/** The double SHA-256 of N consecutive 64-byte inputs, interleaved to hide the latency of the instructions. */
+template <int N>
+void inline TransformD64Lanes(unsigned char* out, const unsigned char* in)
+{
+    __m128i s0[N], s1[N], m[N][4];
+    const __m128i init0 = _mm_load_si128((const __m128i*)INIT), init1 = _mm_load_si128((const __m128i*)(INIT + 4));
+
+    // first hash: the input block, then the padding
+    for (int l = 0; l < N; l++) {
+        s0[l] = init0;
+        s1[l] = init1;
+        Shuffle(s0[l], s1[l]);
+        for (int j = 0; j < 4; j++)
+            m[l][j] = ByteSwap(_mm_loadu_si128((const __m128i*)(in + 64 * l + 16 * j)));
+    }
+    Compress<N>(s0, s1, m);
+    for (int l = 0; l < N; l++) {
+        for (int j = 0; j < 4; j++)
+            m[l][j] = _mm_load_si128((const __m128i*)(PADDING64 + 4 * j));
+    }
+    Compress<N>(s0, s1, m);
+
+    // second hash, of the 32-byte first one and its padding
+    for (int l = 0; l < N; l++) {
+        Unshuffle(s0[l], s1[l]);
+        m[l][0] = s0[l];
+        m[l][1] = s1[l];
+        m[l][2] = _mm_load_si128((const __m128i*)PADDING32);
+        m[l][3] = _mm_load_si128((const __m128i*)(PADDING32 + 4));
+        s0[l] = init0;
+        s1[l] = init1;
+        Shuffle(s0[l], s1[l]);
+    }
+    Compress<N>(s0, s1, m);
+
+    for (int l = 0; l < N; l++) {
+        Unshuffle(s0[l], s1[l]);
+        _mm_storeu_si128((__m128i*)(out + 32 * l), ByteSwap(s0[l]));
+        _mm_storeu_si128((__m128i*)(out + 32 * l + 16), ByteSwap(s1[l]));
+    }
+}
+
+}
+
+namespace sha256_shani {
+
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0[1], s1[1], m[1][4];
+    s0[0] = _mm_loadu_si128((const __m128i*)s);
+    s1[0] = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0[0], s1[0]);
+
+    while (blocks--) {
+        for (int j = 0; j < 4; j++)
+            m[0][j] = ByteSwap(_mm_loadu_si128((const __m128i*)(chunk + 16 * j)));
+        Compress<1>(s0, s1, m);
+        chunk += 64;
+    }
+
+    Unshuffle(s0[0], s1[0]);
+    _mm_storeu_si128((__m128i*)s, s0[0]);
+    _mm_storeu_si128((__m128i*)(s + 4), s1[0]);
+}
+
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Lanes<1>(out, in);
+}
+
+}
+
+namespace sha256d64_shani {
+
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Lanes<2>(out, in);
+}
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <txdb.h>
+#include <main.h>
+
+#ifdef ENABLE_ADDRESS_INDEXING
+#include <addressindex.h>
+
+class AddressIndexTestSuite: public ::testing::Test {
+public:
+    AddressIndexTestSuite(): addressIndexDb(CLevelDBOptions(1 << 20), /*fMemory*/true) {}
+
+protected:
+    CAddressIndexDB addressIndexDb;
+
+    // a few entries per address, with type alternating so that request order differs from key order
+    std::vector<std::pair<uint160, int> > FillIndexes(unsigned int nAddresses)
+    {
+        std::vector<std::pair<uint160, int> > addresses;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+        std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > deltas;
+
+        for (unsigned int i = 0; i < nAddresses; ++i) {
+            uint160 hash = Hash160(std::vector<unsigned char>(1, (unsigned char)i));
+            int type = (i % 2) ? 2 : 1;
+            addresses.push_back(std::make_pair(hash, type));
+
+            for (unsigned int j = 0; j <= i % 3; ++j) {
+                uint256 txid = Hash(BEGIN(i), END(i), BEGIN(j), END(j));
+                unspent.push_back(std::make_pair(CAddressUnspentKey(type, hash, txid, j),
+                                                 CAddressUnspentValue(1000 * (j + 1), CScript(), 10 + j, 0)));
+                deltas.push_back(std::make_pair(CAddressIndexKey(type, hash, 10 + j, 1, txid, j, false),
+                                                CAddressIndexValue(1000 * (j + 1), 0)));
+            }
+        }
+
+        EXPECT_TRUE(addressIndexDb.UpdateAddressUnspentIndex(unspent));
+        EXPECT_TRUE(addressIndexDb.WriteAddressIndex(deltas));
+        return addresses;
+    }
+};
+
+TEST_F(AddressIndexTestSuite, BatchedUnspentLookupMatchesSingleLookups) {
+    // enough addresses to be split over several lookup threads
+    std::vector<std::pair<uint160, int> > addresses = FillIndexes(5 * ADDRESS_LOOKUP_CHUNK_SIZE + 3);
+
+    std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > batch;
+    ASSERT_TRUE(addressIndexDb.ReadAddressUnspentIndexBatch(addresses, batch));
+    ASSERT_EQ(batch.size(), addresses.size());
+
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > single;
+        ASSERT_TRUE(addressIndexDb.ReadAddressUnspentIndex(addresses[i].first, addresses[i].second, single));
+        ASSERT_EQ(batch[i].size(), single.size());
+        EXPECT_EQ(batch[i].size(), i % 3 + 1);
+        for (size_t j = 0; j < single.size(); ++j) {
+            EXPECT_EQ(batch[i][j].first.hashBytes, addresses[i].first);
+            EXPECT_EQ(batch[i][j].first.txhash, single[j].first.txhash);
+            EXPECT_EQ(batch[i][j].second.satoshis, single[j].second.satoshis);
+        }
+    }
+}
+
+TEST_F(AddressIndexTestSuite, BatchedIndexLookupHonoursHeightRange) {
+    std::vector<std::pair<uint160, int> > addresses = FillIndexes(2 * ADDRESS_LOOKUP_CHUNK_SIZE);
+
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > batch;
+    ASSERT_TRUE(addressIndexDb.ReadAddressIndexBatch(addresses, batch, 11, 11));
+    ASSERT_EQ(batch.size(), addresses.size());
+
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        // only addresses with at least two entries have one at height 11
+        EXPECT_EQ(batch[i].size(), (i % 3 >= 1) ? 1U : 0U);
+        for (const std::pair<CAddressIndexKey, CAddressIndexValue>& entry : batch[i])
+            EXPECT_EQ(entry.first.blockHeight, 11);
+    }
+}
+
+TEST_F(AddressIndexTestSuite, BatchedLookupOfNoAddresses) {
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > batch;
+    EXPECT_TRUE(addressIndexDb.ReadAddressIndexBatch(std::vector<std::pair<uint160, int> >(), batch));
+    EXPECT_TRUE(batch.empty());
+}
+#endif // ENABLE_ADDRESS_INDEXING
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include "checkqueue.h"
+#include "hash.h"
 #include "primitives/block.h"
 
 
@@ -11,3 +13,85 @@ TEST(block_tests, header_size_is_expected) {
 
     ASSERT_EQ(ss.size(), CBlockHeader::HEADER_SIZE);
 }
+
+namespace {
+
+// the tree as built hash by hash before the nodes of a level were hashed together
+uint256 LegacyMerkleRoot(std::vector<uint256> vMerkleTree, bool& mutated)
+{
+    int j = 0;
+    mutated = false;
+    for (int nSize = vMerkleTree.size(); nSize > 1; nSize = (nSize + 1) / 2) {
+        for (int i = 0; i < nSize; i += 2) {
+            int i2 = std::min(i + 1, nSize - 1);
+            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j + i] == vMerkleTree[j + i2])
+                mutated = true;
+            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j + i]), END(vMerkleTree[j + i]),
+                                       BEGIN(vMerkleTree[j + i2]), END(vMerkleTree[j + i2])));
+        }
+        j += nSize;
+    }
+    return vMerkleTree.empty() ? uint256() : vMerkleTree.back();
+}
+
+std::vector<uint256> MakeLeaves(size_t nLeaves)
+{
+    std::vector<uint256> vLeaves(nLeaves);
+    for (size_t i = 0; i < nLeaves; i++)
+        vLeaves[i] = Hash(BEGIN(i), END(i));
+    return vLeaves;
+}
+
+}
+
+TEST(block_tests, merkle_root_matches_pairwise_hashing) {
+    for (size_t nLeaves = 0; nLeaves < 70; nLeaves++) {
+        std::vector<uint256> vTree = MakeLeaves(nLeaves);
+        bool legacyMutated = true, mutated = true;
+        uint256 expected = LegacyMerkleRoot(vTree, legacyMutated);
+        EXPECT_EQ(CBlock::BuildMerkleTree(vTree, nLeaves, &mutated), expected) << nLeaves;
+        EXPECT_FALSE(mutated);
+        EXPECT_FALSE(legacyMutated);
+    }
+}
+
+TEST(block_tests, merkle_mutation_is_detected) {
+    // [1,2,3,4,5,6] and [1,2,3,4,5,6,5,6] have the same root, the latter being mutated
+    std::vector<uint256> vTree = MakeLeaves(6);
+    bool mutated = true;
+    uint256 root = CBlock::BuildMerkleTree(vTree, 6, &mutated);
+    EXPECT_FALSE(mutated);
+
+    vTree = MakeLeaves(6);
+    vTree.push_back(vTree[4]);
+    vTree.push_back(vTree[5]);
+    EXPECT_EQ(CBlock::BuildMerkleTree(vTree, 8, &mutated), root);
+    EXPECT_TRUE(mutated);
+
+    // two identical leaves at the end of a level
+    vTree = MakeLeaves(10);
+    vTree[9] = vTree[8];
+    CBlock::BuildMerkleTree(vTree, 10, &mutated);
+    EXPECT_TRUE(mutated);
+}
+
+TEST(block_tests, merkle_levels_split_across_threads) {
+    boost::thread_group threadGroup;
+    CCheckExecutor executor;
+    executor.Start(threadGroup, 3, false);
+
+    // the bottom levels are large enough to be split, with odd sizes on the way up
+    for (size_t nLeaves : {4095, 4096, 5001, 20000}) {
+        std::vector<uint256> vTree = MakeLeaves(nLeaves);
+        std::vector<uint256> vSerialTree = vTree;
+        bool legacyMutated = true, mutated = true;
+        uint256 expected = LegacyMerkleRoot(vTree, legacyMutated);
+        EXPECT_EQ(CBlock::BuildMerkleTree(vTree, nLeaves, &mutated, &executor), expected) << nLeaves;
+        EXPECT_FALSE(mutated);
+        CBlock::BuildMerkleTree(vSerialTree, nLeaves);
+        EXPECT_EQ(vTree, vSerialTree);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include "chainsnapshot.h"
+#include "main.h"
+
+class ChainSnapshotTestSuite: public ::testing::Test {
+public:
+    void SetUp() override {
+        // main chain [0]..[9], fork [5']..[7'] stemming from [4]
+        BuildBranch(mainBlocks, hashesMain, NULL, 10, 0);
+        BuildBranch(forkBlocks, hashesFork, &mainBlocks[4], 3, 1000);
+
+        LOCK(cs_main);
+        chainActive.SetTip(&mainBlocks.back());
+    }
+
+    void TearDown() override {
+        LOCK(cs_main);
+        chainActive.SetTip(NULL);
+        for (const uint256& hash : hashesMain)
+            mapBlockIndex.erase(hash);
+        for (const uint256& hash : hashesFork)
+            mapBlockIndex.erase(hash);
+    }
+
+protected:
+    std::vector<CBlockIndex> mainBlocks;
+    std::vector<CBlockIndex> forkBlocks;
+    std::vector<uint256> hashesMain;
+    std::vector<uint256> hashesFork;
+
+    void BuildBranch(std::vector<CBlockIndex>& blocks, std::vector<uint256>& hashes, CBlockIndex* pprev, int nLength, int nSeed)
+    {
+        // reserved upfront, pprev and phashBlock point into the vectors
+        blocks.resize(nLength);
+        hashes.resize(nLength);
+        for (int i = 0; i < nLength; ++i) {
+            hashes[i] = ArithToUint256(arith_uint256(nSeed + i + 1));
+            blocks[i].phashBlock = &hashes[i];
+            blocks[i].pprev = (i == 0) ? pprev : &blocks[i - 1];
+            blocks[i].nHeight = blocks[i].pprev ? blocks[i].pprev->nHeight + 1 : 0;
+            blocks[i].BuildSkip();
+            LOCK(cs_main);
+            mapBlockIndex[hashes[i]] = &blocks[i];
+        }
+    }
+};
+
+TEST_F(ChainSnapshotTestSuite, ReflectsActiveChain) {
+    CChainSnapshot chain;
+
+    EXPECT_EQ(chain.Tip(), &mainBlocks.back());
+    EXPECT_EQ(chain.Height(), 9);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(chain[i], &mainBlocks[i]);
+        EXPECT_TRUE(chain.Contains(&mainBlocks[i]));
+    }
+    EXPECT_EQ(chain[-1], nullptr);
+    EXPECT_EQ(chain[10], nullptr);
+
+    EXPECT_EQ(chain.Next(&mainBlocks[3]), &mainBlocks[4]);
+    EXPECT_EQ(chain.Next(&mainBlocks.back()), nullptr);
+    EXPECT_FALSE(chain.Contains(&forkBlocks[0]));
+    EXPECT_EQ(chain.Next(&forkBlocks[0]), nullptr);
+
+    EXPECT_EQ(CChainSnapshot::LookupBlockIndex(hashesFork[1]), &forkBlocks[1]);
+    EXPECT_EQ(CChainSnapshot::LookupBlockIndex(uint256S("0xdead")), nullptr);
+}
+
+TEST_F(ChainSnapshotTestSuite, NotAffectedByLaterReorg) {
+    CChainSnapshot chain;
+
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&forkBlocks.back());
+    }
+
+    // the snapshot keeps describing the chain it was taken on
+    EXPECT_EQ(chain.Height(), 9);
+    EXPECT_TRUE(chain.Contains(&mainBlocks[7]));
+    EXPECT_FALSE(chain.Contains(&forkBlocks[2]));
+    EXPECT_EQ(chain.Next(&mainBlocks[4]), &mainBlocks[5]);
+
+    CChainSnapshot after;
+    EXPECT_EQ(after.Height(), 7);
+    EXPECT_TRUE(after.Contains(&forkBlocks[2]));
+    EXPECT_FALSE(after.Contains(&mainBlocks[5]));
+    EXPECT_EQ(after.Next(&mainBlocks[4]), &forkBlocks[0]);
+}
+
+TEST_F(ChainSnapshotTestSuite, TipChainMatchesActiveChain) {
+    CTipChain chain(&forkBlocks.back());
+    const CChain& base = chain;
+
+    // accessed through the base class, as script checks do
+    EXPECT_EQ(base.Height(), 7);
+    EXPECT_EQ(base.Tip(), &forkBlocks.back());
+    EXPECT_EQ(base[4], &mainBlocks[4]);
+    EXPECT_EQ(base[5], &forkBlocks[0]);
+    EXPECT_EQ(base[8], nullptr);
+    EXPECT_EQ(base[-1], nullptr);
+    EXPECT_TRUE(base.Contains(&forkBlocks[1]));
+    EXPECT_FALSE(base.Contains(&mainBlocks[5]));
+
+    CTipChain empty(NULL);
+    EXPECT_EQ(empty.Height(), -1);
+    EXPECT_EQ(empty.Tip(), nullptr);
+}
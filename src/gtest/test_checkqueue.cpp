@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include "checkqueue.h"
+
+#include <atomic>
+#include <thread>
+
+namespace {
+
+struct CountingCheck
+{
+    std::atomic<int>* pnRun;
+    bool fOk;
+
+    CountingCheck(): pnRun(nullptr), fOk(true) {}
+    CountingCheck(std::atomic<int>* pnRunIn, bool fOkIn): pnRun(pnRunIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        ++*pnRun;
+        return fOk;
+    }
+
+    void swap(CountingCheck& check)
+    {
+        std::swap(pnRun, check.pnRun);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+std::vector<CountingCheck> MakeChecks(std::atomic<int>& nRun, size_t nChecks, size_t nFailing = SIZE_MAX)
+{
+    std::vector<CountingCheck> vChecks;
+    for (size_t i = 0; i < nChecks; i++)
+        vChecks.push_back(CountingCheck(&nRun, i != nFailing));
+    return vChecks;
+}
+
+class CheckQueueTest : public ::testing::Test
+{
+protected:
+    boost::thread_group threadGroup;
+    CCheckExecutor executor;
+
+    void TearDown()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
+}
+
+TEST_F(CheckQueueTest, AllChecksRunOnWorkers) {
+    executor.Start(threadGroup, 3, false);
+    std::atomic<int> nRun(0);
+    CCheckGroup<CountingCheck> group(&executor, 7);
+    for (int i = 0; i < 100; i++) {
+        std::vector<CountingCheck> vChecks = MakeChecks(nRun, i % 20);
+        group.Add(vChecks);
+    }
+    EXPECT_TRUE(group.Wait());
+    EXPECT_EQ(nRun.load(), 950);
+}
+
+TEST_F(CheckQueueTest, FailureIsReportedOnce) {
+    executor.Start(threadGroup, 3, false);
+    std::atomic<int> nRun(0);
+    CCheckGroup<CountingCheck> group(&executor, 4);
+    std::vector<CountingCheck> vChecks = MakeChecks(nRun, 1000, 500);
+    group.Add(vChecks);
+    EXPECT_FALSE(group.Wait());
+
+    // the result is reset for the next checks of the group
+    vChecks = MakeChecks(nRun, 10);
+    group.Add(vChecks);
+    EXPECT_TRUE(group.Wait());
+}
+
+TEST_F(CheckQueueTest, WaitingThreadRunsTasksWithoutWorkers) {
+    executor.Start(threadGroup, 0, false);
+    std::atomic<int> nRun(0);
+    CCheckGroup<CountingCheck> group(&executor);
+    std::vector<CountingCheck> vChecks = MakeChecks(nRun, 100);
+    group.Add(vChecks);
+    EXPECT_EQ(nRun.load(), 0);
+    EXPECT_TRUE(group.Wait());
+    EXPECT_EQ(nRun.load(), 100);
+}
+
+TEST_F(CheckQueueTest, ChecksRunInlineWithoutExecutor) {
+    std::atomic<int> nRun(0);
+    CCheckGroup<CountingCheck> group(nullptr);
+    std::vector<CountingCheck> vChecks = MakeChecks(nRun, 10, 3);
+    group.Add(vChecks);
+    EXPECT_EQ(nRun.load(), 4);
+    EXPECT_FALSE(group.Wait());
+}
+
+TEST_F(CheckQueueTest, DestructorWaitsForTheChecks) {
+    executor.Start(threadGroup, 2, false);
+    std::atomic<int> nRun(0);
+    {
+        CCheckGroup<CountingCheck> group(&executor, 1);
+        std::vector<CountingCheck> vChecks = MakeChecks(nRun, 200);
+        group.Add(vChecks);
+    }
+    EXPECT_EQ(nRun.load(), 200);
+}
+
+TEST_F(CheckQueueTest, GroupsShareTheExecutor) {
+    executor.Start(threadGroup, 4, false);
+    std::atomic<int> nRun(0);
+    std::atomic<int> nFailedGroups(0);
+    std::vector<std::thread> owners;
+    for (int t = 0; t < 4; t++) {
+        owners.emplace_back([&, t]() {
+            for (int i = 0; i < 50; i++) {
+                CCheckGroup<CountingCheck> group(&executor, 3);
+                std::vector<CountingCheck> vChecks = MakeChecks(nRun, 20, t == 0 ? 5 : SIZE_MAX);
+                group.Add(vChecks);
+                if (!group.Wait())
+                    nFailedGroups++;
+            }
+        });
+    }
+    for (std::thread& owner : owners)
+        owner.join();
+    EXPECT_EQ(nFailedGroups.load(), 50);
+}
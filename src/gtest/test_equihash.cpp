@@ -5,8 +5,16 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "checkqueue.h"
 #include "crypto/equihash.h"
+#include "miner.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "streams.h"
 #include "uint256.h"
+#include "version.h"
 
 void TestExpandAndCompress(const std::string &scope, size_t bit_len, size_t byte_pad,
                            std::vector<unsigned char> compact,
@@ -289,3 +297,163 @@ TEST(equihash_tests, check_optimised_solver_cancelled) {
     }
 }
 #endif // ENABLE_MINING
+
+namespace {
+
+/** The input of the Equihash solution of a header: I||V */
+std::vector<unsigned char> EquihashInput(const CBlockHeader& header)
+{
+    CEquihashInput I{header};
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+    ss << header.nNonce;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+bool IsValidGeneric(const std::vector<unsigned char>& input, const std::vector<unsigned char>& soln)
+{
+    eh_HashState state;
+    Eh200_9.InitialiseState(state);
+    crypto_generichash_blake2b_update(&state, input.data(), input.size());
+    return Eh200_9.IsValidSolution(state, soln);
+}
+
+bool IsValidSpecialised(const std::vector<unsigned char>& input, const std::vector<unsigned char>& soln)
+{
+    return Eh200_9.IsValidSolution(input.data(), input.size(), soln);
+}
+
+}
+
+TEST(equihash_tests, specialised_verifier_accepts_genesis_solutions) {
+    EXPECT_EQ(EhAutoDetect().find("self-test failed"), std::string::npos);
+    for (CBaseChainParams::Network network : {CBaseChainParams::MAIN, CBaseChainParams::TESTNET}) {
+        SCOPED_TRACE(network);
+        CBlockHeader header = Params(network).GenesisBlock().GetBlockHeader();
+        std::vector<unsigned char> input = EquihashInput(header);
+        EXPECT_TRUE(IsValidGeneric(input, header.nSolution));
+        EXPECT_TRUE(IsValidSpecialised(input, header.nSolution));
+    }
+}
+
+TEST(equihash_tests, specialised_verifier_matches_generic_one) {
+    CBlockHeader header = Params(CBaseChainParams::MAIN).GenesisBlock().GetBlockHeader();
+    std::vector<unsigned char> input = EquihashInput(header);
+
+    for (size_t i = 0; i < header.nSolution.size(); i += 5) {
+        std::vector<unsigned char> soln = header.nSolution;
+        soln[i] ^= 1 << (i % 8);
+        EXPECT_EQ(IsValidGeneric(input, soln), IsValidSpecialised(input, soln)) << "solution byte " << i;
+    }
+    for (size_t i = 0; i < input.size(); i++) {
+        std::vector<unsigned char> mutated = input;
+        mutated[i] ^= 0x10;
+        EXPECT_FALSE(IsValidSpecialised(mutated, header.nSolution)) << "input byte " << i;
+    }
+
+    // subtrees swapped, at each level, still collide but are misordered
+    std::vector<eh_index> indices = GetIndicesFromMinimal(header.nSolution, 20);
+    for (size_t l = 0; l < 9; l++) {
+        std::vector<eh_index> swapped = indices;
+        std::rotate(swapped.begin(), swapped.begin() + (1 << l), swapped.begin() + (2 << l));
+        std::vector<unsigned char> soln = GetMinimalFromIndices(swapped, 20);
+        EXPECT_FALSE(IsValidGeneric(input, soln)) << "level " << l;
+        EXPECT_FALSE(IsValidSpecialised(input, soln)) << "level " << l;
+    }
+
+    // a subtree repeated cancels out, but with duplicate indices
+    std::vector<eh_index> repeated = indices;
+    std::copy(repeated.begin(), repeated.begin() + 256, repeated.begin() + 256);
+    std::vector<unsigned char> soln = GetMinimalFromIndices(repeated, 20);
+    EXPECT_FALSE(IsValidGeneric(input, soln));
+    EXPECT_FALSE(IsValidSpecialised(input, soln));
+
+    soln = header.nSolution;
+    soln.pop_back();
+    EXPECT_FALSE(IsValidSpecialised(input, soln));
+}
+
+TEST(equihash_tests, headers_checked_in_parallel) {
+    const CChainParams& params = Params(CBaseChainParams::MAIN);
+    std::vector<CBlockHeader> headers(50, params.GenesisBlock().GetBlockHeader());
+    boost::thread_group threadGroup;
+    CCheckExecutor executor;
+    executor.Start(threadGroup, 3, false);
+
+    std::vector<unsigned char> vChecked;
+    EXPECT_TRUE(CheckEquihashSolutions(headers, params, &executor, vChecked));
+    EXPECT_EQ(vChecked, std::vector<unsigned char>(headers.size(), true));
+
+    headers[20].nSolution[100] ^= 1;
+    vChecked.clear();
+    EXPECT_FALSE(CheckEquihashSolutions(headers, params, &executor, vChecked));
+    ASSERT_EQ(vChecked.size(), headers.size());
+    EXPECT_FALSE(vChecked[20]);
+
+    // the headers already checked are skipped
+    vChecked.assign(headers.size(), false);
+    vChecked[20] = true;
+    EXPECT_TRUE(CheckEquihashSolutions(headers, params, &executor, vChecked));
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+#ifdef ENABLE_MINING
+namespace {
+
+std::set<std::vector<unsigned char>> SolveAll(CEquihashSolver& solver, unsigned int n, unsigned int k,
+                                              const std::vector<unsigned char>& input)
+{
+    std::set<std::vector<unsigned char>> solns;
+    solver.Solve(n, k, input.data(), input.size(), [&solns](std::vector<unsigned char> soln) {
+        solns.insert(soln);
+        return false;
+    }, [](EhSolverCancelCheck pos) {
+        return false;
+    });
+    return solns;
+}
+
+}
+
+TEST(equihash_tests, tromp_solver_reused_across_nonces) {
+    EXPECT_TRUE(CEquihashSolver::IsKnown("tromp"));
+    EXPECT_FALSE(CEquihashSolver::IsKnown("xenoncat"));
+
+    CBlockHeader header = Params(CBaseChainParams::MAIN).GenesisBlock().GetBlockHeader();
+    CEquihashSolver solver("tromp");
+    size_t nSolutions = 0;
+    for (int i = 0; i < 2; i++) {
+        header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+        std::vector<unsigned char> input = EquihashInput(header);
+        std::set<std::vector<unsigned char>> solns = SolveAll(solver, 200, 9, input);
+        for (const std::vector<unsigned char>& soln : solns)
+            EXPECT_TRUE(IsValidSpecialised(input, soln));
+        nSolutions += solns.size();
+
+        // the tables left by the previous nonce make no difference
+        if (i > 0) {
+            CEquihashSolver fresh("tromp");
+            EXPECT_EQ(SolveAll(fresh, 200, 9, input), solns);
+        }
+    }
+    EXPECT_GT(nSolutions, 0);
+}
+
+TEST(equihash_tests, tromp_solver_runs_default_one_for_other_parameters) {
+    std::vector<unsigned char> input(140, 0x5a);
+    eh_HashState state;
+    Eh48_5.InitialiseState(state);
+    crypto_generichash_blake2b_update(&state, input.data(), input.size());
+    std::set<std::vector<unsigned char>> expected;
+    EhOptimisedSolveUncancellable(48, 5, state, [&expected](std::vector<unsigned char> soln) {
+        expected.insert(soln);
+        return false;
+    });
+    EXPECT_FALSE(expected.empty());
+
+    CEquihashSolver solver("tromp");
+    EXPECT_EQ(SolveAll(solver, 48, 5, input), expected);
+}
+#endif // ENABLE_MINING
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "leveldbwrapper.h"
+#include "uint256.h"
+
+TEST(LevelDBWrapper, LatencyHistogramBuckets) {
+    CLevelDBLatencyHistogram histogram;
+    EXPECT_EQ(histogram.GetCount(), 0U);
+    EXPECT_EQ(histogram.GetPercentile(0.5), 0);
+
+    histogram.Add(0);     // bucket 0: < 1us
+    histogram.Add(1);     // bucket 1: < 2us
+    histogram.Add(3);     // bucket 2: < 4us
+    histogram.Add(3);
+    histogram.Add(-5);    // clock going backwards counts as 0
+    histogram.Add(int64_t(1) << 40); // clamped to the last bucket
+
+    EXPECT_EQ(histogram.GetCount(), 6U);
+    EXPECT_EQ(histogram.GetBucket(0), 2U);
+    EXPECT_EQ(histogram.GetBucket(1), 1U);
+    EXPECT_EQ(histogram.GetBucket(2), 2U);
+    EXPECT_EQ(histogram.GetBucket(CLevelDBLatencyHistogram::NUM_BUCKETS - 1), 1U);
+    EXPECT_EQ(histogram.GetTotalMicros(), 7U + (uint64_t(1) << 40));
+
+    EXPECT_EQ(histogram.GetPercentile(0.5), 2);
+    EXPECT_EQ(histogram.GetPercentile(0.8), 4);
+    EXPECT_EQ(histogram.GetPercentile(1.0), int64_t(1) << (CLevelDBLatencyHistogram::NUM_BUCKETS - 1));
+}
+
+TEST(LevelDBWrapper, CountersTrackOperations) {
+    CLevelDBWrapper db("", CLevelDBOptions(1 << 20), /*fMemory*/true);
+
+    CLevelDBBatch batch;
+    batch.Write('k', uint256());
+    batch.Write('l', uint256());
+    batch.Erase('m');
+    EXPECT_GT(batch.SizeEstimate(), 2 * sizeof(uint256));
+    size_t nBatchSize = batch.SizeEstimate();
+    ASSERT_TRUE(db.WriteBatch(batch));
+
+    uint256 value;
+    EXPECT_TRUE(db.Read('k', value));
+    EXPECT_FALSE(db.Read('m', value));
+    EXPECT_TRUE(db.Exists('l'));
+    delete db.NewIterator();
+
+    const CLevelDBCounters& counters = db.GetCounters();
+    EXPECT_EQ(counters.nBatchWrites, 1U);
+    EXPECT_EQ(counters.nBytesWritten, nBatchSize);
+    EXPECT_EQ(counters.nReads, 2U);
+    EXPECT_EQ(counters.nReadsNotFound, 1U);
+    EXPECT_EQ(counters.nExists, 1U);
+    EXPECT_EQ(counters.nIterators, 1U);
+    EXPECT_EQ(counters.readLatency.GetCount(), 3U);
+    EXPECT_EQ(counters.writeLatency.GetCount(), 1U);
+
+    bool fRegistered = false;
+    ForEachLevelDB([&db, &fRegistered](const CLevelDBWrapper& other) {
+        if (&other == &db)
+            fRegistered = true;
+    });
+    EXPECT_TRUE(fRegistered);
+
+    std::string strLevel0;
+    EXPECT_TRUE(db.GetProperty("leveldb.num-files-at-level0", strLevel0));
+}
+
+TEST(LevelDBWrapper, InMemoryDatabasesHaveUniqueNames) {
+    CLevelDBWrapper db1("", CLevelDBOptions(1 << 20), /*fMemory*/true);
+    CLevelDBWrapper db2("", CLevelDBOptions(1 << 20), /*fMemory*/true);
+    EXPECT_FALSE(db1.GetName().empty());
+    EXPECT_NE(db1.GetName(), db2.GetName());
+}
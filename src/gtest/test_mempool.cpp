@@ -468,3 +468,434 @@ TEST(ProcessMempoolMsgTest, TxesInMempoolAreRelayed)
     EXPECT_TRUE(theNode.pushedInvList.count(CInv{MSG_TX, scTx.GetHash()}));
     EXPECT_TRUE(theNode.pushedInvList.count(CInv{MSG_TX, cert.GetHash()}));
 }
+
+static CTransaction CreateSpendingTx(const uint256& prevHash, uint32_t prevN)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(prevHash, prevN);
+    mtx.addOut(CTxOut(CAmount(1000), CScript() << OP_TRUE));
+    return CTransaction(mtx);
+}
+
+static void AddTx(CTxMemPool& pool, const CTransaction& tx, CAmount fee)
+{
+    CTxMemPoolEntry entry(tx, fee, /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    pool.addUnchecked(tx.GetHash(), entry);
+}
+
+TEST(Mempool, TrimToSizeEvictsLowestFeeRateFirst)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    std::vector<CTransaction> txs;
+    for (int i = 0; i < 5; ++i)
+    {
+        txs.push_back(CreateSpendingTx(uint256S(std::to_string(i + 1)), 0));
+        AddTx(pool, txs.back(), CAmount(1000 * (i + 1)));
+    }
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.TrimToSize(pool.DynamicMemoryUsage(), removedTxs, removedCerts);
+    EXPECT_TRUE(removedTxs.empty());
+    EXPECT_EQ(pool.GetMinFee(1000000), CFeeRate(0));
+
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1, removedTxs, removedCerts);
+    ASSERT_EQ(removedTxs.size(), 1U);
+    EXPECT_EQ(removedTxs.front().GetHash(), txs[0].GetHash());
+    EXPECT_TRUE(removedCerts.empty());
+    for (int i = 1; i < 5; ++i)
+        EXPECT_TRUE(pool.existsTx(txs[i].GetHash()));
+
+    // the minimum fee is raised above the fee rate of the evicted tx
+    unsigned int nSize = txs[0].GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    EXPECT_GT(pool.GetMinFee(1000000), CFeeRate(1000, nSize));
+}
+
+TEST(Mempool, TrimToSizeKeepsParentsPaidForByDescendants)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    CTransaction parent = CreateSpendingTx(uint256S("1"), 0);
+    AddTx(pool, parent, CAmount(0));
+    CTransaction child = CreateSpendingTx(parent.GetHash(), 0);
+    AddTx(pool, child, CAmount(10000));
+    CTransaction standalone = CreateSpendingTx(uint256S("2"), 0);
+    AddTx(pool, standalone, CAmount(2000));
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1, removedTxs, removedCerts);
+    ASSERT_EQ(removedTxs.size(), 1U);
+    EXPECT_EQ(removedTxs.front().GetHash(), standalone.GetHash());
+
+    // evicting the parent takes its child along
+    removedTxs.clear();
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1, removedTxs, removedCerts);
+    EXPECT_EQ(removedTxs.size(), 2U);
+    EXPECT_EQ(pool.sizeTx(), 0U);
+}
+
+TEST(Mempool, TrimToSizeEvictsTopQualityCertificateLast)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CTxMemPool pool(::minRelayTxFee);
+
+    uint256 scId = uint256S("aaa");
+    CScCertificate lowQualityCert = txCreationUtils::createCertificate(scId, /*epochNum*/0,
+            CFieldElement{}, /*changeTotalAmount*/0, /*numChangeOut*/0, /*bwtTotalAmount*/0,
+            /*numBwt*/1, /*ftScFee*/0, /*mbtrScFee*/0, /*quality*/1);
+    CScCertificate topQualityCert = txCreationUtils::createCertificate(scId, /*epochNum*/0,
+            CFieldElement{}, /*changeTotalAmount*/0, /*numChangeOut*/0, /*bwtTotalAmount*/0,
+            /*numBwt*/2, /*ftScFee*/0, /*mbtrScFee*/0, /*quality*/2);
+    CCertificateMemPoolEntry lowQualityEntry(lowQualityCert, /*fee*/CAmount(0), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    pool.addUnchecked(lowQualityCert.GetHash(), lowQualityEntry);
+    CCertificateMemPoolEntry topQualityEntry(topQualityCert, /*fee*/CAmount(0), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    pool.addUnchecked(topQualityCert.GetHash(), topQualityEntry);
+
+    CTransaction fwdTx = txCreationUtils::createFwdTransferTxWith(scId, CAmount(10));
+    AddTx(pool, fwdTx, CAmount(10000000));
+    CTransaction unrelatedTx = CreateSpendingTx(uint256S("2"), 0);
+    AddTx(pool, unrelatedTx, CAmount(50000));
+
+    std::vector<uint256> evictionOrder;
+    while (pool.size() > 0)
+    {
+        std::list<CTransaction> removedTxs;
+        std::list<CScCertificate> removedCerts;
+        pool.TrimToSize(pool.DynamicMemoryUsage() - 1, removedTxs, removedCerts);
+        ASSERT_EQ(removedTxs.size() + removedCerts.size(), 1U);
+        evictionOrder.push_back(removedTxs.empty() ? removedCerts.front().GetHash() : removedTxs.front().GetHash());
+    }
+
+    ASSERT_EQ(evictionOrder.size(), 4U);
+    EXPECT_EQ(evictionOrder[0], lowQualityCert.GetHash());
+    EXPECT_EQ(evictionOrder[1], unrelatedTx.GetHash());
+    EXPECT_EQ(evictionOrder[2], fwdTx.GetHash());
+    EXPECT_EQ(evictionOrder[3], topQualityCert.GetHash());
+}
+
+TEST(Mempool, PackageStatsFollowAddAndRemove)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    // grandParent -> parent -> child
+    CTransaction grandParent = CreateSpendingTx(uint256S("1"), 0);
+    AddTx(pool, grandParent, CAmount(1000));
+    CTransaction parent = CreateSpendingTx(grandParent.GetHash(), 0);
+    AddTx(pool, parent, CAmount(2000));
+    CTransaction child = CreateSpendingTx(parent.GetHash(), 0);
+    AddTx(pool, child, CAmount(4000));
+
+    const int64_t nTxSize = grandParent.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+
+    LOCK(pool.cs);
+    const CMemPoolEntry* pGrandParent = pool.getEntry(grandParent.GetHash());
+    const CMemPoolEntry* pParent = pool.getEntry(parent.GetHash());
+    const CMemPoolEntry* pChild = pool.getEntry(child.GetHash());
+    ASSERT_TRUE(pGrandParent != nullptr && pParent != nullptr && pChild != nullptr);
+
+    EXPECT_EQ(pGrandParent->GetCountWithDescendants(), 3U);
+    EXPECT_EQ(pGrandParent->GetSizeWithDescendants(), uint64_t(3 * nTxSize));
+    EXPECT_EQ(pGrandParent->GetModFeesWithDescendants(), CAmount(7000));
+    EXPECT_EQ(pChild->GetCountWithAncestors(), 3U);
+    EXPECT_EQ(pChild->GetModFeesWithAncestors(), CAmount(7000));
+    EXPECT_EQ(pParent->GetCountWithAncestors(), 2U);
+    EXPECT_EQ(pParent->GetCountWithDescendants(), 2U);
+
+    // prioritisation is accounted for in the packages of the relatives
+    pool.PrioritiseTransaction(parent.GetHash(), parent.GetHash().ToString(), 0, CAmount(500));
+    EXPECT_EQ(pParent->GetModifiedFee(), CAmount(2500));
+    EXPECT_EQ(pGrandParent->GetModFeesWithDescendants(), CAmount(7500));
+    EXPECT_EQ(pChild->GetModFeesWithAncestors(), CAmount(7500));
+
+    // removing the top of the chain, as when it gets mined
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.remove(grandParent, removedTxs, removedCerts, /*fRecursive*/false);
+    EXPECT_EQ(pParent->GetCountWithAncestors(), 1U);
+    EXPECT_EQ(pParent->GetModFeesWithAncestors(), CAmount(2500));
+    EXPECT_EQ(pChild->GetCountWithAncestors(), 2U);
+    EXPECT_EQ(pChild->GetSizeWithAncestors(), uint64_t(2 * nTxSize));
+
+    // removing the middle of the chain disconnects the others
+    AddTx(pool, grandParent, CAmount(1000));
+    pGrandParent = pool.getEntry(grandParent.GetHash());
+    EXPECT_EQ(pChild->GetCountWithAncestors(), 3U);
+    pool.remove(parent, removedTxs, removedCerts, /*fRecursive*/false);
+    EXPECT_EQ(pGrandParent->GetCountWithDescendants(), 1U);
+    EXPECT_EQ(pGrandParent->GetModFeesWithDescendants(), CAmount(1000));
+    EXPECT_EQ(pChild->GetCountWithAncestors(), 1U);
+    EXPECT_EQ(pChild->GetModFeesWithAncestors(), CAmount(4000));
+}
+
+TEST(Mempool, PackageStatsOfEntryAddedBelowItsDescendants)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    // as on a chain reorg, parent goes back to the mempool where child already is
+    CTransaction parent = CreateSpendingTx(uint256S("1"), 0);
+    CTransaction child = CreateSpendingTx(parent.GetHash(), 0);
+    CTransaction grandChild = CreateSpendingTx(child.GetHash(), 0);
+    AddTx(pool, child, CAmount(2000));
+    AddTx(pool, grandChild, CAmount(4000));
+    AddTx(pool, parent, CAmount(1000));
+
+    LOCK(pool.cs);
+    const CMemPoolEntry* pParent = pool.getEntry(parent.GetHash());
+    const CMemPoolEntry* pGrandChild = pool.getEntry(grandChild.GetHash());
+    EXPECT_EQ(pParent->GetCountWithDescendants(), 3U);
+    EXPECT_EQ(pParent->GetModFeesWithDescendants(), CAmount(7000));
+    EXPECT_EQ(pGrandChild->GetCountWithAncestors(), 3U);
+    EXPECT_EQ(pGrandChild->GetModFeesWithAncestors(), CAmount(7000));
+
+    // evicting the parent takes the whole package along
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.remove(parent, removedTxs, removedCerts, /*fRecursive*/true);
+    EXPECT_EQ(removedTxs.size(), 3U);
+    EXPECT_EQ(pool.sizeTx(), 0U);
+}
+
+TEST(Mempool, AncestorScoreIndexRanksPackagesByFeeRate)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    CTransaction lowFeeParent = CreateSpendingTx(uint256S("1"), 0);
+    AddTx(pool, lowFeeParent, CAmount(100));
+    CTransaction midFeeTx = CreateSpendingTx(uint256S("2"), 0);
+    AddTx(pool, midFeeTx, CAmount(3000));
+
+    LOCK(pool.cs);
+    ASSERT_EQ(pool.setTxByAncestorScore.size(), 2U);
+    EXPECT_EQ(pool.setTxByAncestorScore.begin()->hash, midFeeTx.GetHash());
+
+    // a child paying for its parent ranks the package above the others
+    CTransaction highFeeChild = CreateSpendingTx(lowFeeParent.GetHash(), 0);
+    AddTx(pool, highFeeChild, CAmount(10000));
+    ASSERT_EQ(pool.setTxByAncestorScore.size(), 3U);
+    EXPECT_EQ(pool.setTxByAncestorScore.begin()->hash, highFeeChild.GetHash());
+    EXPECT_EQ(pool.setTxByAncestorScore.rbegin()->hash, lowFeeParent.GetHash());
+
+    // the index follows the prioritisation
+    pool.PrioritiseTransaction(lowFeeParent.GetHash(), lowFeeParent.GetHash().ToString(), 0, CAmount(20000));
+    EXPECT_EQ(pool.setTxByAncestorScore.begin()->hash, lowFeeParent.GetHash());
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.remove(lowFeeParent, removedTxs, removedCerts, /*fRecursive*/true);
+    ASSERT_EQ(pool.setTxByAncestorScore.size(), 1U);
+    EXPECT_EQ(pool.setTxByAncestorScore.begin()->hash, midFeeTx.GetHash());
+    EXPECT_EQ(pool.setTxByHeightAllowingFree.size(), 1U);
+}
+
+TEST(Mempool, DescendantScoreIndexRanksPackagesByFeeRate)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    CTransaction lowFeeParent = CreateSpendingTx(uint256S("1"), 0);
+    AddTx(pool, lowFeeParent, CAmount(100));
+    CTransaction midFeeTx = CreateSpendingTx(uint256S("2"), 0);
+    AddTx(pool, midFeeTx, CAmount(3000));
+
+    LOCK(pool.cs);
+    ASSERT_EQ(pool.setTxByDescendantScore.size(), 2U);
+    EXPECT_EQ(pool.setTxByDescendantScore.begin()->hash, lowFeeParent.GetHash());
+
+    // a child paying for its parent keeps the package from being evicted first
+    CTransaction highFeeChild = CreateSpendingTx(lowFeeParent.GetHash(), 0);
+    AddTx(pool, highFeeChild, CAmount(10000));
+    ASSERT_EQ(pool.setTxByDescendantScore.size(), 3U);
+    EXPECT_EQ(pool.setTxByDescendantScore.begin()->hash, midFeeTx.GetHash());
+    EXPECT_EQ(pool.setTxByDescendantScore.rbegin()->hash, highFeeChild.GetHash());
+
+    // the index follows the removals and the prioritisation
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.remove(highFeeChild, removedTxs, removedCerts, /*fRecursive*/false);
+    ASSERT_EQ(pool.setTxByDescendantScore.size(), 2U);
+    EXPECT_EQ(pool.setTxByDescendantScore.begin()->hash, lowFeeParent.GetHash());
+
+    pool.PrioritiseTransaction(lowFeeParent.GetHash(), lowFeeParent.GetHash().ToString(), 0, CAmount(20000));
+    EXPECT_EQ(pool.setTxByDescendantScore.begin()->hash, midFeeTx.GetHash());
+}
+
+TEST(Mempool, HeightAllowingFreeIsTheFirstOneAboveThreshold)
+{
+    CTransaction tx = CreateSpendingTx(uint256S("1"), 0);
+    CTxMemPoolEntry entry(tx, /*fee*/CAmount(0), /*time*/ 1000, /*priority*/1.0, /*height*/100);
+
+    unsigned int nFreeHeight = entry.GetHeightAllowingFree(0);
+    ASSERT_GT(nFreeHeight, 100U);
+    EXPECT_TRUE(AllowFree(entry.GetPriority(nFreeHeight)));
+    EXPECT_FALSE(AllowFree(entry.GetPriority(nFreeHeight - 1)));
+
+    // a priority delta above the threshold makes it free right away
+    EXPECT_EQ(entry.GetHeightAllowingFree(AllowFreeThreshold()), 0U);
+}
+
+TEST(Mempool, AddedJournalListsTheLatestEntries)
+{
+    CTxMemPool pool(::minRelayTxFee);
+    const uint64_t nStart = pool.GetAddedSequence();
+    const unsigned int nUpdatesStart = pool.GetTransactionsUpdated();
+
+    CTransaction first = CreateSpendingTx(uint256S("1"), 0);
+    AddTx(pool, first, CAmount(1000));
+    CTransaction second = CreateSpendingTx(uint256S("2"), 0);
+    AddTx(pool, second, CAmount(1000));
+
+    std::vector<uint256> vHashes;
+    ASSERT_TRUE(pool.GetAddedSince(nStart, vHashes));
+    ASSERT_EQ(vHashes.size(), 2U);
+    EXPECT_EQ(vHashes[0], first.GetHash());
+    EXPECT_EQ(vHashes[1], second.GetHash());
+
+    vHashes.clear();
+    ASSERT_TRUE(pool.GetAddedSince(nStart + 1, vHashes));
+    ASSERT_EQ(vHashes.size(), 1U);
+    EXPECT_EQ(vHashes[0], second.GetHash());
+
+    // the updates are seen without waiting, and an unchanged mempool times out
+    EXPECT_TRUE(pool.WaitForUpdate(nUpdatesStart, boost::get_system_time()));
+    EXPECT_FALSE(pool.WaitForUpdate(pool.GetTransactionsUpdated(), boost::get_system_time() + boost::posix_time::milliseconds(10)));
+
+    // the journal is bounded
+    for (unsigned int i = 0; i < CTxMemPool::MAX_ADDED_JOURNAL_SIZE; ++i)
+        AddTx(pool, CreateSpendingTx(uint256S("3"), i), CAmount(1000));
+    vHashes.clear();
+    EXPECT_FALSE(pool.GetAddedSince(nStart, vHashes));
+    EXPECT_TRUE(pool.GetAddedSince(nStart + 2, vHashes));
+    EXPECT_EQ(vHashes.size(), size_t(CTxMemPool::MAX_ADDED_JOURNAL_SIZE));
+}
+
+TEST(Mempool, LoadedTimeIsGivenOnlyToEntriesStillExpected)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    CTransaction loaded = CreateSpendingTx(uint256S("1"), 0);
+    pool.SetLoadedTime(loaded.GetHash(), 42);
+    AddTx(pool, loaded, CAmount(1000));
+
+    // a loaded entry that failed acceptance gets its own time if it comes in again
+    CTransaction failed = CreateSpendingTx(uint256S("2"), 0);
+    pool.SetLoadedTime(failed.GetHash(), 42);
+    pool.EraseLoadedTime(failed.GetHash());
+    AddTx(pool, failed, CAmount(1000));
+
+    LOCK(pool.cs);
+    EXPECT_EQ(pool.mapTx.at(loaded.GetHash()).GetTime(), 42);
+    EXPECT_EQ(pool.mapTx.at(failed.GetHash()).GetTime(), 1000);
+}
+
+TEST(Mempool, EntriesShareTheTransactionInsteadOfCopyingIt)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    CTransactionRef ptx(new CTransaction(CreateSpendingTx(uint256S("1"), 0)));
+    CTxMemPoolEntry entry(ptx, /*fee*/CAmount(1000), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    pool.addUnchecked(ptx->GetHash(), entry);
+
+    // the very same object is served to the relay and the notifications
+    std::shared_ptr<const CTransactionBase> pShared = pool.get(ptx->GetHash());
+    ASSERT_TRUE(pShared != nullptr);
+    EXPECT_EQ(pShared.get(), ptx.get());
+    {
+        LOCK(pool.cs);
+        EXPECT_EQ(&pool.mapTx.at(ptx->GetHash()).GetTx(), ptx.get());
+    }
+
+    // it outlives its removal from the mempool as long as someone holds it
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.remove(*ptx, removedTxs, removedCerts, /*fRecursive*/false);
+    EXPECT_TRUE(pool.get(ptx->GetHash()) == nullptr);
+    EXPECT_EQ(pShared->GetHash(), ptx->GetHash());
+}
+
+static CTransaction CreateJoinSplitTx(const uint256& anchor)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = GROTH_TX_VERSION;
+    mtx.vjoinsplit.push_back(JSDescription::getNewInstance(/*isGroth*/true));
+    mtx.vjoinsplit[0].anchor = anchor;
+    mtx.vjoinsplit[0].nullifiers.at(0) = GetRandHash();
+    mtx.vjoinsplit[0].nullifiers.at(1) = GetRandHash();
+    mtx.addOut(CTxOut(CAmount(1000), CScript() << OP_TRUE));
+    return CTransaction(mtx);
+}
+
+TEST(Mempool, RemoveWithAnchorsEvictsSpendersOfAnyInvalidRoot)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    const uint256 firstRoot = uint256S("aa");
+    const uint256 secondRoot = uint256S("bb");
+    const uint256 validRoot = uint256S("cc");
+    CTransaction firstTx = CreateJoinSplitTx(firstRoot);
+    AddTx(pool, firstTx, CAmount(1000));
+    CTransaction secondTx = CreateJoinSplitTx(secondRoot);
+    AddTx(pool, secondTx, CAmount(1000));
+    CTransaction validTx = CreateJoinSplitTx(validRoot);
+    AddTx(pool, validTx, CAmount(1000));
+    CTransaction child = CreateSpendingTx(firstTx.GetHash(), 0);
+    AddTx(pool, child, CAmount(1000));
+
+    pool.removeWithAnchors(std::set<uint256>());
+    EXPECT_EQ(pool.sizeTx(), 4U);
+
+    // the roots of all the disconnected blocks at once, the descendants go along
+    pool.removeWithAnchors(std::set<uint256>{firstRoot, secondRoot});
+    EXPECT_EQ(pool.sizeTx(), 1U);
+    EXPECT_TRUE(pool.existsTx(validTx.GetHash()));
+}
+
+static CTransaction CreateCswTx(const uint256& scId, const CFieldElement& nullifier, CAmount nValue = 10)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = SC_TX_VERSION;
+    mtx.vcsw_ccin.resize(1);
+    mtx.vcsw_ccin[0].scId = scId;
+    mtx.vcsw_ccin[0].nValue = nValue;
+    mtx.vcsw_ccin[0].nullifier = nullifier;
+    mtx.addOut(CTxOut(CAmount(1), CScript() << OP_TRUE));
+    return CTransaction(mtx);
+}
+
+TEST(Mempool, CswNullifierIndexFollowsAddAndRemove)
+{
+    CTxMemPool pool(::minRelayTxFee);
+
+    const uint256 scId = uint256S("aa");
+    const uint256 otherScId = uint256S("bb");
+    CFieldElement firstNullifier;
+    blockchain_test_utils::RandomSidechainField(firstNullifier);
+    CFieldElement secondNullifier;
+    blockchain_test_utils::RandomSidechainField(secondNullifier);
+
+    CTransaction firstTx = CreateCswTx(scId, firstNullifier);
+    AddTx(pool, firstTx, CAmount(9));
+    CTransaction secondTx = CreateCswTx(scId, secondNullifier);
+    AddTx(pool, secondTx, CAmount(9));
+
+    EXPECT_EQ(pool.getNumOfCswInputs(scId), 2);
+    EXPECT_EQ(pool.getNumOfCswInputs(otherScId), 0);
+    EXPECT_TRUE(pool.HaveCswNullifier(scId, firstNullifier));
+    EXPECT_FALSE(pool.HaveCswNullifier(otherScId, firstNullifier));
+
+    // the same nullifier conflicts only within its own sidechain
+    EXPECT_FALSE(pool.checkIncomingTxConflicts(CreateCswTx(scId, firstNullifier, CAmount(20))));
+    EXPECT_TRUE(pool.checkIncomingTxConflicts(CreateCswTx(otherScId, firstNullifier, CAmount(20))));
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.remove(firstTx, removedTxs, removedCerts, /*fRecursive*/false);
+    EXPECT_EQ(pool.getNumOfCswInputs(scId), 1);
+    EXPECT_FALSE(pool.HaveCswNullifier(scId, firstNullifier));
+    EXPECT_TRUE(pool.checkIncomingTxConflicts(CreateCswTx(scId, firstNullifier, CAmount(20))));
+
+    pool.remove(secondTx, removedTxs, removedCerts, /*fRecursive*/false);
+    EXPECT_EQ(pool.getNumOfCswInputs(scId), 0);
+    EXPECT_EQ(pool.mapSidechains.count(scId), 0U);
+}
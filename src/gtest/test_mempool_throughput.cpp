@@ -0,0 +1,466 @@
+#include <gtest/gtest.h>
+#include <gtest/libzendoo_test_files.h>
+
+#include "consensus/validation.h"
+#include "main.h"
+#include "miner.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "utiltime.h"
+#include "zen/forks/fork8_sidechainfork.h"
+
+#include "tx_creation_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+using namespace blockchain_test_utils;
+
+/*
+ * Throughput of the mempool hot path on realistic workloads: every transaction and certificate
+ * is sent through AcceptTxBaseToMemoryPool() one at a time, then a block template is built
+ * with CreateNewBlock() and its content is evicted with removeForBlock(), as ConnectTip() does.
+ *
+ * For each stage the accepted items per second and the latency percentiles are reported on stdout,
+ * together with the cs_main hold times of the driver and the time two probe threads spend
+ * waiting for cs_main and mempool.cs, which is what the network and RPC threads would see.
+ * Proofs are generated with the test circuits but not verified, proof verification being
+ * asynchronous and out of the mempool critical sections in the node.
+ *
+ * The measurement is too long for every test run and is disabled, the test runs only go through small workloads
+ * to check that all the stages still succeed.
+ */
+
+static const ProvingSystem testProvingSystem = ProvingSystem::Darlin;
+
+/** Number of items of each workload */
+struct WorkloadSize
+{
+    unsigned int nP2pkhSpends;
+    unsigned int nTxChains;
+    unsigned int nTxChainLength;
+    unsigned int nScCreations;
+    unsigned int nForwardTransfers;
+    unsigned int nBtrs;
+    // generating a proof takes much longer than accepting it, keep these small
+    unsigned int nCertificates;
+    unsigned int nCsws;
+};
+
+// the measurement, run it with --gtest_also_run_disabled_tests
+static const WorkloadSize FULL_WORKLOAD  = {200, 10, 20, 20, 50, 50, 3, 3};
+// every kind of item once or twice, checked on every test run
+static const WorkloadSize SMALL_WORKLOAD = {  4,  2,  3,  1,  2,  2, 2, 1};
+
+static const CAmount TX_FEE = 10000;
+
+/** Latencies in microseconds of a set of operations */
+class LatencySample
+{
+public:
+    void Add(int64_t nMicros) { vMicros.push_back(nMicros); }
+
+    int64_t Percentile(double fraction) const
+    {
+        if (vMicros.empty())
+            return 0;
+        std::vector<int64_t> sorted(vMicros);
+        std::sort(sorted.begin(), sorted.end());
+        size_t nIndex = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+        return sorted[nIndex];
+    }
+
+private:
+    std::vector<int64_t> vMicros;
+};
+
+/** Takes a lock every millisecond from a separate thread, recording how long it had to wait for it */
+class LockWaitProbe
+{
+public:
+    explicit LockWaitProbe(CCriticalSection& csIn): cs(csIn), fStop(false)
+    {
+        thread = boost::thread(&LockWaitProbe::Run, this);
+    }
+
+    ~LockWaitProbe()
+    {
+        Stop();
+    }
+
+    const LatencySample& Stop()
+    {
+        fStop = true;
+        if (thread.joinable())
+            thread.join();
+        return waits;
+    }
+
+private:
+    void Run()
+    {
+        while (!fStop)
+        {
+            int64_t nStart = GetTimeMicros();
+            {
+                LOCK(cs);
+                waits.Add(GetTimeMicros() - nStart);
+            }
+            MilliSleep(1);
+        }
+    }
+
+    CCriticalSection& cs;
+    std::atomic<bool> fStop;
+    boost::thread thread;
+    LatencySample waits;
+};
+
+class MempoolThroughputTestSuite : public ::testing::Test
+{
+public:
+    MempoolThroughputTestSuite() :
+        blockchain(BlockchainTestManager::GetInstance()),
+        pcoinsTipSaved(nullptr),
+        fReport(false),
+        aliveScId(uint256S("aaaa")),
+        ceasedScId(uint256S("bbbb"))
+    {
+    }
+
+    void SetUp() override
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+
+        // clear globals
+        UnloadBlockIndex();
+        mGlobalForkTips.clear();
+        mempool.clear();
+
+        blockchain.Reset();
+        blockchain.GenerateSidechainTestParameters(testProvingSystem, TestCircuitType::Certificate);
+        blockchain.GenerateSidechainTestParameters(testProvingSystem, TestCircuitType::CSW);
+
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+
+        int chainHeight = SidechainFork().getHeight(CBaseChainParams::REGTEST) + 200;
+        blockchain.ExtendChainActiveToHeight(chainHeight);
+
+        // the first epoch of aliveScId just ended and its certificate submission window is open
+        CSidechain alive = GenerateTestSidechain();
+        alive.creationBlockHeight = chainHeight - alive.fixedParams.withdrawalEpochLength;
+        alive.fixedParams.mainchainBackwardTransferRequestDataLength = 1;
+        blockchain.StoreSidechainWithCurrentHeight(aliveScId, alive, chainHeight);
+
+        // ceasedScId never received a certificate and ceased long ago
+        CSidechain ceased = GenerateTestSidechain();
+        ceased.creationBlockHeight = chainHeight - 5 * ceased.fixedParams.withdrawalEpochLength;
+        ceased.pastEpochTopQualityCertView.certDataHash = CFieldElement{SAMPLE_FIELD};
+        blockchain.StoreSidechainWithCurrentHeight(ceasedScId, ceased, chainHeight);
+
+        pcoinsTipSaved = pcoinsTip;
+        pcoinsTip = blockchain.CoinsViewCache().get();
+        pcoinsTip->SetBestBlock(chainActive.Tip()->GetBlockHash());
+        pindexBestHeader = chainActive.Tip();
+
+        // needed by TestBlockValidity() in CreateNewBlock()
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+    }
+
+    void TearDown() override
+    {
+        mempool.clear();
+
+        delete pblocktree;
+        pblocktree = nullptr;
+        pcoinsTip = pcoinsTipSaved;
+
+        // clear globals
+        UnloadBlockIndex();
+        mGlobalForkTips.clear();
+
+        ClearDatadirCache();
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(pathTemp.string(), ec);
+    }
+
+protected:
+    CSidechain GenerateTestSidechain() const
+    {
+        CSidechain sidechain;
+        sidechain.fixedParams.version = 0;
+        sidechain.fixedParams.withdrawalEpochLength = 20;
+        sidechain.fixedParams.constant = CFieldElement{SAMPLE_FIELD};
+        sidechain.fixedParams.wCertVk = blockchain.GetTestVerificationKey(testProvingSystem, TestCircuitType::Certificate);
+        sidechain.fixedParams.wCeasedVk = blockchain.GetTestVerificationKey(testProvingSystem, TestCircuitType::CSW);
+        sidechain.lastTopQualityCertReferencedEpoch = CScCertificate::EPOCH_NULL;
+        sidechain.balance = 1000 * COIN;
+        return sidechain;
+    }
+
+    CScript OutputScript() const
+    {
+        return GetScriptForDestination(key.GetPubKey().GetID(), /*withCheckBlockAtHeight*/true);
+    }
+
+    CTransaction CreateP2pkhSpend() const
+    {
+        CTransactionCreationArguments args;
+        args.fGenerateValidInput = true;
+        args.nVersion = TRANSPARENT_TX_VERSION;
+        args.vout.push_back(CTxOut(COIN, OutputScript()));
+        args.nFee = TX_FEE;
+        return blockchain.CreateTransaction(args);
+    }
+
+    CTransaction CreateChild(const CTransaction& parent) const
+    {
+        CMutableTransaction child;
+        child.nVersion = TRANSPARENT_TX_VERSION;
+        child.vin.push_back(CTxIn(COutPoint(parent.GetHash(), 0), CScript(), -1));
+        child.addOut(CTxOut(parent.GetVout()[0].nValue - TX_FEE, OutputScript()));
+        EXPECT_TRUE(SignSignature(keystore, parent.GetVout()[0].scriptPubKey, child, 0));
+        return child;
+    }
+
+    CTransaction CreateSidechainTx(const CTxScCreationOut* scCreation, const CTxForwardTransferOut* ft, const CBwtRequestOut* btr) const
+    {
+        CTransactionCreationArguments args;
+        args.fGenerateValidInput = true;
+        args.nVersion = SC_TX_VERSION;
+        if (scCreation)
+            args.vsc_ccout.push_back(*scCreation);
+        if (ft)
+            args.vft_ccout.push_back(*ft);
+        if (btr)
+            args.vmbtr_out.push_back(*btr);
+        args.nFee = TX_FEE;
+        return blockchain.CreateTransaction(args);
+    }
+
+    CTransaction CreateCsw(CAmount nValue) const
+    {
+        CFieldElement nullifier;
+        RandomSidechainField(nullifier);
+
+        CTransactionCreationArguments args;
+        args.nVersion = SC_TX_VERSION;
+        args.vcsw_ccin.push_back(blockchain.CreateCswInput(ceasedScId, nValue, nullifier, testProvingSystem));
+        args.vout.push_back(CTxOut(nValue - TX_FEE, OutputScript()));
+        return blockchain.CreateTransaction(args);
+    }
+
+    /** Accepts the items in order, each one in its own cs_main critical section as ProcessMessages() does */
+    template <typename T>
+    void AcceptAll(const std::string& strWorkload, const std::vector<T>& items)
+    {
+        LatencySample latencies;
+        LatencySample holdTimes;
+
+        LockWaitProbe mainProbe(cs_main);
+        LockWaitProbe mempoolProbe(mempool.cs);
+
+        int64_t nStart = GetTimeMicros();
+        for (const T& item : items)
+        {
+            CValidationState state;
+            MempoolReturnValue ret;
+            int64_t nItemStart = GetTimeMicros();
+            {
+                LOCK(cs_main);
+                int64_t nLocked = GetTimeMicros();
+                ret = AcceptTxBaseToMemoryPool(mempool, state, item, LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF,
+                                               MempoolProofVerificationFlag::DISABLED);
+                holdTimes.Add(GetTimeMicros() - nLocked);
+            }
+            latencies.Add(GetTimeMicros() - nItemStart);
+            EXPECT_TRUE(ret == MempoolReturnValue::VALID) << strWorkload << ": " << item.GetHash().ToString()
+                                                          << " rejected: " << state.GetRejectReason();
+        }
+        int64_t nElapsed = GetTimeMicros() - nStart;
+
+        Report(strWorkload, items.size(), nElapsed, latencies, holdTimes, mainProbe.Stop(), mempoolProbe.Stop());
+    }
+
+    /** Accepts every workload, builds a block template out of the mempool and evicts its content */
+    void RunWorkloads(const WorkloadSize& size)
+    {
+        std::vector<CTransaction> p2pkhSpends;
+        for (unsigned int i = 0; i < size.nP2pkhSpends; ++i)
+            p2pkhSpends.push_back(CreateP2pkhSpend());
+
+        // chains are interleaved, so that every child is accepted while its ancestors are in the mempool
+        std::vector<CTransaction> chains;
+        for (unsigned int i = 0; i < size.nTxChains; ++i)
+            chains.push_back(CreateP2pkhSpend());
+        for (unsigned int depth = 1; depth < size.nTxChainLength; ++depth)
+            for (unsigned int i = 0; i < size.nTxChains; ++i)
+                chains.push_back(CreateChild(chains[chains.size() - size.nTxChains]));
+
+        std::vector<CTransaction> scCreations;
+        for (unsigned int i = 0; i < size.nScCreations; ++i)
+        {
+            CTxScCreationOut scCreation = blockchain.CreateScCreationOut(0, testProvingSystem);
+            scCreations.push_back(CreateSidechainTx(&scCreation, nullptr, nullptr));
+        }
+
+        std::vector<CTransaction> forwardTransfers;
+        for (unsigned int i = 0; i < size.nForwardTransfers; ++i)
+        {
+            CTxForwardTransferOut ft = blockchain.CreateForwardTransferOut(aliveScId);
+            forwardTransfers.push_back(CreateSidechainTx(nullptr, &ft, nullptr));
+        }
+
+        std::vector<CTransaction> btrs;
+        for (unsigned int i = 0; i < size.nBtrs; ++i)
+        {
+            CBwtRequestOut btr = blockchain.CreateBackwardTransferRequestOut(aliveScId);
+            btrs.push_back(CreateSidechainTx(nullptr, nullptr, &btr));
+        }
+
+        std::vector<CScCertificate> certificates;
+        for (unsigned int quality = 1; quality <= size.nCertificates; ++quality)
+            certificates.push_back(blockchain.GenerateCertificate(aliveScId, /*epochNumber*/0, quality, testProvingSystem));
+
+        std::vector<CTransaction> csws;
+        for (unsigned int i = 0; i < size.nCsws; ++i)
+            csws.push_back(CreateCsw(COIN));
+
+        AcceptAll("p2pkh spends", p2pkhSpends);
+        AcceptAll("dependent chains", chains);
+        AcceptAll("sc creations", scCreations);
+        AcceptAll("forward transfers", forwardTransfers);
+        AcceptAll("btrs", btrs);
+        AcceptAll("certificates", certificates);
+        AcceptAll("csws", csws);
+
+        size_t nExpectedTxs = p2pkhSpends.size() + chains.size() + scCreations.size() + forwardTransfers.size() + btrs.size() + csws.size();
+        ASSERT_EQ(mempool.sizeTx(), nExpectedTxs);
+        ASSERT_EQ(mempool.sizeCert(), certificates.size());
+
+        // block template
+        std::unique_ptr<CBlockTemplate> pblocktemplate;
+        {
+            LockWaitProbe mainProbe(cs_main);
+            LockWaitProbe mempoolProbe(mempool.cs);
+
+            int64_t nStart = GetTimeMicros();
+            pblocktemplate.reset(CreateNewBlock(OutputScript()));
+            int64_t nElapsed = GetTimeMicros() - nStart;
+            ASSERT_TRUE(pblocktemplate != nullptr);
+
+            LatencySample latencies;
+            latencies.Add(nElapsed);
+            const CBlock& block = pblocktemplate->block;
+            Report("CreateNewBlock", block.vtx.size() + block.vcert.size(), nElapsed, latencies, latencies,
+                   mainProbe.Stop(), mempoolProbe.Stop());
+        }
+
+        const CBlock& block = pblocktemplate->block;
+        ASSERT_GT(block.vtx.size(), 1U);
+
+        // eviction of the template content, as if it had been connected
+        {
+            LockWaitProbe mempoolProbe(mempool.cs);
+
+            size_t nSizeBefore = mempool.size();
+            std::list<CTransaction> removedTxs;
+            std::list<CScCertificate> removedCerts;
+
+            int64_t nStart = GetTimeMicros();
+            {
+                LOCK(cs_main);
+                mempool.removeForBlock(block.vtx, chainActive.Height() + 1, removedTxs, removedCerts);
+                mempool.removeForBlock(block.vcert, chainActive.Height() + 1, removedTxs, removedCerts);
+            }
+            int64_t nElapsed = GetTimeMicros() - nStart;
+
+            LatencySample latencies;
+            latencies.Add(nElapsed);
+            Report("removeForBlock", block.vtx.size() + block.vcert.size(), nElapsed, latencies, latencies,
+                   LatencySample(), mempoolProbe.Stop());
+
+            EXPECT_LT(mempool.size(), nSizeBefore);
+        }
+    }
+
+    void Report(const std::string& strStage, size_t nItems, int64_t nElapsed, const LatencySample& latencies,
+                const LatencySample& holdTimes, const LatencySample& mainWaits, const LatencySample& mempoolWaits) const
+    {
+        if (!fReport)
+            return;
+
+        std::string strReport = strprintf(
+            "%-20s %5u items %10.1f items/s, latency p50 %6dus p99 %6dus, cs_main hold p99 %6dus max %6dus, "
+            "wait cs_main p99 %6dus max %6dus, wait mempool.cs p99 %6dus max %6dus\n",
+            strStage, nItems, nElapsed > 0 ? nItems * 1000000.0 / nElapsed : 0.0,
+            latencies.Percentile(0.5), latencies.Percentile(0.99),
+            holdTimes.Percentile(0.99), holdTimes.Percentile(1.0),
+            mainWaits.Percentile(0.99), mainWaits.Percentile(1.0),
+            mempoolWaits.Percentile(0.99), mempoolWaits.Percentile(1.0));
+        printf("%s", strReport.c_str());
+        LogPrintf("%s", strReport);
+    }
+
+    BlockchainTestManager& blockchain;
+    CCoinsViewCache* pcoinsTipSaved;
+    boost::filesystem::path pathTemp;
+    bool fReport;
+
+    CKey key;
+    CBasicKeyStore keystore;
+
+    uint256 aliveScId;
+    uint256 ceasedScId;
+};
+
+TEST_F(MempoolThroughputTestSuite, SmallWorkloadsAreAcceptedMinedAndEvicted)
+{
+    RunWorkloads(SMALL_WORKLOAD);
+}
+
+TEST_F(MempoolThroughputTestSuite, DISABLED_AcceptanceBlockTemplateAndEviction)
+{
+    fReport = true;
+    RunWorkloads(FULL_WORKLOAD);
+}
+
+TEST_F(MempoolThroughputTestSuite, SharedObjectsAreKeptByTheMempoolWithoutCopies)
+{
+    CTransactionRef ptx = std::make_shared<const CTransaction>(CreateP2pkhSpend());
+    std::shared_ptr<const CTransactionBase> pchild = std::make_shared<const CTransaction>(CreateChild(*ptx));
+    CScCertificateRef pcert = std::make_shared<const CScCertificate>(
+        blockchain.GenerateCertificate(aliveScId, /*epochNumber*/0, /*quality*/1, testProvingSystem));
+
+    LOCK(cs_main);
+    CValidationState state;
+    EXPECT_EQ(MempoolReturnValue::VALID, AcceptTxToMemoryPool(mempool, state, ptx, LimitFreeFlag::OFF,
+                                                              RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED));
+    EXPECT_EQ(MempoolReturnValue::VALID, AcceptTxBaseToMemoryPool(mempool, state, pchild, LimitFreeFlag::OFF,
+                                                                  RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED));
+    EXPECT_EQ(MempoolReturnValue::VALID, AcceptCertificateToMemoryPool(mempool, state, pcert, LimitFreeFlag::OFF,
+                                                                       RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED));
+
+    EXPECT_EQ(ptx.get(), mempool.get(ptx->GetHash()).get());
+    EXPECT_EQ(pchild.get(), mempool.get(pchild->GetHash()).get());
+    EXPECT_EQ(pcert.get(), mempool.get(pcert->GetHash()).get());
+
+    // objects given by reference are still copied
+    CTransaction tx = CreateP2pkhSpend();
+    EXPECT_EQ(MempoolReturnValue::VALID, AcceptTxToMemoryPool(mempool, state, tx, LimitFreeFlag::OFF,
+                                                              RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED));
+    EXPECT_NE(static_cast<const CTransactionBase*>(&tx), mempool.get(tx.GetHash()).get());
+}
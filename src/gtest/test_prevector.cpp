@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "prevector.h"
+#include "random.h"
+#include "serialize.h"
+#include "streams.h"
+#include "version.h"
+
+#include <vector>
+
+namespace {
+
+/** Applies every operation to a prevector and a std::vector, and checks that they always match. */
+template <unsigned int N, typename T>
+class CPrevectorTester
+{
+    typedef prevector<N, T> pretype;
+    typedef std::vector<T> realtype;
+
+    pretype pre;
+    realtype real;
+
+public:
+    void Check()
+    {
+        ASSERT_EQ(pre.size(), real.size());
+        ASSERT_EQ(pre.empty(), real.empty());
+        ASSERT_GE(pre.capacity(), pre.size());
+        for (size_t i = 0; i < real.size(); i++)
+            ASSERT_EQ(pre[i], real[i]);
+        ASSERT_TRUE(std::equal(pre.begin(), pre.end(), real.begin()));
+        ASSERT_TRUE(std::equal(pre.rbegin(), pre.rend(), real.rbegin()));
+
+        pretype copy(pre);
+        ASSERT_TRUE(copy == pre);
+        ASSERT_FALSE(copy < pre);
+        ASSERT_EQ(copy.allocated_memory() == 0, copy.size() <= N);
+
+        CDataStream ssPre(SER_DISK, PROTOCOL_VERSION);
+        CDataStream ssReal(SER_DISK, PROTOCOL_VERSION);
+        ssPre << pre;
+        ssReal << real;
+        ASSERT_EQ(ssPre.str(), ssReal.str());
+        pretype unserialized;
+        ssReal >> unserialized;
+        ASSERT_TRUE(unserialized == pre);
+    }
+
+    void resize(size_t s) { pre.resize(s); real.resize(s); }
+    void insert(size_t pos, const T& value) { pre.insert(pre.begin() + pos, value); real.insert(real.begin() + pos, value); }
+    void insert(size_t pos, size_t count, const T& value) { pre.insert(pre.begin() + pos, count, value); real.insert(real.begin() + pos, count, value); }
+    template <typename I>
+    void insert_range(size_t pos, I first, I last) { pre.insert(pre.begin() + pos, first, last); real.insert(real.begin() + pos, first, last); }
+    void erase(size_t pos) { pre.erase(pre.begin() + pos); real.erase(real.begin() + pos); }
+    void erase(size_t first, size_t last) { pre.erase(pre.begin() + first, pre.begin() + last); real.erase(real.begin() + first, real.begin() + last); }
+    void update(size_t pos, const T& value) { pre[pos] = value; real[pos] = value; }
+    void push_back(const T& value) { pre.push_back(value); real.push_back(value); }
+    void pop_back() { pre.pop_back(); real.pop_back(); }
+    void clear() { pre.clear(); real.clear(); }
+    void assign(size_t n, const T& value) { pre.assign(n, value); real.assign(n, value); }
+    void reserve(size_t s) { pre.reserve(s); real.reserve(s); }
+    void shrink_to_fit() { pre.shrink_to_fit(); real.shrink_to_fit(); }
+    void swap() { pretype other(pre.begin(), pre.end()); pre.swap(other); }
+    void move() { pretype other(std::move(pre)); pre = std::move(other); }
+    void copy() { pretype other; other = pre; pre = other; }
+    size_t size() const { return real.size(); }
+};
+
+}
+
+TEST(Prevector, MatchesVector) {
+    for (int j = 0; j < 64; j++) {
+        CPrevectorTester<8, int> test;
+        for (int i = 0; i < 1024; i++) {
+            int r = GetRandInt(1 << 30);
+            int value = GetRandInt(1 << 20);
+            size_t size = test.size();
+            switch (r % 16) {
+            case 0: test.insert(GetRandInt(size + 1), value); break;
+            case 1: test.resize(std::max(0, std::min(30, (int)size + GetRandInt(5) - 2))); break;
+            case 2: test.insert(GetRandInt(size + 1), 1 + GetRandInt(2), value); break;
+            case 3: if (size) test.erase(GetRandInt(size)); break;
+            case 4: {
+                size_t first = GetRandInt(size + 1);
+                test.erase(first, first + GetRandInt(size - first + 1));
+                break;
+            }
+            case 5: if (size) test.update(GetRandInt(size), value); break;
+            case 6: test.push_back(value); break;
+            case 7: if (size) test.pop_back(); break;
+            case 8: {
+                std::vector<int> values(GetRandInt(20), value);
+                test.insert_range(GetRandInt(size + 1), values.begin(), values.end());
+                break;
+            }
+            case 9: if (GetRandInt(32) == 0) test.clear(); break;
+            case 10: test.assign(GetRandInt(20), value); break;
+            case 11: test.reserve(GetRandInt(32)); break;
+            case 12: test.shrink_to_fit(); break;
+            case 13: test.swap(); break;
+            case 14: test.move(); break;
+            case 15: test.copy(); break;
+            }
+            test.Check();
+        }
+    }
+}
+
+TEST(Prevector, SmallVectorsDoNotAllocate) {
+    prevector<28, unsigned char> v;
+    for (int i = 0; i < 28; i++)
+        v.push_back(i);
+    EXPECT_EQ(v.allocated_memory(), 0U);
+    EXPECT_EQ(v.capacity(), 28U);
+
+    v.push_back(28);
+    EXPECT_GT(v.allocated_memory(), 0U);
+
+    // erasing keeps the capacity, shrinking moves the elements back inline
+    v.erase(v.begin() + 10, v.end());
+    EXPECT_GT(v.allocated_memory(), 0U);
+    v.shrink_to_fit();
+    EXPECT_EQ(v.allocated_memory(), 0U);
+    ASSERT_EQ(v.size(), 10U);
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(v[i], i);
+}
+
+TEST(Prevector, OrderedLikeVectors) {
+    std::vector<unsigned char> a = {1, 2, 3}, b = {1, 3}, c = {1, 2, 3, 0};
+    prevector<2, unsigned char> pa(a.begin(), a.end()), pb(b.begin(), b.end()), pc(c.begin(), c.end());
+    EXPECT_EQ(pa < pb, a < b);
+    EXPECT_EQ(pb < pa, b < a);
+    EXPECT_EQ(pa < pc, a < c);
+    EXPECT_EQ(pc < pb, c < b);
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+
+#include "key.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <atomic>
+#include <thread>
+
+static uint256 RandomEntry(CSignatureCache& cache)
+{
+    std::vector<unsigned char> vchSig(72);
+    GetRandBytes(vchSig.data(), vchSig.size());
+    std::vector<unsigned char> vchPubKey(COMPRESSED_PUBLIC_KEY_SIZE);
+    GetRandBytes(vchPubKey.data(), vchPubKey.size());
+    vchPubKey[0] = 0x02;
+
+    uint256 entry;
+    cache.ComputeEntry(entry, GetRandHash(), vchSig, CPubKey(vchPubKey.begin(), vchPubKey.end()));
+    return entry;
+}
+
+TEST(SigCache, StoredSignaturesAreFound) {
+    CSignatureCache cache(1 << 20);
+    std::vector<uint256> entries;
+    for (int i = 0; i < 1000; i++)
+        entries.push_back(RandomEntry(cache));
+
+    for (const uint256& entry : entries)
+        EXPECT_FALSE(cache.Get(entry, false));
+    for (const uint256& entry : entries)
+        cache.Set(entry);
+    for (const uint256& entry : entries)
+        EXPECT_TRUE(cache.Get(entry, false));
+
+    CSignatureCacheStats stats = cache.GetStats();
+    EXPECT_LE(stats.nBytes, 1U << 20);
+    EXPECT_EQ(stats.nLookups, 2000U);
+    EXPECT_EQ(stats.nHits, 1000U);
+    EXPECT_EQ(stats.nInserts, 1000U);
+}
+
+TEST(SigCache, EntriesAreSalted) {
+    CSignatureCache cache1(1 << 20);
+    CSignatureCache cache2(1 << 20);
+
+    std::vector<unsigned char> vchSig(72, 0x30);
+    std::vector<unsigned char> vchPubKey(COMPRESSED_PUBLIC_KEY_SIZE, 0x02);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
+    uint256 hash = GetRandHash();
+
+    uint256 entry1, entry1Again, entry2;
+    cache1.ComputeEntry(entry1, hash, vchSig, pubkey);
+    cache1.ComputeEntry(entry1Again, hash, vchSig, pubkey);
+    cache2.ComputeEntry(entry2, hash, vchSig, pubkey);
+    EXPECT_EQ(entry1, entry1Again);
+    EXPECT_NE(entry1, entry2);
+}
+
+TEST(SigCache, DisabledCacheNeverHits) {
+    CSignatureCache cache(0);
+    uint256 entry = RandomEntry(cache);
+    cache.Set(entry);
+    EXPECT_FALSE(cache.Get(entry, false));
+    EXPECT_EQ(cache.GetStats().nCapacity, 0U);
+}
+
+TEST(SigCache, ErasedEntriesAreReplacedFirst) {
+    // a budget below two buckets: a single one, holding WAYS entries
+    CSignatureCache cache(200);
+    ASSERT_EQ(cache.GetStats().nCapacity, (size_t)CSignatureCache::WAYS);
+
+    std::vector<uint256> entries;
+    for (int i = 0; i < CSignatureCache::WAYS; i++) {
+        entries.push_back(RandomEntry(cache));
+        cache.Set(entries.back());
+    }
+    EXPECT_EQ(cache.GetStats().nEvictions, 0U);
+
+    // an erased entry is still valid until it is overwritten
+    EXPECT_TRUE(cache.Get(entries[1], true));
+    EXPECT_TRUE(cache.Get(entries[1], false));
+    EXPECT_EQ(cache.GetStats().nErasures, 1U);
+
+    uint256 newEntry = RandomEntry(cache);
+    cache.Set(newEntry);
+    EXPECT_EQ(cache.GetStats().nEvictions, 0U);
+    EXPECT_TRUE(cache.Get(newEntry, false));
+    EXPECT_FALSE(cache.Get(entries[1], false));
+    for (int i = 0; i < CSignatureCache::WAYS; i++) {
+        if (i != 1)
+            EXPECT_TRUE(cache.Get(entries[i], false));
+    }
+
+    // the bucket is full of live entries: the next insertion evicts one of them
+    cache.Set(RandomEntry(cache));
+    EXPECT_EQ(cache.GetStats().nEvictions, 1U);
+}
+
+TEST(SigCache, ConcurrentReadersSeeNoFalsePositives) {
+    // readers look up entries that are never inserted while writers fill a small cache,
+    // so that buckets are rewritten under the readers
+    CSignatureCache cache(4096);
+    std::vector<uint256> inserted, absent;
+    for (int i = 0; i < 20000; i++)
+        inserted.push_back(RandomEntry(cache));
+    for (int i = 0; i < 1000; i++)
+        absent.push_back(RandomEntry(cache));
+
+    std::atomic<bool> fDone(false);
+    std::atomic<int> nFalsePositives(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&]() {
+            while (!fDone) {
+                for (const uint256& entry : absent) {
+                    if (cache.Get(entry, false))
+                        nFalsePositives++;
+                }
+            }
+        });
+    }
+
+    std::thread writer([&]() {
+        for (const uint256& entry : inserted)
+            cache.Set(entry);
+    });
+    writer.join();
+    fDone = true;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(nFalsePositives, 0);
+    EXPECT_GT(cache.GetStats().nEvictions, 0U);
+}
+
+TEST(SigCache, PubKeyCacheVerifiesLikeThePubKey) {
+    CPubKeyCache pubkeyCache;
+    for (int i = 0; i < 10; i++) {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        CPubKey pubkey = key.GetPubKey();
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        ASSERT_TRUE(key.Sign(hash, vchSig));
+
+        // twice, the second time with the key already parsed
+        for (int j = 0; j < 2; j++) {
+            EXPECT_TRUE(pubkeyCache.Verify(pubkey, hash, vchSig));
+            EXPECT_FALSE(pubkeyCache.Verify(pubkey, GetRandHash(), vchSig));
+            EXPECT_FALSE(pubkeyCache.Verify(pubkey, hash, std::vector<unsigned char>()));
+        }
+    }
+
+    // a key which is not on the curve is never valid
+    std::vector<unsigned char> vchPubKey(COMPRESSED_PUBLIC_KEY_SIZE, 0xff);
+    vchPubKey[0] = 0x02;
+    CPubKey invalid(vchPubKey.begin(), vchPubKey.end());
+    EXPECT_FALSE(pubkeyCache.Verify(invalid, GetRandHash(), std::vector<unsigned char>(72, 0x30)));
+}
+
+TEST(SigCache, SignatureBatchStoresOnlyValidSignatures) {
+    CPubKeyCache pubkeyCache;
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    CSignatureBatch batch;
+    uint64_t nInserts = GetSignatureCacheStats().nInserts;
+    for (int i = 0; i < 4; i++) {
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        ASSERT_TRUE(key.Sign(hash, vchSig));
+        // the third signature is of another hash
+        if (i == 2)
+            hash = GetRandHash();
+        uint256 entry = GetRandHash();
+        batch.Add(vchSig, pubkey, hash, &entry);
+    }
+    // not to be stored
+    std::vector<unsigned char> vchSig;
+    uint256 hash = GetRandHash();
+    ASSERT_TRUE(key.Sign(hash, vchSig));
+    batch.Add(vchSig, pubkey, hash, nullptr);
+    ASSERT_EQ(batch.size(), 5U);
+
+    EXPECT_TRUE(batch.Verify(0, 2, pubkeyCache));
+    EXPECT_EQ(GetSignatureCacheStats().nInserts, nInserts + 2);
+    // nothing is stored from a range with an invalid signature
+    EXPECT_FALSE(batch.Verify(1, 4, pubkeyCache));
+    EXPECT_EQ(GetSignatureCacheStats().nInserts, nInserts + 2);
+    EXPECT_TRUE(batch.Verify(3, 5, pubkeyCache));
+    EXPECT_EQ(GetSignatureCacheStats().nInserts, nInserts + 3);
+}
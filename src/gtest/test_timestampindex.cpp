@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <txdb.h>
+#include <main.h>
+
+#ifdef ENABLE_ADDRESS_INDEXING
+#include <timestampindex.h>
+
+class TimestampIndexTestSuite: public ::testing::Test {
+public:
+    TimestampIndexTestSuite(): timestampIndexDb(CLevelDBOptions(1 << 20), /*fMemory*/true) {}
+
+    void SetUp() override {
+        // two blocks per timestamp 100, 110, ..., 190; the odd ones at height -1, i.e. not on the active chain
+        for (int i = 0; i < 20; ++i) {
+            uint256 hash = Hash(BEGIN(i), END(i));
+            ASSERT_TRUE(timestampIndexDb.WriteTimestampIndex(CTimestampIndexKey(100 + 10 * (i / 2), hash), (i % 2) ? -1 : i));
+        }
+        // an entry of the logical timestamp index, which sorts after the timestamp index
+        ASSERT_TRUE(timestampIndexDb.WriteTimestampBlockIndex(CTimestampBlockIndexKey(uint256()), CTimestampBlockIndexValue(1)));
+    }
+
+protected:
+    CTimestampIndexDB timestampIndexDb;
+
+    std::vector<std::pair<uint256, unsigned int> > ReadAll(unsigned int high, unsigned int low, CTimestampIndexScan scan,
+                                                           const std::function<bool(const uint256&, int)>& filter)
+    {
+        std::vector<std::pair<uint256, unsigned int> > result;
+        while (true) {
+            std::vector<std::pair<uint256, unsigned int> > page;
+            CTimestampIndexKey lastKey;
+            bool fMore = false;
+            EXPECT_TRUE(timestampIndexDb.ReadTimestampIndex(high, low, scan, filter, page, lastKey, fMore));
+            EXPECT_LE(page.size(), scan.nLimit);
+            result.insert(result.end(), page.begin(), page.end());
+            if (!fMore)
+                break;
+            scan.cursor = lastKey;
+            scan.fHaveCursor = true;
+            scan.nOffset = 0;
+        }
+        return result;
+    }
+};
+
+static bool ActiveOnly(const uint256& hash, int nHeight)
+{
+    return nHeight >= 0;
+}
+
+TEST_F(TimestampIndexTestSuite, UnlimitedScanReturnsRange) {
+    std::vector<std::pair<uint256, unsigned int> > hashes;
+    CTimestampIndexKey lastKey;
+    bool fMore = true;
+    ASSERT_TRUE(timestampIndexDb.ReadTimestampIndex(150, 120, CTimestampIndexScan(), nullptr, hashes, lastKey, fMore));
+    EXPECT_FALSE(fMore);
+    ASSERT_EQ(hashes.size(), 6U);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        EXPECT_EQ(hashes[i].second, 120 + 10 * (i / 2));
+}
+
+TEST_F(TimestampIndexTestSuite, PagedScanMatchesUnlimitedScan) {
+    for (int fReverse = 0; fReverse <= 1; ++fReverse) {
+        CTimestampIndexScan scan;
+        scan.fReverse = fReverse;
+
+        std::vector<std::pair<uint256, unsigned int> > expected;
+        CTimestampIndexKey lastKey;
+        bool fMore;
+        ASSERT_TRUE(timestampIndexDb.ReadTimestampIndex(1000, 0, scan, ActiveOnly, expected, lastKey, fMore));
+        ASSERT_EQ(expected.size(), 10U);
+        EXPECT_EQ(expected.front().second, fReverse ? 190U : 100U);
+
+        for (unsigned int nLimit = 1; nLimit <= 11; ++nLimit) {
+            scan.nLimit = nLimit;
+            std::vector<std::pair<uint256, unsigned int> > paged = ReadAll(1000, 0, scan, ActiveOnly);
+            ASSERT_EQ(paged.size(), expected.size());
+            for (size_t i = 0; i < paged.size(); ++i)
+                EXPECT_EQ(paged[i].first, expected[i].first);
+        }
+    }
+}
+
+TEST_F(TimestampIndexTestSuite, OffsetSkipsMatchingEntries) {
+    CTimestampIndexScan scan;
+    scan.nOffset = 3;
+    scan.nLimit = 2;
+
+    std::vector<std::pair<uint256, unsigned int> > hashes;
+    CTimestampIndexKey lastKey;
+    bool fMore = false;
+    ASSERT_TRUE(timestampIndexDb.ReadTimestampIndex(1000, 0, scan, ActiveOnly, hashes, lastKey, fMore));
+    EXPECT_TRUE(fMore);
+    ASSERT_EQ(hashes.size(), 2U);
+    EXPECT_EQ(hashes[0].second, 130U);
+    EXPECT_EQ(hashes[1].second, 140U);
+    EXPECT_EQ(lastKey.blockHash, hashes[1].first);
+}
+#endif // ENABLE_ADDRESS_INDEXING
@@ -1,9 +1,14 @@
 #include <gtest/gtest.h>
 
 #include "consensus/validation.h"
+#include "keystore.h"
 #include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
 #include "utiltest.h"
 
+#include <atomic>
+
 extern ZCJoinSplit* params;
 
 extern bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, BlockSet* sForkTips);
@@ -78,6 +83,144 @@ TEST(Validation, ContextualCheckInputsPassesWithCoinbase) {
     EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, false, chainActive, 0, false, Params(CBaseChainParams::MAIN).GetConsensus()));
 }
 
+TEST(Validation, ScriptExecutionCacheSkipsCheckedTransactions) {
+    SelectParams(CBaseChainParams::REGTEST);
+    InitScriptExecutionCache();
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID(), /*withCheckBlockAtHeight*/false);
+
+    // the view is at a block of height 1, holding the output spent
+    FakeCoinsViewDB fakeDB;
+    CCoinsViewCache view(&fakeDB);
+    uint256 hashBest = GetRandHash();
+    CBlockIndex indexBest;
+    indexBest.nHeight = 1;
+    mapBlockIndex[hashBest] = &indexBest;
+    view.SetBestBlock(hashBest);
+
+    CMutableTransaction funding;
+    funding.vin.resize(1);
+    funding.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    funding.addOut(CTxOut(COIN, scriptPubKey));
+    CTransaction fundingTx(funding);
+    view.ModifyCoins(fundingTx.GetHash())->From(fundingTx, 1);
+
+    CMutableTransaction spend;
+    spend.vin.emplace_back(fundingTx.GetHash(), 0);
+    spend.addOut(CTxOut(COIN - 1000, scriptPubKey));
+    ASSERT_TRUE(SignSignature(keystore, scriptPubKey, spend, 0, SIGHASH_ALL));
+    CTransaction tx(spend);
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CValidationState state;
+    CSignatureCacheStats stats = GetScriptExecutionCacheStats();
+
+    // the standard flags of the mempool are not cached
+    EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, consensus));
+    EXPECT_EQ(GetScriptExecutionCacheStats().nLookups, stats.nLookups);
+
+    // mempool acceptance with the block flags: a miss, then the result is stored
+    EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, consensus));
+    EXPECT_EQ(GetScriptExecutionCacheStats().nHits, stats.nHits);
+    EXPECT_EQ(GetScriptExecutionCacheStats().nInserts, stats.nInserts + 1);
+
+    // block connection: found without queueing any script check, and released
+    std::vector<CScriptCheck> vChecks;
+    EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, false, consensus, &vChecks));
+    EXPECT_TRUE(vChecks.empty());
+    EXPECT_EQ(GetScriptExecutionCacheStats().nHits, stats.nHits + 1);
+    EXPECT_EQ(GetScriptExecutionCacheStats().nErasures, stats.nErasures + 1);
+
+    // another signature makes another transaction, whose scripts are checked
+    CMutableTransaction tampered = spend;
+    tampered.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << ToByteVector(key.GetPubKey());
+    EXPECT_FALSE(ContextualCheckTxInputs(CTransaction(tampered), state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, consensus));
+
+    mapBlockIndex.erase(hashBest);
+}
+
+static CMutableTransaction CreateUnsignedSpend() {
+    CMutableTransaction spend;
+    spend.vin.emplace_back(GetRandHash(), 0);
+    spend.addOut(CTxOut(COIN, CScript() << OP_TRUE));
+    return spend;
+}
+
+static std::vector<unsigned char> SignSpend(const CKey& key, const CScript& scriptPubKey, const CMutableTransaction& spend) {
+    std::vector<unsigned char> vchSig;
+    EXPECT_TRUE(key.Sign(SignatureHash(scriptPubKey, CTransaction(spend), 0, SIGHASH_ALL), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    return vchSig;
+}
+
+// the input of tx checked as in a block, with its signatures deferred to the end of the batch
+static bool RunBatchedScriptCheck(const CScript& scriptPubKey, const CTransaction& tx, ScriptError& error) {
+    CPubKeyCache pubkeyCache;
+    std::vector<CScriptCheck> vChecks;
+    vChecks.push_back(CScriptCheck(scriptPubKey, tx, 0, &chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, /*cacheStore*/false));
+    vChecks.back().EnableBatchVerification(&pubkeyCache);
+    std::atomic<bool> fContinue(true);
+    bool fResult = RunCheckBatch(vChecks, fContinue);
+    error = vChecks.back().GetScriptError();
+    return fResult;
+}
+
+TEST(Validation, BatchedScriptCheckOfCheckSigNot) {
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG << OP_NOT;
+    ScriptError error;
+
+    // the deferred signature is assumed valid and fails the script, which passes once it is found invalid
+    CMutableTransaction spend = CreateUnsignedSpend();
+    spend.vin[0].scriptSig = CScript() << SignSpend(otherKey, scriptPubKey, spend);
+    EXPECT_TRUE(RunBatchedScriptCheck(scriptPubKey, spend, error));
+    EXPECT_EQ(error, SCRIPT_ERR_OK);
+
+    spend.vin[0].scriptSig = CScript() << SignSpend(key, scriptPubKey, spend);
+    EXPECT_FALSE(RunBatchedScriptCheck(scriptPubKey, spend, error));
+    EXPECT_EQ(error, SCRIPT_ERR_EVAL_FALSE);
+}
+
+TEST(Validation, BatchedScriptCheckOfMultisigSignedBySecondKey) {
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << OP_1 << ToByteVector(key1.GetPubKey()) << ToByteVector(key2.GetPubKey())
+                                     << OP_2 << OP_CHECKMULTISIG;
+    ScriptError error;
+
+    // the signature is deferred against the first key, and the script runs again when that fails
+    CMutableTransaction spend = CreateUnsignedSpend();
+    spend.vin[0].scriptSig = CScript() << OP_0 << SignSpend(key2, scriptPubKey, spend);
+    EXPECT_TRUE(RunBatchedScriptCheck(scriptPubKey, spend, error));
+    EXPECT_EQ(error, SCRIPT_ERR_OK);
+}
+
+TEST(Validation, BatchedScriptCheckOfBadSignatureReportsTheScriptError) {
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    ScriptError error;
+
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend = CreateUnsignedSpend();
+    spend.vin[0].scriptSig = CScript() << SignSpend(otherKey, scriptPubKey, spend);
+    EXPECT_FALSE(RunBatchedScriptCheck(scriptPubKey, spend, error));
+    EXPECT_EQ(error, SCRIPT_ERR_EVAL_FALSE);
+
+    // the script passed with the signature deferred, the error is the one of the script run again
+    scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIGVERIFY << OP_TRUE;
+    spend.vin[0].scriptSig = CScript() << SignSpend(otherKey, scriptPubKey, spend);
+    EXPECT_FALSE(RunBatchedScriptCheck(scriptPubKey, spend, error));
+    EXPECT_EQ(error, SCRIPT_ERR_CHECKSIGVERIFY);
+}
+
 TEST(Validation, ReceivedBlockTransactions) {
     auto sk = libzcash::SpendingKey::random();
 
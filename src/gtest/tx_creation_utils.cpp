@@ -539,6 +539,21 @@ void BlockchainTestManager::Reset()
  * @return CTxCeasedSidechainWithdrawalInput the CSW input created.
  */
 CTxCeasedSidechainWithdrawalInput BlockchainTestManager::CreateCswInput(uint256 scId, CAmount nValue, ProvingSystem provingSystem) const
+{
+    return CreateCswInput(scId, nValue, CFieldElement{SAMPLE_FIELD}, provingSystem);
+}
+
+/**
+ * @brief Creates a CSW input object with a given nullifier, so that several
+ * CSW inputs for the same sidechain do not conflict with each other.
+ * 
+ * @param scId The ID of the sidechain the CSW refers to
+ * @param nValue The amount of the CSW input
+ * @param nullifier The nullifier of the CSW input
+ * @param provingSystem The proving system for the verification of the CSW input proof
+ * @return CTxCeasedSidechainWithdrawalInput the CSW input created.
+ */
+CTxCeasedSidechainWithdrawalInput BlockchainTestManager::CreateCswInput(uint256 scId, CAmount nValue, const CFieldElement& nullifier, ProvingSystem provingSystem) const
 {
     CTxCeasedSidechainWithdrawalInput input;
 
@@ -546,7 +561,7 @@ CTxCeasedSidechainWithdrawalInput BlockchainTestManager::CreateCswInput(uint256
     input.nValue = nValue;
     input.actCertDataHash = CFieldElement{SAMPLE_FIELD};
     input.ceasingCumScTxCommTree = CFieldElement{SAMPLE_FIELD};
-    input.nullifier = CFieldElement{SAMPLE_FIELD};
+    input.nullifier = nullifier;
     input.pubKeyHash = uint160S("aaaa");
 
     CSidechain sidechain;
@@ -619,9 +634,19 @@ CMutableTransaction BlockchainTestManager::CreateTransaction(const CTransactionC
     tx.vmbtr_out = args.vmbtr_out;
     tx.vsc_ccout = args.vsc_ccout;
 
+    for (const auto& out : args.vout)
+    {
+        tx.addOut(out);
+    }
+
     if (args.fGenerateValidInput)
     {
-        uint32_t totalInputAmount = 0;
+        CAmount totalInputAmount = args.nFee;
+
+        for (const auto& out : args.vout)
+        {
+            totalInputAmount += out.nValue;
+        }
 
         // Count the total amount of coins we need as input
         for (const auto& out : args.vft_ccout)
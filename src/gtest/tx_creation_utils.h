@@ -90,6 +90,8 @@ struct CTransactionCreationArguments
     std::vector<CTxScCreationOut>                  vsc_ccout;     /**< The list of sidechain creation outputs */
     std::vector<CTxForwardTransferOut>             vft_ccout;     /**< The list of sidechain forward transfer outputs */
     std::vector<CBwtRequestOut>                    vmbtr_out;     /**< The list of sidechain backward transfer request outputs */
+    std::vector<CTxOut>                            vout;          /**< The list of transparent outputs */
+    CAmount nFee = 0;                                             /**< The fee left by the generated input on top of the outputs */
 };
 
 class CInMemorySidechainDb final: public CCoinsView {
@@ -178,6 +180,7 @@ public:
 
     // TRANSACTION HELPERS
     CTxCeasedSidechainWithdrawalInput CreateCswInput(uint256 scId, CAmount nValue, ProvingSystem provingSystem) const;
+    CTxCeasedSidechainWithdrawalInput CreateCswInput(uint256 scId, CAmount nValue, const CFieldElement& nullifier, ProvingSystem provingSystem) const;
     CTxScCreationOut CreateScCreationOut(uint8_t sidechainVersion, ProvingSystem provingSystem) const;
     CTxForwardTransferOut CreateForwardTransferOut(uint256 scId) const;
     CBwtRequestOut CreateBackwardTransferRequestOut(uint256 scId) const;
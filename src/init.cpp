@@ -9,6 +9,8 @@
 
 #include "init.h"
 #include "crypto/common.h"
+#include "crypto/equihash.h"
+#include "crypto/sha256.h"
 #include "addrman.h"
 #include "amount.h"
 #ifdef ENABLE_MINING
@@ -25,6 +27,7 @@
 #include "miner.h"
 #include "net.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "txdb.h"
@@ -215,6 +218,9 @@ void Shutdown()
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (fMempoolLoaded && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
+
     if (fFeeEstimatesInitialized)
     {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -239,6 +245,14 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+#ifdef ENABLE_ADDRESS_INDEXING
+        delete paddressindexdb;
+        paddressindexdb = NULL;
+        delete ptimestampindexdb;
+        ptimestampindexdb = NULL;
+        delete pspentindexdb;
+        pspentindexdb = NULL;
+#endif // ENABLE_ADDRESS_INDEXING
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -321,6 +335,7 @@ bool static Bind(const CService &addr, unsigned int flags) {
 void OnRPCStopped()
 {
     cvBlockChange.notify_all();
+    mempool.InterruptWaits();
     LogPrint("rpc", "RPC stopped.\n");
 }
 
@@ -333,6 +348,34 @@ void OnRPCPreCommand(const CRPCCommand& cmd)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 }
 
+#ifdef ENABLE_ADDRESS_INDEXING
+/** Help for the -<name>db* options tuning the LevelDB instance of an explorer index */
+static std::string IndexDBHelpMessage(const std::string& name, int64_t nDefaultCache, int64_t nDefaultWriteBuffer)
+{
+    std::string strUsage;
+    strUsage += HelpMessageOpt(strprintf("-%sdbcache=<n>", name), strprintf(_("Set the %s database cache size in megabytes, on top of -dbcache (default: %d)"), name, nDefaultCache));
+    strUsage += HelpMessageOpt(strprintf("-%sdbwritebuffer=<n>", name), strprintf(_("Set the %s database write buffer size in megabytes (default: %d)"), name, nDefaultWriteBuffer));
+    strUsage += HelpMessageOpt(strprintf("-%sdbbloombits=<n>", name), strprintf(_("Bits per key of the %s database bloom filter, 0 to disable it (default: %d)"), name, DEFAULT_INDEX_DB_BLOOM_BITS));
+    strUsage += HelpMessageOpt(strprintf("-%sdbcompression", name), strprintf(_("Enable compression for the %s database (default: %u)"), name, DEFAULT_DB_COMPRESSION));
+    return strUsage;
+}
+
+static CLevelDBOptions GetIndexDBOptions(const std::string& name, int64_t nDefaultCache, int64_t nDefaultWriteBuffer, int maxOpenFiles)
+{
+    int64_t nCache = GetArg(strprintf("-%sdbcache", name), nDefaultCache);
+    nCache = std::min(std::max(nCache, nMinDbCache), nMaxDbCache);
+    int64_t nWriteBuffer = GetArg(strprintf("-%sdbwritebuffer", name), nDefaultWriteBuffer);
+    nWriteBuffer = std::min(std::max(nWriteBuffer, (int64_t)1), nCache);
+    int nBloomBits = std::max(0, (int)GetArg(strprintf("-%sdbbloombits", name), DEFAULT_INDEX_DB_BLOOM_BITS));
+    bool fCompression = GetBoolArg(strprintf("-%sdbcompression", name), DEFAULT_DB_COMPRESSION);
+
+    LogPrintf("* %s database: %dMiB cache, %dMiB write buffer, %d bloom bits, compression %s\n",
+        name, nCache, nWriteBuffer, nBloomBits, fCompression ? "enabled" : "disabled");
+
+    return CLevelDBOptions(nCache << 20, nWriteBuffer << 20, nBloomBits, fCompression, maxOpenFiles);
+}
+#endif // ENABLE_ADDRESS_INDEXING
+
 std::string HelpMessage(HelpMessageMode mode)
 {
     const bool showDebug = GetBoolArg("-help-debug", false);
@@ -361,9 +404,17 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-mempoolacceptthreads=<n>", strprintf(_("Set the number of threads checking the transactions received from peers before they enter the memory pool (0 to %d, 0 = check them in the message handler, default: %d)"),
+        MAX_MEMPOOL_ACCEPT_THREADS, DEFAULT_MEMPOOL_ACCEPT_THREADS));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parpin", strprintf(_("Pin each script verification thread to its own CPU, so that it keeps its caches and the memory close to it (Linux only, default: %u)"),
+        DEFAULT_PIN_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-sigbatch", strprintf(_("Verify the signatures of the scripts of a block in batches, after the scripts, parsing each public key once (default: %u)"),
+        DEFAULT_SIG_BATCH));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "zend.pid"));
 #endif
@@ -385,6 +436,9 @@ std::string HelpMessage(HelpMessageMode mode)
 
     strUsage += HelpMessageOpt("-blocktreedbmaxopenfiles", strprintf(_("Maximum number of open files for the Block Tree LevelDB (default: %u)"), DEFAULT_DB_MAX_OPEN_FILES));
     strUsage += HelpMessageOpt("-blocktreedbcompression", strprintf(_("Enable compression for the Block Tree LevelDB (default: %u)"), DEFAULT_DB_COMPRESSION));
+    strUsage += IndexDBHelpMessage("addressindex", DEFAULT_ADDRESSINDEX_DB_CACHE, DEFAULT_ADDRESSINDEX_DB_WRITEBUFFER);
+    strUsage += IndexDBHelpMessage("timestampindex", DEFAULT_TIMESTAMPINDEX_DB_CACHE, DEFAULT_TIMESTAMPINDEX_DB_WRITEBUFFER);
+    strUsage += IndexDBHelpMessage("spentindex", DEFAULT_SPENTINDEX_DB_CACHE, DEFAULT_SPENTINDEX_DB_WRITEBUFFER);
 #endif // ENABLE_ADDRESS_INDEXING
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -498,7 +552,8 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachemem=<n>", strprintf("Limit size of signature and script execution caches to <n> MiB, split evenly between the two, 0 disables them (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", "Deprecated, limit the signature cache to <n> entries: converted to -maxsigcachemem unless that is given");
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
         CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -525,6 +580,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blocktxpartitionmaxsize=<n> (regtest only)", strprintf(_("Set maximum partition block size for transcations in bytes (default: %u)"), DEFAULT_BLOCK_TX_PART_MAX_SIZE));
 
     strUsage += HelpMessageOpt("-blockprioritysize=<n>", strprintf(_("Set maximum size of high-priority/low-fee transactions/certificates in bytes (default: %d)"), DEFAULT_BLOCK_PRIORITY_SIZE));
+    strUsage += HelpMessageOpt("-blockancestorscore", strprintf(_("Past the high-priority area, select transactions together with their unconfirmed "
+        "ancestors by the fee rate of the whole package, so that a child can pay for its parents; ignored with -deprecatedgetblocktemplate (default: %u)"),
+        DEFAULT_BLOCK_ANCESTOR_SCORE));
     strUsage += HelpMessageOpt("-blockmaxcomplexity=<n>",
         strprintf(_("Limit transactions to be included into blocks based on block complexity. "
         " Block complexity is the sum of transaction complexity per block. Transaction complexity is the number of inputs of a transaction squared. "
@@ -573,7 +631,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Mining options:"));
     strUsage += HelpMessageOpt("-gen", strprintf(_("Generate coins (default: %u)"), 0));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), 1));
-    strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Specify the Equihash solver to be used if enabled (default: \"default\")"));
+    strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Specify the Equihash solver to be used if enabled: \"default\" or \"tromp\", which only supports the parameters of the main chains (default: \"default\")"));
     strUsage += HelpMessageOpt("-mineraddress=<addr>", _("Send mined coins to a specific single address"));
     strUsage += HelpMessageOpt("-minetolocalwallet", strprintf(
             _("Require that mined blocks use a coinbase address in the local wallet (default: %u)"),
@@ -756,6 +814,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    // The chain is already being activated and blocks are being received meanwhile: the mempool is loaded last, in
+    // the background, against whatever the tip is by then
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        LoadMempool();
+    fMempoolLoaded = !ShutdownRequested();
 }
 
 void ThreadNotifyRecentlyAdded()
@@ -1103,6 +1167,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nMempoolAcceptThreads = GetArg("-mempoolacceptthreads", DEFAULT_MEMPOOL_ACCEPT_THREADS);
+    if (nMempoolAcceptThreads < 0)
+        nMempoolAcceptThreads = 0;
+    else if (nMempoolAcceptThreads > MAX_MEMPOOL_ACCEPT_THREADS)
+        nMempoolAcceptThreads = MAX_MEMPOOL_ACCEPT_THREADS;
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MB) to allot for block & undo files
@@ -1204,8 +1274,33 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 mapArgs["-mineraddress"]));
         }
     }
+    if (!CEquihashSolver::IsKnown(GetArg("-equihashsolver", "default")))
+        return InitError(strprintf(_("Unknown Equihash solver -equihashsolver=%s"), GetArg("-equihashsolver", "default")));
 #endif
 
+    // mempool limits: the pool must be able to hold at least a couple of full blocks
+    int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    int64_t nMempoolSizeMin = 2 * MAX_BLOCK_SIZE;
+    if (nMempoolSizeMax < 0 || nMempoolSizeMax < nMempoolSizeMin)
+        return InitError(strprintf(_("-maxmempool must be at least %d MB"), (nMempoolSizeMin + 999999) / 1000000));
+
+    // -maxsigcachesize is a number of signature cache entries: give the signature cache, which gets half
+    // of -maxsigcachemem, the memory for as many entries
+    if (mapArgs.count("-maxsigcachesize")) {
+        int64_t nEntries = std::max<int64_t>(0, GetArg("-maxsigcachesize", 0));
+        int64_t nSigCacheMiB = (2 * nEntries * CSignatureCache::BytesPerEntry() + (1 << 20) - 1) >> 20;
+        nSigCacheMiB = std::min<int64_t>(nSigCacheMiB, MAX_MAX_SIG_CACHE_SIZE);
+        if (SoftSetArg("-maxsigcachemem", strprintf("%d", nSigCacheMiB)))
+            InitWarning(strprintf(_("Warning: -maxsigcachesize is deprecated, %d entries converted to -maxsigcachemem=%d."), nEntries, nSigCacheMiB));
+        else
+            InitWarning(_("Warning: Deprecated argument -maxsigcachesize ignored, -maxsigcachemem is given."));
+    }
+    int64_t nSigCacheSize = GetArg("-maxsigcachemem", DEFAULT_MAX_SIG_CACHE_SIZE);
+    if (nSigCacheSize < 0 || nSigCacheSize > MAX_MAX_SIG_CACHE_SIZE)
+        return InitError(strprintf(_("-maxsigcachemem must be between 0 and %u MiB"), MAX_MAX_SIG_CACHE_SIZE));
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
     // Default value of 0 for mempooltxinputlimit means no limit is applied
     if (mapArgs.count("-mempooltxinputlimit")) {
         int64_t limit = GetArg("-mempooltxinputlimit", 0);
@@ -1223,6 +1318,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    // Select the fastest SHA-256 and Equihash verifier implementations, before any other thread hashes
+    std::string sha256_algo = SHA256AutoDetect();
+    std::string equihash_algo = EhAutoDetect();
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1272,6 +1371,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         OpenDebugLog();
 
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    LogPrintf("Using the '%s' Equihash<200,9> verifier implementation\n", equihash_algo);
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
 #endif
@@ -1286,10 +1387,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     std::ostringstream strErrors;
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
-    if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
-            threadGroup.create_thread(&ThreadScriptCheck);
-    }
+    if (nScriptCheckThreads)
+        StartValidationThreads(threadGroup, nScriptCheckThreads, GetBoolArg("-parpin", DEFAULT_PIN_SCRIPTCHECK_THREADS));
+
+    LogPrintf("Using %u threads for memory pool acceptance\n", nMempoolAcceptThreads);
+    for (int i = 0; i < nMempoolAcceptThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "mempoolacc", &ThreadMempoolAccept));
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1547,20 +1650,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-
-#ifdef ENABLE_ADDRESS_INDEXING
-    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
-        nBlockTreeDBCache = nTotalCache * 3 / 4;
-    } else {
-#endif // ENABLE_ADDRESS_INDEXING
-        if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
-            nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
-        }
-
-#ifdef ENABLE_ADDRESS_INDEXING
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
+        nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     }
-#endif // ENABLE_ADDRESS_INDEXING
 
     nTotalCache -= nBlockTreeDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
@@ -1572,6 +1664,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
+#ifdef ENABLE_ADDRESS_INDEXING
+    // the explorer indexes live in their own databases, with caches sized independently of -dbcache
+    CLevelDBOptions addressIndexDBOptions = GetIndexDBOptions("addressindex", DEFAULT_ADDRESSINDEX_DB_CACHE, DEFAULT_ADDRESSINDEX_DB_WRITEBUFFER, dbMaxOpenFiles);
+    CLevelDBOptions timestampIndexDBOptions = GetIndexDBOptions("timestampindex", DEFAULT_TIMESTAMPINDEX_DB_CACHE, DEFAULT_TIMESTAMPINDEX_DB_WRITEBUFFER, dbMaxOpenFiles);
+    CLevelDBOptions spentIndexDBOptions = GetIndexDBOptions("spentindex", DEFAULT_SPENTINDEX_DB_CACHE, DEFAULT_SPENTINDEX_DB_WRITEBUFFER, dbMaxOpenFiles);
+#endif // ENABLE_ADDRESS_INDEXING
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex || fReindexFast;
@@ -1587,8 +1686,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+#ifdef ENABLE_ADDRESS_INDEXING
+                delete paddressindexdb;
+                paddressindexdb = NULL;
+                delete ptimestampindexdb;
+                ptimestampindexdb = NULL;
+                delete pspentindexdb;
+                pspentindexdb = NULL;
+#endif // ENABLE_ADDRESS_INDEXING
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex || fReindexFast, dbCompression, dbMaxOpenFiles);
+#ifdef ENABLE_ADDRESS_INDEXING
+                if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+                    paddressindexdb = new CAddressIndexDB(addressIndexDBOptions, false, fReindex || fReindexFast);
+                if (GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))
+                    ptimestampindexdb = new CTimestampIndexDB(timestampIndexDBOptions, false, fReindex || fReindexFast);
+                if (GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+                    pspentindexdb = new CSpentIndexDB(spentIndexDBOptions, false, fReindex || fReindexFast);
+#endif // ENABLE_ADDRESS_INDEXING
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexFast);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
@@ -1650,8 +1765,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                if (fAddressIndex && indexVersionStr == DEFAULT_INDEX_VERSION_STR) {
-                    strLoadError = _("You need to reindex in order to use -addressindex");
+                // Check for changed -timestampindex and -spentindex state, their databases are only opened when requested
+                if (fTimestampIndex != GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -timestampindex");
+                    break;
+                }
+
+                if (fSpentIndex != GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
+                // Explorer indexes written before version 2.0 are stored in the block index database
+                if ((fAddressIndex || fTimestampIndex || fSpentIndex) && indexVersionStr != CURRENT_INDEX_VERSION_STR) {
+                    strLoadError = _("You need to reindex in order to use -addressindex, -timestampindex or -spentindex");
                     break;
                 }
 #endif // ENABLE_ADDRESS_INDEXING
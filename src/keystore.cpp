@@ -80,8 +80,8 @@ bool CBasicKeyStore::HaveWatchOnly(const CScript &dest) const
      * for full match with watchonly scripts, cause OP_CHECKBLOCKATHEIGHT arguments are different all the time.
      * So, instead, check that dest starts with some of the scripts from setWatchOnly */
     auto predicate = [&dest](const CScript& script) {
-        auto res = search(begin(dest), end(dest), begin(script), end(script));
-        return res == begin(dest);
+        auto res = std::search(dest.begin(), dest.end(), script.begin(), script.end());
+        return res == dest.begin();
     };
 
     return std::find_if(setWatchOnly.begin(), setWatchOnly.end(), predicate) != setWatchOnly.end();
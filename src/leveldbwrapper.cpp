@@ -13,6 +13,9 @@
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
 
+#include <mutex>
+#include <set>
+
 void HandleError(const leveldb::Status& status)
 {
     if (status.ok())
@@ -27,14 +30,130 @@ void HandleError(const leveldb::Status& status)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles)
+CLevelDBLatencyHistogram::CLevelDBLatencyHistogram() : nCount(0), nTotalMicros(0)
+{
+    for (int i = 0; i < NUM_BUCKETS; ++i)
+        buckets[i] = 0;
+}
+
+void CLevelDBLatencyHistogram::Add(int64_t nMicros)
+{
+    if (nMicros < 0)
+        nMicros = 0;
+    int nBucket = 0;
+    while (nBucket < NUM_BUCKETS - 1 && (int64_t(1) << nBucket) <= nMicros)
+        ++nBucket;
+    buckets[nBucket].fetch_add(1, std::memory_order_relaxed);
+    nCount.fetch_add(1, std::memory_order_relaxed);
+    nTotalMicros.fetch_add(nMicros, std::memory_order_relaxed);
+}
+
+int64_t CLevelDBLatencyHistogram::GetPercentile(double fraction) const
+{
+    uint64_t nTotal = 0;
+    uint64_t vBuckets[NUM_BUCKETS];
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        vBuckets[i] = buckets[i];
+        nTotal += vBuckets[i];
+    }
+    if (nTotal == 0)
+        return 0;
+
+    uint64_t nSeen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        nSeen += vBuckets[i];
+        if (nSeen >= fraction * nTotal)
+            return int64_t(1) << i;
+    }
+    return int64_t(1) << (NUM_BUCKETS - 1);
+}
+
+CLevelDBCounters::CLevelDBCounters() :
+    nReads(0), nReadsNotFound(0), nExists(0), nBatchWrites(0), nBytesWritten(0), nIterators(0),
+    nBlockCacheHits(0), nBlockCacheMisses(0), nTableFileOpens(0)
+{
+}
+
+namespace {
+
+/** LRU block cache counting its hits and misses */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* pcache;
+    CLevelDBCounters& counters;
+
+public:
+    CCountingCache(leveldb::Cache* pcacheIn, CLevelDBCounters& countersIn) : pcache(pcacheIn), counters(countersIn) {}
+    ~CCountingCache() { delete pcache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge,
+                   void (*deleter)(const leveldb::Slice& key, void* value)) override
+    {
+        return pcache->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key) override
+    {
+        Handle* handle = pcache->Lookup(key);
+        if (handle != NULL)
+            counters.nBlockCacheHits.fetch_add(1, std::memory_order_relaxed);
+        else
+            counters.nBlockCacheMisses.fetch_add(1, std::memory_order_relaxed);
+        return handle;
+    }
+
+    void Release(Handle* handle) override { pcache->Release(handle); }
+    void* Value(Handle* handle) override { return pcache->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { pcache->Erase(key); }
+    uint64_t NewId() override { return pcache->NewId(); }
+};
+
+/** Environment counting the table files LevelDB opens for reading */
+class CCountingEnv : public leveldb::EnvWrapper
+{
+private:
+    CLevelDBCounters& counters;
+
+public:
+    CCountingEnv(leveldb::Env* penv, CLevelDBCounters& countersIn) : leveldb::EnvWrapper(penv), counters(countersIn) {}
+
+    leveldb::Status NewRandomAccessFile(const std::string& fname, leveldb::RandomAccessFile** result) override
+    {
+        counters.nTableFileOpens.fetch_add(1, std::memory_order_relaxed);
+        return leveldb::EnvWrapper::NewRandomAccessFile(fname, result);
+    }
+};
+
+std::mutex& LevelDBRegistryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::set<const CLevelDBWrapper*>& LevelDBRegistry()
+{
+    static std::set<const CLevelDBWrapper*> registry;
+    return registry;
+}
+
+} // namespace
+
+void ForEachLevelDB(const std::function<void(const CLevelDBWrapper&)>& fn)
+{
+    std::lock_guard<std::mutex> lock(LevelDBRegistryMutex());
+    for (const CLevelDBWrapper* pdbw : LevelDBRegistry())
+        fn(*pdbw);
+}
+
+static leveldb::Options GetOptions(const CLevelDBOptions& dbOptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
-    options.max_open_files = maxOpenFiles;
+    options.block_cache = leveldb::NewLRUCache(dbOptions.nCacheSize / 2);
+    options.write_buffer_size = dbOptions.nWriteBufferSize > 0 ? dbOptions.nWriteBufferSize : dbOptions.nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = dbOptions.nBloomFilterBits > 0 ? leveldb::NewBloomFilterPolicy(dbOptions.nBloomFilterBits) : NULL;
+    options.compression = dbOptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbOptions.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -44,17 +163,23 @@ static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxO
 }
 
 CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles)
+    : CLevelDBWrapper(path, CLevelDBOptions(nCacheSize, 0, 10, compression, maxOpenFiles), fMemory, fWipe)
+{
+}
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, const CLevelDBOptions& dbOptions, bool fMemory, bool fWipe)
 {
     penv = NULL;
+    pstatsenv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, compression, maxOpenFiles);
+    options = GetOptions(dbOptions);
     options.create_if_missing = true;
+    options.block_cache = new CCountingCache(options.block_cache, counters);
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
-        options.env = penv;
     } else {
         if (fWipe) {
             LogPrintf("Wiping LevelDB in %s\n", path.string());
@@ -64,26 +189,63 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
     }
+    pstatsenv = new CCountingEnv(penv ? penv : leveldb::Env::Default(), counters);
+    options.env = pstatsenv;
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+
+    strName = path.string();
+    if (!fMemory) {
+        const std::string strDataDir = GetDataDir().string();
+        if (strName.compare(0, strDataDir.size(), strDataDir) == 0 && strName.size() > strDataDir.size())
+            strName = strName.substr(strDataDir.size() + 1);
+    }
+
+    std::lock_guard<std::mutex> lock(LevelDBRegistryMutex());
+    // in-memory and unnamed databases may share their path with others, number them to keep names unique
+    if (fMemory || strName.empty()) {
+        static unsigned int nUnnamed = 0;
+        strName = strprintf("%s%smemory-%u", strName, strName.empty() ? "" : ":", ++nUnnamed);
+    }
+    LevelDBRegistry().insert(this);
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    {
+        std::lock_guard<std::mutex> lock(LevelDBRegistryMutex());
+        LevelDBRegistry().erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
     options.filter_policy = NULL;
     delete options.block_cache;
     options.block_cache = NULL;
+    delete pstatsenv;
+    pstatsenv = NULL;
     delete penv;
     options.env = NULL;
 }
 
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
 {
+    int64_t nTimeStart = GetTimeMicros();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    counters.writeLatency.Add(GetTimeMicros() - nTimeStart);
+    counters.nBatchWrites++;
+    counters.nBytesWritten += batch.SizeEstimate();
     HandleError(status);
     return true;
 }
+
+uint64_t CLevelDBWrapper::GetApproximateSize() const
+{
+    // the whole key space: every key sorts before a run of 0xff bytes longer than any key we store
+    std::string strEnd(128, '\xff');
+    leveldb::Range range("", strEnd);
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
@@ -11,6 +11,9 @@
 #include "util.h"
 #include "version.h"
 
+#include <atomic>
+#include <functional>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -24,6 +27,70 @@ public:
 
 void HandleError(const leveldb::Status& status);
 
+/** Tuning of a single LevelDB instance */
+struct CLevelDBOptions
+{
+    //! memory budget of the instance; half of it is used as block cache
+    size_t nCacheSize;
+    //! size of the memtable, 0 means a quarter of nCacheSize (up to two of them may be held in memory simultaneously)
+    size_t nWriteBufferSize;
+    //! bits per key of the bloom filter policy, 0 disables the filter
+    int nBloomFilterBits;
+    bool fCompression;
+    int nMaxOpenFiles;
+
+    CLevelDBOptions(size_t nCacheSizeIn = 0, size_t nWriteBufferSizeIn = 0, int nBloomFilterBitsIn = 10,
+                    bool fCompressionIn = false, int nMaxOpenFilesIn = 64):
+        nCacheSize(nCacheSizeIn), nWriteBufferSize(nWriteBufferSizeIn), nBloomFilterBits(nBloomFilterBitsIn),
+        fCompression(fCompressionIn), nMaxOpenFiles(nMaxOpenFilesIn) {}
+};
+
+/** Latency histogram of LevelDB operations, with power-of-two microsecond buckets */
+class CLevelDBLatencyHistogram
+{
+public:
+    //! bucket i counts operations that took less than 2^i us (and at least 2^(i-1) us), the last one everything slower
+    static const int NUM_BUCKETS = 24;
+
+    CLevelDBLatencyHistogram();
+
+    void Add(int64_t nMicros);
+
+    uint64_t GetCount() const { return nCount; }
+    uint64_t GetTotalMicros() const { return nTotalMicros; }
+    uint64_t GetBucket(int i) const { return buckets[i]; }
+    //! upper bound in us of the bucket reached by the given fraction of all operations
+    int64_t GetPercentile(double fraction) const;
+
+private:
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nTotalMicros;
+};
+
+/** Usage counters of a CLevelDBWrapper, updated without locking by concurrent readers and writers */
+struct CLevelDBCounters
+{
+    std::atomic<uint64_t> nReads;
+    std::atomic<uint64_t> nReadsNotFound;
+    std::atomic<uint64_t> nExists;
+    std::atomic<uint64_t> nBatchWrites;
+    std::atomic<uint64_t> nBytesWritten;
+    std::atomic<uint64_t> nIterators;
+    //! lookups in the LevelDB block cache, counted by the cache itself
+    std::atomic<uint64_t> nBlockCacheHits;
+    std::atomic<uint64_t> nBlockCacheMisses;
+    //! table files opened by LevelDB, i.e. table cache misses bounded by max_open_files
+    std::atomic<uint64_t> nTableFileOpens;
+
+    //! Read and Exists
+    CLevelDBLatencyHistogram readLatency;
+    //! WriteBatch, including the time spent stalled by compactions
+    CLevelDBLatencyHistogram writeLatency;
+
+    CLevelDBCounters();
+};
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -31,8 +98,11 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    size_t nBytes;
 
 public:
+    CLevelDBBatch() : nBytes(0) {}
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +117,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nBytes += slKey.size() + slValue.size();
     }
 
     template <typename K>
@@ -58,7 +129,11 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nBytes += slKey.size();
     }
+
+    //! payload bytes (keys and values) queued so far
+    size_t SizeEstimate() const { return nBytes; }
 };
 
 class CLevelDBWrapper
@@ -82,26 +157,44 @@ private:
     //! options used when sync writing to the database
     leveldb::WriteOptions syncoptions;
 
+    //! environment counting file opens, wrapping penv or the default environment
+    leveldb::Env* pstatsenv;
+
     //! the database itself
     leveldb::DB* pdb;
 
+    //! name reported in statistics: the path relative to the data directory, numbered for in-memory databases
+    std::string strName;
+
+    mutable CLevelDBCounters counters;
+
 public:
     CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = false, int maxOpenFiles = 64);
+    CLevelDBWrapper(const boost::filesystem::path& path, const CLevelDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
+    //! snapshot, if given, must have been obtained with GetSnapshot()
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot = NULL) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
+
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        int64_t nTimeStart = GetTimeMicros();
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
+        counters.readLatency.Add(GetTimeMicros() - nTimeStart);
+        counters.nReads++;
         if (!status.ok()) {
-            if (status.IsNotFound())
+            if (status.IsNotFound()) {
+                counters.nReadsNotFound++;
                 return false;
+            }
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             HandleError(status);
         }
@@ -131,7 +224,10 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
+        int64_t nTimeStart = GetTimeMicros();
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        counters.readLatency.Add(GetTimeMicros() - nTimeStart);
+        counters.nExists++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -166,8 +262,51 @@ public:
     // not exactly clean encapsulation, but it's easiest for now
     leveldb::Iterator* NewIterator()
     {
+        counters.nIterators++;
         return pdb->NewIterator(iteroptions);
     }
+
+    //! iterator reading from a consistent point-in-time view obtained with GetSnapshot()
+    leveldb::Iterator* NewIterator(const leveldb::Snapshot* snapshot)
+    {
+        leveldb::ReadOptions snapoptions = iteroptions;
+        snapoptions.snapshot = snapshot;
+        counters.nIterators++;
+        return pdb->NewIterator(snapoptions);
+    }
+
+    //! the returned snapshot must be handed back with ReleaseSnapshot()
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot)
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
+    //! read one of the LevelDB internal properties (e.g. "leveldb.stats"), false if it is not supported
+    bool GetProperty(const std::string& name, std::string& value) const
+    {
+        return pdb->GetProperty(name, &value);
+    }
+
+    //! approximate on-disk size of the whole key range
+    uint64_t GetApproximateSize() const;
+
+    const std::string& GetName() const
+    {
+        return strName;
+    }
+
+    const CLevelDBCounters& GetCounters() const
+    {
+        return counters;
+    }
 };
 
+/** Calls fn on every open CLevelDBWrapper; none of them can be closed while this runs */
+void ForEachLevelDB(const std::function<void(const CLevelDBWrapper&)>& fn);
+
 #endif // BITCOIN_LEVELDBWRAPPER_H
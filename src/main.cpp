@@ -12,6 +12,7 @@
 #include "arith_uint256.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "crypto/common.h"
 #include "consensus/validation.h"
 #include "deprecation.h"
 #include "init.h"
@@ -72,10 +73,12 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nMempoolAcceptThreads = 0;
 bool fExperimentalMode = false;
 bool fImporting = false;
 bool fReindex = false;
 bool fReindexFast = false;
+std::atomic<bool> fMempoolLoaded(false);
 bool fTxIndex = false;
 bool fMaturityHeightIndex = false;
 
@@ -110,6 +113,54 @@ void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 static void CheckBlockIndex();
 
+namespace {
+
+/**
+ * Transactions and certificates whose inputs all passed the script checks, keyed by hash and script verification
+ * flags, so that connecting a block does not run again the scripts of the ones accepted to the mempool.
+ * Scripts may check the hash of a block at a given height (OP_CHECKBLOCKATHEIGHT), which only changes when blocks
+ * are disconnected: the entries are also keyed by the number of blocks disconnected so far, and the ones checked
+ * against a chain reorganized since then are never found again. Only valid for chainActive, under cs_main.
+ */
+CSignatureCache scriptExecutionCache;
+CSHA256 scriptExecutionCacheHasher;
+uint64_t nDisconnectedTips = 0;
+
+uint256 ScriptExecutionCacheEntry(const uint256& hash, unsigned int flags)
+{
+    unsigned char buf[12];
+    WriteLE32(buf, flags);
+    WriteLE64(buf + 4, nDisconnectedTips);
+
+    uint256 entry;
+    CSHA256 hasher = scriptExecutionCacheHasher;
+    hasher.Write(hash.begin(), 32).Write(buf, sizeof(buf)).Finalize(entry.begin());
+    return entry;
+}
+
+}
+
+void InitScriptExecutionCache()
+{
+    // the nonce fills a whole SHA256 block, as the one of the signature cache
+    unsigned char nonce[64] = {};
+    GetRandBytes(nonce, 32);
+    scriptExecutionCacheHasher.Reset().Write(nonce, sizeof(nonce));
+
+    // the other half of -maxsigcachemem goes to the signature cache
+    int64_t nMaxCacheSize = GetArg("-maxsigcachemem", DEFAULT_MAX_SIG_CACHE_SIZE);
+    nMaxCacheSize = std::max<int64_t>(0, std::min<int64_t>(nMaxCacheSize, MAX_MAX_SIG_CACHE_SIZE));
+    scriptExecutionCache.Resize((size_t)nMaxCacheSize << 19);
+
+    CSignatureCacheStats stats = scriptExecutionCache.GetStats();
+    LogPrintf("Using %u MiB for script execution cache, able to store %u elements\n", stats.nBytes >> 20, stats.nCapacity);
+}
+
+CSignatureCacheStats GetScriptExecutionCacheStats()
+{
+    return scriptExecutionCache.GetStats();
+}
+
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
 
@@ -598,14 +649,20 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+#ifdef ENABLE_ADDRESS_INDEXING
+CAddressIndexDB *paddressindexdb = NULL;
+CTimestampIndexDB *ptimestampindexdb = NULL;
+CSpentIndexDB *pspentindexdb = NULL;
+#endif // ENABLE_ADDRESS_INDEXING
 
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransactionBase& txObj, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const std::shared_ptr<const CTransactionBase>& pTxObj, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    const CTransactionBase& txObj = *pTxObj;
     uint256 hash = txObj.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -624,7 +681,7 @@ bool AddOrphanTx(const CTransactionBase& txObj, NodeId peer) EXCLUSIVE_LOCKS_REQ
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = txObj.MakeShared();
+    mapOrphanTransactions[hash].tx = pTxObj;
     mapOrphanTransactions[hash].fromPeer = peer;
     BOOST_FOREACH(const CTxIn& txin, txObj.GetVin())
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
@@ -634,6 +691,11 @@ bool AddOrphanTx(const CTransactionBase& txObj, NodeId peer) EXCLUSIVE_LOCKS_REQ
     return true;
 }
 
+bool AddOrphanTx(const CTransactionBase& txObj, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return AddOrphanTx(txObj.MakeShared(), peer);
+}
+
 void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
@@ -1160,6 +1222,14 @@ CAmount GetMinRelayFee(const CTransactionBase& tx, unsigned int nBytes, bool fAl
 
 void RejectMemoryPoolTxBase(const CValidationState& state, const CTransactionBase& txBase, CNode* pfrom)
 {
+    if (pfrom == nullptr)
+    {
+        // submitted locally, e.g. reloaded from mempool.dat: there is nobody to notify
+        LogPrint("mempool", "%s was not accepted into the memory pool: %s\n", txBase.GetHash().ToString(),
+                 state.GetRejectReason());
+        return;
+    }
+
     LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", txBase.GetHash().ToString(),
              pfrom->id, pfrom->cleanSubVer,
              state.GetRejectReason());
@@ -1170,171 +1240,341 @@ void RejectMemoryPoolTxBase(const CValidationState& state, const CTransactionBas
         Misbehaving(pfrom->GetId(), state.GetDoS());
 }
 
-MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom)
+void LimitMempoolSize(CTxMemPool& pool, size_t limit)
 {
-    AssertLockHeld(cs_main);
-
-    //we retrieve the current height from the pcoinsTip and not from chainActive because on DisconnectTip the Accept*ToMemoryPool
-    // is called after having reverted the txs from the pcoinsTip view but before having updated the chainActive
-    int nextBlockHeight = pcoinsTip->GetHeight() + 1;
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    pool.TrimToSize(limit, removedTxs, removedCerts);
 
-    if (!cert.CheckInputsLimit())
-    {
-        LogPrintf("%s(): CheckInputsLimit failed\n", __func__);
-        return MempoolReturnValue::INVALID;
+    for(const CTransaction& tx: removedTxs) {
+        LogPrint("mempool", "%s():%d - syncing evicted tx %s\n", __func__, __LINE__, tx.GetHash().ToString());
+        SyncWithWallets(tx, nullptr);
     }
-
-    if(!CheckCertificate(cert, state))
-    {
-        error("%s(): CheckCertificate failed", __func__);
-        return MempoolReturnValue::INVALID;
+    for(const CScCertificate& cert: removedCerts) {
+        LogPrint("mempool", "%s():%d - syncing evicted cert %s\n", __func__, __LINE__, cert.GetHash().ToString());
+        SyncWithWallets(cert, nullptr);
     }
+}
 
-    static const int DOS_LEVEL = 10;
-    if(!cert.ContextualCheck(state, nextBlockHeight, DOS_LEVEL))
+/**
+ * The cheap checks of a transaction or certificate against the policy, the mempool and its inputs, run before its
+ * scripts and proofs by Accept*ToMemoryPool() and by PreCheckTxBaseForMemoryPool(). The view must be backed by the
+ * mempool; on success it holds the inputs and nFees is set. The rate limiter of the free entries is left to the
+ * caller, since its state changes with every entry accepted.
+ */
+static MempoolReturnValue CheckTxBaseMempoolPolicy(CTxMemPool& pool, CValidationState& state, const CTransactionBase& txBase,
+                                                   CCoinsViewCache& view, int nextBlockHeight, LimitFreeFlag fLimitFree,
+                                                   OverrideMempoolLimitFlag fOverrideMempoolLimit, CAmount& nFees)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+
+    const uint256 hash = txBase.GetHash();
+    const bool fCertificate = txBase.IsCertificate();
+
+    if (!fCertificate)
     {
-        LogPrintf("%s(): ContextualCheck failed\n", __func__);
-        return MempoolReturnValue::INVALID;
+        // Silently drop pre-chainsplit transactions
+        if (!ForkManager::getInstance().isAfterChainsplit(nextBlockHeight))
+        {
+            LogPrint("mempool", "%s():%d - Dropping txid[%s]: chain height[%d] is before chain split\n",
+                __func__, __LINE__, hash.ToString(), nextBlockHeight);
+            return MempoolReturnValue::INVALID;
+        }
+
+        // Coinbase is only valid in a block, not as a loose transaction
+        if (txBase.IsCoinBase())
+        {
+            state.DoS(100, error("%s(): coinbase as individual tx", __func__),
+                      CValidationState::Code::INVALID, "coinbase");
+            return MempoolReturnValue::INVALID;
+        }
     }
 
     // Rather not work on nonstandard transactions (unless -testnet/-regtest)
     string reason;
-    if (getRequireStandard() &&  !IsStandardTx(cert, reason, nextBlockHeight))
+    if (getRequireStandard() && !IsStandardTx(txBase, reason, nextBlockHeight))
     {
-        LogPrintf("%s():%d - Dropping nonstandard certid %s\n", __func__, __LINE__, cert.GetHash().ToString());
-        state.DoS(0, error("%s(): nonstandard certificate: %s", __func__, reason),
-                            CValidationState::Code::NONSTANDARD, reason);
+        if (fCertificate)
+            LogPrintf("%s():%d - Dropping nonstandard certid %s\n", __func__, __LINE__, hash.ToString());
+        state.DoS(0, error("%s(): nonstandard %s: %s", __func__, fCertificate ? "certificate" : "transaction", reason),
+                  CValidationState::Code::NONSTANDARD, reason);
         return MempoolReturnValue::INVALID;
     }
 
-    if (!pool.checkIncomingCertConflicts(cert))
+    if (fCertificate)
     {
-        LogPrintf("%s(): certificate has conflicts in mempool\n", __func__);
-        return MempoolReturnValue::INVALID;
+        if (!pool.checkIncomingCertConflicts(dynamic_cast<const CScCertificate&>(txBase)))
+        {
+            LogPrintf("%s(): certificate has conflicts in mempool\n", __func__);
+            return MempoolReturnValue::INVALID;
+        }
     }
-
-    // Check if cert is already in mempool or if there are conflicts with in-memory certs
-    std::pair<uint256, CAmount> conflictingCertData = pool.FindCertWithQuality(cert.GetScId(), cert.quality);
-
+    else
     {
-        uint256 certHash = cert.GetHash();
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+        const CTransaction& tx = dynamic_cast<const CTransaction&>(txBase);
 
-        CAmount nFees = 0;
+        // Only accept nLockTime-using transactions that can be mined in the next
+        // block; we don't want our mempool filled up with transactions that can't
+        // be mined yet.
+        if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
         {
-            LOCK(pool.cs);
-            CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
-            view.SetBackend(viewMemPool);
+            state.DoS(0, false, CValidationState::Code::NONSTANDARD, "non-final");
+            return MempoolReturnValue::INVALID;
+        }
 
-            // do we already have it?
-            if (view.HaveCoins(certHash))
-            {
-                LogPrint("mempool", "%s():%d Dropping cert %s : view already has coins\n",
-                    __func__, __LINE__, certHash.ToString());
-                return MempoolReturnValue::INVALID;
-            }
+        if (!pool.checkCswInputsPerScLimit(tx))
+        {
+            state.Invalid(error("%s():%d: tx[%s] would exceed limit of csw inputs for sc in mempool\n",
+                __func__, __LINE__, hash.ToString()),
+                CValidationState::Code::TOO_MANY_CSW_INPUTS_FOR_SC, "bad-txns-too-many-csw-inputs-for-sc");
+            return MempoolReturnValue::INVALID;
+        }
 
-            bool banSenderNode = false;
-            int nDoS = 0;
+        if (!pool.checkIncomingTxConflicts(tx))
+        {
+            LogPrintf("%s():%d: tx[%s] has conflicts in mempool\n", __func__, __LINE__, hash.ToString());
+            return MempoolReturnValue::INVALID;
+        }
+    }
 
-            CValidationState::Code ret_code = view.IsCertApplicableToState(cert, &banSenderNode);
-            if (ret_code != CValidationState::Code::OK)
-            {
-                if (banSenderNode)
-                    nDoS = 100;
+    // do we already have it?
+    if (view.HaveCoins(hash))
+    {
+        LogPrint("mempool", "%s():%d Dropping %s %s : view already has coins\n",
+            __func__, __LINE__, fCertificate ? "cert" : "tx", hash.ToString());
+        return MempoolReturnValue::INVALID;
+    }
 
-                state.DoS(nDoS, error("%s():%d - certificate not applicable: ret_code[0x%x]",
-                    __func__, __LINE__, CValidationState::CodeToChar(ret_code)),
-                    ret_code, "bad-sc-cert-not-applicable");
-                return MempoolReturnValue::INVALID;
-            }
-            
-            // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // and only helps with filling in pfMissingInputs (to determine missing vs spent).
-            for(const CTxIn txin: cert.GetVin())
-            {
-                if (!view.HaveCoins(txin.prevout.hash))
-                {
-                    LogPrint("mempool", "%s(): Dropping cert %s : no coins for vin (tx=%s)\n",
-                        __func__, certHash.ToString(), txin.prevout.hash.ToString());
-                    return MempoolReturnValue::MISSING_INPUT;
-                }
-            }
+    bool banSenderNode = false;
+    if (fCertificate)
+    {
+        CValidationState::Code ret_code =
+            view.IsCertApplicableToState(dynamic_cast<const CScCertificate&>(txBase), &banSenderNode);
+        if (ret_code != CValidationState::Code::OK)
+        {
+            state.DoS(banSenderNode ? 100 : 0, error("%s():%d - certificate not applicable: ret_code[0x%x]",
+                __func__, __LINE__, CValidationState::CodeToChar(ret_code)),
+                ret_code, "bad-sc-cert-not-applicable");
+            return MempoolReturnValue::INVALID;
+        }
+    }
 
-            // are the actual inputs available?
-            if (!view.HaveInputs(cert))
-            {
-                state.Invalid(
-                    error("%s():%d - ERROR: cert[%s] inputs already spent\n", __func__, __LINE__, certHash.ToString()),
-                    CValidationState::Code::DUPLICATED, "bad-sc-cert-inputs-spent");
-                return MempoolReturnValue::INVALID;
-            }
+    // do all inputs exist?
+    // Note that this does not check for the presence of actual outputs (see the next check for that),
+    // and only helps with filling in pfMissingInputs (to determine missing vs spent).
+    for(const CTxIn& txin: txBase.GetVin())
+    {
+        if (!view.HaveCoins(txin.prevout.hash))
+        {
+            LogPrint("mempool", "%s():%d - Dropping %s %s : no coins for vin (tx=%s)\n",
+                __func__, __LINE__, fCertificate ? "cert" : "tx", hash.ToString(), txin.prevout.hash.ToString());
+            return MempoolReturnValue::MISSING_INPUT;
+        }
+    }
 
-            // Bring the best block into scope: it's gonna be needed for CheckInputsTx hereinafter
-            view.GetBestBlock();
-            nFees = cert.GetFeeAmount(view.GetValueIn(cert));
+    // are the actual inputs available?
+    if (!view.HaveInputs(txBase))
+    {
+        if (fCertificate)
+        {
+            state.Invalid(
+                error("%s():%d - ERROR: cert[%s] inputs already spent\n", __func__, __LINE__, hash.ToString()),
+                CValidationState::Code::DUPLICATED, "bad-sc-cert-inputs-spent");
+        }
+        else
+        {
+            LogPrintf("%s():%d - ERROR: tx[%s]\n", __func__, __LINE__, hash.ToString());
+            state.Invalid(error("%s(): inputs already spent", __func__),
+                                 CValidationState::Code::DUPLICATED, "bad-txns-inputs-spent");
+        }
+        return MempoolReturnValue::INVALID;
+    }
 
-            if (!conflictingCertData.first.IsNull() && conflictingCertData.second >= nFees)
-            {
-                state.Invalid(
-                    error("%s():%d - Dropping cert %s : low fee and same quality as other cert in mempool\n",
-                        __func__, __LINE__, certHash.ToString()),
-                    CValidationState::Code::INVALID, "bad-sc-cert-quality");
-                return MempoolReturnValue::INVALID;
-            }
+    if (!fCertificate)
+    {
+        const CTransaction& tx = dynamic_cast<const CTransaction&>(txBase);
 
-            // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-            view.SetBackend(dummy);
+        CValidationState::Code ret_code = view.IsScTxApplicableToState(tx, Sidechain::ScFeeCheckFlag::LATEST_VALUE, &banSenderNode);
+        if (ret_code != CValidationState::Code::OK)
+        {
+            state.DoS(banSenderNode ? 100 : 0,
+                error("%s():%d - ERROR: sc-related tx [%s] is not applicable: ret_code[0x%x]\n",
+                    __func__, __LINE__, hash.ToString(), CValidationState::CodeToChar(ret_code)),
+                ret_code, "bad-sc-tx-not-applicable");
+            return MempoolReturnValue::INVALID;
         }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (getRequireStandard() && !AreInputsStandard(cert, view)) {
-            LogPrintf("%s():%d - Dropping cert %s : nonstandard transaction input\n",
-                    __func__, __LINE__, certHash.ToString());
+        // are the joinsplit's requirements met?
+        if (!view.HaveJoinSplitRequirements(tx))
+        {
+            state.Invalid(error("%s():%d - joinsplit requirements not met", __func__, __LINE__),
+                          CValidationState::Code::DUPLICATED, "bad-txns-joinsplit-requirements-not-met");
             return MempoolReturnValue::INVALID;
         }
+    }
+
+    // Bring the best block into scope: it's gonna be needed for the input checks hereinafter
+    view.GetBestBlock();
+    nFees = txBase.GetFeeAmount(view.GetValueIn(txBase));
 
-        unsigned int nSigOps = GetLegacySigOpCount(cert);
-        if (nSigOps > MAX_STANDARD_TX_SIGOPS)
+    if (fCertificate)
+    {
+        const CScCertificate& cert = dynamic_cast<const CScCertificate&>(txBase);
+        std::pair<uint256, CAmount> conflictingCertData = pool.FindCertWithQuality(cert.GetScId(), cert.quality);
+        if (!conflictingCertData.first.IsNull() && conflictingCertData.second >= nFees)
         {
-            state.DoS(0,
-                error("%s():%d - too many sigops %s, %d > %d",
-                    __func__, __LINE__, certHash.ToString(), nSigOps, MAX_STANDARD_TX_SIGOPS),
-                CValidationState::Code::NONSTANDARD, "bad-sc-cert-too-many-sigops");
+            state.Invalid(
+                error("%s():%d - Dropping cert %s : low fee and same quality as other cert in mempool\n",
+                    __func__, __LINE__, hash.ToString()),
+                CValidationState::Code::INVALID, "bad-sc-cert-quality");
             return MempoolReturnValue::INVALID;
         }
+    }
 
-        // cert: this computes priority based on input amount and depth in blockchain, as transparent txes.
-        // another option would be to return max prio, as shielded txes do
-        double dPriority = view.GetPriority(cert, chainActive.Height());
-        LogPrint("mempool", "%s():%d - Computed fee=%lld, prio[%22.8f]\n", __func__, __LINE__, nFees, dPriority);
+    // Check for non-standard pay-to-script-hash in inputs
+    if (getRequireStandard() && !AreInputsStandard(txBase, view))
+    {
+        LogPrintf("%s():%d - Dropping %s %s : nonstandard transaction input\n",
+                __func__, __LINE__, fCertificate ? "cert" : "tx", hash.ToString());
+        return MempoolReturnValue::INVALID;
+    }
 
-        CCertificateMemPoolEntry entry(cert, nFees, GetTime(), dPriority, chainActive.Height());
-        unsigned int nSize = entry.GetCertificateSize();
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    unsigned int nSigOps = GetLegacySigOpCount(txBase);
+    if (!fCertificate)
+        nSigOps += GetP2SHSigOpCount(txBase, view);
+    if (nSigOps > MAX_STANDARD_TX_SIGOPS)
+    {
+        state.DoS(0,
+            error("%s():%d - too many sigops %s, %d > %d",
+                __func__, __LINE__, hash.ToString(), nSigOps, MAX_STANDARD_TX_SIGOPS),
+            CValidationState::Code::NONSTANDARD, fCertificate ? "bad-sc-cert-too-many-sigops" : "bad-txns-too-many-sigops");
+        return MempoolReturnValue::INVALID;
+    }
+
+    // The size of the mempool entry
+    const unsigned int nSize = txBase.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+
+    // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
+    // In future we will we have more accurate and dynamic computation of fees for tx with joinsplits.
+    if (txBase.GetVjoinsplit().empty() || nFees < ASYNC_RPC_OPERATION_DEFAULT_MINERS_FEE)
+    {
+        unsigned int block_priority_size = DEFAULT_BLOCK_PRIORITY_SIZE;
+        if (!fCertificate && !ForkManager::getInstance().areSidechainsSupported(nextBlockHeight))
+            block_priority_size = DEFAULT_BLOCK_PRIORITY_SIZE_BEFORE_SC;
 
         // Don't accept it if it can't get into a block
-        CAmount txMinFee = GetMinRelayFee(cert, nSize, true, DEFAULT_BLOCK_PRIORITY_SIZE);
+        CAmount txMinFee = GetMinRelayFee(txBase, nSize, true, block_priority_size);
 
         LogPrintf("nFees=%d, txMinFee=%d\n", nFees, txMinFee);
         if (fLimitFree == LimitFreeFlag::ON && nFees < txMinFee)
         {
-            state.DoS(0, error("%s(): not enough fees %s, %d < %d",
-                                    __func__, certHash.ToString(), nFees, txMinFee),
-                            CValidationState::Code::INSUFFICIENT_FEE, "insufficient fee");
+            state.DoS(0, error("%s():%d - not enough fees %s, %d < %d",
+                      __func__, __LINE__, hash.ToString(), nFees, txMinFee),
+                      CValidationState::Code::INSUFFICIENT_FEE, "insufficient fee");
             return MempoolReturnValue::INVALID;
         }
+    }
 
-        // Require that free transactions have sufficient priority to be mined in the next block.
-        if (GetBoolArg("-relaypriority", false) &&
-            nFees < ::minRelayTxFee.GetFee(nSize) &&
-            !AllowFree(view.GetPriority(cert, chainActive.Height() + 1)))
+    // Don't accept it if the mempool is full of transactions paying a better fee rate.
+    // Certificates are exempted, see AcceptCertificateToMemoryPool().
+    if (!fCertificate && fOverrideMempoolLimit == OverrideMempoolLimitFlag::OFF)
+    {
+        double dPriorityDelta = 0;
+        CAmount nFeeDelta = 0;
+        pool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (mempoolRejectFee > 0 && nFees + nFeeDelta < mempoolRejectFee)
         {
-            state.DoS(0, false, CValidationState::Code::INSUFFICIENT_FEE, "insufficient priority");
+            state.DoS(0, error("%s():%d - mempool min fee not met %s, %d < %d",
+                      __func__, __LINE__, hash.ToString(), nFees + nFeeDelta, mempoolRejectFee),
+                      CValidationState::Code::INSUFFICIENT_FEE, "mempool min fee not met");
             return MempoolReturnValue::INVALID;
         }
+    }
+
+    // Require that free transactions have sufficient priority to be mined in the next block.
+    if (GetBoolArg("-relaypriority", false) &&
+        nFees < ::minRelayTxFee.GetFee(nSize) &&
+        !AllowFree(view.GetPriority(txBase, chainActive.Height() + 1)))
+    {
+        state.DoS(0, false, CValidationState::Code::INSUFFICIENT_FEE, "insufficient priority");
+        return MempoolReturnValue::INVALID;
+    }
+
+    return MempoolReturnValue::VALID;
+}
+
+MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit, const CMempoolPreCheck* pPreCheck)
+{
+    return AcceptCertificateToMemoryPool(pool, state, std::make_shared<const CScCertificate>(cert), fLimitFree, fRejectAbsurdFee,
+                                         fProofVerification, pfrom, fOverrideMempoolLimit, pPreCheck);
+}
+
+MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificateRef &pcert,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit, const CMempoolPreCheck* pPreCheck)
+{
+    AssertLockHeld(cs_main);
+    const CScCertificate& cert = *pcert;
+
+    //we retrieve the current height from the pcoinsTip and not from chainActive because on DisconnectTip the Accept*ToMemoryPool
+    // is called after having reverted the txs from the pcoinsTip view but before having updated the chainActive
+    int nextBlockHeight = pcoinsTip->GetHeight() + 1;
+
+    if (!cert.CheckInputsLimit())
+    {
+        LogPrintf("%s(): CheckInputsLimit failed\n", __func__);
+        return MempoolReturnValue::INVALID;
+    }
+
+    if ((pPreCheck == nullptr || !pPreCheck->fContextFreeChecked) && !CheckCertificate(cert, state))
+    {
+        error("%s(): CheckCertificate failed", __func__);
+        return MempoolReturnValue::INVALID;
+    }
+
+    static const int DOS_LEVEL = 10;
+    if(!cert.ContextualCheck(state, nextBlockHeight, DOS_LEVEL))
+    {
+        LogPrintf("%s(): ContextualCheck failed\n", __func__);
+        return MempoolReturnValue::INVALID;
+    }
+
+    {
+        uint256 certHash = cert.GetHash();
+        CCoinsView dummy;
+        CCoinsViewCache view(&dummy);
+
+        CAmount nFees = 0;
+        {
+            LOCK(pool.cs);
+            CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+            view.SetBackend(viewMemPool);
+
+            MempoolReturnValue res = CheckTxBaseMempoolPolicy(pool, state, cert, view, nextBlockHeight, fLimitFree,
+                                                              fOverrideMempoolLimit, nFees);
+            if (res != MempoolReturnValue::VALID)
+                return res;
+
+            // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
+            view.SetBackend(dummy);
+        }
+
+        // cert: this computes priority based on input amount and depth in blockchain, as transparent txes.
+        // another option would be to return max prio, as shielded txes do
+        double dPriority = view.GetPriority(cert, chainActive.Height());
+        LogPrint("mempool", "%s():%d - Computed fee=%lld, prio[%22.8f]\n", __func__, __LINE__, nFees, dPriority);
+
+        CCertificateMemPoolEntry entry(pcert, nFees, GetTime(), dPriority, chainActive.Height());
+        unsigned int nSize = entry.GetCertificateSize();
 
         // Continuously rate-limit free (really, very-low-fee) transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
@@ -1370,33 +1610,45 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
             return MempoolReturnValue::INVALID;
         }
 
+        // The scripts checked by PreCheckTxBaseForMemoryPool() against this very tip are still valid: the outputs
+        // they spend are the same, as they are still there
+        const bool fScriptsChecked = pPreCheck != nullptr && !pPreCheck->hashScriptsCheckedTip.IsNull() &&
+                                     pPreCheck->hashScriptsCheckedTip == chainActive.Tip()->GetBlockHash();
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!ContextualCheckCertInputs(cert, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        if (!ContextualCheckCertInputs(cert, state, view, !fScriptsChecked, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
         {
             LogPrintf("%s():%d - ERROR: ConnectInputs failed, cert[%s]\n", __func__, __LINE__, certHash.ToString());
             return MempoolReturnValue::INVALID;
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
+        // Check again against the flags blocks are checked with (the consensus-critical
+        // mandatory ones plus CHECKLOCKTIMEVERIFY), in case of bugs in the standard flags
+        // that cause transactions to pass as valid when they're actually invalid. For
         // instance the STRICTENC flag was incorrectly allowing certain
         // CHECKSIG NOT scripts to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!ContextualCheckCertInputs(cert, state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        //
+        // The result is cached, and the scripts are not run again when the certificate is connected.
+        if (!fScriptsChecked &&
+            !ContextualCheckCertInputs(cert, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
         {
-            LogPrintf("%s():%d - BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags, cert[%s]\n",
+            LogPrintf("%s():%d - BUG! PLEASE REPORT THIS! ConnectInputs failed against BLOCK but not STANDARD flags, cert[%s]\n",
                                 __func__, __LINE__, certHash.ToString());
             return MempoolReturnValue::INVALID;
         }
 
+        // PreCheckTxBaseForMemoryPool() used the same flags, on this very chain
+        if (fScriptsChecked)
+            scriptExecutionCache.Set(ScriptExecutionCacheEntry(certHash, BLOCK_SCRIPT_VERIFY_FLAGS));
+
         if (fProofVerification == MempoolProofVerificationFlag::ASYNC)
         {
-            CScAsyncProofVerifier::GetInstance().LoadDataForCertVerification(view, cert, pfrom);
+            CScAsyncProofVerifier::GetInstance().LoadDataForCertVerification(view, cert, pfrom, pcert);
             return MempoolReturnValue::PARTIALLY_VALIDATED;
         }
         else if (fProofVerification == MempoolProofVerificationFlag::SYNC)
@@ -1413,6 +1665,8 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
             }
         }
 
+        // The certificate of the same quality it replaces, if any, pays a lower fee as checked above
+        std::pair<uint256, CAmount> conflictingCertData = pool.FindCertWithQuality(cert.GetScId(), cert.quality);
         if (!pool.RemoveCertAndSync(conflictingCertData.first))
         {
             state.Invalid(
@@ -1436,14 +1690,36 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
             pool.addSpentIndex(entry.GetCertificate(), view);
         }
 #endif // ENABLE_ADDRESS_INDEXING
+
+        // Certificates are not checked against the mempool minimum fee: they carry a verified proof and at most one
+        // per quality and epoch is kept. They are still accounted for and may be trimmed, see CTxMemPool::TrimToSize.
+        if (fOverrideMempoolLimit == OverrideMempoolLimitFlag::OFF)
+        {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+            if (!pool.existsCert(certHash))
+            {
+                state.DoS(0, false, CValidationState::Code::INSUFFICIENT_FEE, "mempool full");
+                return MempoolReturnValue::INVALID;
+            }
+        }
     }
     return MempoolReturnValue::VALID;
 }
 
 MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, LimitFreeFlag fLimitFree,
-                        RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom)
+                        RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+                        OverrideMempoolLimitFlag fOverrideMempoolLimit, const CMempoolPreCheck* pPreCheck)
+{
+    return AcceptTxToMemoryPool(pool, state, std::make_shared<const CTransaction>(tx), fLimitFree, fRejectAbsurdFee,
+                                fProofVerification, pfrom, fOverrideMempoolLimit, pPreCheck);
+}
+
+MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, LimitFreeFlag fLimitFree,
+                        RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+                        OverrideMempoolLimitFlag fOverrideMempoolLimit, const CMempoolPreCheck* pPreCheck)
 {
     AssertLockHeld(cs_main);
+    const CTransaction& tx = *ptx;
 
     //we retrieve the current height from the pcoinsTip and not from chainActive because on DisconnectTip the Accept*ToMemoryPool
     // is called after having reverted the txs from the pcoinsTip view but before having updated the chainActive
@@ -1455,11 +1731,14 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
         return MempoolReturnValue::INVALID;
     }
 
-    auto verifier = libzcash::ProofVerifier::Strict();
-    if (!CheckTransaction(tx, state, verifier))
+    if (pPreCheck == nullptr || !pPreCheck->fContextFreeChecked)
     {
-        error("%s(): CheckTransaction failed", __func__);
-        return MempoolReturnValue::INVALID;
+        auto verifier = libzcash::ProofVerifier::Strict();
+        if (!CheckTransaction(tx, state, verifier))
+        {
+            error("%s(): CheckTransaction failed", __func__);
+            return MempoolReturnValue::INVALID;
+        }
     }
 
     // DoS level set to 10 to be more forgiving.
@@ -1470,55 +1749,6 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
         return MempoolReturnValue::INVALID;
     }
 
-    // Silently drop pre-chainsplit transactions
-    if (!ForkManager::getInstance().isAfterChainsplit(nextBlockHeight))
-    {
-        LogPrint("mempool", "%s():%d - Dropping txid[%s]: chain height[%d] is before chain split\n",
-            __func__, __LINE__, tx.GetHash().ToString(), nextBlockHeight);
-        return MempoolReturnValue::INVALID;
-    }
-
-    // Coinbase is only valid in a block, not as a loose transaction
-    if (tx.IsCoinBase())
-    {
-        state.DoS(100, error("%s(): coinbase as individual tx", __func__),
-                  CValidationState::Code::INVALID, "coinbase");
-        return MempoolReturnValue::INVALID;
-    }
-
-
-    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
-    string reason;
-    if (getRequireStandard() && !IsStandardTx(tx, reason, nextBlockHeight))
-    {
-        state.DoS(0, error("%s(): nonstandard transaction: %s", __func__, reason),
-                  CValidationState::Code::NONSTANDARD, reason);
-        return MempoolReturnValue::INVALID;
-    }
-
-    // Only accept nLockTime-using transactions that can be mined in the next
-    // block; we don't want our mempool filled up with transactions that can't
-    // be mined yet.
-    if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
-    {
-        state.DoS(0, false, CValidationState::Code::NONSTANDARD, "non-final");
-        return MempoolReturnValue::INVALID;
-    }
-
-    if (!pool.checkCswInputsPerScLimit(tx))
-    {
-        state.Invalid(error("%s():%d: tx[%s] would exceed limit of csw inputs for sc in mempool\n",
-            __func__, __LINE__, tx.GetHash().ToString()),
-            CValidationState::Code::TOO_MANY_CSW_INPUTS_FOR_SC, "bad-txns-too-many-csw-inputs-for-sc");
-        return MempoolReturnValue::INVALID;
-    }
-
-    if (!pool.checkIncomingTxConflicts(tx))
-    {
-        LogPrintf("%s():%d: tx[%s] has conflicts in mempool\n", __func__, __LINE__, tx.GetHash().ToString());
-        return MempoolReturnValue::INVALID;
-    }
-
     {
         uint256 hash = tx.GetHash();
         CCoinsView dummy;
@@ -1530,129 +1760,21 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
             CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
             view.SetBackend(viewMemPool);
 
-            // do we already have it?
-            if (view.HaveCoins(hash))
-            {
-                LogPrint("mempool", "%s():%d Dropping tx %s : view already has coins\n",
-                    __func__, __LINE__, tx.GetHash().ToString());
-                return MempoolReturnValue::INVALID;
-            }
-
-            // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // and only helps with filling in pfMissingInputs (to determine missing vs spent).
-            for(const CTxIn txin: tx.GetVin())
-            {
-                if (!view.HaveCoins(txin.prevout.hash))
-                {
-                    LogPrint("mempool", "%s():%d - Dropping tx %s : no coins for vin (tx=%s)\n",
-                        __func__, __LINE__, tx.GetHash().ToString(), txin.prevout.hash.ToString());
-                    return MempoolReturnValue::MISSING_INPUT;
-                }
-            }
-
-            // are the actual inputs available?
-            if (!view.HaveInputs(tx))
-            {
-                LogPrintf("%s():%d - ERROR: tx[%s]\n", __func__, __LINE__, hash.ToString());
-                state.Invalid(error("%s(): inputs already spent", __func__),
-                                     CValidationState::Code::DUPLICATED, "bad-txns-inputs-spent");
-                return MempoolReturnValue::INVALID;
-            }
-
-            bool banSenderNode = false;
-            int nDoS = 0;
-
-            CValidationState::Code ret_code = view.IsScTxApplicableToState(tx, Sidechain::ScFeeCheckFlag::LATEST_VALUE, &banSenderNode);
-            if (ret_code != CValidationState::Code::OK)
-            {
-                if (banSenderNode)
-                    nDoS = 100;
-
-                state.DoS(nDoS,
-                    error("%s():%d - ERROR: sc-related tx [%s] is not applicable: ret_code[0x%x]\n",
-                        __func__, __LINE__, hash.ToString(), CValidationState::CodeToChar(ret_code)),
-                    ret_code, "bad-sc-tx-not-applicable");
-                return MempoolReturnValue::INVALID;
-            }
-
-            // are the joinsplit's requirements met?
-            if (!view.HaveJoinSplitRequirements(tx))
-            {
-                state.Invalid(error("%s():%d - joinsplit requirements not met", __func__, __LINE__),
-                              CValidationState::Code::DUPLICATED, "bad-txns-joinsplit-requirements-not-met");
-                return MempoolReturnValue::INVALID;
-            }
-
-            // Bring the best block into scope
-            view.GetBestBlock();
-
-            nFees = tx.GetFeeAmount(view.GetValueIn(tx));
+            MempoolReturnValue res = CheckTxBaseMempoolPolicy(pool, state, tx, view, nextBlockHeight, fLimitFree,
+                                                              fOverrideMempoolLimit, nFees);
+            if (res != MempoolReturnValue::VALID)
+                return res;
 
             // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
             view.SetBackend(dummy);
         }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (getRequireStandard() && !AreInputsStandard(tx, view))
-        {
-            LogPrintf("%s():%d - Dropping tx %s : nonstandard transaction input\n",
-                    __func__, __LINE__, tx.GetHash().ToString());
-            return MempoolReturnValue::INVALID;
-        }
-
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        unsigned int nSigOps = GetLegacySigOpCount(tx);
-        nSigOps += GetP2SHSigOpCount(tx, view);
-        if (nSigOps > MAX_STANDARD_TX_SIGOPS)
-        {
-            state.Invalid(
-                error("%s():%d - too many sigops %s, %d > %d",
-                    __func__, __LINE__, hash.ToString(), nSigOps, MAX_STANDARD_TX_SIGOPS),
-                CValidationState::Code::NONSTANDARD, "bad-txns-too-many-sigops");
-            return MempoolReturnValue::INVALID;
-        }
-
         double dPriority = view.GetPriority(tx, chainActive.Height());
         LogPrint("mempool", "%s():%d - tx[%s], Computed fee=%lld, prio[%22.8f]\n", __func__, __LINE__, hash.ToString(), nFees, dPriority);
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx));
+        CTxMemPoolEntry entry(ptx, nFees, GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx));
         unsigned int nSize = entry.GetTxSize();
 
-        // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
-        if (tx.GetVjoinsplit().size() > 0 && nFees >= ASYNC_RPC_OPERATION_DEFAULT_MINERS_FEE) {
-            // In future we will we have more accurate and dynamic computation of fees for tx with joinsplits.
-        } else {
-            unsigned int block_priority_size = DEFAULT_BLOCK_PRIORITY_SIZE;
-            if (!ForkManager::getInstance().areSidechainsSupported(nextBlockHeight))
-                block_priority_size = DEFAULT_BLOCK_PRIORITY_SIZE_BEFORE_SC;
-    
-            // Don't accept it if it can't get into a block
-            CAmount txMinFee = GetMinRelayFee(tx, nSize, true, block_priority_size);
-
-            LogPrintf("nFees=%d, txMinFee=%d\n", nFees, txMinFee);
-            if (fLimitFree == LimitFreeFlag::ON && nFees < txMinFee)
-            {
-                state.DoS(0, error("%s():%d - not enough fees %s, %d < %d",
-                          __func__, __LINE__, hash.ToString(), nFees, txMinFee),
-                          CValidationState::Code::INSUFFICIENT_FEE, "insufficient fee");
-                return MempoolReturnValue::INVALID;
-            }
-        }
-
-        // Require that free transactions have sufficient priority to be mined in the next block.
-        if (GetBoolArg("-relaypriority", false) &&
-            nFees < ::minRelayTxFee.GetFee(nSize) &&
-            !AllowFree(view.GetPriority(tx, chainActive.Height() + 1)))
-        {
-            state.DoS(0, false, CValidationState::Code::INSUFFICIENT_FEE, "insufficient priority");
-            return MempoolReturnValue::INVALID;
-        }
-
         // Continuously rate-limit free (really, very-low-fee) transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
@@ -1687,35 +1809,47 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
             return MempoolReturnValue::INVALID;
         }
 
+        // The scripts checked by PreCheckTxBaseForMemoryPool() against this very tip are still valid: the outputs
+        // they spend are the same, as they are still there
+        const bool fScriptsChecked = pPreCheck != nullptr && !pPreCheck->hashScriptsCheckedTip.IsNull() &&
+                                     pPreCheck->hashScriptsCheckedTip == chainActive.Tip()->GetBlockHash();
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!ContextualCheckTxInputs(tx, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        if (!ContextualCheckTxInputs(tx, state, view, !fScriptsChecked, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
         {
             error("%s(): ConnectInputs failed %s", __func__, hash.ToString());
             return MempoolReturnValue::INVALID;
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
+        // Check again against the flags blocks are checked with (the consensus-critical
+        // mandatory ones plus CHECKLOCKTIMEVERIFY), in case of bugs in the standard flags
+        // that cause transactions to pass as valid when they're actually invalid. For
         // instance the STRICTENC flag was incorrectly allowing certain
         // CHECKSIG NOT scripts to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!ContextualCheckTxInputs(tx, state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        //
+        // The result is cached, and the scripts are not run again when the transaction is connected.
+        if (!fScriptsChecked &&
+            !ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
         {
-            error("%s(): BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", __func__,  hash.ToString());
+            error("%s(): BUG! PLEASE REPORT THIS! ConnectInputs failed against BLOCK but not STANDARD flags %s", __func__,  hash.ToString());
             return MempoolReturnValue::INVALID;
         }
 
+        // PreCheckTxBaseForMemoryPool() used the same flags, on this very chain
+        if (fScriptsChecked)
+            scriptExecutionCache.Set(ScriptExecutionCacheEntry(hash, BLOCK_SCRIPT_VERIFY_FLAGS));
+
         // Run the proof verification only if there is at least one CSW input.
         if (tx.GetVcswCcIn().size() > 0)
         {
             if (fProofVerification == MempoolProofVerificationFlag::ASYNC)
             {
-                CScAsyncProofVerifier::GetInstance().LoadDataForCswVerification(view, tx, pfrom);
+                CScAsyncProofVerifier::GetInstance().LoadDataForCswVerification(view, tx, pfrom, ptx);
                 return MempoolReturnValue::PARTIALLY_VALIDATED;
             }
             else if (fProofVerification == MempoolProofVerificationFlag::SYNC)
@@ -1733,62 +1867,293 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
                     return MempoolReturnValue::INVALID;
                 }
             }
-        }
-
-        pool.addUnchecked(hash, entry, !IsInitialBlockDownload());
+        }
+
+        pool.addUnchecked(hash, entry, !IsInitialBlockDownload());
+
+#ifdef ENABLE_ADDRESS_INDEXING
+        // Add memory address index
+        if (fAddressIndex) {
+            pool.addAddressIndex(entry.GetTx(), entry.GetTime(), view);
+        }
+
+        // Add memory spent index
+        if (fSpentIndex) {
+            pool.addSpentIndex(entry.GetTx(), view);
+        }
+#endif // ENABLE_ADDRESS_INDEXING
+
+        // trim the mempool and check if tx was trimmed
+        if (fOverrideMempoolLimit == OverrideMempoolLimitFlag::OFF)
+        {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+            if (!pool.existsTx(hash))
+            {
+                state.DoS(0, false, CValidationState::Code::INSUFFICIENT_FEE, "mempool full");
+                return MempoolReturnValue::INVALID;
+            }
+        }
+    }
+
+    return MempoolReturnValue::VALID;
+}
+
+MempoolReturnValue AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionBase &txBase,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit, const CMempoolPreCheck* pPreCheck)
+{
+    try
+    {
+        if (txBase.IsCertificate())
+        {
+            return AcceptCertificateToMemoryPool(pool, state, dynamic_cast<const CScCertificate&>(txBase), fLimitFree,
+                                                 fRejectAbsurdFee, fProofVerification, pfrom, fOverrideMempoolLimit, pPreCheck);
+        }
+        else
+        {
+            return AcceptTxToMemoryPool(pool, state, dynamic_cast<const CTransaction&>(txBase), fLimitFree,
+                                        fRejectAbsurdFee, fProofVerification, pfrom, fOverrideMempoolLimit, pPreCheck);
+        }
+    }
+    catch (...)
+    {
+        LogPrintf("%s():%d - ERROR: txBase[%s] cast error\n", __func__, __LINE__, txBase.GetHash().ToString());
+    }
+
+    return MempoolReturnValue::INVALID;
+}
+
+MempoolReturnValue AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const std::shared_ptr<const CTransactionBase> &pTxBase,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit, const CMempoolPreCheck* pPreCheck)
+{
+    if (pTxBase->IsCertificate())
+    {
+        CScCertificateRef pcert = std::dynamic_pointer_cast<const CScCertificate>(pTxBase);
+        if (pcert)
+            return AcceptCertificateToMemoryPool(pool, state, pcert, fLimitFree,
+                                                 fRejectAbsurdFee, fProofVerification, pfrom, fOverrideMempoolLimit, pPreCheck);
+    }
+    else
+    {
+        CTransactionRef ptx = std::dynamic_pointer_cast<const CTransaction>(pTxBase);
+        if (ptx)
+            return AcceptTxToMemoryPool(pool, state, ptx, fLimitFree,
+                                        fRejectAbsurdFee, fProofVerification, pfrom, fOverrideMempoolLimit, pPreCheck);
+    }
+
+    LogPrintf("%s():%d - ERROR: txBase[%s] cast error\n", __func__, __LINE__, pTxBase->GetHash().ToString());
+    return MempoolReturnValue::INVALID;
+}
+
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+//! how long LoadMempool waits for entries depending on proofs still being verified, without any of them coming in
+static const int64_t MEMPOOL_LOAD_PROOF_WAIT = 60;
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<std::pair<std::shared_ptr<const CTransactionBase>, int64_t> > vInfo;
+
+    {
+        LOCK(mempool.cs);
+        std::vector<std::pair<const CMemPoolEntry*, std::shared_ptr<const CTransactionBase> > > vEntries;
+        mapDeltas = mempool.mapDeltas;
+
+        // Certificates first, then transactions with their in-mempool ancestors before them, so that on reload most
+        // entries find their inputs already there
+        vInfo.reserve(mempool.mapCertificate.size() + mempool.mapTx.size());
+        vEntries.reserve(mempool.mapTx.size());
+        for (const auto& entry: mempool.mapCertificate)
+            vInfo.push_back(std::make_pair(entry.second.GetSharedCertificate(), entry.second.GetTime()));
+
+        for (const auto& entry: mempool.mapTx)
+            vEntries.push_back(std::make_pair(&entry.second, entry.second.GetSharedTx()));
+        std::sort(vEntries.begin(), vEntries.end(),
+            [](const std::pair<const CMemPoolEntry*, std::shared_ptr<const CTransactionBase> >& a,
+               const std::pair<const CMemPoolEntry*, std::shared_ptr<const CTransactionBase> >& b)
+            { return a.first->GetCountWithAncestors() < b.first->GetCountWithAncestors(); });
+        for (const auto& entry: vEntries)
+            vInfo.push_back(std::make_pair(entry.second, entry.first->GetTime()));
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        boost::filesystem::path path = GetDataDir() / "mempool.dat";
+        boost::filesystem::path pathNew = GetDataDir() / "mempool.dat.new";
+        FILE* filestr = fopen(pathNew.string().c_str(), "wb");
+        if (!filestr)
+            return error("%s: failed to open %s", __func__, pathNew.string());
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_DUMP_VERSION;
+        file << mapDeltas;
+        file << (uint64_t)vInfo.size();
+        for (const auto& info: vInfo)
+        {
+            bool fIsCertificate = info.first->IsCertificate();
+            file << fIsCertificate;
+            if (fIsCertificate)
+                file << dynamic_cast<const CScCertificate&>(*info.first);
+            else
+                file << dynamic_cast<const CTransaction&>(*info.first);
+            file << info.second;
+        }
+
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathNew, path))
+            return error("%s: failed to rename %s", __func__, pathNew.string());
+
+        int64_t nLast = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (nMid - nStart) * 0.000001, (nLast - nMid) * 0.000001);
+    } catch (const std::exception& e) {
+        return error("%s: failed to dump mempool: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool LoadMempool()
+{
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    FILE* filestr = fopen(path.string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        LogPrintf("%s: no mempool file at %s, starting with an empty mempool\n", __func__, path.string());
+        return false;
+    }
+
+    int64_t nStart = GetTimeMicros();
+    unsigned int nAccepted = 0, nVerifying = 0, nFailed = 0, nAlreadyThere = 0;
+
+    // entries with inputs not there yet, and the entries that were queued for the asynchronous proof verification
+    // and may provide them
+    std::vector<std::shared_ptr<const CTransactionBase> > vMissingInputs;
+    std::set<uint256> setVerifying;
+
+    auto accept = [&](const std::shared_ptr<const CTransactionBase>& txBase) {
+        LOCK(cs_main);
+        CValidationState state;
+        // Entries were already accepted once: do not rate-limit free ones again, but let the proofs go through the
+        // asynchronous verifier so that they are batched
+        return AcceptTxBaseToMemoryPool(mempool, state, txBase, LimitFreeFlag::OFF,
+                                        RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::ASYNC);
+    };
+
+    try {
+        uint64_t nVersion;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s: unsupported mempool file version %d", __func__, nVersion);
+
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (const auto& delta: mapDeltas)
+            mempool.PrioritiseTransaction(delta.first, delta.first.ToString(), delta.second.first, delta.second.second);
+
+        uint64_t nEntries;
+        file >> nEntries;
+        for (uint64_t i = 0; i < nEntries && !ShutdownRequested(); ++i)
+        {
+            bool fIsCertificate;
+            file >> fIsCertificate;
+            // deserialized in place, the mempool entry sharing the object
+            std::shared_ptr<const CTransactionBase> txBase;
+            if (fIsCertificate)
+            {
+                std::shared_ptr<CScCertificate> pcert = std::make_shared<CScCertificate>();
+                file >> *pcert;
+                txBase = pcert;
+            }
+            else
+            {
+                std::shared_ptr<CTransaction> ptx = std::make_shared<CTransaction>();
+                file >> *ptx;
+                txBase = ptx;
+            }
+            int64_t nTime;
+            file >> nTime;
 
-#ifdef ENABLE_ADDRESS_INDEXING
-        // Add memory address index
-        if (fAddressIndex) {
-            pool.addAddressIndex(entry.GetTx(), entry.GetTime(), view);
-        }
+            const uint256& hash = txBase->GetHash();
+            if (mempool.exists(hash))
+            {
+                ++nAlreadyThere;
+                continue;
+            }
 
-        // Add memory spent index
-        if (fSpentIndex) {
-            pool.addSpentIndex(entry.GetTx(), view);
+            mempool.SetLoadedTime(hash, nTime);
+            switch (accept(txBase))
+            {
+                case MempoolReturnValue::VALID:               ++nAccepted; break;
+                case MempoolReturnValue::PARTIALLY_VALIDATED: setVerifying.insert(hash); break;
+                case MempoolReturnValue::MISSING_INPUT:       vMissingInputs.push_back(txBase); break;
+                default:                                      ++nFailed; mempool.EraseLoadedTime(hash); break;
+            }
         }
-#endif // ENABLE_ADDRESS_INDEXING
+    } catch (const std::exception& e) {
+        LogPrintf("%s: failed to deserialize mempool data on disk: %s. Continuing anyway.\n", __func__, e.what());
+        for (const std::shared_ptr<const CTransactionBase>& txBase: vMissingInputs)
+            mempool.EraseLoadedTime(txBase->GetHash());
+        return false;
     }
 
-    return MempoolReturnValue::VALID;
-}
-
-MempoolReturnValue AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionBase &txBase,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom)
-{
-    try
+    // Retry the entries missing some input until they stop coming in. Those spending outputs of entries still in the
+    // proof verifier have to wait for it, which is given up on once nothing has been verified for a while.
+    int64_t nLastProgress = GetTime();
+    while (!vMissingInputs.empty() && !ShutdownRequested())
     {
-        if (txBase.IsCertificate())
+        bool fProgress = false;
+        for (std::set<uint256>::iterator it = setVerifying.begin(); it != setVerifying.end();)
         {
-            return AcceptCertificateToMemoryPool(pool, state, dynamic_cast<const CScCertificate&>(txBase), fLimitFree,
-                                                 fRejectAbsurdFee, fProofVerification, pfrom);
+            if (mempool.exists(*it))
+            {
+                ++nVerifying;
+                fProgress = true;
+                it = setVerifying.erase(it);
+            }
+            else
+                ++it;
         }
-        else
+
+        std::vector<std::shared_ptr<const CTransactionBase> > vStillMissing;
+        for (const std::shared_ptr<const CTransactionBase>& txBase: vMissingInputs)
         {
-            return AcceptTxToMemoryPool(pool, state, dynamic_cast<const CTransaction&>(txBase), fLimitFree,
-                                        fRejectAbsurdFee, fProofVerification, pfrom);
+            switch (accept(txBase))
+            {
+                case MempoolReturnValue::VALID:               ++nAccepted; fProgress = true; break;
+                case MempoolReturnValue::PARTIALLY_VALIDATED: setVerifying.insert(txBase->GetHash()); fProgress = true; break;
+                case MempoolReturnValue::MISSING_INPUT:       vStillMissing.push_back(txBase); break;
+                default:                                      ++nFailed; mempool.EraseLoadedTime(txBase->GetHash()); break;
+            }
         }
-    }
-    catch (...)
-    {
-        LogPrintf("%s():%d - ERROR: txBase[%s] cast error\n", __func__, __LINE__, txBase.GetHash().ToString());
-    }
-
-    return MempoolReturnValue::INVALID;
-}
+        vMissingInputs.swap(vStillMissing);
 
-#ifdef ENABLE_ADDRESS_INDEXING
-bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
-{
-    if (!fTimestampIndex)
-        return error("Timestamp index not enabled");
-
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
-        return error("Unable to get hashes for timestamps");
+        if (fProgress)
+            nLastProgress = GetTime();
+        else if (setVerifying.empty() || GetTime() - nLastProgress > MEMPOOL_LOAD_PROOF_WAIT)
+            break;
+        else
+            MilliSleep(100);
+    }
+    nFailed += vMissingInputs.size();
+    for (const std::shared_ptr<const CTransactionBase>& txBase: vMissingInputs)
+        mempool.EraseLoadedTime(txBase->GetHash());
+    // the ones still in the proof verifier are taken care of by ProcessTxBaseAcceptToMemoryPool()
+    nVerifying += setVerifying.size();
 
+    LogPrintf("Imported mempool transactions from disk: %u accepted, %u sent to proof verification, %u failed, "
+              "%u already there, in %gs\n", nAccepted, nVerifying, nFailed, nAlreadyThere,
+              (GetTimeMicros() - nStart) * 0.000001);
     return true;
 }
 
+#ifdef ENABLE_ADDRESS_INDEXING
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
     if (!fSpentIndex)
@@ -1797,7 +2162,7 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!pspentindexdb->ReadSpentIndex(key, value))
         return false;
 
     return true;
@@ -1809,7 +2174,7 @@ bool GetAddressIndex(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!paddressindexdb->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
@@ -1821,7 +2186,7 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!paddressindexdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
     return true;
@@ -2340,22 +2705,30 @@ void UpdateCoins(const CScCertificate& cert, CCoinsViewCache &inputs, CTxUndo &t
 
 CScriptCheck::CScriptCheck(): ptxTo(0), nIn(0), chain(nullptr),
                               nFlags(0), cacheStore(false),
-                              error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+                              error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), ppubkeyCache(nullptr) {}
 CScriptCheck::CScriptCheck(const CCoins& txFromIn, const CTransactionBase& txToIn,
                            unsigned int nInIn, const CChain* chainIn,
-                           unsigned int nFlagsIn, bool cacheIn):
+                           unsigned int nFlagsIn, bool cacheIn,
+                           const CPrecomputedTransactionData* txdataIn):
                             scriptPubKey(txFromIn.vout[txToIn.GetVin()[nInIn].prevout.n].scriptPubKey),
                             ptxTo(&txToIn), nIn(nInIn), chain(chainIn), nFlags(nFlagsIn),
-                            cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+                            cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn),
+                            ppubkeyCache(nullptr) { }
 
 CScriptCheck::CScriptCheck(const CScript& scriptPubKeyIn, const CTransactionBase& txToIn,
                            unsigned int nInIn, const CChain* chainIn,
-                           unsigned int nFlagsIn, bool cacheIn):
+                           unsigned int nFlagsIn, bool cacheIn,
+                           const CPrecomputedTransactionData* txdataIn):
                             scriptPubKey(scriptPubKeyIn), ptxTo(&txToIn), nIn(nInIn), chain(chainIn),
-                            nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+                            nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn),
+                            ppubkeyCache(nullptr) { }
 
 bool CScriptCheck::operator()() {
-    return ptxTo->VerifyScript(scriptPubKey, nFlags, nIn, chain, cacheStore, &error);
+    return ptxTo->VerifyScript(scriptPubKey, nFlags, nIn, chain, cacheStore, &error, txdata);
+}
+
+bool CScriptCheck::RunDeferred(CSignatureBatch& batch) {
+    return ptxTo->VerifyScript(scriptPubKey, nFlags, nIn, chain, cacheStore, &error, txdata, &batch);
 }
 
 void CScriptCheck::swap(CScriptCheck &check) {
@@ -2366,10 +2739,48 @@ void CScriptCheck::swap(CScriptCheck &check) {
     std::swap(nFlags, check.nFlags);
     std::swap(cacheStore, check.cacheStore);
     std::swap(error, check.error);
+    std::swap(txdata, check.txdata);
+    std::swap(ppubkeyCache, check.ppubkeyCache);
 }
 
 ScriptError CScriptCheck::GetScriptError() const { return error; }
 
+template <>
+bool RunCheckBatch(std::vector<CScriptCheck>& vChecks, const std::atomic<bool>& fContinue)
+{
+    // the scripts first, each leaving its signatures in batch up to vEnd[i]
+    CSignatureBatch batch;
+    std::vector<size_t> vEnd(vChecks.size());
+    std::vector<bool> vScriptOk(vChecks.size());
+    for (size_t i = 0; i < vChecks.size(); i++) {
+        if (!fContinue.load(std::memory_order_relaxed))
+            return true;
+        if (vChecks[i].GetPubKeyCache() == nullptr) {
+            if (!vChecks[i]())
+                return false;
+            vScriptOk[i] = true;
+        } else {
+            vScriptOk[i] = vChecks[i].RunDeferred(batch);
+        }
+        vEnd[i] = batch.size();
+    }
+
+    // then the signatures; the result of a script is only known for sure if they are all valid,
+    // otherwise it may have been a multisig trying a signature with the wrong key, so it runs again
+    size_t nBegin = 0;
+    for (size_t i = 0; i < vChecks.size(); i++) {
+        if (!fContinue.load(std::memory_order_relaxed))
+            return true;
+        CPubKeyCache* ppubkeyCache = vChecks[i].GetPubKeyCache();
+        if (ppubkeyCache != nullptr &&
+            !(vScriptOk[i] && batch.Verify(nBegin, vEnd[i], *ppubkeyCache)) &&
+            !vChecks[i]())
+            return false;
+        nBegin = vEnd[i];
+    }
+    return true;
+}
+
 bool IsCommunityFund(const CCoins *coins, int nIn)
 {
     if(coins != NULL &&
@@ -2498,10 +2909,11 @@ bool CheckTxInputs(const CTransactionBase& txBase, CValidationState& state, cons
 }// namespace Consensus
 
 bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, unsigned int nIn,
-                      const CChain& chain, unsigned int flags, bool cacheStore,  CValidationState &state, std::vector<CScriptCheck> *pvChecks)
+                      const CChain& chain, unsigned int flags, bool cacheStore,  CValidationState &state, std::vector<CScriptCheck> *pvChecks,
+                      const CPrecomputedTransactionData* txdata)
 {
     // Verify signature
-    CScriptCheck check(scriptPubKey, tx, nIn, &chain, flags, cacheStore);
+    CScriptCheck check(scriptPubKey, tx, nIn, &chain, flags, cacheStore, txdata);
     if (pvChecks) {
         pvChecks->push_back(CScriptCheck());
         check.swap(pvChecks->back());
@@ -2517,7 +2929,7 @@ bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, u
             // avoid splitting the network between upgraded and
             // non-upgraded nodes.
             CScriptCheck check(scriptPubKey, tx, nIn, &chain,
-                    flags & ~STANDARD_CONTEXTUAL_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                    flags & ~STANDARD_CONTEXTUAL_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
             if (check())
                 return state.Invalid(false, CValidationState::Code::NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
         }
@@ -2534,7 +2946,8 @@ bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, u
     return true;
 }
 
-bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams, std::vector<CScriptCheck> *pvChecks)
+bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams, std::vector<CScriptCheck> *pvChecks,
+                             CPrecomputedTransactionData* txdata)
 {
     if (!tx.IsCoinBase())
     {
@@ -2556,13 +2969,30 @@ bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, co
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // inputs already found valid when accepted to the mempool; a block being connected will not need them again
+            const bool fUseScriptCache = (&chain == &chainActive) && flags == BLOCK_SCRIPT_VERIFY_FLAGS;
+            uint256 scriptCacheEntry;
+            if (fUseScriptCache) {
+                scriptCacheEntry = ScriptExecutionCacheEntry(tx.GetHash(), flags);
+                if (scriptExecutionCache.Get(scriptCacheEntry, !cacheStore))
+                    return true;
+            }
+
+            // serialized once for the signature hashes of all inputs, which only pays off with more than one;
+            // queued checks can only use the caller's
+            CPrecomputedTransactionData localTxData;
+            if (txdata == nullptr && pvChecks == nullptr)
+                txdata = &localTxData;
+            if (txdata != nullptr && !txdata->IsReady() && tx.GetVin().size() + tx.GetVcswCcIn().size() > 1)
+                txdata->Init(tx);
+
             for (unsigned int i = 0; i < tx.GetVin().size(); i++) {
                 const COutPoint &prevout = tx.GetVin()[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 const CScript& scriptPubKey = coins->vout[tx.GetVin()[i].prevout.n].scriptPubKey;
-                if(!InputScriptCheck(scriptPubKey, tx, i, chain, flags, cacheStore, state, pvChecks)) {
+                if(!InputScriptCheck(scriptPubKey, tx, i, chain, flags, cacheStore, state, pvChecks, txdata)) {
                     return false;
                 }
             }
@@ -2570,17 +3000,22 @@ bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, co
             unsigned int vinSize = tx.GetVin().size();
             for (unsigned int i = 0; i < tx.GetVcswCcIn().size(); i++) {
                 const CScript& scriptPubKey = tx.GetVcswCcIn()[i].scriptPubKey();
-                if(!InputScriptCheck(scriptPubKey, tx, i + vinSize, chain, flags, cacheStore, state, pvChecks)) {
+                if(!InputScriptCheck(scriptPubKey, tx, i + vinSize, chain, flags, cacheStore, state, pvChecks, txdata)) {
                     return false;
                 }
             }
+
+            // queued checks have not run yet
+            if (fUseScriptCache && cacheStore && pvChecks == nullptr)
+                scriptExecutionCache.Set(scriptCacheEntry);
         }
     }
 
     return true;
 }
 
-bool ContextualCheckCertInputs(const CScCertificate& cert, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams, std::vector<CScriptCheck> *pvChecks)
+bool ContextualCheckCertInputs(const CScCertificate& cert, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams, std::vector<CScriptCheck> *pvChecks,
+                               CPrecomputedTransactionData* txdata)
 {
     // While checking, GetHeight() is the height of the parent block.
     // This is also true for mempool checks.
@@ -2600,17 +3035,123 @@ bool ContextualCheckCertInputs(const CScCertificate& cert, CValidationState &sta
     // before the last block chain checkpoint. This is safe because block merkle hashes are
     // still computed and checked, and any change will be caught at the next checkpoint.
     if (fScriptChecks) {
+        // inputs already found valid when accepted to the mempool; a block being connected will not need them again
+        const bool fUseScriptCache = (&chain == &chainActive) && flags == BLOCK_SCRIPT_VERIFY_FLAGS;
+        uint256 scriptCacheEntry;
+        if (fUseScriptCache) {
+            scriptCacheEntry = ScriptExecutionCacheEntry(cert.GetHash(), flags);
+            if (scriptExecutionCache.Get(scriptCacheEntry, !cacheStore))
+                return true;
+        }
+
+        CPrecomputedTransactionData localTxData;
+        if (txdata == nullptr && pvChecks == nullptr)
+            txdata = &localTxData;
+        if (txdata != nullptr && !txdata->IsReady() && cert.GetVin().size() > 1)
+            txdata->Init(cert);
+
         for (unsigned int i = 0; i < cert.GetVin().size(); i++) {
             const COutPoint &prevout = cert.GetVin()[i].prevout;
             const CCoins* coins = inputs.AccessCoins(prevout.hash);
             assert(coins);
 
             const CScript& scriptPubKey = coins->vout[cert.GetVin()[i].prevout.n].scriptPubKey;
-            if(!InputScriptCheck(scriptPubKey, cert, i, chain, flags, cacheStore, state, pvChecks)) {
+            if(!InputScriptCheck(scriptPubKey, cert, i, chain, flags, cacheStore, state, pvChecks, txdata)) {
                 return false;
             }
         }
+
+        // queued checks have not run yet
+        if (fUseScriptCache && cacheStore && pvChecks == nullptr)
+            scriptExecutionCache.Set(scriptCacheEntry);
+    }
+
+    return true;
+}
+
+bool CheckTxBaseInputScripts(const CTransactionBase& txBase, CValidationState& state, const CCoinsViewCache& inputs,
+                             const CChain& chain)
+{
+    std::vector<CScript> vScriptPubKeys;
+    vScriptPubKeys.reserve(txBase.GetVin().size());
+    for (const CTxIn& txin: txBase.GetVin())
+    {
+        const CCoins* coins = inputs.AccessCoins(txin.prevout.hash);
+        if (coins == nullptr || !coins->IsAvailable(txin.prevout.n))
+            return false;
+        vScriptPubKeys.push_back(coins->vout[txin.prevout.n].scriptPubKey);
+    }
+    if (!txBase.IsCertificate())
+    {
+        for (const CTxCeasedSidechainWithdrawalInput& csw: dynamic_cast<const CTransaction&>(txBase).GetVcswCcIn())
+            vScriptPubKeys.push_back(csw.scriptPubKey());
+    }
+
+    // both passes hash every input
+    const CPrecomputedTransactionData txdata(txBase);
+
+    // Same order as ContextualCheckTxInputs() called by AcceptTxToMemoryPool(): the block flags only catch bugs
+    // of the standard ones
+    for (unsigned int flags: {STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, BLOCK_SCRIPT_VERIFY_FLAGS})
+    {
+        for (unsigned int i = 0; i < vScriptPubKeys.size(); i++)
+        {
+            if (!InputScriptCheck(vScriptPubKeys[i], txBase, i, chain, flags, true, state, nullptr, &txdata))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool PreCheckTxBaseForMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionBase& txBase,
+                                 CMempoolPreCheck& precheck)
+{
+    // Copy the inputs, the same way Accept*ToMemoryPool() does, and the tip they are read at. What its cheap checks
+    // reject, including missing or spent inputs, is left to it without spending any time on the proofs and the scripts.
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    CBlockIndex* pindexTip = nullptr;
+    bool fAcceptable = false;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        view.SetBackend(viewMemPool);
+
+        CValidationState statePolicy;
+        CAmount nFees = 0;
+        fAcceptable = txBase.CheckInputsLimit() &&
+                      CheckTxBaseMempoolPolicy(pool, statePolicy, txBase, view, pcoinsTip->GetHeight() + 1,
+                                               LimitFreeFlag::ON, OverrideMempoolLimitFlag::OFF, nFees) ==
+                          MempoolReturnValue::VALID;
+        pindexTip = chainActive.Tip();
+
+        view.SetBackend(dummy);
+    }
+    if (!fAcceptable)
+        return true;
+
+    if (txBase.IsCertificate())
+    {
+        if (!CheckCertificate(dynamic_cast<const CScCertificate&>(txBase), state))
+            return error("%s(): CheckCertificate failed", __func__);
     }
+    else
+    {
+        auto verifier = libzcash::ProofVerifier::Strict();
+        if (!CheckTransaction(dynamic_cast<const CTransaction&>(txBase), state, verifier))
+            return error("%s(): CheckTransaction failed", __func__);
+    }
+    precheck.fContextFreeChecked = true;
+
+    // Failed scripts are reported by Accept*ToMemoryPool(): they may have failed only because of the tip
+    // (e.g. replay protection) which can have changed by then
+    if (pindexTip == nullptr)
+        return true;
+
+    CTipChain chain(pindexTip);
+    CValidationState stateScripts;
+    if (CheckTxBaseInputScripts(txBase, stateScripts, view, chain))
+        precheck.hashScriptsCheckedTip = pindexTip->GetBlockHash();
 
     return true;
 }
@@ -3087,11 +3628,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 #ifdef ENABLE_ADDRESS_INDEXING
         if (fAddressIndex)
         {
-            if (!pblocktree->UpdateAddressIndex(addressIndex))
+            if (!paddressindexdb->UpdateAddressIndex(addressIndex))
             {
                 return AbortNode(state, "Failed to update address index");
             }
-            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            if (!paddressindexdb->UpdateAddressUnspentIndex(addressUnspentIndex))
             {
                 return AbortNode(state, "Failed to write address unspent index");
             }
@@ -3099,7 +3640,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
         if (fSpentIndex)
         {
-            if (!pblocktree->UpdateSpentIndex(spentIndex))
+            if (!pspentindexdb->UpdateSpentIndex(spentIndex))
             {
                 return AbortNode(state, "Failed to write address spent index");
             }
@@ -3135,11 +3676,16 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckExecutor validationExecutor;
+
+void StartValidationThreads(boost::thread_group& threadGroup, int nThreads, bool fPinThreads)
+{
+    validationExecutor.Start(threadGroup, nThreads - 1, fPinThreads);
+}
 
-void ThreadScriptCheck() {
-    RenameThread("horizen-scriptch");
-    scriptcheckqueue.Thread();
+CCheckExecutor* GetValidationExecutor()
+{
+    return validationExecutor.GetWorkerCount() > 0 ? &validationExecutor : NULL;
 }
 
 //
@@ -3236,6 +3782,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         fScRelatedChecks = flagScRelatedChecks::OFF;
     }
 
+    // signatures of a connected block are erased from the cache, they will not be checked again;
+    // a check-only pass (e.g. of a block template) keeps them for the real connection
+    bool fCacheResults = (processingType == flagBlockProcessingType::CHECK_ONLY);
+
     bool fExpensiveChecks = true;
     if (fCheckpointsEnabled) {
         CBlockIndex *pindexLastCheckpoint = Checkpoints::GetLastCheckpoint(chainparams.Checkpoints());
@@ -3302,10 +3852,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
 
-    // Started enforcing CHECKBLOCKATHEIGHT from block.nVersion=4, that means for all the blocks
-    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT;
-
-    // DERSIG (BIP66) is also always enforced, but does not have a flag.
+    unsigned int flags = BLOCK_SCRIPT_VERIFY_FLAGS;
 
     IncludeScAttributes includeSc = IncludeScAttributes::ON;
 
@@ -3314,7 +3861,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo(includeSc);
 
-    CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // signature hash data of each transaction and certificate, used by their queued script checks: it must
+    // outlive control, whose destructor waits for them, and never be reallocated
+    std::vector<CPrecomputedTransactionData> vTxData;
+    vTxData.reserve(block.vtx.size() + block.vcert.size());
+
+    // keys of the signatures of the block, for the script checks verifying them together: it must outlive control too
+    CPubKeyCache pubkeyCache;
+    const bool fSigBatch = GetBoolArg("-sigbatch", DEFAULT_SIG_BATCH);
+
+    CCheckGroup<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? GetValidationExecutor() : NULL, SCRIPT_CHECK_BATCH_SIZE);
 
     int64_t deltaPreProcTime = GetTimeMicros() - nTime0;
     LogPrint("bench", "    - block preproc: %.2fms\n", 0.001 * deltaPreProcTime);
@@ -3445,9 +4001,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nFees += tx.GetFeeAmount(view.GetValueIn(tx));
 
             std::vector<CScriptCheck> vChecks;
-            if (!ContextualCheckTxInputs(tx, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
+            vTxData.emplace_back();
+            if (!ContextualCheckTxInputs(tx, state, view, fExpensiveChecks, chain, flags, fCacheResults, chainparams.GetConsensus(),
+                                         nScriptCheckThreads ? &vChecks : NULL, &vTxData.back()))
                 return false;
 
+            if (fSigBatch) {
+                for (CScriptCheck& check : vChecks)
+                    check.EnableBatchVerification(&pubkeyCache);
+            }
             control.Add(vChecks);
         }
 
@@ -3578,9 +4140,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         nFees += cert.GetFeeAmount(view.GetValueIn(cert));
 
         std::vector<CScriptCheck> vChecks;
-        if (!ContextualCheckCertInputs(cert, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
+        vTxData.emplace_back();
+        if (!ContextualCheckCertInputs(cert, state, view, fExpensiveChecks, chain, flags, fCacheResults, chainparams.GetConsensus(),
+                                       nScriptCheckThreads ? &vChecks : NULL, &vTxData.back()))
             return false;
 
+        if (fSigBatch) {
+            for (CScriptCheck& check : vChecks)
+                check.EnableBatchVerification(&pubkeyCache);
+        }
         control.Add(vChecks);
 
         CValidationState::Code ret_code = view.IsCertApplicableToState(cert);
@@ -3877,12 +4445,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 #ifdef ENABLE_ADDRESS_INDEXING
         if (fAddressIndex)
         {
-            if (!pblocktree->WriteAddressIndex(addressIndex))
+            if (!paddressindexdb->WriteAddressIndex(addressIndex))
             {
                 return AbortNode(state, "Failed to write address index");
             }
 
-            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            if (!paddressindexdb->UpdateAddressUnspentIndex(addressUnspentIndex))
             {
                 return AbortNode(state, "Failed to write address unspent index");
             }
@@ -3890,7 +4458,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         if (fSpentIndex)
         {
-            if (!pblocktree->UpdateSpentIndex(spentIndex))
+            if (!pspentindexdb->UpdateSpentIndex(spentIndex))
             {
                 return AbortNode(state, "Failed to write address spent index");
             }
@@ -3903,7 +4471,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             // retrieve logical timestamp of the previous block
             if (pindex->pprev)
-                if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+                if (!ptimestampindexdb->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
                     LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
 
             if (logicalTS <= prevLogicalTS)
@@ -3912,10 +4480,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
             }
 
-            if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
+            if (!ptimestampindexdb->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash()), pindex->nHeight))
                 return AbortNode(state, "Failed to write timestamp index");
 
-            if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
+            if (!ptimestampindexdb->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
                 return AbortNode(state, "Failed to write blockhash index");
         }
 #endif // ENABLE_ADDRESS_INDEXING
@@ -4015,6 +4583,15 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 vBlocks.push_back(*it);
                 setDirtyBlockIndex.erase(it++);
             }
+#ifdef ENABLE_ADDRESS_INDEXING
+            // The explorer indexes are written without syncing as blocks are connected, make them durable
+            // before the block index and the chainstate that refer to these blocks, so that they never lag behind.
+            if ((paddressindexdb && !paddressindexdb->Sync()) ||
+                (ptimestampindexdb && !ptimestampindexdb->Sync()) ||
+                (pspentindexdb && !pspentindexdb->Sync())) {
+                return AbortNode(state, "Failed to write to explorer index databases");
+            }
+#endif // ENABLE_ADDRESS_INDEXING
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Files to write to block index database");
             }
@@ -4083,11 +4660,105 @@ void static UpdateTip(CBlockIndex *pindexNew) {
     cvBlockChange.notify_all();
 }
 
-/** Disconnect chainActive's tip. */
-bool static DisconnectTip(CValidationState &state) {
+/**
+ * Blocks disconnected by a reorg, whose transactions and certificates go back to the mempool once
+ * all of them have been disconnected instead of after each one of them.
+ */
+struct CDisconnectedBlocks
+{
+    //! by increasing height, so that the parents are accepted before their children
+    std::deque<CBlock> blocks;
+    //! commitment tree roots the disconnected blocks have invalidated
+    std::set<uint256> invalidAnchors;
+    size_t nBytes = 0;
+};
+
+//! size of the disconnected blocks above which they are given back to the mempool before the reorg goes on
+static const size_t MAX_DISCONNECTED_BLOCKS_SIZE = 20 * 1000 * 1000;
+
+/**
+ * Give the transactions and certificates of the disconnected blocks back to the mempool, then remove
+ * the entries made invalid by the reorg, in one pass for all the blocks.
+ */
+static void UpdateMempoolForReorg(CDisconnectedBlocks& disconnected)
+{
+    AssertLockHeld(cs_main);
+    if (disconnected.blocks.empty())
+        return;
+    int64_t nStart = GetTimeMicros();
+
+    // the context-free checks, JoinSplit proofs included, were passed when the blocks were connected
+    CMempoolPreCheck precheck;
+    precheck.fContextFreeChecked = true;
+
+    // Resurrect mempool transactions and certificates from the disconnected blocks.
+    std::list<CTransaction> dummyTxs;
+    std::list<CScCertificate> dummyCerts;
+    for (const CBlock& block : disconnected.blocks) {
+        for(const CTransaction &tx: block.vtx) {
+            // ignore validation errors in resurrected transactions
+            CValidationState stateDummy;
+            if (tx.IsScVersion()) {
+                LogPrint("sc", "%s():%d - resurrecting tx [%s] to mempool\n", __func__, __LINE__, tx.GetHash().ToString());
+            }
+
+            if (tx.IsCoinBase() ||
+                MempoolReturnValue::VALID != AcceptTxToMemoryPool(mempool, stateDummy, tx,
+                        LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED,
+                        nullptr, OverrideMempoolLimitFlag::ON, &precheck))
+            {
+                LogPrint("sc", "%s():%d - removing tx [%s] from mempool\n[%s]\n",
+                    __func__, __LINE__, tx.GetHash().ToString(), tx.ToString());
+                mempool.remove(tx, dummyTxs, dummyCerts, true);
+            }
+        }
+
+        for (const CScCertificate& cert : block.vcert) {
+            // ignore validation errors in resurrected certificates
+            LogPrint("sc", "%s():%d - resurrecting certificate [%s] to mempool\n", __func__, __LINE__, cert.GetHash().ToString());
+            CValidationState stateDummy;
+            if (MempoolReturnValue::VALID != AcceptCertificateToMemoryPool(mempool, stateDummy, cert,
+                    LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED,
+                    nullptr, OverrideMempoolLimitFlag::ON, &precheck))
+            {
+                LogPrint("sc", "%s():%d - removing certificate [%s] from mempool\n[%s]\n",
+                    __func__, __LINE__, cert.GetHash().ToString(), cert.ToString());
+
+                mempool.remove(cert, dummyTxs, dummyCerts, true);
+            }
+        }
+    }
+
+    // the anchors may not change between block disconnects, in which case nothing is evicted for them
+    mempool.removeWithAnchors(disconnected.invalidAnchors);
+
+    // maturity and sidechain states depend on the height of the tip only: one pass for the whole reorg
+    dummyTxs.clear();
+    dummyCerts.clear();
+    mempool.removeStaleTransactions(pcoinsTip, dummyTxs, dummyCerts);
+    mempool.removeStaleCertificates(pcoinsTip, dummyCerts);
+
+    mempool.check(pcoinsTip);
+    LogPrint("bench", "- Mempool update for %u disconnected blocks: %.2fms\n",
+        disconnected.blocks.size(), (GetTimeMicros() - nStart) * 0.001);
+
+    disconnected.blocks.clear();
+    disconnected.invalidAnchors.clear();
+    disconnected.nBytes = 0;
+}
+
+/**
+ * Disconnect chainActive's tip. The block is added to disconnected, the caller gives its content back to the
+ * mempool with UpdateMempoolForReorg() once it is done disconnecting blocks.
+ */
+bool static DisconnectTip(CValidationState &state, CDisconnectedBlocks& disconnected) {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    mempool.check(pcoinsTip);
+    // the scripts found valid so far may check the hash of this block
+    ++nDisconnectedTips;
+    // while a reorg is in progress, the mempool may hold children of the entries of the blocks already disconnected
+    if (disconnected.blocks.empty())
+        mempool.check(pcoinsTip);
     // Read block from disk.
     CBlock block;
     if (!ReadBlockFromDisk(block, pindexDelete))
@@ -4108,52 +4779,16 @@ bool static DisconnectTip(CValidationState &state) {
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
 
-    // Resurrect mempool transactions and certificates from the disconnected block.
-    std::list<CTransaction> dummyTxs;
-    std::list<CScCertificate> dummyCerts;
-    for(const CTransaction &tx: block.vtx) {
-        // ignore validation errors in resurrected transactions
-        CValidationState stateDummy;
-        if (tx.IsScVersion()) {
-            LogPrint("sc", "%s():%d - resurrecting tx [%s] to mempool\n", __func__, __LINE__, tx.GetHash().ToString());
-        }
-
-        if (tx.IsCoinBase() ||
-            MempoolReturnValue::VALID != AcceptTxToMemoryPool(mempool, stateDummy, tx,
-                    LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED))
-        {
-            LogPrint("sc", "%s():%d - removing tx [%s] from mempool\n[%s]\n",
-                __func__, __LINE__, tx.GetHash().ToString(), tx.ToString());
-            mempool.remove(tx, dummyTxs, dummyCerts, true);
-        }
-    }
-
-    dummyTxs.clear();
-    dummyCerts.clear();
-    for (const CScCertificate& cert : block.vcert) {
-        // ignore validation errors in resurrected certificates
-        LogPrint("sc", "%s():%d - resurrecting certificate [%s] to mempool\n", __func__, __LINE__, cert.GetHash().ToString());
-        CValidationState stateDummy;
-        if (MempoolReturnValue::VALID != AcceptCertificateToMemoryPool(mempool, stateDummy, cert,
-                LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED))
-        {
-            LogPrint("sc", "%s():%d - removing certificate [%s] from mempool\n[%s]\n",
-                __func__, __LINE__, cert.GetHash().ToString(), cert.ToString());
-
-            mempool.remove(cert, dummyTxs, dummyCerts, true);
-        }
-    }
-
+    disconnected.nBytes += ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    disconnected.blocks.push_front(block);
     if (anchorBeforeDisconnect != anchorAfterDisconnect) {
         // The anchor may not change between block disconnects,
         // in which case we don't want to evict from the mempool yet!
-        mempool.removeWithAnchor(anchorBeforeDisconnect);
+        disconnected.invalidAnchors.insert(anchorBeforeDisconnect);
     }
+    if (disconnected.nBytes > MAX_DISCONNECTED_BLOCKS_SIZE)
+        UpdateMempoolForReorg(disconnected);
 
-    mempool.removeStaleTransactions(pcoinsTip, dummyTxs, dummyCerts);
-    mempool.removeStaleCertificates(pcoinsTip, dummyCerts);
-
-    mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
     // Get the current commitment tree
@@ -4371,13 +5006,18 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
     // Disconnect active blocks which are no longer in the best chain.
+    bool fBlocksDisconnected = false;
+    CDisconnectedBlocks disconnected;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork)
     {
-        if (!DisconnectTip(state))
+        if (!DisconnectTip(state, disconnected))
         {
+            UpdateMempoolForReorg(disconnected);
             return false;
         }
+        fBlocksDisconnected = true;
     }
+    UpdateMempoolForReorg(disconnected);
 
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
@@ -4425,6 +5065,10 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
         }
     }
 
+    // Entries resurrected from the disconnected blocks were allowed to exceed the mempool limit
+    if (fBlocksDisconnected)
+        LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+
     // Callbacks/notifications for a new best chain.
     if (fInvalidFound)
         CheckForkWarningConditionsOnNewFork(vpindexToConnect.back());
@@ -4526,6 +5170,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
+    CDisconnectedBlocks disconnected;
     while (chainActive.Contains(pindex)) {
         CBlockIndex *pindexWalk = chainActive.Tip();
         pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
@@ -4533,10 +5178,14 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
         setBlockIndexCandidates.erase(pindexWalk);
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state)) {
+        if (!DisconnectTip(state, disconnected)) {
+            UpdateMempoolForReorg(disconnected);
             return false;
         }
     }
+    UpdateMempoolForReorg(disconnected);
+
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -4922,7 +5571,7 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCheckPow fCheckPOW)
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCheckPow fCheckPOW, flagCheckEquihash fCheckEquihash)
 {
     // Check block version
     if (block.nVersion < MIN_BLOCK_VERSION)
@@ -4930,7 +5579,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCh
                          CValidationState::Code::INVALID, "version-invalid");
 
     // Check Equihash solution is valid
-    if (fCheckPOW == flagCheckPow::ON && !CheckEquihashSolution(&block, Params()))
+    if (fCheckPOW == flagCheckPow::ON && fCheckEquihash == flagCheckEquihash::ON && !CheckEquihashSolution(&block, Params()))
         return state.DoS(100, error("CheckBlockHeader(): Equihash solution invalid"),
                          CValidationState::Code::INVALID, "invalid-solution");
 
@@ -4956,7 +5605,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
     // Check the merkle root.
     if (fCheckMerkleRoot == flagCheckMerkleRoot::ON) {
         bool mutated;
-        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
+        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated, GetValidationExecutor());
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(100, error("CheckBlock(): hashMerkleRoot mismatch"),
                              CValidationState::Code::INVALID, "bad-txnmrklroot", true);
@@ -5184,7 +5833,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool lookForwardTips)
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool lookForwardTips,
+                       flagCheckEquihash fCheckEquihash)
 {
     dump_global_tips(10);
 
@@ -5208,7 +5858,7 @@ bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBloc
         return true;
     }
 
-    if (!CheckBlockHeader(block, state))
+    if (!CheckBlockHeader(block, state, flagCheckPow::ON, fCheckEquihash))
         return false;
 
     // Get prev block index
@@ -6391,6 +7041,100 @@ std::string GetWarnings(const std::string& strFor)
 //
 
 
+namespace {
+
+/** A transaction or certificate received from a peer, queued for ThreadMempoolAccept() */
+struct CPendingTxBase
+{
+    std::shared_ptr<const CTransactionBase> txBase;
+    //! referenced until the entry has been processed
+    CNode* pfrom;
+    BatchVerificationStateFlag proofVerificationState;
+};
+
+CWaitableCriticalSection csPendingTxBase;
+CConditionVariable cvPendingTxBase;
+std::deque<CPendingTxBase> queuePendingTxBase;
+//! hashes of the queued entries and of those being processed, so that one received from several peers is checked once
+std::set<uint256> setPendingTxBase;
+
+bool IsTxBasePending(const uint256& hash)
+{
+    boost::unique_lock<boost::mutex> lock(csPendingTxBase);
+    return setPendingTxBase.count(hash) != 0;
+}
+
+/** Hand a transaction or certificate over to ThreadMempoolAccept(), false if there is no room for it */
+bool QueuePendingTxBase(const std::shared_ptr<const CTransactionBase>& pTxBase, CNode* pfrom, BatchVerificationStateFlag proofVerificationState)
+{
+    if (nMempoolAcceptThreads == 0)
+        return false;
+
+    CPendingTxBase item;
+    item.txBase = pTxBase;
+    item.proofVerificationState = proofVerificationState;
+
+    {
+        boost::unique_lock<boost::mutex> lock(csPendingTxBase);
+        if (queuePendingTxBase.size() >= MAX_MEMPOOL_ACCEPT_QUEUE_SIZE)
+            return false;
+
+        {
+            LOCK(cs_vNodes);
+            item.pfrom = pfrom->AddRef();
+        }
+        setPendingTxBase.insert(pTxBase->GetHash());
+        queuePendingTxBase.push_back(item);
+    }
+    cvPendingTxBase.notify_one();
+    return true;
+}
+
+void ProcessPendingTxBase(const CPendingTxBase& item)
+{
+    const CTransactionBase& txBase = *item.txBase;
+    CValidationState state;
+    CMempoolPreCheck precheck;
+
+    // The expensive checks first, without any lock, then the acceptance itself holding cs_main
+    if (PreCheckTxBaseForMemoryPool(mempool, state, txBase, precheck))
+        ProcessTxBaseAcceptToMemoryPool(item.txBase, item.pfrom, item.proofVerificationState, state, &precheck);
+
+    if (state.IsInvalid())
+    {
+        LOCK(cs_main);
+        RejectMemoryPoolTxBase(state, txBase, item.pfrom);
+    }
+}
+
+} // anon namespace
+
+void ThreadMempoolAccept()
+{
+    while (true)
+    {
+        CPendingTxBase item;
+        {
+            boost::unique_lock<boost::mutex> lock(csPendingTxBase);
+            while (queuePendingTxBase.empty())
+                cvPendingTxBase.wait(lock);
+            item = queuePendingTxBase.front();
+            queuePendingTxBase.pop_front();
+        }
+
+        ProcessPendingTxBase(item);
+
+        {
+            boost::unique_lock<boost::mutex> lock(csPendingTxBase);
+            setPendingTxBase.erase(item.txBase->GetHash());
+        }
+        {
+            LOCK(cs_vNodes);
+            item.pfrom->Release();
+        }
+    }
+}
+
 bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     switch (inv.type)
@@ -6411,7 +7155,8 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoins(inv.hash);
+                   pcoinsTip->HaveCoins(inv.hash) ||
+                   IsTxBasePending(inv.hash);
         }
         case MSG_BLOCK:
         {
@@ -6562,38 +7307,30 @@ void static ProcessGetData(CNode* pfrom)
             }
             else if (inv.IsKnownType())
             {
-                // Send stream from relay memory
-                bool pushed = false;
+                // Send from relay memory, or else from the mempool, without copying the object
+                std::shared_ptr<const CTransactionBase> ptxBase;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
+                    map<CInv, std::shared_ptr<const CTransactionBase> >::iterator mi = mapRelay.find(inv);
+                    if (mi != mapRelay.end())
+                        ptxBase = mi->second;
                 }
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
+                if (!ptxBase && inv.type == MSG_TX)
+                    ptxBase = mempool.get(inv.hash);
+
+                bool pushed = false;
+                if (ptxBase) {
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    ss.reserve(1000);
+                    if (ptxBase->IsCertificate()) {
+                        ss << dynamic_cast<const CScCertificate&>(*ptxBase);
+                        LogPrint("cert", "%s():%d - pushing certificate\n", __func__, __LINE__);
+                    } else {
+                        ss << dynamic_cast<const CTransaction&>(*ptxBase);
                         LogPrint("cert", "%s():%d - pushing tx\n", __func__, __LINE__);
-                        pfrom->PushMessage("tx", ss);
-                        pushed = true;
-                    }
-                    else
-                    {
-                        CScCertificate cert;
-                        if (mempool.lookup(inv.hash, cert)) {
-                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                            ss.reserve(1000);
-                            ss << cert;
-                            LogPrint("cert", "%s():%d - pushing certificate\n", __func__, __LINE__);
-                            pfrom->PushMessage("tx", ss);
-                            pushed = true;
-                        }
                     }
+                    pfrom->PushMessage(inv.GetCommand(), ss);
+                    pushed = true;
                 }
                 if (!pushed) {
                     vNotFound.push_back(inv);
@@ -6667,14 +7404,22 @@ void ProcessMempoolMsg(const CTxMemPool& pool, CNode* pfrom)
     return;
 }
 
-void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfrom, BatchVerificationStateFlag proofVerificationState, CValidationState& state)
+void ProcessTxBaseAcceptToMemoryPool(const std::shared_ptr<const CTransactionBase>& pTxBase, CNode* pfrom,
+                                     BatchVerificationStateFlag proofVerificationState,
+                                     CValidationState& state, const CMempoolPreCheck* pPreCheck)
 {
+    const CTransactionBase& txBase = *pTxBase;
+
+    // Entries without a peer may have been reloaded from mempool.dat, their entry time is not needed anymore
+    // if they do not make it to the mempool after the proof verification
     if (proofVerificationState == BatchVerificationStateFlag::FAILED)
     {
         state.DoS(100, error("%s():%d - cert proof failed to verify", __func__, __LINE__),
                   CValidationState::Code::INVALID_PROOF, "bad-sc-cert-proof");
 
         RejectMemoryPoolTxBase(state, txBase, pfrom);
+        if (pfrom == nullptr)
+            mempool.EraseLoadedTime(txBase.GetHash());
 
         return;
     }
@@ -6684,11 +7429,16 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
     MempoolProofVerificationFlag verificationFlag = proofVerificationState == BatchVerificationStateFlag::NOT_VERIFIED_YET ?
                                                     MempoolProofVerificationFlag::ASYNC : MempoolProofVerificationFlag::DISABLED;
 
-    MempoolReturnValue res = AcceptTxBaseToMemoryPool(mempool, state, txBase,
+    MempoolReturnValue res = AcceptTxBaseToMemoryPool(mempool, state, pTxBase,
                                                       LimitFreeFlag::ON,
                                                       RejectAbsurdFeeFlag::OFF,
                                                       verificationFlag,
-                                                      pfrom);
+                                                      pfrom,
+                                                      OverrideMempoolLimitFlag::OFF,
+                                                      pPreCheck);
+
+    if (pfrom == nullptr && res != MempoolReturnValue::VALID && res != MempoolReturnValue::PARTIALLY_VALIDATED)
+        mempool.EraseLoadedTime(txBase.GetHash());
 
     if (res == MempoolReturnValue::VALID)
     {
@@ -6698,7 +7448,7 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
         std::vector<uint256> vEraseQueue;
 
         LogPrint("mempool", "%s(): peer=%d %s: accepted %s (poolsz %u)\n", __func__,
-            pfrom->id, pfrom->cleanSubVer,
+            pfrom ? pfrom->id : -1, pfrom ? pfrom->cleanSubVer : std::string(),
             txBase.GetHash().ToString(),
             mempool.size());
 
@@ -6711,7 +7461,8 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
                 continue;
             for (const uint256& orphanHash: itByPrev->second)
             {
-                const CTransactionBase& orphanTx = *mapOrphanTransactions[orphanHash].tx;
+                std::shared_ptr<const CTransactionBase> pOrphanTx = mapOrphanTransactions[orphanHash].tx;
+                const CTransactionBase& orphanTx = *pOrphanTx;
                 NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
                 bool fMissingInputs2 = false;
                 // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
@@ -6722,7 +7473,7 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
                 if (setMisbehaving.count(fromPeer))
                     continue;
 
-                MempoolReturnValue resOrphan = AcceptTxBaseToMemoryPool(mempool, stateDummy, orphanTx,
+                MempoolReturnValue resOrphan = AcceptTxBaseToMemoryPool(mempool, stateDummy, pOrphanTx,
                             LimitFreeFlag::ON,RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::ASYNC, pfrom);
                 if (resOrphan == MempoolReturnValue::VALID)
                 {
@@ -6759,9 +7510,10 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
             EraseOrphanTx(hash);
     }
     // TODO: currently, prohibit joinsplits from entering mapOrphans
-    else if (res == MempoolReturnValue::MISSING_INPUT && txBase.GetVjoinsplit().size() == 0)
+    // Entries without a peer (reloaded from mempool.dat) are not kept as orphans, LoadMempool retries them itself
+    else if (res == MempoolReturnValue::MISSING_INPUT && txBase.GetVjoinsplit().size() == 0 && pfrom != nullptr)
     {
-        AddOrphanTx(txBase, pfrom->GetId());
+        AddOrphanTx(pTxBase, pfrom->GetId());
 
         // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
         unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -6771,8 +7523,9 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
     }
 }
 
-void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
+void ProcessTxBaseMsg(const std::shared_ptr<const CTransactionBase>& pTxBase, CNode* pfrom)
 {
+    const CTransactionBase& txBase = *pTxBase;
     CInv inv(MSG_TX, txBase.GetHash());
     pfrom->AddInventoryKnown(inv);
 
@@ -6781,6 +7534,10 @@ void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
     pfrom->setAskFor.erase(inv.hash);
     mapAlreadyAskedFor.erase(inv);
 
+    // Already received from another peer and being checked meanwhile
+    if (IsTxBasePending(inv.hash))
+        return;
+
     MempoolReturnValue res = MempoolReturnValue::INVALID;
     CValidationState state;
 
@@ -6795,7 +7552,11 @@ void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
         }
         // CODE USED FOR UNIT TEST ONLY [End]
 
-        ProcessTxBaseAcceptToMemoryPool(txBase, pfrom, flag, state);
+        // Leave it to ThreadMempoolAccept(), unless it has too much to do already
+        if (QueuePendingTxBase(pTxBase, pfrom, flag))
+            return;
+
+        ProcessTxBaseAcceptToMemoryPool(pTxBase, pfrom, flag, state);
     }
     else
     {
@@ -7416,7 +8177,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         std::unique_ptr<CTransactionBase> pTxBase;
         ::makeSerializedTxObj(vRecv, txVers, pTxBase, nType, nVersion);
         if (pTxBase) {
-            ProcessTxBaseMsg(*pTxBase, pfrom);
+            // from here on shared, without copies, by the pending queue, the orphans and the mempool entry
+            ProcessTxBaseMsg(std::shared_ptr<const CTransactionBase>(std::move(pTxBase)), pfrom);
         } else {
             // This case should never happen. Consider that failing to read stream properly throws an exception
             // which is not handled here
@@ -7442,13 +8204,25 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
 
+        // Check the Equihash solutions of the new headers, the bulk of their validation, all at once
+        // on the validation threads and without cs_main. Known headers are not checked again, as block
+        // index entries are never removed, and the ones left unchecked after an invalid solution are
+        // fully checked as they are accepted.
+        std::vector<unsigned char> vSolutionChecked(nCount, false);
+        {
+            LOCK(cs_main);
+            for (unsigned int n = 0; n < nCount; n++)
+                vSolutionChecked[n] = mapBlockIndex.count(headers[n].GetHash()) != 0;
+        }
+        CheckEquihashSolutions(headers, Params(), GetValidationExecutor(), vSolutionChecked);
+
+        LOCK(cs_main);
+
         CBlockIndex *pindexLast = NULL;
         int cnt = 0;
         BOOST_FOREACH(const CBlockHeader& header, headers) {
@@ -7461,7 +8235,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             bool lookForwardTips = (++cnt == MAX_HEADERS_RESULTS);
              
-            if (!AcceptBlockHeader(header, state, &pindexLast, lookForwardTips))
+            flagCheckEquihash fCheckEquihash = vSolutionChecked[cnt - 1] ? flagCheckEquihash::OFF : flagCheckEquihash::ON;
+            if (!AcceptBlockHeader(header, state, &pindexLast, lookForwardTips, fCheckEquihash))
             {
                 if (state.IsInvalid())
                 {
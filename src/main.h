@@ -18,14 +18,17 @@
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "net.h"
 #include "script/script.h"
+#include "script/sigcache.h"
 #include "sync.h"
 #include "tinyformat.h"
 #include "txmempool.h"
 #include "uint256.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <map>
 #include <set>
@@ -43,12 +46,19 @@ class CCoinsView;
 class CBlock;
 class CBlockLocator;
 class CBlockTreeDB;
+#ifdef ENABLE_ADDRESS_INDEXING
+class CAddressIndexDB;
+class CTimestampIndexDB;
+class CSpentIndexDB;
+#endif // ENABLE_ADDRESS_INDEXING
 class CScriptCheck;
 class CValidationState;
 class CTxUndo;
 struct CNodeStateStats;
 class CTxInUndo;
 
+namespace boost { class thread_group; }
+
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
 static const unsigned int DEFAULT_BLOCK_MAX_SIZE = MAX_BLOCK_SIZE;
 static const unsigned int DEFAULT_BLOCK_MAX_SIZE_BEFORE_SC = MAX_BLOCK_SIZE_BEFORE_SC;
@@ -61,6 +71,9 @@ static const unsigned int DEFAULT_BLOCK_TX_PART_MAX_SIZE = BLOCK_TX_PARTITION_SI
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE = BLOCK_TX_PARTITION_SIZE / 2;
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE_BEFORE_SC = MAX_BLOCK_SIZE_BEFORE_SC / 2;
 
+/** Default for -blockancestorscore, select fee paying transactions together with their unconfirmed ancestors **/
+static const bool DEFAULT_BLOCK_ANCESTOR_SCORE = true;
+
 /** Default for -blockmaxcomplexity, which control the maximum comlexity of the block during template creation **/
 static const unsigned int DEFAULT_BLOCK_MAX_COMPLEXITY_SIZE = 0;
 /** Default for accepting alerts from the P2P network. */
@@ -75,6 +88,16 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -persistmempool, whether the mempool is saved on shutdown and reloaded on startup */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempoolacceptthreads, the threads checking the transactions and certificates received from peers */
+static const int DEFAULT_MEMPOOL_ACCEPT_THREADS = 2;
+/** Maximum number of -mempoolacceptthreads */
+static const int MAX_MEMPOOL_ACCEPT_THREADS = 16;
+/** Received transactions and certificates queued for these threads, beyond which the message handler checks them */
+static const size_t MAX_MEMPOOL_ACCEPT_QUEUE_SIZE = 5000;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -82,9 +105,15 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parpin default, whether the script-checking threads are pinned to CPUs */
+static const bool DEFAULT_PIN_SCRIPTCHECK_THREADS = false;
+/** Largest number of script checks run as one task by the validation threads */
+static const unsigned int SCRIPT_CHECK_BATCH_SIZE = 16;
+/** -sigbatch default, whether the signatures of the script checks of a task are verified together, after their scripts */
+static const bool DEFAULT_SIG_BATCH = true;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -145,10 +174,14 @@ extern bool fExperimentalMode;
 extern bool fImporting;
 extern bool fReindex;
 extern bool fReindexFast;
+//! whether mempool.dat has been loaded at startup, so that an interrupted load does not get it overwritten
+extern std::atomic<bool> fMempoolLoaded;
 extern int nScriptCheckThreads;
+extern int nMempoolAcceptThreads;
 
 #ifdef ENABLE_ADDRESS_INDEXING
 extern bool fAddressIndex;
+extern bool fTimestampIndex;
 extern bool fSpentIndex;
 #endif // ENABLE_ADDRESS_INDEXING
 
@@ -266,12 +299,19 @@ enum class BatchVerificationStateFlag
     FAILED              /**< The sidechain proof has been rejected. */
 };
 
-/** Process a transaction or certificate that has to be added to memory pool */
-void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfrom,
+struct CMempoolPreCheck;
+
+/** Process a transaction or certificate that has to be added to memory pool, which then shares pTxBase */
+void ProcessTxBaseAcceptToMemoryPool(const std::shared_ptr<const CTransactionBase>& pTxBase, CNode* pfrom,
                                      BatchVerificationStateFlag proofVerificationState,
-                                     CValidationState& state);
+                                     CValidationState& state, const CMempoolPreCheck* pPreCheck = nullptr);
+/**
+ * Check the transactions and certificates queued by ProcessTxBaseMsg(), the first phase of their acceptance
+ * running without cs_main. There are -mempoolacceptthreads of them.
+ */
+void ThreadMempoolAccept();
 /** Process protocol message of type "tx" */
-void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom);
+void ProcessTxBaseMsg(const std::shared_ptr<const CTransactionBase>& pTxBase, CNode* pfrom);
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom);
 /**
@@ -281,8 +321,10 @@ bool ProcessMessages(CNode* pfrom);
  * @param[in]   fSendTrickle    When true send the trickled data, otherwise trickle the data until true.
  */
 bool SendMessages(CNode* pto, bool fSendTrickle);
-/** Run an instance of the script checking thread */
-void ThreadScriptCheck();
+/** Start the nThreads - 1 threads running validation checks along with the one connecting blocks */
+void StartValidationThreads(boost::thread_group& threadGroup, int nThreads, bool fPinThreads);
+/** Executor of the checks run in parallel by validation, NULL without validation threads */
+CCheckExecutor* GetValidationExecutor();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -352,6 +394,8 @@ void PruneAndFlush();
 // Accept Tx/Cert ToMempool parameters types and signature
 enum class LimitFreeFlag       { ON, OFF };
 enum class RejectAbsurdFeeFlag { ON, OFF };
+//! ON only when resurrecting the entries of disconnected blocks, which may temporarily exceed -maxmempool
+enum class OverrideMempoolLimitFlag { ON, OFF };
 enum class MempoolReturnValue { INVALID, MISSING_INPUT, VALID, PARTIALLY_VALIDATED };
 
 /**
@@ -377,15 +421,75 @@ enum class MempoolProofVerificationFlag
  */
 void RejectMemoryPoolTxBase(const CValidationState& state, const CTransactionBase& txBase, CNode* pfrom);
 
+/**
+ * What PreCheckTxBaseForMemoryPool() verified of a transaction or certificate, so that the Accept*ToMemoryPool()
+ * call that follows does not do it again
+ */
+struct CMempoolPreCheck
+{
+    //! the context-free checks passed, the JoinSplit proofs included
+    bool fContextFreeChecked = false;
+    //! the input scripts passed against the chain ending at this block, null if they were not checked
+    uint256 hashScriptsCheckedTip;
+};
+
+/**
+ * First phase of the acceptance to the memory pool, which can run on several threads at once: the context-free
+ * checks, then the input scripts against a copy of the inputs taken holding cs_main and pool.cs only while copying.
+ * Both are skipped for the entries that the cheap policy, conflict and fee checks of Accept*ToMemoryPool() reject.
+ * Returns false if the entry is invalid whatever the context. Everything else, including the reason why the
+ * scripts could not be checked, is left to Accept*ToMemoryPool() holding the locks, which must follow.
+ */
+bool PreCheckTxBaseForMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionBase& txBase,
+                                 CMempoolPreCheck& precheck);
+
+/** Check the input scripts with the standard and then the mandatory flags, caching the valid signatures */
+bool CheckTxBaseInputScripts(const CTransactionBase& txBase, CValidationState& state, const CCoinsViewCache& inputs,
+                             const CChain& chain);
+
+/** Evict entries from the mempool until it fits in -maxmempool, syncing the removed ones with the wallets */
+void LimitMempoolSize(CTxMemPool& pool, size_t limit);
+
+/** Write the mempool entries, their entry times and the prioritisation deltas to mempool.dat */
+bool DumpMempool();
+
+/** Accept again the entries of mempool.dat, the proofs going through the asynchronous verifier */
+bool LoadMempool();
+
 /** (try to) add transaction to memory pool **/
 MempoolReturnValue AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionBase &txBase,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr);
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit = OverrideMempoolLimitFlag::OFF,
+    const CMempoolPreCheck* pPreCheck = nullptr);
 
 MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr);
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit = OverrideMempoolLimitFlag::OFF,
+    const CMempoolPreCheck* pPreCheck = nullptr);
 
 MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr);
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit = OverrideMempoolLimitFlag::OFF,
+    const CMempoolPreCheck* pPreCheck = nullptr);
+
+/**
+ * Same as above for an object the caller already shares: the mempool entry shares it too, while the overloads
+ * above copy theirs first.
+ */
+MempoolReturnValue AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const std::shared_ptr<const CTransactionBase> &pTxBase,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit = OverrideMempoolLimitFlag::OFF,
+    const CMempoolPreCheck* pPreCheck = nullptr);
+
+MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit = OverrideMempoolLimitFlag::OFF,
+    const CMempoolPreCheck* pPreCheck = nullptr);
+
+MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificateRef &pcert,
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    OverrideMempoolLimitFlag fOverrideMempoolLimit = OverrideMempoolLimitFlag::OFF,
+    const CMempoolPreCheck* pPreCheck = nullptr);
 
 struct CNodeStateStats {
     int nMisbehavior;
@@ -440,26 +544,35 @@ unsigned int GetP2SHSigOpCount(const CTransactionBase& tx, const CCoinsViewCache
 /**
  * Check whether the specified input (either regular or CSW) of this transaction has valid scripts & sigs.
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. txdata, if given, must have been initialized with tx.
  */
 bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, unsigned int nIn,
-                      const CChain& chain, unsigned int flags, bool cache,  CValidationState &state, std::vector<CScriptCheck> *pvChecks);
+                      const CChain& chain, unsigned int flags, bool cache,  CValidationState &state, std::vector<CScriptCheck> *pvChecks,
+                      const CPrecomputedTransactionData* txdata = nullptr);
 /**
  * Check whether all inputs (either regular and CSW) of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. In that case they use txdata, if given, which is initialized
+ * here for transactions with several inputs and must outlive them; inline checks use their own.
  */
 bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
                            const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams,
-                           std::vector<CScriptCheck> *pvChecks = NULL);
+                           std::vector<CScriptCheck> *pvChecks = NULL, CPrecomputedTransactionData* txdata = NULL);
 /**
  * Check whether all inputs of this certificates are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline, with txdata as in ContextualCheckTxInputs().
  */
 bool ContextualCheckCertInputs(const CScCertificate& cert, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
                            const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams,
-                           std::vector<CScriptCheck> *pvChecks = NULL);
+                           std::vector<CScriptCheck> *pvChecks = NULL, CPrecomputedTransactionData* txdata = NULL);
+
+/**
+ * Size the cache of the transactions and certificates whose scripts were all found valid, consulted by the two
+ * functions above when checking against chainActive with BLOCK_SCRIPT_VERIFY_FLAGS. It takes half of -maxsigcachemem.
+ */
+void InitScriptExecutionCache();
+CSignatureCacheStats GetScriptExecutionCacheStats();
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out);
@@ -509,18 +622,36 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    //! shared by the checks of all inputs of ptxTo, may be null
+    const CPrecomputedTransactionData *txdata;
+    //! keys of the block, to verify the signatures of the check after its script if set
+    CPubKeyCache *ppubkeyCache;
 
 public:
     CScriptCheck();
-    CScriptCheck(const CCoins& txFromIn, const CTransactionBase& txToIn, unsigned int nInIn, const CChain* chainIn, unsigned int nFlagsIn, bool cacheIn);
-    CScriptCheck(const CScript& scriptPubKeyIn, const CTransactionBase& txToIn, unsigned int nInIn, const CChain* chainIn, unsigned int nFlagsIn, bool cacheIn);
+    CScriptCheck(const CCoins& txFromIn, const CTransactionBase& txToIn, unsigned int nInIn, const CChain* chainIn, unsigned int nFlagsIn, bool cacheIn,
+                 const CPrecomputedTransactionData* txdataIn = nullptr);
+    CScriptCheck(const CScript& scriptPubKeyIn, const CTransactionBase& txToIn, unsigned int nInIn, const CChain* chainIn, unsigned int nFlagsIn, bool cacheIn,
+                 const CPrecomputedTransactionData* txdataIn = nullptr);
     bool operator()();
     void swap(CScriptCheck &check);
     ScriptError GetScriptError() const;
+
+    //! Let RunCheckBatch defer the verification of the signatures to pubkeyCache, which must outlive the check
+    void EnableBatchVerification(CPubKeyCache* ppubkeyCacheIn) { ppubkeyCache = ppubkeyCacheIn; }
+    CPubKeyCache* GetPubKeyCache() const { return ppubkeyCache; }
+    //! Run the script assuming that the signatures not in the cache are valid, adding them to batch instead
+    bool RunDeferred(CSignatureBatch& batch);
 };
 
+/**
+ * Run the scripts of the checks first, then verify their signatures with the keys parsed
+ * once per block; a check whose signatures are not all valid runs again the usual way.
+ */
+template <>
+bool RunCheckBatch(std::vector<CScriptCheck>& vChecks, const std::atomic<bool>& fContinue);
+
 #ifdef ENABLE_ADDRESS_INDEXING
-bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
@@ -554,6 +685,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
 enum class flagCheckPow             { ON, OFF };
+enum class flagCheckEquihash        { ON, OFF };
 enum class flagCheckMerkleRoot      { ON, OFF };
 enum class flagScRelatedChecks      { ON, OFF };
 enum class flagScProofVerification  { ON, OFF };
@@ -579,7 +711,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false);
 
 /** Context-independent validity checks */
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCheckPow fCheckPOW = flagCheckPow::ON);
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCheckPow fCheckPOW = flagCheckPow::ON,
+                      flagCheckEquihash fCheckEquihash = flagCheckEquihash::ON);
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
                 flagCheckPow fCheckPOW = flagCheckPow::ON,
@@ -601,7 +734,9 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
  * If dbp is non-NULL, the file is known to already reside on disk
  */
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex **pindex, bool fRequested, CDiskBlockPos* dbp, BlockSet* sForkTips = NULL);
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool lookForwardTips = false);
+/** With fCheckEquihash OFF, the Equihash solution of the header must have been checked already */
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool lookForwardTips = false,
+                       flagCheckEquihash fCheckEquihash = flagCheckEquihash::ON);
 
 
 class CBlockFileInfo
@@ -684,6 +819,13 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+#ifdef ENABLE_ADDRESS_INDEXING
+/** Explorer index databases, each in its own LevelDB instance */
+extern CAddressIndexDB *paddressindexdb;
+extern CTimestampIndexDB *ptimestampindexdb;
+extern CSpentIndexDB *pspentindexdb;
+#endif // ENABLE_ADDRESS_INDEXING
+
 /**
  * Check if the output nIn is CF Reward
  */
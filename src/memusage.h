@@ -5,6 +5,8 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include "prevector.h"
+
 #include <stdlib.h>
 
 #include <map>
@@ -74,6 +76,13 @@ static inline size_t DynamicUsage(const std::vector<X>& v)
     return MallocUsage(v.capacity() * sizeof(X));
 }
 
+template<unsigned int N, typename X, typename S, typename D>
+static inline size_t DynamicUsage(const prevector<N, X, S, D>& v)
+{
+    // nothing is allocated while the elements are inline
+    return v.allocated_memory() ? MallocUsage(v.allocated_memory()) : 0;
+}
+
 template<typename X>
 static inline size_t DynamicUsage(const std::list<X>& l)
 {
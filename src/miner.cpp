@@ -57,6 +57,11 @@ uint64_t nLastBlockCert = 0;
 uint64_t nLastBlockSize = 0;
 uint64_t nLastBlockTxPartitionSize = 0;
 
+// Stop the package selection after this many packages in a row that could not be added...
+static const unsigned int MAX_CONSECUTIVE_PACKAGE_FAILURES = 1000;
+// ... once the tx partition is this close to being full
+static const unsigned int PACKAGE_FAILURES_PARTITION_MARGIN = 4000;
+
 bool TxPriorityCompare::operator()(const TxPriority& a, const TxPriority& b)
 {
     // first of all, if we are comparing two certs, we must be sure they are ordered by
@@ -349,43 +354,54 @@ void GetBlockCertPriorityData(const CCoinsViewCache& view, int nHeight,
     }
 }
 
-void GetBlockTxPriorityData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
-                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
+static void AddTxPriorityData(const CTxMemPoolEntry& mpEntry, const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
+                              vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
 {
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
-    {
-        const CTransaction& tx = mi->second.GetTx();
+    const CTransaction& tx = mpEntry.GetTx();
 
-        if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff))
-            continue;
+    if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff))
+        return;
 
-        CAmount nTotalIn = 0;
-        COrphan* porphan = nullptr;
+    CAmount nTotalIn = 0;
+    COrphan* porphan = nullptr;
 
-        if (!GetInputsDependencies(tx, nTotalIn, vOrphan, mapDependers, porphan) )
-        {
-            if (porphan)
-                vOrphan.pop_back();
-            continue;
-        }
+    if (!GetInputsDependencies(tx, nTotalIn, vOrphan, mapDependers, porphan) )
+    {
+        if (porphan)
+            vOrphan.pop_back();
+        return;
+    }
 
-        if (!VerifySidechainTxDependencies(tx, view, vOrphan, mapDependers, porphan) )
-        {
-            if (porphan)
-                vOrphan.pop_back();
-            continue;
-        }
+    if (!VerifySidechainTxDependencies(tx, view, vOrphan, mapDependers, porphan) )
+    {
+        if (porphan)
+            vOrphan.pop_back();
+        return;
+    }
 
-        const CMemPoolEntry& mpEntry = mi->second;
-        if (!AddToPriorities(tx, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
-        {
-            if (porphan)
-                vOrphan.pop_back();
-            continue;
-        }
+    if (!AddToPriorities(tx, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
+    {
+        if (porphan)
+            vOrphan.pop_back();
+        return;
     }
 }
 
+void GetBlockTxPriorityData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
+                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
+{
+    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        AddTxPriorityData(mi->second, view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
+}
+
+void GetBlockHighPriorityTxData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
+                                vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
+{
+    for (auto it = mempool.setTxByHeightAllowingFree.begin();
+         it != mempool.setTxByHeightAllowingFree.end() && it->first <= (unsigned int)nHeight; ++it)
+        AddTxPriorityData(mempool.mapTx.at(it->second), view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
+}
+
 void GetBlockTxPriorityDataOld(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
                                vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
 {
@@ -602,10 +618,20 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 : pblock->GetBlockTime();
 
         bool fDeprecatedGetBlockTemplate = GetBoolArg("-deprecatedgetblocktemplate", false);
+        bool fSortedByFee = (nBlockPrioritySize <= 0);
+
+        // Past the high-priority area, transactions are selected along with their unconfirmed ancestors
+        // by the fee rate of the whole package instead of one by one by their own fee rate
+        bool fAncestorScore = !fDeprecatedGetBlockTemplate && GetBoolArg("-blockancestorscore", DEFAULT_BLOCK_ANCESTOR_SCORE);
+        bool fPackagesSelected = false;
+
         if (fDeprecatedGetBlockTemplate)
             GetBlockTxPriorityDataOld(view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
-        else
+        else if (!fAncestorScore)
             GetBlockTxPriorityData(view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
+        else if (!fSortedByFee)
+            // only the candidates for the high-priority area, the packages are read from the mempool index later
+            GetBlockHighPriorityTxData(view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
 
         GetBlockCertPriorityData(view, nHeight, vecPriority, vOrphan, mapDependers);
 
@@ -616,91 +642,38 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
         uint64_t nBlockTx = 0;
         uint64_t nBlockCert = 0;
         int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
+
+        // transactions and certificates added to the block so far
+        std::set<uint256> setInBlock;
 
         TxPriorityCompare comparer(fSortedByFee);
         std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
-        // considering certs having a higher priority than any possible tx.
-        // An algorithm for managing tx/cert priorities could be devised
-        while (!vecPriority.empty())
+        // Checks tx against the remaining block limits and its inputs in txView, then adds it to the block
+        auto addToBlock = [&](const CTransactionBase& tx, CCoinsViewCache& txView, double dPriority, const CFeeRate& feeRate) -> bool
         {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransactionBase& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxBaseSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-
-            if (!tx.IsCertificate())
-            {
-                // only a portion of the block can have ordinary transactions, we can not exceed this size
-                if (nBlockTxPartitionSize + nTxBaseSize >= nBlockTxPartitionMaxSize)
-                {
-                    LogPrint("sc", "%s():%d - Skipping tx[%s] because nBlockTxPartitionMaxSize %d would be exceeded (partSize=%d / txSize=%d)\n",
-                        __func__, __LINE__, tx.GetHash().ToString(), nBlockTxPartitionMaxSize, nBlockTxPartitionSize, nTxBaseSize );
-                    continue;
-                }
-            }
-
-            if (nBlockSize + nTxBaseSize >= nBlockMaxSize)
-            {
-                LogPrint("sc", "%s():%d - Skipping %s[%s] because nBlockMaxSize %d would be exceeded (blSize=%d / txBaseSize=%d)\n",
-                    __func__, __LINE__, tx.IsCertificate()?"cert":"tx", tx.GetHash().ToString(), nBlockMaxSize, nBlockSize, nTxBaseSize );
-                continue;
-            }
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
             const uint256& hash = tx.GetHash();
-
-            // Skip free transactions / certificates if we're past the minimum block size:
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxBaseSize >= nBlockMinSize))
-            {
-                LogPrint("sc", "%s():%d - Skipping [%s] because it is free (feeDelta=%lld/feeRate=%s, blsz=%u/txsz=%u/blminsz=%u)\n",
-                    __func__, __LINE__, tx.GetHash().ToString(), nFeeDelta, feeRate.ToString(), nBlockSize, nTxBaseSize, nBlockMinSize );
-                continue;
-            }
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxBaseSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
-            {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
+            unsigned int nTxBaseSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
 
             // Skip transaction if max block complexity reached.
             int nTxComplexity = tx.GetComplexity();
             if (!fDeprecatedGetBlockTemplate && nBlockMaxComplexitySize > 0 && nBlockComplexity + nTxComplexity >= nBlockMaxComplexitySize)
-                continue;
+                return false;
 
-            if (!view.HaveInputs(tx))
+            if (!txView.HaveInputs(tx))
             {
                 LogPrint("sc", "%s():%d - Skipping [%s] because it has no inputs\n",
                     __func__, __LINE__, tx.GetHash().ToString() );
-                continue;
+                return false;
             }
 
-            CAmount nTxFees = tx.GetFeeAmount(view.GetValueIn(tx));
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
+            CAmount nTxFees = tx.GetFeeAmount(txView.GetValueIn(tx));
+            unsigned int nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, txView);
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
             {
                 LogPrint("sc", "%s():%d - Skipping [%s] because too many sigops in block\n",
                     __func__, __LINE__, tx.GetHash().ToString() );
-                continue;
+                return false;
             }
 
             try {
@@ -713,10 +686,10 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 if (tx.IsCertificate())
                 {
                     const CScCertificate& castedCert = dynamic_cast<const CScCertificate&>(tx);
-                    if(!ContextualCheckCertInputs(castedCert, dummyState, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
-                        continue;
+                    if(!ContextualCheckCertInputs(castedCert, dummyState, txView, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+                        return false;
 
-                    UpdateCoins(castedCert, view, dummyUndo, nHeight, /*isBlockTopQualityCert*/true);
+                    UpdateCoins(castedCert, txView, dummyUndo, nHeight, /*isBlockTopQualityCert*/true);
                     pblock->vcert.push_back(castedCert);
                     pblocktemplate.get()->vCertFees.push_back(nTxFees);
                     pblocktemplate.get()->vCertSigOps.push_back(nTxSigOps);
@@ -724,10 +697,10 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 } else
                 {
                     const CTransaction& castedTx = dynamic_cast<const CTransaction&>(tx);
-                    if (!ContextualCheckTxInputs(castedTx, dummyState, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
-                        continue;
+                    if (!ContextualCheckTxInputs(castedTx, dummyState, txView, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+                        return false;
 
-                    UpdateCoins(castedTx, view, dummyUndo, nHeight);
+                    UpdateCoins(castedTx, txView, dummyUndo, nHeight);
                     pblock->vtx.push_back(castedTx);
                     pblocktemplate.get()->vTxFees.push_back(nTxFees);
                     pblocktemplate.get()->vTxSigOps.push_back(nTxSigOps);
@@ -755,7 +728,13 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 assert("could not cast txbase obj" == 0);
             }
 
-            // Add transactions that depend on this one to the priority queue
+            setInBlock.insert(hash);
+            return true;
+        };
+
+        // Add transactions that depend on this one to the priority queue
+        auto releaseDependers = [&](const uint256& hash)
+        {
             if (mapDependers.count(hash))
             {
                 LogPrint("sc", "%s():%d - tx[%s] has %d orphans\n",
@@ -770,7 +749,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                         {
                             LogPrint("sc", "%s():%d - tx[%s] resolved all dependencies, adding to prio vec, prio=%f, feeRate=%s\n",
                                 __func__, __LINE__, porphan->ptx->GetHash().ToString(), porphan->dPriority, porphan->feeRate.ToString());
-                            
+
                             vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
                             std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
                         }
@@ -781,6 +760,281 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                     }
                 }
             }
+        };
+
+        // Fills the rest of the tx partition with the packages of highest ancestor score, i.e. the fee rate of a
+        // transaction together with its ancestors not yet in the block, reading the mempool index by ancestor score
+        // only until the partition is full. Certificates in the mempool never have transaction descendants, hence
+        // they are left to the priority queue.
+        auto addPackagesByAncestorScore = [&]()
+        {
+            // transactions with ancestors in the block, whose score is better than the one in the mempool index
+            std::map<uint256, CAncestorScoreKey> mapModified;
+            std::set<CAncestorScoreKey> setModified;
+            // transactions which cannot be mined, and neither can their descendants
+            std::set<uint256> setFailed;
+
+            auto removeFromPackages = [&](const uint256& hash)
+            {
+                const CMemPoolEntry& entry = *mempool.getEntry(hash);
+                for(const uint256& descendant: mempool.mempoolDependenciesOf(entry.GetTxBase()))
+                {
+                    if (setInBlock.count(descendant) || setFailed.count(descendant) || mempool.mapTx.count(descendant) == 0)
+                        continue;
+
+                    std::map<uint256, CAncestorScoreKey>::iterator it = mapModified.find(descendant);
+                    if (it == mapModified.end())
+                        it = mapModified.insert(std::make_pair(descendant, CAncestorScoreKey(mempool.mapTx.at(descendant)))).first;
+                    else
+                        setModified.erase(it->second);
+
+                    it->second.nModFeesWithAncestors -= entry.GetModifiedFee();
+                    it->second.nSizeWithAncestors -= entry.GetSize();
+                    setModified.insert(it->second);
+                }
+            };
+
+            // the transactions included by priority are no longer part of the packages
+            for(const uint256& hash: setInBlock)
+                removeFromPackages(hash);
+
+            // the checks done by GetBlockTxPriorityData, for the transactions actually considered
+            std::map<uint256, bool> mapMinable;
+            auto isMinable = [&](const CTransaction& tx) -> bool
+            {
+                std::map<uint256, bool>::const_iterator it = mapMinable.find(tx.GetHash());
+                if (it != mapMinable.end())
+                    return it->second;
+
+                // dependencies are handled by the package itself, the orphans bookkeeping is not needed
+                list<COrphan> vUnusedOrphan;
+                map<uint256, vector<COrphan*> > mapUnusedDependers;
+                COrphan* porphan = nullptr;
+                CAmount nTotalIn = 0;
+                bool fMinable = !tx.IsCoinBase() && IsFinalTx(tx, nHeight, nLockTimeCutoff) &&
+                                GetInputsDependencies(tx, nTotalIn, vUnusedOrphan, mapUnusedDependers, porphan) &&
+                                VerifySidechainTxDependencies(tx, view, vUnusedOrphan, mapUnusedDependers, porphan);
+                mapMinable[tx.GetHash()] = fMinable;
+                return fMinable;
+            };
+
+            std::set<CAncestorScoreKey>::const_iterator mi = mempool.setTxByAncestorScore.begin();
+            unsigned int nConsecutiveFailed = 0;
+            while (mi != mempool.setTxByAncestorScore.end() || !setModified.empty())
+            {
+                // skip the index entries superseded by mapModified, or already dealt with
+                if (mi != mempool.setTxByAncestorScore.end() &&
+                    (setInBlock.count(mi->hash) || mapModified.count(mi->hash) || setFailed.count(mi->hash)))
+                {
+                    ++mi;
+                    continue;
+                }
+
+                bool fUsingModified = (mi == mempool.setTxByAncestorScore.end() ||
+                                       (!setModified.empty() && *setModified.begin() < *mi));
+                const CAncestorScoreKey package = fUsingModified ? *setModified.begin() : *mi;
+                if (fUsingModified)
+                    setModified.erase(setModified.begin()); // back in if some more ancestors get in the block
+                else
+                    ++mi;
+
+                // packages come by decreasing score: none of the remaining ones pays the relay fee
+                if (package.GetFeeRate() < ::minRelayTxFee && nBlockSize + package.nSizeWithAncestors >= nBlockMinSize)
+                {
+                    LogPrint("sc", "%s():%d - Stopping at package of [%s] because it is free (feeRate=%s, blsz=%u/pkgsz=%u/blminsz=%u)\n",
+                        __func__, __LINE__, package.hash.ToString(), package.GetFeeRate().ToString(), nBlockSize, package.nSizeWithAncestors, nBlockMinSize);
+                    break;
+                }
+
+                if (nBlockTxPartitionSize + package.nSizeWithAncestors >= nBlockTxPartitionMaxSize ||
+                    nBlockSize + package.nSizeWithAncestors >= nBlockMaxSize)
+                {
+                    LogPrint("sc", "%s():%d - Skipping package of [%s] because block limits would be exceeded (partSize=%d / blSize=%d / pkgSize=%d)\n",
+                        __func__, __LINE__, package.hash.ToString(), nBlockTxPartitionSize, nBlockSize, package.nSizeWithAncestors);
+
+                    // give up when the partition is almost full and nothing fits anymore
+                    if (++nConsecutiveFailed > MAX_CONSECUTIVE_PACKAGE_FAILURES &&
+                        nBlockTxPartitionSize + PACKAGE_FAILURES_PARTITION_MARGIN > nBlockTxPartitionMaxSize)
+                        break;
+                    continue;
+                }
+
+                // the package: the candidate and its ancestors not yet in the block, parents first
+                const CTxMemPoolEntry& candidateEntry = mempool.mapTx.at(package.hash);
+                std::vector<const CTxMemPoolEntry*> vPackage(1, &candidateEntry);
+                bool fMinable = isMinable(candidateEntry.GetTx());
+                for(const uint256& ancestor: mempool.mempoolDependenciesFrom(candidateEntry.GetTx()))
+                {
+                    if (!fMinable)
+                        break;
+                    if (setInBlock.count(ancestor))
+                        continue;
+
+                    std::map<uint256, CTxMemPoolEntry>::const_iterator itAncestor = mempool.mapTx.find(ancestor);
+                    fMinable = itAncestor != mempool.mapTx.end() && setFailed.count(ancestor) == 0 &&
+                               isMinable(itAncestor->second.GetTx());
+                    if (fMinable)
+                        vPackage.push_back(&itAncestor->second);
+                }
+                if (!fMinable)
+                {
+                    setFailed.insert(package.hash);
+                    continue;
+                }
+                std::sort(vPackage.begin(), vPackage.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+                    return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+                });
+
+                // the package is added as a whole or not at all
+                const size_t nTxCountBefore = pblock->vtx.size();
+                const uint64_t nBlockSizeBefore = nBlockSize;
+                const uint64_t nBlockTxPartitionSizeBefore = nBlockTxPartitionSize;
+                const uint64_t nBlockTxBefore = nBlockTx;
+                const int nBlockSigOpsBefore = nBlockSigOps;
+                const CAmount nFeesBefore = nFees;
+                const int nBlockComplexityBefore = nBlockComplexity;
+
+                CCoinsViewCache packageView(&view);
+                const CTxMemPoolEntry* pFailed = nullptr;
+                for(const CTxMemPoolEntry* pEntry: vPackage)
+                {
+                    if (!addToBlock(pEntry->GetTx(), packageView, pEntry->GetPriority(nHeight), package.GetFeeRate()))
+                    {
+                        pFailed = pEntry;
+                        break;
+                    }
+                }
+
+                if (pFailed != nullptr)
+                {
+                    for(size_t i = nTxCountBefore; i < pblock->vtx.size(); ++i)
+                        setInBlock.erase(pblock->vtx[i].GetHash());
+                    pblock->vtx.resize(nTxCountBefore);
+                    pblocktemplate->vTxFees.resize(nTxCountBefore);
+                    pblocktemplate->vTxSigOps.resize(nTxCountBefore);
+                    nBlockSize = nBlockSizeBefore;
+                    nBlockTxPartitionSize = nBlockTxPartitionSizeBefore;
+                    nBlockTx = nBlockTxBefore;
+                    nBlockSigOps = nBlockSigOpsBefore;
+                    nFees = nFeesBefore;
+                    nBlockComplexity = nBlockComplexityBefore;
+
+                    // limits only get tighter and inputs do not change: the failed transaction will not make it
+                    setFailed.insert(pFailed->GetTx().GetHash());
+                    setFailed.insert(package.hash);
+                    ++nConsecutiveFailed;
+                    continue;
+                }
+
+                // make sure the best block and anchor are not reset by the flush
+                packageView.GetBestBlock();
+                packageView.GetBestAnchor();
+                packageView.Flush();
+                nConsecutiveFailed = 0;
+
+                for(const CTxMemPoolEntry* pEntry: vPackage)
+                {
+                    removeFromPackages(pEntry->GetTx().GetHash());
+                    releaseDependers(pEntry->GetTx().GetHash());
+                }
+            }
+        };
+
+        if (fAncestorScore && fSortedByFee)
+        {
+            // no high-priority area at all
+            addPackagesByAncestorScore();
+            fPackagesSelected = true;
+        }
+
+        // considering certs having a higher priority than any possible tx.
+        // An algorithm for managing tx/cert priorities could be devised
+        while (!vecPriority.empty() || (fAncestorScore && !fPackagesSelected))
+        {
+            if (vecPriority.empty())
+            {
+                // no candidate left for the high-priority area
+                addPackagesByAncestorScore();
+                fPackagesSelected = true;
+                continue;
+            }
+
+            // Take highest priority transaction off the priority queue:
+            double dPriority = vecPriority.front().get<0>();
+            CFeeRate feeRate = vecPriority.front().get<1>();
+            const CTransactionBase& tx = *(vecPriority.front().get<2>());
+
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            vecPriority.pop_back();
+
+            // the transactions still queued have already been considered by the package selection
+            if (fPackagesSelected && !tx.IsCertificate())
+                continue;
+
+            // Size limits
+            unsigned int nTxBaseSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+
+            if (!tx.IsCertificate())
+            {
+                // only a portion of the block can have ordinary transactions, we can not exceed this size
+                if (nBlockTxPartitionSize + nTxBaseSize >= nBlockTxPartitionMaxSize)
+                {
+                    LogPrint("sc", "%s():%d - Skipping tx[%s] because nBlockTxPartitionMaxSize %d would be exceeded (partSize=%d / txSize=%d)\n",
+                        __func__, __LINE__, tx.GetHash().ToString(), nBlockTxPartitionMaxSize, nBlockTxPartitionSize, nTxBaseSize );
+                    continue;
+                }
+            }
+
+            if (nBlockSize + nTxBaseSize >= nBlockMaxSize)
+            {
+                LogPrint("sc", "%s():%d - Skipping %s[%s] because nBlockMaxSize %d would be exceeded (blSize=%d / txBaseSize=%d)\n",
+                    __func__, __LINE__, tx.IsCertificate()?"cert":"tx", tx.GetHash().ToString(), nBlockMaxSize, nBlockSize, nTxBaseSize );
+                continue;
+            }
+
+            // Legacy limits on sigOps:
+            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+                continue;
+
+            const uint256& hash = tx.GetHash();
+
+            // Skip free transactions / certificates if we're past the minimum block size:
+            double dPriorityDelta = 0;
+            CAmount nFeeDelta = 0;
+            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxBaseSize >= nBlockMinSize))
+            {
+                LogPrint("sc", "%s():%d - Skipping [%s] because it is free (feeDelta=%lld/feeRate=%s, blsz=%u/txsz=%u/blminsz=%u)\n",
+                    __func__, __LINE__, tx.GetHash().ToString(), nFeeDelta, feeRate.ToString(), nBlockSize, nTxBaseSize, nBlockMinSize );
+                continue;
+            }
+
+            // Prioritise by fee once past the priority size or we run out of high-priority
+            // transactions:
+            if (!fSortedByFee &&
+                ((nBlockSize + nTxBaseSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
+            {
+                if (fAncestorScore && !fPackagesSelected)
+                {
+                    // back in the queue, it is considered again as part of a package or, if a certificate, below
+                    vecPriority.push_back(TxPriority(dPriority, feeRate, &tx));
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+                    addPackagesByAncestorScore();
+                    fPackagesSelected = true;
+                    continue;
+                }
+
+                fSortedByFee = true;
+                comparer = TxPriorityCompare(fSortedByFee);
+                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            }
+
+            if (!addToBlock(tx, view, dPriority, feeRate))
+                continue;
+
+            releaseDependers(hash);
         }
 
         nLastBlockTx = nBlockTx;
@@ -795,6 +1049,16 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
         pblock->vtx[0] = createCoinbase(scriptPubKeyIn, nFees, nHeight);
         pblocktemplate->vTxFees[0] = -nFees;
 
+        pblocktemplate->nHeight = nHeight;
+        pblocktemplate->nLockTimeCutoff = nLockTimeCutoff;
+        pblocktemplate->nBlockMaxSize = nBlockMaxSize;
+        pblocktemplate->nBlockTxPartitionMaxSize = nBlockTxPartitionMaxSize;
+        pblocktemplate->nBlockMaxComplexity = fDeprecatedGetBlockTemplate ? 0 : nBlockMaxComplexitySize;
+        pblocktemplate->nBlockSize = nBlockSize;
+        pblocktemplate->nBlockTxPartitionSize = nBlockTxPartitionSize;
+        pblocktemplate->nBlockSigOps = nBlockSigOps;
+        pblocktemplate->nBlockComplexity = nBlockComplexity;
+
         // Randomise nonce
         arith_uint256 nonce = UintToArith256(GetRandHash());
         // Clear the top and bottom 16 bits (for local use as thread flags and counters)
@@ -865,6 +1129,203 @@ CBlockTemplate* CreateNewBlockWithKey()
     return CreateNewBlock(*scriptPubKey);
 }
 
+bool UpdateBlockTemplate(CBlockTemplate& blocktemplate, const std::vector<uint256>& vAdded)
+{
+    LOCK2(cs_main, mempool.cs);
+    CBlock& block = blocktemplate.block;
+    if (chainActive.Tip()->GetBlockHash() != block.hashPrevBlock)
+        return false;
+
+    // certificates are ordered by quality and checked against the sidechain state, which the transactions
+    // creating, funding or withdrawing from sidechains change: the template is left to CreateNewBlock for them
+    auto isSidechainRelated = [](const CTransaction& tx) {
+        return !tx.GetVscCcOut().empty() || !tx.GetVftCcOut().empty() ||
+               !tx.GetVBwtRequestOut().empty() || !tx.GetVcswCcIn().empty();
+    };
+
+    for(const CScCertificate& cert: block.vcert)
+    {
+        if (!mempool.existsCert(cert.GetHash()))
+            return false;
+    }
+
+    for(const uint256& hash: vAdded)
+    {
+        if (mempool.existsCert(hash))
+            return false;
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end() && isSidechainRelated(it->second.GetTx()))
+            return false;
+    }
+
+    // the transactions no longer in the mempool are dropped, along with the ones spending their outputs
+    std::vector<CTransaction> vtx(1, block.vtx[0]);
+    std::vector<CAmount> vTxFees(1, blocktemplate.vTxFees[0]);
+    std::vector<int64_t> vTxSigOps(1, blocktemplate.vTxSigOps[0]);
+    std::set<uint256> setInBlock;
+    std::set<uint256> setDropped;
+    uint64_t nDroppedSize = 0;
+    int nDroppedSigOps = 0;
+    int nDroppedComplexity = 0;
+    for(size_t i = 1; i < block.vtx.size(); ++i)
+    {
+        const CTransaction& tx = block.vtx[i];
+        bool fDrop = !mempool.existsTx(tx.GetHash());
+        for(const CTxIn& in: tx.GetVin())
+            fDrop = fDrop || setDropped.count(in.prevout.hash);
+
+        if (!fDrop)
+        {
+            vtx.push_back(tx);
+            vTxFees.push_back(blocktemplate.vTxFees[i]);
+            vTxSigOps.push_back(blocktemplate.vTxSigOps[i]);
+            setInBlock.insert(tx.GetHash());
+            continue;
+        }
+
+        if (isSidechainRelated(tx))
+            return false;
+        setDropped.insert(tx.GetHash());
+        nDroppedSize += tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+        nDroppedSigOps += blocktemplate.vTxSigOps[i];
+        nDroppedComplexity += tx.GetComplexity();
+    }
+
+    block.vtx.swap(vtx);
+    blocktemplate.vTxFees.swap(vTxFees);
+    blocktemplate.vTxSigOps.swap(vTxSigOps);
+    blocktemplate.nBlockSize -= nDroppedSize;
+    blocktemplate.nBlockTxPartitionSize -= nDroppedSize;
+    blocktemplate.nBlockSigOps -= nDroppedSigOps;
+    blocktemplate.nBlockComplexity -= nDroppedComplexity;
+
+    // the new transactions are appended if they fit and their inputs are confirmed or in the template already,
+    // the others wait for the next full rebuild
+    CCoinsViewCache view(pcoinsTip);
+    CTxUndo dummyUndo;
+    for(size_t i = 1; i < block.vtx.size(); ++i)
+        UpdateCoins(block.vtx[i], view, dummyUndo, blocktemplate.nHeight);
+
+    for(const uint256& hash: vAdded)
+    {
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end() || setInBlock.count(hash))
+            continue;
+
+        const CTxMemPoolEntry& entry = it->second;
+        const CTransaction& tx = entry.GetTx();
+        const unsigned int nTxSize = entry.GetTxSize();
+        const int nTxComplexity = tx.GetComplexity();
+        if (!IsFinalTx(tx, blocktemplate.nHeight, blocktemplate.nLockTimeCutoff) ||
+            CFeeRate(entry.GetModifiedFee(), nTxSize) < ::minRelayTxFee ||
+            blocktemplate.nBlockSize + nTxSize >= blocktemplate.nBlockMaxSize ||
+            blocktemplate.nBlockTxPartitionSize + nTxSize >= blocktemplate.nBlockTxPartitionMaxSize ||
+            (blocktemplate.nBlockMaxComplexity > 0 &&
+             blocktemplate.nBlockComplexity + nTxComplexity >= (int)blocktemplate.nBlockMaxComplexity) ||
+            !view.HaveInputs(tx))
+            continue;
+
+        const unsigned int nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, view);
+        if (blocktemplate.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            continue;
+
+        CValidationState dummyState;
+        if (!ContextualCheckTxInputs(tx, dummyState, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+            continue;
+
+        UpdateCoins(tx, view, dummyUndo, blocktemplate.nHeight);
+        block.vtx.push_back(tx);
+        blocktemplate.vTxFees.push_back(tx.GetFeeAmount(view.GetValueIn(tx)));
+        blocktemplate.vTxSigOps.push_back(nTxSigOps);
+        blocktemplate.nBlockSize += nTxSize;
+        blocktemplate.nBlockTxPartitionSize += nTxSize;
+        blocktemplate.nBlockSigOps += nTxSigOps;
+        blocktemplate.nBlockComplexity += nTxComplexity;
+        setInBlock.insert(hash);
+    }
+
+    CAmount nFees = 0;
+    for(size_t i = 1; i < blocktemplate.vTxFees.size(); ++i)
+        nFees += blocktemplate.vTxFees[i];
+    for(const CAmount& nCertFee: blocktemplate.vCertFees)
+        nFees += nCertFee;
+
+    block.vtx[0] = createCoinbase(block.vtx[0].GetVout()[0].scriptPubKey, nFees, blocktemplate.nHeight);
+    blocktemplate.vTxFees[0] = -nFees;
+
+    nLastBlockTx = block.vtx.size() - 1;
+    nLastBlockSize = blocktemplate.nBlockSize;
+    nLastBlockTxPartitionSize = blocktemplate.nBlockTxPartitionSize;
+    return true;
+}
+
+CBlockTemplateManager blockTemplateManager;
+
+CBlockTemplateManager::CBlockTemplateManager():
+    pindexPrev(NULL), nTransactionsUpdated(0), nAddedSequence(0), nFullBuilds(0), nDeltaUpdates(0) {}
+
+#ifdef ENABLE_WALLET
+CBlockTemplate* CBlockTemplateManager::GetTemplate(CReserveKey& reservekey)
+#else
+CBlockTemplate* CBlockTemplateManager::GetTemplate()
+#endif
+{
+    AssertLockHeld(cs_main);
+    const int64_t nTimeStart = GetTimeMicros();
+
+    // read before looking at the mempool, so that a concurrent change is picked up by the next call at worst
+    const unsigned int nTransactionsUpdatedNew = mempool.GetTransactionsUpdated();
+    const uint64_t nAddedSequenceNew = mempool.GetAddedSequence();
+
+    bool fUpToDate = pblocktemplate && pindexPrev == chainActive.Tip();
+    if (fUpToDate && nTransactionsUpdatedNew != nTransactionsUpdated)
+    {
+        std::vector<uint256> vAdded;
+        fUpToDate = mempool.GetAddedSince(nAddedSequence, vAdded) && UpdateBlockTemplate(*pblocktemplate, vAdded);
+        if (fUpToDate)
+            ++nDeltaUpdates;
+    }
+
+    if (!fUpToDate)
+    {
+        // Clear pindexPrev so future calls make a new block, despite any failures from here on
+        pindexPrev = NULL;
+        pblocktemplate.reset();
+
+        CBlockIndex* pindexPrevNew = chainActive.Tip();
+#ifdef ENABLE_WALLET
+        pblocktemplate.reset(CreateNewBlockWithKey(reservekey));
+#else
+        pblocktemplate.reset(CreateNewBlockWithKey());
+#endif
+        if (!pblocktemplate)
+            return NULL;
+
+        // Need to update only after we know CreateNewBlockWithKey succeeded
+        pindexPrev = pindexPrevNew;
+        ++nFullBuilds;
+    }
+    nTransactionsUpdated = nTransactionsUpdatedNew;
+    nAddedSequence = nAddedSequenceNew;
+
+    latencies.push_back(GetTimeMicros() - nTimeStart);
+    if (latencies.size() > LATENCY_SAMPLES)
+        latencies.pop_front();
+
+    return pblocktemplate.get();
+}
+
+int64_t CBlockTemplateManager::GetLatencyPercentile(double fraction) const
+{
+    if (latencies.empty())
+        return 0;
+
+    std::vector<int64_t> vSorted(latencies.begin(), latencies.end());
+    size_t nIndex = std::min(vSorted.size() - 1, (size_t)(fraction * vSorted.size()));
+    std::nth_element(vSorted.begin(), vSorted.begin() + nIndex, vSorted.end());
+    return vSorted[nIndex];
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Internal miner
@@ -888,7 +1349,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = txCoinbase;
-    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->hashMerkleRoot = pblock->BuildMerkleTree(NULL, GetValidationExecutor());
 #ifdef DEBUG_SC_COMMITMENT_HASH
     std::cout << "-------------------------------------------" << std::endl;
     std::cout << "  hashScTxsCommitment: " << pblock->hashScTxsCommitment.ToString() << std::endl;
@@ -935,6 +1396,63 @@ static bool ProcessBlockFound(CBlock* pblock)
     return true;
 }
 
+bool CEquihashSolver::IsKnown(const std::string& strName)
+{
+    return strName == "default" || strName == "tromp";
+}
+
+CEquihashSolver::CEquihashSolver(const std::string& strNameIn): strName(strNameIn)
+{
+    assert(IsKnown(strName));
+}
+
+CEquihashSolver::~CEquihashSolver() {}
+
+bool CEquihashSolver::Solve(unsigned int n, unsigned int k, const unsigned char* input, size_t inputLen,
+                            const std::function<bool(std::vector<unsigned char>)>& validBlock,
+                            const std::function<bool(EhSolverCancelCheck)>& cancelled)
+{
+    if (strName == "tromp" && n == WN && k == WK) {
+        // the tables are only reset for the next nonce, not allocated again
+        if (!ptromp)
+            ptromp.reset(new equi(1));
+        equi& eq = *ptromp;
+        eq.setinput(input, inputLen);
+
+        eq.digit0(0);
+        eq.xfull = eq.bfull = eq.hfull = 0;
+        eq.showbsizes(0);
+        for (u32 r = 1; r < WK; r++) {
+            (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
+            eq.xfull = eq.bfull = eq.hfull = 0;
+            eq.showbsizes(r);
+        }
+        eq.digitK(0);
+
+        // Convert solution indices to byte array (decompress) and pass it to validBlock method.
+        for (size_t s = 0; s < eq.nsols; s++) {
+            LogPrint("pow", "Checking solution %d\n", s+1);
+            std::vector<eh_index> index_vector(PROOFSIZE);
+            for (size_t i = 0; i < PROOFSIZE; i++) {
+                index_vector[i] = eq.sols[s][i];
+            }
+            std::vector<unsigned char> sol_char = GetMinimalFromIndices(index_vector, DIGITBITS);
+
+            if (validBlock(sol_char)) {
+                // If we find a POW solution, do not try other solutions
+                // because they become invalid as we created a new block in blockchain.
+                return true;
+            }
+        }
+        return false;
+    }
+
+    crypto_generichash_blake2b_state state;
+    EhInitialiseState(n, k, state);
+    crypto_generichash_blake2b_update(&state, input, inputLen);
+    return EhOptimisedSolve(n, k, state, validBlock, cancelled);
+}
+
 #ifdef ENABLE_WALLET
 void static BitcoinMiner(CWallet *pwallet)
 #else
@@ -958,9 +1476,9 @@ void static BitcoinMiner()
     unsigned int n = chainparams.EquihashN();
     unsigned int k = chainparams.EquihashK();
 
-    std::string solver = GetArg("-equihashsolver", "default");
-    assert(solver == "tromp" || solver == "default");
-    LogPrint("pow", "Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
+    // checked by AppInit2()
+    CEquihashSolver solver(GetArg("-equihashsolver", "default"));
+    LogPrint("pow", "Using Equihash solver \"%s\" with n = %u, k = %u\n", solver.GetName(), n, k);
 
     std::mutex m_cs;
     bool cancelSolver = false;
@@ -1024,28 +1542,14 @@ void static BitcoinMiner()
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
 
             while (true) {
-                // Hash state
-                crypto_generichash_blake2b_state state;
-                EhInitialiseState(n, k, state);
-
-                // I = the block header minus nonce and solution.
+                // I = the block header minus nonce and solution, V = the nonce.
                 CEquihashInput I{*pblock};
                 CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                ss << I;
-
-                // H(I||...
-                crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
-                // H(I||V||...
-                crypto_generichash_blake2b_state curr_state;
-                curr_state = state;
-                crypto_generichash_blake2b_update(&curr_state,
-                                                  pblock->nNonce.begin(),
-                                                  pblock->nNonce.size());
+                ss << I << pblock->nNonce;
 
                 // (x_1, x_2, ...) = A(I, V, n, k)
                 LogPrint("pow", "Running Equihash solver \"%s\" with nNonce = %s\n",
-                         solver, pblock->nNonce.ToString());
+                         solver.GetName(), pblock->nNonce.ToString());
 
                 std::function<bool(std::vector<unsigned char>)> validBlock =
 #ifdef ENABLE_WALLET
@@ -1092,52 +1596,17 @@ void static BitcoinMiner()
                     return cancelSolver;
                 };
 
-                // TODO: factor this out into a function with the same API for each solver.
-                if (solver == "tromp") {
-                    // Create solver and initialize it.
-                    equi eq(1);
-                    eq.setstate(&curr_state);
-
-                    // Intialization done, start algo driver.
-                    eq.digit0(0);
-                    eq.xfull = eq.bfull = eq.hfull = 0;
-                    eq.showbsizes(0);
-                    for (u32 r = 1; r < WK; r++) {
-                        (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
-                        eq.xfull = eq.bfull = eq.hfull = 0;
-                        eq.showbsizes(r);
-                    }
-                    eq.digitK(0);
+                try {
+                    // If we find a valid block, we rebuild
+                    bool found = solver.Solve(n, k, (unsigned char*)&ss[0], ss.size(), validBlock, cancelled);
                     ehSolverRuns.increment();
-
-                    // Convert solution indices to byte array (decompress) and pass it to validBlock method.
-                    for (size_t s = 0; s < eq.nsols; s++) {
-                        LogPrint("pow", "Checking solution %d\n", s+1);
-                        std::vector<eh_index> index_vector(PROOFSIZE);
-                        for (size_t i = 0; i < PROOFSIZE; i++) {
-                            index_vector[i] = eq.sols[s][i];
-                        }
-                        std::vector<unsigned char> sol_char = GetMinimalFromIndices(index_vector, DIGITBITS);
-
-                        if (validBlock(sol_char)) {
-                            // If we find a POW solution, do not try other solutions
-                            // because they become invalid as we created a new block in blockchain.
-                            break;
-                        }
-                    }
-                } else {
-                    try {
-                        // If we find a valid block, we rebuild
-                        bool found = EhOptimisedSolve(n, k, curr_state, validBlock, cancelled);
-                        ehSolverRuns.increment();
-                        if (found) {
-                            break;
-                        }
-                    } catch (EhSolverCancelledException&) {
-                        LogPrint("pow", "Equihash solver cancelled\n");
-                        std::lock_guard<std::mutex> lock{m_cs};
-                        cancelSolver = false;
+                    if (found) {
+                        break;
                     }
+                } catch (EhSolverCancelledException&) {
+                    LogPrint("pow", "Equihash solver cancelled\n");
+                    std::lock_guard<std::mutex> lock{m_cs};
+                    cancelSolver = false;
                 }
 
                 // Check for stop or if block needs to be rebuilt
@@ -7,9 +7,14 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#ifdef ENABLE_MINING
+#include "crypto/equihash.h"
+#endif
 
 #include <boost/optional.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <deque>
+#include <memory>
 #include <stdint.h>
 
 class CBlockIndex;
@@ -28,6 +33,17 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
     std::vector<CAmount> vCertFees;
     std::vector<int64_t> vCertSigOps;
+
+    //! limits the block has been assembled within and how much of them is used, for UpdateBlockTemplate()
+    int nHeight = 0;
+    int64_t nLockTimeCutoff = 0;
+    uint64_t nBlockMaxSize = 0;
+    uint64_t nBlockTxPartitionMaxSize = 0;
+    unsigned int nBlockMaxComplexity = 0;
+    uint64_t nBlockSize = 0;
+    uint64_t nBlockTxPartitionSize = 0;
+    int nBlockSigOps = 0;
+    int nBlockComplexity = 0;
 };
 
 //
@@ -62,6 +78,9 @@ public:
 /** Retrieve mempool transactions priority info */
 void GetBlockTxPriorityData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
                                std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers);
+/** Retrieve priority info of the mempool transactions whose priority is high enough to be mined for free */
+void GetBlockHighPriorityTxData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
+                                std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers);
 /** DEPRECATED. Retrieve mempool transactions priority info */
 void GetBlockTxPriorityDataOld(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
                                std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers);
@@ -82,7 +101,89 @@ CBlockTemplate* CreateNewBlockWithKey();
 
 CMutableTransaction createCoinbase(const CScript &scriptPubKeyIn, CAmount fees, const int nHeight);
 
+/**
+ * Bring a template built by CreateNewBlock() on the current tip up to date with the mempool: the transactions no longer
+ * in the mempool are dropped along with their descendants, the ones in vAdded that fit are appended. Returns false,
+ * leaving the template untouched, if a full rebuild is needed: certificates and sidechain transactions are involved, or
+ * the tip has changed.
+ */
+bool UpdateBlockTemplate(CBlockTemplate& blocktemplate, const std::vector<uint256>& vAdded);
+
+/**
+ * The last template served by getblocktemplate. It is built from scratch on a new tip only: in between, the
+ * transactions added to and removed from the mempool are applied to it with UpdateBlockTemplate().
+ * All methods require cs_main.
+ */
+class CBlockTemplateManager
+{
+public:
+    //! number of the latest GetTemplate() calls whose latency is tracked
+    static const size_t LATENCY_SAMPLES = 1000;
+
+    CBlockTemplateManager();
+
+    /** The template for the current tip and mempool, NULL if it could not be created */
+#ifdef ENABLE_WALLET
+    CBlockTemplate* GetTemplate(CReserveKey& reservekey);
+#else
+    CBlockTemplate* GetTemplate();
+#endif
+    const CBlockIndex* GetTip() const { return pindexPrev; }
+    //! value of mempool.GetTransactionsUpdated() the template reflects
+    unsigned int GetTransactionsUpdated() const { return nTransactionsUpdated; }
+
+    uint64_t GetFullBuilds() const { return nFullBuilds; }
+    uint64_t GetDeltaUpdates() const { return nDeltaUpdates; }
+    //! GetTemplate() latency in microseconds below which the given fraction of the latest requests fall
+    int64_t GetLatencyPercentile(double fraction) const;
+
+private:
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    const CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    uint64_t nAddedSequence;
+
+    uint64_t nFullBuilds;
+    uint64_t nDeltaUpdates;
+    std::deque<int64_t> latencies;
+};
+
+extern CBlockTemplateManager blockTemplateManager;
+
 #ifdef ENABLE_MINING
+struct equi;
+
+/**
+ * Equihash solver selected by -equihashsolver, keeping the memory it needs from one nonce to
+ * the next: each mining thread owns one for all the nonces it tries.
+ */
+class CEquihashSolver
+{
+public:
+    //! Whether strName is the name of a solver: "default" or "tromp"
+    static bool IsKnown(const std::string& strName);
+
+    explicit CEquihashSolver(const std::string& strNameIn);
+    ~CEquihashSolver();
+
+    const std::string& GetName() const { return strName; }
+
+    /**
+     * Run on the inputLen bytes of input, I||V, passing the solutions to validBlock until it
+     * accepts one, and return whether it did. The tromp solver only supports Equihash<200,9>,
+     * the default one runs for other parameters. Throws EhSolverCancelledException when
+     * cancelled.
+     */
+    bool Solve(unsigned int n, unsigned int k, const unsigned char* input, size_t inputLen,
+               const std::function<bool(std::vector<unsigned char>)>& validBlock,
+               const std::function<bool(EhSolverCancelCheck)>& cancelled);
+
+private:
+    std::string strName;
+    //! hash tables of the tromp solver, allocated by its first run
+    std::unique_ptr<equi> ptromp;
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Run the miner threads */
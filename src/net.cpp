@@ -95,7 +95,7 @@ bool fAddressesInitialized = false;
 TLSManager tlsmanager = TLSManager();
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, std::shared_ptr<const CTransactionBase> > mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -2116,8 +2116,9 @@ void CNode::NetCleanup()
 #endif
 }
 
-void Relay(const CTransactionBase& tx, const CDataStream& ss)
+void Relay(const std::shared_ptr<const CTransactionBase>& ptx)
 {
+    const CTransactionBase& tx = *ptx;
     CInv inv(MSG_TX, tx.GetHash());
     {
         LOCK(cs_mapRelay);
@@ -2128,8 +2129,8 @@ void Relay(const CTransactionBase& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Serialized on request, the object is shared with the mempool as long as it is there
+        mapRelay.insert(std::make_pair(inv, ptx));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2147,16 +2148,6 @@ void Relay(const CTransactionBase& tx, const CDataStream& ss)
     }
 }
 
-#if 0
-void Relay(const CScCertificate& cert)
-{
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << cert;
-    Relay(cert, ss);
-}
-#endif
-
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -165,7 +165,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, std::shared_ptr<const CTransactionBase> > mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -687,9 +687,8 @@ public:
 
 class CTransaction;
 class CScCertificate;
-void Relay(const CTransaction& tx);
-void Relay(const CScCertificate& cert);
-void Relay(const CTransactionBase& tx, const CDataStream& ss);
+/** Announce a transaction or certificate to the peers, keeping it for their getdata requests */
+void Relay(const std::shared_ptr<const CTransactionBase>& ptx);
 
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
@@ -91,3 +91,13 @@ bool PaymentDisclosureDB::Get(const PaymentDisclosureKey& key, PaymentDisclosure
     }
     return true;
 }
+
+bool PaymentDisclosureDB::GetProperty(const std::string& name, std::string& value) const
+{
+    if (db == nullptr) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    return db->GetProperty(name, &value);
+}
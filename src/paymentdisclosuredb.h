@@ -36,6 +36,8 @@ public:
 
     bool Put(const PaymentDisclosureKey& key, const PaymentDisclosureInfo& info);
     bool Get(const PaymentDisclosureKey& key, PaymentDisclosureInfo& info);
+    //! read one of the LevelDB internal properties (e.g. "leveldb.stats")
+    bool GetProperty(const std::string& name, std::string& value) const;
 };
 
 
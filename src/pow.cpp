@@ -10,6 +10,7 @@
 #include "arith_uint256.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "crypto/equihash.h"
 #include "primitives/block.h"
 #include "streams.h"
@@ -84,10 +85,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
 
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
-
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
     // I||V
@@ -96,16 +93,62 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     ss << pblock->nNonce;
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
-    bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
-    if (!isValid)
+    if (!EhIsValidSolutionForInput(n, k, (unsigned char*)&ss[0], ss.size(), pblock->nSolution))
         return error("CheckEquihashSolution(): invalid solution");
 
     return true;
 }
 
+namespace {
+
+/** The check of the Equihash solution of a header, run by a CCheckGroup */
+class CEquihashCheck
+{
+private:
+    const CBlockHeader* pheader;
+    const CChainParams* pparams;
+    unsigned char* pfChecked;
+
+public:
+    CEquihashCheck(): pheader(NULL), pparams(NULL), pfChecked(NULL) {}
+    CEquihashCheck(const CBlockHeader& header, const CChainParams& params, unsigned char* pfCheckedIn):
+        pheader(&header), pparams(&params), pfChecked(pfCheckedIn) {}
+
+    bool operator()()
+    {
+        if (!CheckEquihashSolution(pheader, *pparams))
+            return false;
+        *pfChecked = true;
+        return true;
+    }
+
+    void swap(CEquihashCheck& check)
+    {
+        std::swap(pheader, check.pheader);
+        std::swap(pparams, check.pparams);
+        std::swap(pfChecked, check.pfChecked);
+    }
+};
+
+}
+
+bool CheckEquihashSolutions(const std::vector<CBlockHeader>& headers, const CChainParams& params,
+                            CCheckExecutor* pexecutor, std::vector<unsigned char>& vChecked)
+{
+    vChecked.resize(headers.size(), false);
+    std::vector<CEquihashCheck> vChecks;
+    vChecks.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (!vChecked[i])
+            vChecks.push_back(CEquihashCheck(headers[i], params, &vChecked[i]));
+    }
+
+    // a few solutions per task, each one taking tens of microseconds
+    CCheckGroup<CEquihashCheck> group(pexecutor, 8);
+    group.Add(vChecks);
+    return group.Wait();
+}
+
 /** extracted from rpc command generate and reused in UTs **/
 void generateEquihash(CBlock& block)
 {
@@ -6,6 +6,7 @@
 #define BITCOIN_POW_H
 
 #include <stdint.h>
+#include <vector>
 
 namespace Consensus {
     class Params;
@@ -15,6 +16,7 @@ class CBlock;
 class CBlockHeader;
 class CBlockIndex;
 class CChainParams;
+class CCheckExecutor;
 class uint256;
 class arith_uint256;
 
@@ -26,6 +28,15 @@ unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
 /** Check whether the Equihash solution in a block header is valid */
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&);
 
+/**
+ * Check the Equihash solutions of the headers whose entry of vChecked is not set, in parallel
+ * on the threads of pexecutor, and set the entries of the ones found valid. The checks stop at
+ * the first invalid solution, possibly leaving valid ones unchecked. Return whether all the
+ * solutions checked were valid.
+ */
+bool CheckEquihashSolutions(const std::vector<CBlockHeader>& headers, const CChainParams&,
+                            CCheckExecutor* pexecutor, std::vector<unsigned char>& vChecked);
+
 /** extracted from rpc command generate and reused in UTs **/
 void generateEquihash(CBlock& block);
 
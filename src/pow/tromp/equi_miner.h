@@ -19,6 +19,7 @@
 // twice the number of subtrees expected to land there.
 
 #include "pow/tromp/equi.h"
+#include "crypto/equihash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -203,8 +204,14 @@ u32 min(const u32 a, const u32 b) {
   return a < b ? a : b;
 }
 
+// the hashes of digit 0 are computed by runs of this many blake blocks
+static const u32 BLAKEBATCH = 64;
+
 struct equi {
   crypto_generichash_blake2b_state blake_ctx;
+  // when set, hashes the blake blocks of digit 0 instead of blake_ctx
+  EhIndexHasher200_9 hasher;
+  bool usehasher;
   htalloc hta;
   bsizes *nslots; // PUT IN BUCKET STRUCT
   proof *sols;
@@ -217,6 +224,7 @@ struct equi {
   equi(const u32 n_threads) {
     assert(sizeof(hashunit) == 4);
     nthreads = n_threads;
+    usehasher = false;
     const int err = pthread_barrier_init(&barry, NULL, nthreads);
     assert(!err);
     hta.alloctrees();
@@ -230,9 +238,21 @@ struct equi {
   }
   void setstate(const crypto_generichash_blake2b_state *ctx) {
     blake_ctx = *ctx;
+    usehasher = false;
     memset(nslots, 0, NBUCKETS * sizeof(au32)); // only nslots[0] needs zeroing
     nsols = 0;
   }
+  // same as setstate with the state of the input, whose blocks are compressed only once
+  void setinput(const uchar *input, const size_t inputlen) {
+    crypto_generichash_blake2b_state ctx;
+    Eh200_9.InitialiseState(ctx);
+    crypto_generichash_blake2b_update(&ctx, input, inputlen);
+    setstate(&ctx);
+    if (EhIndexHasher200_9::Supports(inputlen)) {
+      hasher = EhIndexHasher200_9(input, inputlen);
+      usehasher = true;
+    }
+  }
   u32 getslot(const u32 r, const u32 bucketi) {
 #ifdef EQUIHASH_TROMP_ATOMIC
     return std::atomic_fetch_add_explicit(&nslots[r&1][bucketi], 1U, std::memory_order_relaxed);
@@ -429,40 +449,60 @@ struct equi {
     }
   };
 
-  void digit0(const u32 id) {
-    uchar hash[HASHOUT];
+  // hash the run of nblocks blake blocks from block, nthreads apart
+  void hashblocks(const u32 block, const u32 nblocks, uchar *hashes) {
+    if (usehasher) {
+      u32 g[BLAKEBATCH];
+      for (u32 j = 0; j < nblocks; j++)
+        g[j] = block + j * nthreads;
+      hasher.Hash(g, nblocks, hashes);
+      return;
+    }
     crypto_generichash_blake2b_state state;
-    htlayout htl(this, 0);
-    const u32 hashbytes = hashsize(0);
-    for (u32 block = id; block < NBLOCKS; block += nthreads) {
+    for (u32 j = 0; j < nblocks; j++) {
       state = blake_ctx;
-      u32 leb = htole32(block);
+      u32 leb = htole32(block + j * nthreads);
       crypto_generichash_blake2b_update(&state, (uchar *)&leb, sizeof(u32));
-      crypto_generichash_blake2b_final(&state, hash, HASHOUT);
-      for (u32 i = 0; i<HASHESPERBLAKE; i++) {
-        const uchar *ph = hash + i * WN/8;
+      crypto_generichash_blake2b_final(&state, hashes + j * HASHOUT, HASHOUT);
+    }
+  }
+
+  void digit0(const u32 id) {
+    static_assert(HASHOUT == EhIndexHasher200_9::OUTPUT_BYTES, "hashes of the blake blocks differ in size");
+    uchar hashes[BLAKEBATCH * HASHOUT];
+    htlayout htl(this, 0);
+    const u32 hashbytes = hashsize(0);
+    for (u32 block0 = id; block0 < NBLOCKS; block0 += BLAKEBATCH * nthreads) {
+      const u32 nblocks = min(BLAKEBATCH, (NBLOCKS - block0 + nthreads - 1) / nthreads);
+      hashblocks(block0, nblocks, hashes);
+      for (u32 j = 0; j < nblocks; j++) {
+        const u32 block = block0 + j * nthreads;
+        const uchar *hash = hashes + j * HASHOUT;
+        for (u32 i = 0; i<HASHESPERBLAKE; i++) {
+          const uchar *ph = hash + i * WN/8;
 #if BUCKBITS == 16 && RESTBITS == 4
-        const u32 bucketid = ((u32)ph[0] << 8) | ph[1];
+          const u32 bucketid = ((u32)ph[0] << 8) | ph[1];
 #elif BUCKBITS == 12 && RESTBITS == 8
-        const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
+          const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
 #elif BUCKBITS == 11 && RESTBITS == 9
-        const u32 bucketid = ((u32)ph[0] << 3) | ph[1] >> 5;
+          const u32 bucketid = ((u32)ph[0] << 3) | ph[1] >> 5;
 #elif BUCKBITS == 20 && RESTBITS == 4
-        const u32 bucketid = ((((u32)ph[0] << 8) | ph[1]) << 4) | ph[2] >> 4;
+          const u32 bucketid = ((((u32)ph[0] << 8) | ph[1]) << 4) | ph[2] >> 4;
 #elif BUCKBITS == 12 && RESTBITS == 4
-        const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
-        const u32 xhash = ph[1] & 0xf;
+          const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
+          const u32 xhash = ph[1] & 0xf;
 #else
 #error not implemented
 #endif
-        const u32 slot = getslot(0, bucketid);
-        if (slot >= NSLOTS) {
-          bfull++;
-          continue;
+          const u32 slot = getslot(0, bucketid);
+          if (slot >= NSLOTS) {
+            bfull++;
+            continue;
+          }
+          slot0 &s = hta.trees0[0][bucketid][slot];
+          s.attr = tree(block * HASHESPERBLAKE + i);
+          memcpy(s.hash->bytes+htl.nextbo, ph+WN/8-hashbytes, hashbytes);
         }
-        slot0 &s = hta.trees0[0][bucketid][slot];
-        s.attr = tree(block * HASHESPERBLAKE + i);
-        memcpy(s.hash->bytes+htl.nextbo, ph+WN/8-hashbytes, hashbytes);
       }
     }
   }
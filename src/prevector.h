@@ -0,0 +1,429 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PREVECTOR_H
+#define BITCOIN_PREVECTOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#pragma pack(push, 1)
+/**
+ * A replacement for std::vector<T> which stores up to N elements inline, without
+ * allocating, for vectors which are usually small. Beyond N, the elements are on
+ * the heap as with std::vector.
+ *
+ * The storage is either:
+ *  - direct: _size is the number of elements, at most N, stored in direct;
+ *  - indirect: _size is the number of elements plus N + 1, and the elements are
+ *    in the capacity allocated at indirect.
+ *
+ * T must be movable with memmove() and realloc(), as the plain types it is used for.
+ * Iterators, references and pointers to the elements are invalidated by any change
+ * of size, like for std::vector when it reallocates.
+ */
+template <unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
+class prevector
+{
+public:
+    typedef Size size_type;
+    typedef Diff difference_type;
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+
+    class iterator
+    {
+        T* ptr;
+
+    public:
+        typedef Diff difference_type;
+        typedef T value_type;
+        typedef T* pointer;
+        typedef T& reference;
+        typedef std::random_access_iterator_tag iterator_category;
+
+        iterator() : ptr(nullptr) {}
+        iterator(T* ptr_) : ptr(ptr_) {}
+        T& operator*() const { return *ptr; }
+        T* operator->() const { return ptr; }
+        T& operator[](difference_type pos) const { return ptr[pos]; }
+        iterator& operator++() { ptr++; return *this; }
+        iterator& operator--() { ptr--; return *this; }
+        iterator operator++(int) { iterator copy(*this); ++(*this); return copy; }
+        iterator operator--(int) { iterator copy(*this); --(*this); return copy; }
+        difference_type friend operator-(iterator a, iterator b) { return a.ptr - b.ptr; }
+        iterator operator+(difference_type n) const { return iterator(ptr + n); }
+        iterator friend operator+(difference_type n, iterator x) { return x + n; }
+        iterator& operator+=(difference_type n) { ptr += n; return *this; }
+        iterator operator-(difference_type n) const { return iterator(ptr - n); }
+        iterator& operator-=(difference_type n) { ptr -= n; return *this; }
+        bool operator==(iterator x) const { return ptr == x.ptr; }
+        bool operator!=(iterator x) const { return ptr != x.ptr; }
+        bool operator>=(iterator x) const { return ptr >= x.ptr; }
+        bool operator<=(iterator x) const { return ptr <= x.ptr; }
+        bool operator>(iterator x) const { return ptr > x.ptr; }
+        bool operator<(iterator x) const { return ptr < x.ptr; }
+    };
+
+    class const_iterator
+    {
+        const T* ptr;
+
+    public:
+        typedef Diff difference_type;
+        typedef T value_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+        typedef std::random_access_iterator_tag iterator_category;
+
+        const_iterator() : ptr(nullptr) {}
+        const_iterator(const T* ptr_) : ptr(ptr_) {}
+        const_iterator(iterator x) : ptr(x.operator->()) {}
+        const T& operator*() const { return *ptr; }
+        const T* operator->() const { return ptr; }
+        const T& operator[](difference_type pos) const { return ptr[pos]; }
+        const_iterator& operator++() { ptr++; return *this; }
+        const_iterator& operator--() { ptr--; return *this; }
+        const_iterator operator++(int) { const_iterator copy(*this); ++(*this); return copy; }
+        const_iterator operator--(int) { const_iterator copy(*this); --(*this); return copy; }
+        difference_type friend operator-(const_iterator a, const_iterator b) { return a.ptr - b.ptr; }
+        const_iterator operator+(difference_type n) const { return const_iterator(ptr + n); }
+        const_iterator friend operator+(difference_type n, const_iterator x) { return x + n; }
+        const_iterator& operator+=(difference_type n) { ptr += n; return *this; }
+        const_iterator operator-(difference_type n) const { return const_iterator(ptr - n); }
+        const_iterator& operator-=(difference_type n) { ptr -= n; return *this; }
+        bool operator==(const_iterator x) const { return ptr == x.ptr; }
+        bool operator!=(const_iterator x) const { return ptr != x.ptr; }
+        bool operator>=(const_iterator x) const { return ptr >= x.ptr; }
+        bool operator<=(const_iterator x) const { return ptr <= x.ptr; }
+        bool operator>(const_iterator x) const { return ptr > x.ptr; }
+        bool operator<(const_iterator x) const { return ptr < x.ptr; }
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    size_type _size;
+    union direct_or_indirect {
+        char direct[sizeof(T) * N];
+        struct {
+            size_type capacity;
+            char* indirect;
+        } heap;
+    } _union;
+
+    T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
+    const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
+    T* indirect_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.heap.indirect) + pos; }
+    const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.heap.indirect) + pos; }
+    bool is_direct() const { return _size <= N; }
+
+    void change_capacity(size_type new_capacity)
+    {
+        if (new_capacity <= N) {
+            if (!is_direct()) {
+                T* indirect = indirect_ptr(0);
+                memcpy(direct_ptr(0), indirect, size() * sizeof(T));
+                free(indirect);
+                _size -= N + 1;
+            }
+        } else if (!is_direct()) {
+            char* new_indirect = static_cast<char*>(realloc(_union.heap.indirect, (size_t)sizeof(T) * new_capacity));
+            if (!new_indirect)
+                throw std::bad_alloc();
+            _union.heap.indirect = new_indirect;
+            _union.heap.capacity = new_capacity;
+        } else {
+            char* new_indirect = static_cast<char*>(malloc((size_t)sizeof(T) * new_capacity));
+            if (!new_indirect)
+                throw std::bad_alloc();
+            memcpy(new_indirect, direct_ptr(0), size() * sizeof(T));
+            _union.heap.indirect = new_indirect;
+            _union.heap.capacity = new_capacity;
+            _size += N + 1;
+        }
+    }
+
+    T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+    const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+
+    //! grow geometrically, so that appending one element at a time takes amortized constant time
+    void grow(size_type new_size)
+    {
+        if (capacity() < new_size)
+            change_capacity(new_size + (new_size >> 1));
+    }
+
+    void fill(T* dst, size_type count, const T& value)
+    {
+        for (size_type i = 0; i < count; i++)
+            new(static_cast<void*>(dst + i)) T(value);
+    }
+
+    template <typename InputIterator>
+    void fill(T* dst, InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++first, ++dst)
+            new(static_cast<void*>(dst)) T(*first);
+    }
+
+    template <typename InputIterator>
+    using RequireIterator = typename std::enable_if<!std::is_integral<InputIterator>::value>::type;
+
+public:
+    prevector() : _size(0) {}
+
+    explicit prevector(size_type n) : _size(0)
+    {
+        resize(n);
+    }
+
+    prevector(size_type n, const T& value) : _size(0)
+    {
+        change_capacity(n);
+        fill(item_ptr(0), n, value);
+        _size += n;
+    }
+
+    template <typename InputIterator, typename = RequireIterator<InputIterator>>
+    prevector(InputIterator first, InputIterator last) : _size(0)
+    {
+        size_type n = std::distance(first, last);
+        change_capacity(n);
+        fill(item_ptr(0), first, last);
+        _size += n;
+    }
+
+    prevector(const prevector& other) : _size(0)
+    {
+        change_capacity(other.size());
+        fill(item_ptr(0), other.begin(), other.end());
+        _size += other.size();
+    }
+
+    prevector(prevector&& other) : _size(0)
+    {
+        swap(other);
+    }
+
+    ~prevector()
+    {
+        if (!std::is_trivially_destructible<T>::value)
+            clear();
+        if (!is_direct())
+            free(_union.heap.indirect);
+    }
+
+    prevector& operator=(const prevector& other)
+    {
+        if (&other != this)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+
+    prevector& operator=(prevector&& other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void assign(size_type n, const T& value)
+    {
+        T copy(value);
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        fill(item_ptr(0), n, copy);
+        _size += n;
+    }
+
+    template <typename InputIterator, typename = RequireIterator<InputIterator>>
+    void assign(InputIterator first, InputIterator last)
+    {
+        size_type n = std::distance(first, last);
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        fill(item_ptr(0), first, last);
+        _size += n;
+    }
+
+    size_type size() const { return is_direct() ? _size : _size - N - 1; }
+    bool empty() const { return size() == 0; }
+    size_type capacity() const { return is_direct() ? N : _union.heap.capacity; }
+
+    iterator begin() { return iterator(item_ptr(0)); }
+    const_iterator begin() const { return const_iterator(item_ptr(0)); }
+    iterator end() { return iterator(item_ptr(size())); }
+    const_iterator end() const { return const_iterator(item_ptr(size())); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    T& operator[](size_type pos) { return *item_ptr(pos); }
+    const T& operator[](size_type pos) const { return *item_ptr(pos); }
+
+    T& at(size_type pos)
+    {
+        if (pos >= size())
+            throw std::out_of_range("prevector::at");
+        return *item_ptr(pos);
+    }
+    const T& at(size_type pos) const
+    {
+        if (pos >= size())
+            throw std::out_of_range("prevector::at");
+        return *item_ptr(pos);
+    }
+
+    T& front() { return *item_ptr(0); }
+    const T& front() const { return *item_ptr(0); }
+    T& back() { return *item_ptr(size() - 1); }
+    const T& back() const { return *item_ptr(size() - 1); }
+
+    T* data() { return item_ptr(0); }
+    const T* data() const { return item_ptr(0); }
+
+    void resize(size_type new_size)
+    {
+        size_type cur_size = size();
+        if (new_size < cur_size) {
+            erase(item_ptr(new_size), end());
+        } else if (new_size > cur_size) {
+            if (capacity() < new_size)
+                change_capacity(new_size);
+            fill(item_ptr(cur_size), new_size - cur_size, T());
+            _size += new_size - cur_size;
+        }
+    }
+
+    void reserve(size_type new_capacity)
+    {
+        if (new_capacity > capacity())
+            change_capacity(new_capacity);
+    }
+
+    void shrink_to_fit()
+    {
+        change_capacity(size());
+    }
+
+    //! Like erase(), this keeps the capacity: shrink_to_fit() moves the elements back inline
+    void clear()
+    {
+        resize(0);
+    }
+
+    iterator insert(iterator pos, const T& value)
+    {
+        T copy(value);
+        size_type p = pos - begin();
+        grow(size() + 1);
+        T* ptr = item_ptr(p);
+        memmove(ptr + 1, ptr, (size() - p) * sizeof(T));
+        new(static_cast<void*>(ptr)) T(copy);
+        _size++;
+        return iterator(ptr);
+    }
+
+    void insert(iterator pos, size_type count, const T& value)
+    {
+        T copy(value);
+        size_type p = pos - begin();
+        grow(size() + count);
+        T* ptr = item_ptr(p);
+        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        fill(ptr, count, copy);
+        _size += count;
+    }
+
+    //! [first, last) must not be in this prevector
+    template <typename InputIterator, typename = RequireIterator<InputIterator>>
+    void insert(iterator pos, InputIterator first, InputIterator last)
+    {
+        size_type p = pos - begin();
+        size_type count = std::distance(first, last);
+        grow(size() + count);
+        T* ptr = item_ptr(p);
+        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        fill(ptr, first, last);
+        _size += count;
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        T* endp = item_ptr(size());
+        if (!std::is_trivially_destructible<T>::value) {
+            for (iterator p = first; p != last; ++p)
+                (*p).~T();
+        }
+        memmove(first.operator->(), last.operator->(), (endp - last.operator->()) * sizeof(T));
+        _size -= last - first;
+        return first;
+    }
+
+    void push_back(const T& value)
+    {
+        T copy(value);
+        grow(size() + 1);
+        new(static_cast<void*>(item_ptr(size()))) T(copy);
+        _size++;
+    }
+
+    void pop_back()
+    {
+        erase(end() - 1, end());
+    }
+
+    void swap(prevector& other)
+    {
+        std::swap(_union, other._union);
+        std::swap(_size, other._size);
+    }
+
+    bool operator==(const prevector& other) const
+    {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const prevector& other) const
+    {
+        return !(*this == other);
+    }
+
+    //! lexicographical, as for std::vector
+    bool operator<(const prevector& other) const
+    {
+        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+    }
+
+    //! bytes allocated on the heap, for the memory usage
+    size_t allocated_memory() const
+    {
+        return is_direct() ? 0 : (size_t)sizeof(T) * _union.heap.capacity;
+    }
+};
+#pragma pack(pop)
+
+#endif // BITCOIN_PREVECTOR_H
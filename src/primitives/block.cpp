@@ -5,10 +5,12 @@
 
 #include "primitives/block.h"
 
+#include "checkqueue.h"
 #include "hash.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
 #include <sc/sidechainTxsCommitmentBuilder.h>
 #include <serialize.h>
 // uncomment for debugging mkl root hash calculations
@@ -71,7 +73,7 @@ size_t CBlock::GetSerializeComponentsSize(size_t& headerSize, size_t& totalTxSiz
     return totalBlockSize;
 }
 
-uint256 CBlock::BuildMerkleTree(bool* fMutated) const
+uint256 CBlock::BuildMerkleTree(bool* fMutated, CCheckExecutor* pexecutor) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
@@ -117,31 +119,93 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     for (auto it(vTxBase.begin()); it != vTxBase.end(); ++it)
         vMerkleTree.push_back((*it)->GetHash());
 
-    return BuildMerkleTree(vMerkleTree, vTxBase.size(), fMutated);
+    return BuildMerkleTree(vMerkleTree, vTxBase.size(), fMutated, pexecutor);
 }
 
-uint256 CBlock::BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* fMutated)
+namespace {
+
+/** Hashes of consecutive pairs of nodes of a merkle tree level, stored one after the other, into the next level */
+class CMerkleLevelSlice
 {
-    int j = 0;
+private:
+    const uint256* pIn;
+    uint256* pOut;
+    size_t nPairs;
+
+public:
+    CMerkleLevelSlice(): pIn(NULL), pOut(NULL), nPairs(0) {}
+    CMerkleLevelSlice(const uint256* pInIn, uint256* pOutIn, size_t nPairsIn): pIn(pInIn), pOut(pOutIn), nPairs(nPairsIn) {}
+
+    bool operator()()
+    {
+        SHA256D64(pOut->begin(), pIn->begin(), nPairs);
+        return true;
+    }
+
+    void swap(CMerkleLevelSlice& slice)
+    {
+        std::swap(pIn, slice.pIn);
+        std::swap(pOut, slice.pOut);
+        std::swap(nPairs, slice.nPairs);
+    }
+};
+
+//! pairs hashed by each task when a level is split across threads, a few hundred microseconds of work
+const size_t MERKLE_SLICE_PAIRS = 512;
+
+}
+
+uint256 CBlock::BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* fMutated, CCheckExecutor* pexecutor)
+{
+    static_assert(sizeof(uint256) == 32, "the nodes of a level must be contiguous 32-byte hashes");
+
+    // the levels are stored one after the other: reserving all of them keeps the pointers to the nodes valid
+    size_t nNodes = vMerkleTreeIn.size();
+    for (size_t nSize = vtxSize; nSize > 1; nSize = (nSize + 1) / 2)
+        nNodes += (nSize + 1) / 2;
+    vMerkleTreeIn.reserve(nNodes);
+
+    bool fParallel = pexecutor != NULL && pexecutor->GetWorkerCount() > 0;
+    size_t j = 0;
     bool mutated = false;
-    for (int nSize = vtxSize; nSize > 1; nSize = (nSize + 1) / 2)
+    for (size_t nSize = vtxSize; nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTreeIn[j+i] == vMerkleTreeIn[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTreeIn.push_back(Hash(BEGIN(vMerkleTreeIn[j+i]),  END(vMerkleTreeIn[j+i]),
-                                         BEGIN(vMerkleTreeIn[j+i2]), END(vMerkleTreeIn[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTreeIn[j+nSize-2] == vMerkleTreeIn[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+
+        // the nodes of the level are hashed pairwise as they lie in memory, as 64-byte inputs
+        size_t nPairs = nSize / 2;
+        vMerkleTreeIn.resize(j + nSize + (nSize + 1) / 2);
+        const uint256* pLevel = &vMerkleTreeIn[j];
+        uint256* pNext = &vMerkleTreeIn[j + nSize];
+        if (fParallel && nPairs >= 2 * MERKLE_SLICE_PAIRS) {
+            CCheckGroup<CMerkleLevelSlice> group(pexecutor, 1);
+            std::vector<CMerkleLevelSlice> vSlices;
+            for (size_t i = 0; i < nPairs; i += MERKLE_SLICE_PAIRS)
+                vSlices.push_back(CMerkleLevelSlice(pLevel + 2 * i, pNext + i, std::min(MERKLE_SLICE_PAIRS, nPairs - i)));
+            group.Add(vSlices);
+            group.Wait();
+        } else {
+            SHA256D64(pNext->begin(), pLevel->begin(), nPairs);
+        }
+
+        // an odd node is hashed with itself
+        if (nSize % 2 == 1) {
+            const uint256& last = pLevel[nSize - 1];
+            pNext[nPairs] = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
+        }
 #ifdef DEBUG_MKLTREE_HASH
+        for (size_t i = 0; i < nSize; i += 2)
+        {
+            size_t i2 = std::min(i+1, nSize-1);
             std::cout << " -------------------------------------------" << std::endl;
-            std::cout << i << ") mkl hash: " << vMerkleTreeIn.back().ToString() << std::endl;
-            std::cout <<      "      hash1: " << vMerkleTreeIn[j+i].ToString() << std::endl;
-            std::cout <<      "      hash2: " << vMerkleTreeIn[j+i2].ToString() << std::endl;
-#endif
+            std::cout << i << ") mkl hash: " << pNext[i/2].ToString() << std::endl;
+            std::cout <<      "      hash1: " << pLevel[i].ToString() << std::endl;
+            std::cout <<      "      hash2: " << pLevel[i2].ToString() << std::endl;
         }
+#endif
         j += nSize;
     }
     if (fMutated) {
@@ -12,6 +12,7 @@
 #include "serialize.h"
 #include "uint256.h"
 
+class CCheckExecutor;
 class CCoinsViewCache;
 
 /** Nodes collect new transactions into a block, hash them into a hash tree,
@@ -178,8 +179,9 @@ public:
     // Build the in-memory merkle tree for this block and return the merkle root.
     // If non-NULL, *mutated is set to whether mutation was detected in the merkle
     // tree (a duplication of transactions in the block leading to an identical
-    // merkle root).
-    uint256 BuildMerkleTree(bool* mutated = NULL) const;
+    // merkle root). If non-NULL, pexecutor hashes the largest levels of the tree
+    // on its threads.
+    uint256 BuildMerkleTree(bool* mutated = NULL, CCheckExecutor* pexecutor = NULL) const;
 
     // return the sc txs commitment calculated as described in zendoo paper. It is based on contribution from
     // sidechains-related txes and certificates contained in this block
@@ -192,7 +194,8 @@ public:
     void GetTxAndCertsVector(std::vector<const CTransactionBase*>& vBase) const;
 
     // build the merkel tree storing it in the vMerkleTreeIn in/out vector and return the merkle root hash
-    static uint256 BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* mutated = NULL);
+    static uint256 BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* mutated = NULL,
+                                   CCheckExecutor* pexecutor = NULL);
 
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
 };
@@ -256,7 +256,8 @@ bool CScCertificate::CheckInputsLimit() const {
 bool CScCertificate::ContextualCheck(CValidationState& state, int nHeight, int dosLevel) const { return false;}
 bool CScCertificate::VerifyScript(
         const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
-        bool cacheStore, ScriptError* serror) const { return true; }
+        bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata,
+        CSignatureBatch* psigbatch) const { return true; }
 void CScCertificate::AddJoinSplitToJSON(UniValue& entry) const { return; }
 void CScCertificate::Relay() const {}
 std::shared_ptr<const CTransactionBase> CScCertificate::MakeShared() const
@@ -283,7 +284,8 @@ bool CScCertificate::ContextualCheck(CValidationState& state, int nHeight, int d
 
 bool CScCertificate::VerifyScript(
         const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
-        bool cacheStore, ScriptError* serror) const
+        bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata,
+        CSignatureBatch* psigbatch) const
 {
     if (nIn >= GetVin().size() )
         return ::error("%s:%d can not verify Signature: nIn too large for vin size %d",
@@ -292,7 +294,7 @@ bool CScCertificate::VerifyScript(
     const CScript &scriptSig = GetVin()[nIn].scriptSig;
 
     if (!::VerifyScript(scriptSig, scriptPubKey, nFlags,
-                      CachingCertificateSignatureChecker(this, nIn, chain, cacheStore),
+                      CachingCertificateSignatureChecker(this, nIn, chain, cacheStore, txdata, psigbatch),
                       serror))
     {
         return ::error("%s:%d VerifySignature failed: %s", GetHash().ToString(), nIn, ScriptErrorString(*serror));
@@ -308,10 +310,9 @@ void CScCertificate::AddJoinSplitToJSON(UniValue& entry) const
 
 void CScCertificate::Relay() const
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << *this;
-    ::Relay(*this, ss);
+    // share the mempool copy, only certificates not in the mempool are copied
+    std::shared_ptr<const CTransactionBase> pcert = mempool.get(GetHash());
+    ::Relay(pcert ? pcert : MakeShared());
 }
 
 std::shared_ptr<const CTransactionBase>
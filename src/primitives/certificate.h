@@ -216,10 +216,14 @@ public:
 
     bool VerifyScript(
             const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
-            bool cacheStore, ScriptError* serror) const override;
+            bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata = nullptr,
+            CSignatureBatch* psigbatch = nullptr) const override;
     void AddJoinSplitToJSON(UniValue& entry) const override;
 };
 
+/** Immutable certificate shared by its holders (mempool, relay, notifications) instead of copied */
+typedef std::shared_ptr<const CScCertificate> CScCertificateRef;
+
 /** A mutable version of CScCertificate. */
 struct CMutableScCertificate : public CMutableTransactionBase
 {
@@ -968,7 +968,8 @@ void CTransaction::AddCeasedSidechainWithdrawalInputsToJSON(UniValue& entry) con
 void CTransaction::AddSidechainOutsToJSON(UniValue& entry) const { return; }
 bool CTransaction::VerifyScript(
         const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
-        bool cacheStore, ScriptError* serror) const { return true; }
+        bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata,
+        CSignatureBatch* psigbatch) const { return true; }
 std::string CTransaction::EncodeHex() const { return ""; }
 void CTransaction::Relay() const {}
 std::shared_ptr<const CTransactionBase> CTransaction::MakeShared() const
@@ -1140,7 +1141,8 @@ void CTransaction::AddSidechainOutsToJSON(UniValue& entry) const
 
 bool CTransaction::VerifyScript(
         const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
-        bool cacheStore, ScriptError* serror) const
+        bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata,
+        CSignatureBatch* psigbatch) const
 {
     // For CTransaction we should consider both regular inputs and CSW inputs
     unsigned int nTotalInputs = IsScVersion() ? GetVin().size() + GetVcswCcIn().size() : GetVin().size();
@@ -1152,7 +1154,7 @@ bool CTransaction::VerifyScript(
     const CScript& scriptSig = isRegularInput ? GetVin()[nIn].scriptSig : GetVcswCcIn()[nIn - GetVin().size()].redeemScript;
 
     if (!::VerifyScript(scriptSig, scriptPubKey, nFlags,
-                      CachingTransactionSignatureChecker(this, nIn, chain, cacheStore),
+                      CachingTransactionSignatureChecker(this, nIn, chain, cacheStore, txdata, psigbatch),
                       serror))
     {
         return ::error("%s:%d VerifySignature failed: %s", GetHash().ToString(), nIn, ScriptErrorString(*serror));
@@ -1168,10 +1170,9 @@ std::string CTransaction::EncodeHex() const
 
 void CTransaction::Relay() const
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << *this;
-    ::Relay(*this, ss);
+    // share the mempool copy, only transactions not in the mempool are copied
+    std::shared_ptr<const CTransactionBase> ptx = mempool.get(GetHash());
+    ::Relay(ptx ? ptx : MakeShared());
 }
 
 std::shared_ptr<const CTransactionBase>
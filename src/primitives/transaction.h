@@ -34,6 +34,8 @@ class UniValue;
 class CBackwardTransferOut;
 class CValidationState;
 class CChain;
+class CPrecomputedTransactionData;
+class CSignatureBatch;
 class CMutableTransactionBase;
 struct CMutableTransaction;
 
@@ -835,7 +837,8 @@ public:
 
     virtual bool VerifyScript(
         const CScript& scriptPubKey, unsigned int flags, unsigned int nIn, const CChain* chain,
-        bool cacheStore, ScriptError* serror) const = 0;
+        bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata = nullptr,
+        CSignatureBatch* psigbatch = nullptr) const = 0;
 
     //-----------------
     // default values for derived classes which do not support specific data structures
@@ -1045,9 +1048,13 @@ public:
 
     bool VerifyScript(
             const CScript& scriptPubKey, unsigned int flags, unsigned int nIn, const CChain* chain,
-            bool cacheStore, ScriptError* serror) const override;
+            bool cacheStore, ScriptError* serror, const CPrecomputedTransactionData* txdata = nullptr,
+            CSignatureBatch* psigbatch = nullptr) const override;
 };
 
+/** Immutable transaction shared by its holders (mempool, relay, notifications) instead of copied */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+
 /** A mutable hierarchy version of CTransaction. */
 struct CMutableTransactionBase
 {
@@ -16,24 +16,8 @@ secp256k1_context* secp256k1_context_verify = NULL;
 
 
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
-    if (!IsValid())
-        return false;
-    secp256k1_pubkey pubkey;
-    secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
-        return false;
-    }
-    if (vchSig.size() == 0) {
-        return false;
-    }
-    /* Zcash, unlike Bitcoin, has always enforced strict DER signatures. */
-    if (!secp256k1_ecdsa_signature_parse_der(secp256k1_context_verify, &sig, &vchSig[0], vchSig.size())) {
-        return false;
-    }
-    /* libsecp256k1's ECDSA verification requires lower-S signatures, which have
-     * not historically been enforced in Bitcoin or Zcash, so normalize them first. */
-    secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, &sig, &sig);
-    return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
+    CParsedPubKey pubkey;
+    return pubkey.Set(*this) && pubkey.Verify(hash, vchSig);
 }
 
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
@@ -77,6 +61,34 @@ bool CPubKey::Decompress() {
     return true;
 }
 
+bool CParsedPubKey::Set(const CPubKey& pubkey) {
+    static_assert(sizeof(data) == sizeof(secp256k1_pubkey), "unexpected size of secp256k1_pubkey");
+    secp256k1_pubkey parsed;
+    fValid = pubkey.IsValid() && secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parsed, &pubkey[0], pubkey.size());
+    if (fValid)
+        memcpy(data, &parsed, sizeof(data));
+    return fValid;
+}
+
+bool CParsedPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!fValid)
+        return false;
+    secp256k1_pubkey pubkey;
+    memcpy(&pubkey, data, sizeof(data));
+    secp256k1_ecdsa_signature sig;
+    if (vchSig.size() == 0) {
+        return false;
+    }
+    /* Zcash, unlike Bitcoin, has always enforced strict DER signatures. */
+    if (!secp256k1_ecdsa_signature_parse_der(secp256k1_context_verify, &sig, &vchSig[0], vchSig.size())) {
+        return false;
+    }
+    /* libsecp256k1's ECDSA verification requires lower-S signatures, which have
+     * not historically been enforced in Bitcoin or Zcash, so normalize them first. */
+    secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, &sig, &sig);
+    return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
+}
+
 bool CPubKey::Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const {
     assert(IsValid());
     assert((nChild >> 31) == 0);
@@ -198,6 +198,27 @@ public:
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 };
 
+/**
+ * A public key parsed, and decompressed, once for several verifications: CPubKey::Verify()
+ * parses the key for each of them.
+ */
+class CParsedPubKey
+{
+private:
+    //! the secp256k1_pubkey
+    unsigned char data[64];
+    bool fValid;
+
+public:
+    CParsedPubKey(): fValid(false) {}
+
+    //! Parse pubkey, returning whether it is fully valid
+    bool Set(const CPubKey& pubkey);
+
+    //! Same as CPubKey::Verify() on the key set
+    bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
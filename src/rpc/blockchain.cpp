@@ -7,12 +7,14 @@
 #include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "chainsnapshot.h"
 #include "checkpoints.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/script_error.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "script/standard.h"
 #include "rpc/server.h"
@@ -34,6 +36,8 @@
 #include "validationinterface.h"
 #include "txdb.h"
 #include "maturityheightindex.h"
+#include "leveldbwrapper.h"
+#include "paymentdisclosuredb.h"
 
 using namespace std;
 
@@ -114,14 +118,16 @@ static UniValue ValuePoolDesc(
     return rv;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+// Chain is either chainActive (with cs_main held) or a CChainSnapshot
+template <typename Chain>
+static UniValue blockheaderToJSON(const CBlockIndex* blockindex, const Chain& chain)
 {
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
     result.pushKV("confirmations", confirmations);
     result.pushKV("height", blockindex->nHeight);
     result.pushKV("version", blockindex->nVersion);
@@ -137,21 +143,26 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    const CBlockIndex *pnext = chain.Next(blockindex);
     if (pnext)
         result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
     return result;
 }
 
+UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+{
+    return blockheaderToJSON(blockindex, chainActive);
+}
+
 #ifdef ENABLE_ADDRESS_INDEXING
-UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
+UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain)
 {
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex)) {
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain.Contains(blockindex)) {
+        confirmations = chain.Height() - blockindex->nHeight + 1;
     } else {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block is an orphan");
     }
@@ -183,7 +194,7 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
                 CSpentIndexValue spentInfo;
                 CSpentIndexKey spentKey(input.prevout.hash, input.prevout.n);
 
-                if (GetSpentIndex(spentKey, spentInfo)) {
+                if (chain.GetSpentIndex(spentKey, spentInfo)) {
                     if (spentInfo.addressType == 1) {
                         delta.pushKV("address", CBitcoinAddress(CKeyID(spentInfo.addressHash)).ToString());
                     } else if (spentInfo.addressType == 2)  {
@@ -244,21 +255,22 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    const CBlockIndex *pnext = chain.Next(blockindex);
     if (pnext)
         result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
     return result;
 }
 #endif // ENABLE_ADDRESS_INDEXING
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+template <typename Chain>
+static UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, const Chain& chain, bool txDetails)
 {
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
 
     result.pushKV("confirmations", confirmations);
     result.pushKV("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
@@ -315,12 +327,17 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    const CBlockIndex *pnext = chain.Next(blockindex);
     if (pnext)
         result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
     return result;
 }
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    return blockToJSON(block, blockindex, chainActive, txDetails);
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -336,8 +353,8 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    CChainSnapshot chain;
+    return chain.Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -355,8 +372,8 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    CChainSnapshot chain;
+    return chain.Tip()->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -374,8 +391,10 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
-    return GetNetworkDifficulty();
+    CChainSnapshot chain;
+    if (chain.Tip() == NULL)
+        return 1.0;
+    return GetNetworkDifficulty(chain.Tip());
 }
 
 static void AddDependancy(const CTransactionBase& root, UniValue& info)
@@ -390,7 +409,7 @@ static void AddDependancy(const CTransactionBase& root, UniValue& info)
     info.pushKV("depends", depends);
 }
 
-UniValue mempoolToJSON(bool fVerbose = false)
+static UniValue mempoolToJSON(bool fVerbose, int nTipHeight)
 {
     if (fVerbose)
     {
@@ -406,7 +425,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.pushKV("time", e.GetTime());
             info.pushKV("height", (int)e.GetHeight());
             info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
-            info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
+            info.pushKV("currentpriority", e.GetPriority(nTipHeight));
             info.pushKV("isCert", false);
             const CTransaction& tx = e.GetTx();
             info.pushKV("version", tx.nVersion);
@@ -423,7 +442,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.pushKV("time", e.GetTime());
             info.pushKV("height", (int)e.GetHeight());
             info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
-            info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
+            info.pushKV("currentpriority", e.GetPriority(nTipHeight));
             info.pushKV("isCert", true);
             const CScCertificate& cert = e.GetCertificate();
             info.pushKV("version", cert.nVersion);
@@ -455,6 +474,11 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+UniValue mempoolToJSON(bool fVerbose = false)
+{
+    return mempoolToJSON(fVerbose, chainActive.Height());
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -490,13 +514,13 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getrawmempool", "true")
         );
 
-    LOCK(cs_main);
-
     bool fVerbose = false;
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    // the height is only used for the current priority of the entries
+    CChainSnapshot chain;
+    return mempoolToJSON(fVerbose, chain.Height());
 }
 
 #ifdef ENABLE_ADDRESS_INDEXING
@@ -508,19 +532,20 @@ UniValue getblockdeltas(const UniValue& params, bool fHelp)
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CChainSnapshot chain;
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    const CBlockIndex* pblockindex = CChainSnapshot::LookupBlockIndex(hash);
+    if (pblockindex == NULL)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    if (!CChainSnapshot::HaveBlockData(pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    CBlock block;
     if(!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    return blockToDeltasJSON(block, pblockindex);
+    return blockToDeltasJSON(block, pblockindex, chain);
 }
 
 UniValue getblockhashes(const UniValue& params, bool fHelp)
@@ -536,6 +561,10 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
             "    {\n"
             "      \"noOrphans\":true   (boolean) will only include blocks on the main chain\n"
             "      \"logicalTimes\":true   (boolean) will include logical timestamps with hashes\n"
+            "      \"limit\":n   (numeric, optional) maximum number of hashes to return, enables paging\n"
+            "      \"offset\":n   (numeric, optional, default=0) number of matching hashes to skip\n"
+            "      \"cursor\":\"xxx\"   (string, optional) continue after the \"nextcursor\" of a previous call, enables paging\n"
+            "      \"reverse\":true   (boolean, optional, default=false) return the newest blocks first\n"
             "    }\n"
             "\nResult:\n"
             "[\n"
@@ -547,36 +576,78 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
             "    \"logicalts\": (numeric) The logical timestamp\n"
             "  }\n"
             "]\n"
+            "\nResult (with paging):\n"
+            "{\n"
+            "  \"blockhashes\": [...]   (array) The hashes, in one of the formats above\n"
+            "  \"nextcursor\": \"xxx\"   (string) Cursor of the next page, only present if there are more hashes\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getblockhashes", "1231614698 1231024505")
             + HelpExampleRpc("getblockhashes", "1231614698, 1231024505")
             + HelpExampleCli("getblockhashes", "1231614698 1231024505 '{\"noOrphans\":false, \"logicalTimes\":true}'")
+            + HelpExampleCli("getblockhashes", "1231614698 1231024505 '{\"noOrphans\":true, \"limit\":100, \"reverse\":true}'")
             );
 
     unsigned int high = params[0].get_int();
     unsigned int low = params[1].get_int();
     bool fActiveOnly = false;
     bool fLogicalTS = false;
+    bool fPaged = false;
+    CTimestampIndexScan scan;
 
     if (params.size() > 2) {
         if (params[2].isObject()) {
             UniValue noOrphans = find_value(params[2].get_obj(), "noOrphans");
             UniValue returnLogical = find_value(params[2].get_obj(), "logicalTimes");
+            UniValue limit = find_value(params[2].get_obj(), "limit");
+            UniValue offset = find_value(params[2].get_obj(), "offset");
+            UniValue cursor = find_value(params[2].get_obj(), "cursor");
+            UniValue reverse = find_value(params[2].get_obj(), "reverse");
 
             if (noOrphans.isBool())
                 fActiveOnly = noOrphans.get_bool();
 
             if (returnLogical.isBool())
                 fLogicalTS = returnLogical.get_bool();
+
+            if (reverse.isBool())
+                scan.fReverse = reverse.get_bool();
+
+            if (!limit.isNull()) {
+                if (limit.get_int() <= 0)
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid limit, must be positive");
+                scan.nLimit = limit.get_int();
+                fPaged = true;
+            }
+
+            if (!offset.isNull()) {
+                if (offset.get_int() < 0)
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid offset, must be non-negative");
+                scan.nOffset = offset.get_int();
+            }
+
+            if (!cursor.isNull()) {
+                if (!IsHex(cursor.get_str()))
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+                std::vector<unsigned char> cursorData(ParseHex(cursor.get_str()));
+                CDataStream ssCursor(cursorData, SER_NETWORK, PROTOCOL_VERSION);
+                try {
+                    ssCursor >> scan.cursor;
+                } catch (const std::exception&) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+                }
+                scan.fHaveCursor = true;
+                fPaged = true;
+            }
         }
     }
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
+    CTimestampIndexKey lastKey;
+    bool fMore = false;
 
-    if (fActiveOnly)
-        LOCK(cs_main);
-
-    if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
+    CChainSnapshot chain;
+    if (!chain.GetTimestampIndex(high, low, fActiveOnly, scan, blockHashes, lastKey, fMore)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
 
@@ -593,7 +664,17 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
         }
     }
 
-    return result;
+    if (!fPaged)
+        return result;
+
+    UniValue page(UniValue::VOBJ);
+    page.pushKV("blockhashes", result);
+    if (fMore) {
+        CDataStream ssCursor(SER_NETWORK, PROTOCOL_VERSION);
+        ssCursor << lastKey;
+        page.pushKV("nextcursor", HexStr(ssCursor.begin(), ssCursor.end()));
+    }
+    return page;
 }
 #endif // ENABLE_ADDRESS_INDEXING
 
@@ -615,13 +696,13 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
-    LOCK(cs_main);
+    CChainSnapshot chain;
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > chain.Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = chain[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -660,8 +741,6 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockheader", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -669,10 +748,11 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CChainSnapshot chain;
 
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    const CBlockIndex* pblockindex = CChainSnapshot::LookupBlockIndex(hash);
+    if (pblockindex == NULL)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     if (!fVerbose)
     {
@@ -682,7 +762,7 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockheaderToJSON(pblockindex, chain);
 }
 
 UniValue getblock(const UniValue& params, bool fHelp)
@@ -748,7 +828,7 @@ UniValue getblock(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblock", "height")
         );
 
-    LOCK(cs_main);
+    CChainSnapshot chain;
 
     std::string strHash = params[0].get_str();
 
@@ -768,10 +848,10 @@ UniValue getblock(const UniValue& params, bool fHelp)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
         }
 
-        if (nHeight < 0 || nHeight > chainActive.Height()) {
+        if (nHeight < 0 || nHeight > chain.Height()) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
         }
-        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
+        strHash = chain[nHeight]->GetBlockHash().GetHex();
     }
 
     uint256 hash(uint256S(strHash));
@@ -789,15 +869,14 @@ UniValue getblock(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
     }
 
-    if (mapBlockIndex.count(hash) == 0)
+    const CBlockIndex* pblockindex = CChainSnapshot::LookupBlockIndex(hash);
+    if (pblockindex == NULL)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    if (!CChainSnapshot::HaveBlockData(pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    CBlock block;
     if(!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -809,7 +888,7 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    return blockToJSON(block, pblockindex, chain, verbosity >= 2);
 }
 
 UniValue getblockexpanded(const UniValue& params, bool fHelp)
@@ -887,7 +966,7 @@ UniValue getblockexpanded(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockexpanded", "height")
         );
 
-    LOCK(cs_main);
+    CChainSnapshot chain;
 
     std::string strHash = params[0].get_str();
 
@@ -912,10 +991,10 @@ UniValue getblockexpanded(const UniValue& params, bool fHelp)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
         }
 
-        if (nHeight < 0 || nHeight > chainActive.Height()) {
+        if (nHeight < 0 || nHeight > chain.Height()) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
         }
-        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
+        strHash = chain[nHeight]->GetBlockHash().GetHex();
     }
 
     uint256 hash(uint256S(strHash));
@@ -933,19 +1012,18 @@ UniValue getblockexpanded(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 1 to 2");
     }
 
-    if (mapBlockIndex.count(hash) == 0)
+    const CBlockIndex* pblockindex = CChainSnapshot::LookupBlockIndex(hash);
+    if (pblockindex == NULL)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    if (!CChainSnapshot::HaveBlockData(pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    CBlock block;
     if(!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    UniValue blockJSON = blockToJSON(block, pblockindex, verbosity >= 2);
+    UniValue blockJSON = blockToJSON(block, pblockindex, chain, verbosity >= 2);
     
     //Add certificates that became mature with this block    
     if (block.nVersion == BLOCK_VERSION_SC_SUPPORT)
@@ -1026,6 +1104,198 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue LatencyToJSON(const CLevelDBLatencyHistogram& histogram)
+{
+    UniValue ret(UniValue::VOBJ);
+    uint64_t nCount = histogram.GetCount();
+    ret.pushKV("count", nCount);
+    ret.pushKV("avg_us", nCount > 0 ? (double)histogram.GetTotalMicros() / nCount : 0.0);
+    ret.pushKV("p50_us", histogram.GetPercentile(0.5));
+    ret.pushKV("p99_us", histogram.GetPercentile(0.99));
+
+    // only up to the slowest non-empty bucket
+    int nLast = -1;
+    for (int i = 0; i < CLevelDBLatencyHistogram::NUM_BUCKETS; ++i)
+        if (histogram.GetBucket(i) > 0)
+            nLast = i;
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i <= nLast; ++i)
+        buckets.push_back(histogram.GetBucket(i));
+    ret.pushKV("histogram", buckets);
+    return ret;
+}
+
+static UniValue LevelDBPropertiesToJSON(const std::function<bool(const std::string&, std::string&)>& getProperty)
+{
+    UniValue ret(UniValue::VOBJ);
+    std::string strValue;
+
+    UniValue levels(UniValue::VARR);
+    for (int level = 0; getProperty(strprintf("leveldb.num-files-at-level%d", level), strValue); ++level)
+        levels.push_back(atoi(strValue));
+    ret.pushKV("files_per_level", levels);
+
+    if (getProperty("leveldb.stats", strValue))
+        ret.pushKV("stats", strValue);
+    if (getProperty("leveldb.sstables", strValue))
+        ret.pushKV("sstables", strValue);
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getdbstats ( \"name\" )\n"
+            "\nReturns usage statistics and LevelDB internals of the node databases (chainstate, block index, explorer indexes, payment disclosure).\n"
+            "Counters and latencies are collected since startup.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"                     (string, optional) Only report the database with this name (e.g. \"chainstate\")\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                    (object) one entry per database, keyed by its path relative to the data directory\n"
+            "                                  (numbered, as \"path:memory-n\", for in-memory databases)\n"
+            "    \"approximate_size\": n,     (numeric) approximate size on disk in bytes\n"
+            "    \"reads\": n,                (numeric) number of point reads\n"
+            "    \"reads_not_found\": n,      (numeric) number of point reads for missing keys\n"
+            "    \"exists\": n,               (numeric) number of existence checks\n"
+            "    \"batch_writes\": n,         (numeric) number of written batches\n"
+            "    \"bytes_written\": n,        (numeric) key and value bytes written\n"
+            "    \"iterators\": n,            (numeric) number of iterators created\n"
+            "    \"block_cache\": {           (object) LevelDB block cache\n"
+            "      \"hits\": n,\n"
+            "      \"misses\": n,\n"
+            "      \"hit_rate\": x.xxx\n"
+            "    },\n"
+            "    \"table_file_opens\": n,     (numeric) table files opened, high values mean the open files limit is too low\n"
+            "    \"read_latency\": {          (object) latency of reads and existence checks\n"
+            "      \"count\": n,\n"
+            "      \"avg_us\": x.xxx,\n"
+            "      \"p50_us\": n,             (numeric) upper bound of the median, in microseconds\n"
+            "      \"p99_us\": n,\n"
+            "      \"histogram\": [ n, ... ]  (array) bucket i counts operations faster than 2^i microseconds\n"
+            "    },\n"
+            "    \"write_latency\": { ... },  (object) latency of batch writes, including compaction stalls\n"
+            "    \"leveldb\": {\n"
+            "      \"files_per_level\": [ n, ... ],\n"
+            "      \"stats\": \"...\",         (string) the leveldb.stats property\n"
+            "      \"sstables\": \"...\"       (string) the leveldb.sstables property\n"
+            "    }\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleCli("getdbstats", "\"chainstate\"")
+            + HelpExampleRpc("getdbstats", "\"blocks/index\"")
+        );
+
+    std::string strFilter;
+    if (params.size() > 0)
+        strFilter = params[0].get_str();
+
+    UniValue ret(UniValue::VOBJ);
+
+    ForEachLevelDB([&ret, &strFilter](const CLevelDBWrapper& db) {
+        if (!strFilter.empty() && db.GetName() != strFilter)
+            return;
+
+        const CLevelDBCounters& counters = db.GetCounters();
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("approximate_size", db.GetApproximateSize());
+        entry.pushKV("reads", (uint64_t)counters.nReads);
+        entry.pushKV("reads_not_found", (uint64_t)counters.nReadsNotFound);
+        entry.pushKV("exists", (uint64_t)counters.nExists);
+        entry.pushKV("batch_writes", (uint64_t)counters.nBatchWrites);
+        entry.pushKV("bytes_written", (uint64_t)counters.nBytesWritten);
+        entry.pushKV("iterators", (uint64_t)counters.nIterators);
+
+        uint64_t nHits = counters.nBlockCacheHits;
+        uint64_t nMisses = counters.nBlockCacheMisses;
+        UniValue blockCache(UniValue::VOBJ);
+        blockCache.pushKV("hits", nHits);
+        blockCache.pushKV("misses", nMisses);
+        blockCache.pushKV("hit_rate", (nHits + nMisses) > 0 ? (double)nHits / (nHits + nMisses) : 0.0);
+        entry.pushKV("block_cache", blockCache);
+        entry.pushKV("table_file_opens", (uint64_t)counters.nTableFileOpens);
+
+        entry.pushKV("read_latency", LatencyToJSON(counters.readLatency));
+        entry.pushKV("write_latency", LatencyToJSON(counters.writeLatency));
+        entry.pushKV("leveldb", LevelDBPropertiesToJSON([&db](const std::string& name, std::string& value) {
+            return db.GetProperty(name, value);
+        }));
+
+        ret.pushKV(db.GetName(), entry);
+    });
+
+    // not a CLevelDBWrapper: only LevelDB internals are available, and only if the database is in use
+    if (fExperimentalMode && GetBoolArg("-paymentdisclosure", false) && (strFilter.empty() || strFilter == "paymentdisclosure")) {
+        std::shared_ptr<PaymentDisclosureDB> pdb = PaymentDisclosureDB::sharedInstance();
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("leveldb", LevelDBPropertiesToJSON([&pdb](const std::string& name, std::string& value) {
+            return pdb->GetProperty(name, value);
+        }));
+        ret.pushKV("paymentdisclosure", entry);
+    }
+
+    if (!strFilter.empty() && ret.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database " + strFilter);
+
+    return ret;
+}
+
+static UniValue SignatureCacheStatsToJSON(const CSignatureCacheStats& stats)
+{
+    uint64_t nMisses = stats.nLookups - std::min(stats.nHits, stats.nLookups);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("bytes", (uint64_t)stats.nBytes);
+    ret.pushKV("capacity", (uint64_t)stats.nCapacity);
+    ret.pushKV("lookups", stats.nLookups);
+    ret.pushKV("hits", stats.nHits);
+    ret.pushKV("misses", nMisses);
+    ret.pushKV("hit_rate", stats.nLookups > 0 ? (double)stats.nHits / stats.nLookups : 0.0);
+    ret.pushKV("inserts", stats.nInserts);
+    ret.pushKV("evictions", stats.nEvictions);
+    ret.pushKV("erasures", stats.nErasures);
+    return ret;
+}
+
+UniValue getsigcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns the usage of the cache of verified signatures, and of the one of transactions and certificates\n"
+            "whose scripts were all verified, collected since startup.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"bytes\": n,               (numeric) memory allocated to the cache, half of -maxsigcachemem\n"
+            "  \"capacity\": n,            (numeric) number of signatures the cache can hold\n"
+            "  \"lookups\": n,             (numeric) number of signatures looked up\n"
+            "  \"hits\": n,                (numeric) number of signatures found, whose verification was skipped\n"
+            "  \"misses\": n,\n"
+            "  \"hit_rate\": x.xxx,\n"
+            "  \"inserts\": n,             (numeric) number of verified signatures added\n"
+            "  \"evictions\": n,           (numeric) number of signatures dropped to make room for new ones\n"
+            "  \"erasures\": n,            (numeric) number of signatures found while connecting blocks and released\n"
+            "  \"script_execution\": { ... } (object) the same counters, for transactions and certificates whose inputs\n"
+            "                             were all found valid with the block script verification flags\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+        );
+
+    UniValue ret = SignatureCacheStatsToJSON(GetSignatureCacheStats());
+    ret.pushKV("script_execution", SignatureCacheStatsToJSON(GetScriptExecutionCacheStats()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 4)
@@ -1066,8 +1336,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             + HelpExampleRpc("gettxout", "\"txid\", 1")
         );
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = params[0].get_str();
@@ -1081,27 +1349,33 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 3)
         fIncludeImmatureBTs = params[3].get_bool();
 
+    // only the lookup needs cs_main: the coins are copied out together with the state they belong to
     CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
+    const CBlockIndex *pindex = NULL;
+    int nCoinsHeight = -1;
+    {
+        LOCK(cs_main);
+        if (fMempool) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool view(pcoinsTip, mempool);
+            if (!view.GetCoins(hash, coins))
+                return NullUniValue;
+            mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        } else {
+            if (!pcoinsTip->GetCoins(hash, coins))
+                return NullUniValue;
+        }
+        nCoinsHeight = pcoinsTip->GetHeight();
+        pindex = mapBlockIndex.find(pcoinsTip->GetBestBlock())->second;
     }
     if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
         return NullUniValue;
 
     // Note: we may discard either immature coinbases and certificate BTs
-    bool isOutputMature = coins.isOutputMature(n, pcoinsTip->GetHeight()+1);
+    bool isOutputMature = coins.isOutputMature(n, nCoinsHeight+1);
     if(!fIncludeImmatureBTs && !isOutputMature)
         return NullUniValue;
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *pindex = it->second;
     ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
     if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
         ret.pushKV("confirmations", 0);
@@ -1124,7 +1398,7 @@ UniValue gettxout(const UniValue& params, bool fHelp)
         ret.pushKV("maturityHeight", isCoinFromMempool ? -1 : coins.nBwtMaturityHeight);
         ret.pushKV("blocksToMaturity", isCoinFromMempool ? -1 :
                        isOutputMature ? 0 :
-                           coins.nBwtMaturityHeight - (pcoinsTip->GetHeight() + 1));
+                           coins.nBwtMaturityHeight - (nCoinsHeight + 1));
     }
 
     return ret;
@@ -1393,6 +1667,9 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("size", (int64_t) mempool.size());
     ret.pushKV("bytes", (int64_t) mempool.GetTotalSize());
     ret.pushKV("usage", (int64_t) mempool.DynamicMemoryUsage());
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.pushKV("maxmempool", (int64_t) maxmempool);
+    ret.pushKV("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK()));
 
     if (Params().NetworkIDString() == "regtest") {
         ret.pushKV("fullyNotified", mempool.IsFullyNotified());
@@ -1413,6 +1690,8 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) current tx count\n"
             "  \"bytes\": xxxxx               (numeric) sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) minimum fee for tx to be accepted\n"
             "}\n"
             
             "\nExamples:\n"
@@ -1423,6 +1702,30 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue savemempool(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "savemempool\n"
+            "\nDumps the mempool to disk, it is reloaded from there on the next start (see -persistmempool).\n"
+
+            "\nResult:\n"
+            "Nothing\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("savemempool", "")
+            + HelpExampleRpc("savemempool", "")
+        );
+
+    if (!fMempoolLoaded)
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+
+    if (!DumpMempool())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
+
+    return NullUniValue;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1563,17 +1866,54 @@ static void addScUnconfCcData(const uint256& scId, UniValue& sc)
     // there are no info about bwt requests in sc db, therefore we do not include them neither when they are in mempool
 }
 
-bool FillScRecordFromInfo(const uint256& scId, const CSidechain& info, CSidechain::State scState, const CCoinsViewCache& scView, 
-    UniValue& sc, bool bOnlyAlive, bool bVerbose)
+/** Confirmed state of a sidechain, copied out of the coins view */
+struct CScInfoCopy
+{
+    uint256 scId;
+    CSidechain info;
+    CSidechain::State state;
+    CScCertificateView activeCertView;
+};
+
+/**
+ * Copies the confirmed state of the given sidechains and returns the height of the chain it belongs to.
+ * Only the copy holds cs_main: the coins view cannot be snapshotted, the records are formatted from the copies.
+ */
+static int CopyScInfo(const std::vector<uint256>& vScIds, std::vector<CScInfoCopy>& vScInfo)
+{
+    LOCK(cs_main);
+    CCoinsViewCache scView(pcoinsTip);
+    vScInfo.resize(vScIds.size());
+    for (size_t i = 0; i < vScIds.size(); i++) {
+        CScInfoCopy& sc = vScInfo[i];
+        sc.scId = vScIds[i];
+        if (!scView.GetSidechain(sc.scId, sc.info)) {
+            LogPrint("sc", "%s():%d - scid[%s] not yet created\n", __func__, __LINE__, sc.scId.ToString() );
+        }
+        sc.state = scView.GetSidechainState(sc.scId);
+        if (!sc.info.IsNull())
+            sc.activeCertView = scView.GetActiveCertView(sc.scId);
+    }
+    return chainActive.Height();
+}
+
+bool FillScRecordFromInfo(const CScInfoCopy& scInfo, int nHeight, UniValue& sc, bool bOnlyAlive, bool bVerbose)
 {
+    const uint256& scId = scInfo.scId;
+    const CSidechain& info = scInfo.info;
+    const CSidechain::State scState = scInfo.state;
+
     if (bOnlyAlive && (scState != CSidechain::State::ALIVE))
         return false;
 
+    // the unconfirmed data of the sidechain comes from the mempool
+    LOCK(mempool.cs);
+
     sc.pushKV("scid", scId.GetHex());
     if (!info.IsNull() )
     {
         int currentEpoch = (scState == CSidechain::State::ALIVE)?
-                info.EpochFor(chainActive.Height()):
+                info.EpochFor(nHeight):
                 info.EpochFor(info.GetScheduledCeasingHeight());
  
         sc.pushKV("balance", ValueFromAmount(info.balance));
@@ -1593,7 +1933,7 @@ bool FillScRecordFromInfo(const uint256& scId, const CSidechain& info, CSidechai
         sc.pushKV("lastCertificateQuality", info.lastTopQualityCertQuality);
         sc.pushKV("lastCertificateAmount", ValueFromAmount(info.lastTopQualityCertBwtAmount));
 
-        const CScCertificateView& certView = scView.GetActiveCertView(scId);
+        const CScCertificateView& certView = scInfo.activeCertView;
         sc.pushKV("activeFtScFee", ValueFromAmount(certView.forwardTransferScFee));
         sc.pushKV("activeMbtrScFee", ValueFromAmount(certView.mainchainBackwardTransferRequestScFee));
  
@@ -1761,21 +2101,16 @@ bool FillScRecordFromInfo(const uint256& scId, const CSidechain& info, CSidechai
 
 bool FillScRecord(const uint256& scId, UniValue& scRecord, bool bOnlyAlive, bool bVerbose)
 {
-    CSidechain sidechain;
-    CCoinsViewCache scView(pcoinsTip);
-    if (!scView.GetSidechain(scId, sidechain)) {
-        LogPrint("sc", "%s():%d - scid[%s] not yet created\n", __func__, __LINE__, scId.ToString() );
-    }
-    CSidechain::State scState = scView.GetSidechainState(scId);
-
-    return FillScRecordFromInfo(scId, sidechain, scState, scView, scRecord, bOnlyAlive, bVerbose);
+    std::vector<CScInfoCopy> vScInfo;
+    int nHeight = CopyScInfo(std::vector<uint256>(1, scId), vScInfo);
+    return FillScRecordFromInfo(vScInfo[0], nHeight, scRecord, bOnlyAlive, bVerbose);
 }
 
 int FillScList(UniValue& scItems, bool bOnlyAlive, bool bVerbose, int from=0, int to=-1)
 {
     std::set<uint256> sScIds;
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
         CCoinsViewMemPool scView(pcoinsTip, mempool);
 
         scView.GetScIds(sScIds);
@@ -1797,15 +2132,15 @@ int FillScList(UniValue& scItems, bool bOnlyAlive, bool bVerbose, int from=0, in
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid interval");
     }
 
-    UniValue totalResult(UniValue::VARR);
-    std::set<uint256>::iterator it = sScIds.begin();
+    std::vector<CScInfoCopy> vScInfo;
+    int nHeight = CopyScInfo(std::vector<uint256>(sScIds.begin(), sScIds.end()), vScInfo);
 
-    while (it != sScIds.end())
+    UniValue totalResult(UniValue::VARR);
+    for (const CScInfoCopy& scInfo : vScInfo)
     {
         UniValue scRecord(UniValue::VOBJ);
-        if (FillScRecord(*it, scRecord, bOnlyAlive, bVerbose))
+        if (FillScRecordFromInfo(scInfo, nHeight, scRecord, bOnlyAlive, bVerbose))
             totalResult.push_back(scRecord);
-        ++it;
     }
 
     // check consistency of interval in the filtered results list
@@ -334,6 +334,12 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"pooledcert\": n,                (numeric) the number of certs in the mem pool\n"
             "  \"testnet\": true|false,          (boolean) if using testnet or not\n"
             "  \"chain\": \"xxxx\"               (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"blocktemplate\": {                (json object) the template served by getblocktemplate\n"
+            "    \"fullbuilds\": n,                (numeric) number of times it has been built from scratch\n"
+            "    \"deltaupdates\": n,              (numeric) number of times it has been updated with the mempool changes\n"
+            "    \"latencyp50\": n,                (numeric) median time to get it, in microseconds, over the latest requests\n"
+            "    \"latencyp99\": n                 (numeric) 99th percentile of the time to get it, in microseconds\n"
+            "  }\n"
             "}\n"
             
             "\nExamples:\n"
@@ -359,6 +365,13 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.pushKV("pooledcert",       (uint64_t)mempool.sizeCert());
     obj.pushKV("testnet",          Params().TestnetToBeDeprecatedFieldRPC());
     obj.pushKV("chain",            Params().NetworkIDString());
+
+    UniValue templateStats(UniValue::VOBJ);
+    templateStats.pushKV("fullbuilds",   blockTemplateManager.GetFullBuilds());
+    templateStats.pushKV("deltaupdates", blockTemplateManager.GetDeltaUpdates());
+    templateStats.pushKV("latencyp50",   blockTemplateManager.GetLatencyPercentile(0.5));
+    templateStats.pushKV("latencyp99",   blockTemplateManager.GetLatencyPercentile(0.99));
+    obj.pushKV("blocktemplate", templateStats);
 #ifdef ENABLE_MINING
     obj.pushKV("generate",         getgenerate(params, false));
 #endif
@@ -568,13 +581,10 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         includeMerkleRoots = params[1].get_bool();
     }
 
-    static unsigned int nTransactionsUpdatedLast;
-
     if (!lpval.isNull())
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
+        // Wait to respond until either the best block changes or the mempool does, i.e. the template would change
         uint256 hashWatchedChain;
-        boost::system_time checktxtime;
         unsigned int nTransactionsUpdatedLastLP;
 
         if (lpval.isStr())
@@ -589,24 +599,17 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nTransactionsUpdatedLastLP = blockTemplateManager.GetTransactionsUpdated();
         }
 
         // Release the wallet and main lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
         {
-            checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
-
-            boost::unique_lock<boost::mutex> lock(csBestBlock);
+            // a new tip updates the mempool too, the wait is only bounded to recheck the tip and the RPC state
             while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
             {
-                if (!cvBlockChange.timed_wait(lock, checktxtime))
-                {
-                    // Timeout: Check transactions for update
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
-                        break;
-                    checktxtime += boost::posix_time::seconds(10);
-                }
+                if (mempool.WaitForUpdate(nTransactionsUpdatedLastLP, boost::get_system_time() + boost::posix_time::minutes(1)))
+                    break;
             }
         }
         ENTER_CRITICAL_SECTION(cs_main);
@@ -617,38 +620,15 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     }
 
     // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = NULL;
-
-        // Store the pindexBest used before CreateNewBlockWithKey, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
-
-        // Create new block
-        if(pblocktemplate)
-        {
-            delete pblocktemplate;
-            pblocktemplate = NULL;
-        }
 #ifdef ENABLE_WALLET
-        CReserveKey reservekey(pwalletMain);
-        pblocktemplate = CreateNewBlockWithKey(reservekey);
+    CReserveKey reservekey(pwalletMain);
+    CBlockTemplate* pblocktemplate = blockTemplateManager.GetTemplate(reservekey);
 #else
-        pblocktemplate = CreateNewBlockWithKey();
+    CBlockTemplate* pblocktemplate = blockTemplateManager.GetTemplate();
 #endif
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlockWithKey succeeded
-        pindexPrev = pindexPrevNew;
-    }
+    if (!pblocktemplate)
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    const CBlockIndex* pindexPrev = blockTemplateManager.GetTip();
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
 
     // Update nTime
@@ -727,7 +707,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     if (includeMerkleRoots)
     {
-        pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+        pblock->hashMerkleRoot = pblock->BuildMerkleTree(NULL, GetValidationExecutor());
 
         if (certSupported) {
             CCoinsViewCache view(pcoinsTip);
@@ -772,7 +752,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     if (pblock->nVersion != BLOCK_VERSION_SC_SUPPORT)
         block_size_limit = MAX_BLOCK_SIZE_BEFORE_SC;
 
-    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast));
+    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(blockTemplateManager.GetTransactionsUpdated()));
     result.pushKV("target", hashTarget.GetHex());
     result.pushKV("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1);
     result.pushKV("mutable", aMutable);
@@ -1050,7 +1030,7 @@ UniValue getblockmerkleroots(const UniValue& params, bool fHelp) {
     pblock->vcert = certs;
     CCoinsViewCache view(pcoinsTip);
 
-    uint256 merkleTree = pblock->BuildMerkleTree();
+    uint256 merkleTree = pblock->BuildMerkleTree(NULL, GetValidationExecutor());
     uint256 scTxsCommitment;
     scTxsCommitment.SetNull();
     if (certSupported) {
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "chainsnapshot.h"
 #include "clientversion.h"
 #include "init.h"
 #include "main.h"
@@ -533,6 +534,23 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
 }
 
 #ifdef ENABLE_ADDRESS_INDEXING
+/** Concatenate the per-address results of a batched index lookup, keeping the request order */
+template <typename T>
+static std::vector<T> flattenAddressBatch(std::vector<std::vector<T> > &perAddress)
+{
+    size_t nTotal = 0;
+    for (const std::vector<T>& entries : perAddress)
+        nTotal += entries.size();
+
+    std::vector<T> result;
+    result.reserve(nTotal);
+    for (std::vector<T>& entries : perAddress) {
+        result.insert(result.end(), entries.begin(), entries.end());
+        std::vector<T>().swap(entries);
+    }
+    return result;
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -672,25 +690,22 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > unspentPerAddress;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
+    CChainSnapshot chain;
+    if (!chain.GetAddressUnspentBatch(addresses, unspentPerAddress)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs = flattenAddressBatch(unspentPerAddress);
+
     std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
 
     UniValue utxos(UniValue::VARR);
-    int currentTipHeight = -1;
+    int currentTipHeight = chain.Height();
     std::string bestHashStr;
-    {
-        LOCK(cs_main);
-        if (includeChainInfo)
-            bestHashStr = chainActive.Tip()->GetBlockHash().GetHex();
-        currentTipHeight = (int)chainActive.Height();
-    }
+    if (includeChainInfo)
+        bestHashStr = chain.Tip()->GetBlockHash().GetHex();
 
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
         UniValue output(UniValue::VOBJ);
@@ -824,20 +839,16 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex;
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > indexPerAddress;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    CChainSnapshot chain;
+    bool fHaveRange = (start > 0 && end > 0);
+    if (!chain.GetAddressIndexBatch(addresses, indexPerAddress, fHaveRange ? start : 0, fHaveRange ? end : 0)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex = flattenAddressBatch(indexPerAddress);
+
     UniValue deltas(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
@@ -859,14 +870,12 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     UniValue result(UniValue::VOBJ);
 
     if (includeChainInfo && start > 0 && end > 0) {
-        LOCK(cs_main);
-
-        if (start > chainActive.Height() || end > chainActive.Height()) {
+        if (start > chain.Height() || end > chain.Height()) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
         }
 
-        CBlockIndex* startIndex = chainActive[start];
-        CBlockIndex* endIndex = chainActive[end];
+        const CBlockIndex* startIndex = chain[start];
+        const CBlockIndex* endIndex = chain[end];
 
         UniValue startInfo(UniValue::VOBJ);
         UniValue endInfo(UniValue::VOBJ);
@@ -923,19 +932,20 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         includeImmatureBTs = params[1].get_bool();
 
-    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex;
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > indexPerAddress;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
+    CChainSnapshot chain;
+    if (!chain.GetAddressIndexBatch(addresses, indexPerAddress)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex = flattenAddressBatch(indexPerAddress);
+
     CAmount balance = 0;
     CAmount received = 0;
     CAmount immature = 0;
 
-    int currentTipHeight = chainActive.Tip()->nHeight;
+    int currentTipHeight = chain.Height();
 
     for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         //If maturityHeight is negative it's superseded and we skip it
@@ -1012,20 +1022,16 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex;
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > indexPerAddress;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    CChainSnapshot chain;
+    bool fHaveRange = (start > 0 && end > 0);
+    if (!chain.GetAddressIndexBatch(addresses, indexPerAddress, fHaveRange ? start : 0, fHaveRange ? end : 0)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex = flattenAddressBatch(indexPerAddress);
+
     std::set<std::pair<int, std::string> > txids;
     UniValue result(UniValue::VARR);
 
@@ -1088,7 +1094,8 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
     CSpentIndexKey key(txid, outputIndex);
     CSpentIndexValue value;
 
-    if (!GetSpentIndex(key, value)) {
+    CChainSnapshot chain;
+    if (!chain.GetSpentIndex(key, value)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
     }
 
@@ -203,6 +203,7 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 
     if (!hashBlock.IsNull()) {
         entry.pushKV("blockhash", hashBlock.GetHex());
+        LOCK(cs_main);
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
             CBlockIndex* pindex = (*mi).second;
@@ -317,6 +318,7 @@ void CertToJSON(const CScCertificate& cert, const uint256 hashBlock, UniValue& e
 
     if (!hashBlock.IsNull()) {
         entry.pushKV("blockhash", hashBlock.GetHex());
+        LOCK(cs_main);
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
             CBlockIndex* pindex = (*mi).second;
@@ -596,33 +598,36 @@ UniValue gettxoutproof(const UniValue& params, bool fHelp)
        oneTxid = hash;
     }
 
-    LOCK(cs_main);
-
     CBlockIndex* pblockindex = NULL;
 
-    uint256 hashBlock;
-    if (params.size() > 1)
+    // cs_main is only needed to locate the block, reading and scanning it is done without
     {
-        hashBlock = uint256S(params[1].get_str());
-        if (!mapBlockIndex.count(hashBlock))
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        pblockindex = mapBlockIndex[hashBlock];
-    } else {
-        CCoins coins;
-        if (pcoinsTip->GetCoins(oneTxid, coins) && coins.nHeight > 0 && coins.nHeight <= chainActive.Height())
-            pblockindex = chainActive[coins.nHeight];
-    }
+        LOCK(cs_main);
 
-    if (pblockindex == NULL)
-    {
-        // allocated by the callee
-        std::unique_ptr<CTransactionBase> pTxBase;
-        static const bool ALLOW_SLOW = false;
-        if (!GetTxBaseObj(oneTxid, pTxBase, hashBlock, ALLOW_SLOW) || !pTxBase)
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction/Certificate not yet in block");
-        if (!mapBlockIndex.count(hashBlock))
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction/Certificate index corrupt");
-        pblockindex = mapBlockIndex[hashBlock];
+        uint256 hashBlock;
+        if (params.size() > 1)
+        {
+            hashBlock = uint256S(params[1].get_str());
+            if (!mapBlockIndex.count(hashBlock))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            pblockindex = mapBlockIndex[hashBlock];
+        } else {
+            CCoins coins;
+            if (pcoinsTip->GetCoins(oneTxid, coins) && coins.nHeight > 0 && coins.nHeight <= chainActive.Height())
+                pblockindex = chainActive[coins.nHeight];
+        }
+
+        if (pblockindex == NULL)
+        {
+            // allocated by the callee
+            std::unique_ptr<CTransactionBase> pTxBase;
+            static const bool ALLOW_SLOW = false;
+            if (!GetTxBaseObj(oneTxid, pTxBase, hashBlock, ALLOW_SLOW) || !pTxBase)
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction/Certificate not yet in block");
+            if (!mapBlockIndex.count(hashBlock))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction/Certificate index corrupt");
+            pblockindex = mapBlockIndex[hashBlock];
+        }
     }
 
     CBlock block;
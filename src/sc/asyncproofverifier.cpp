@@ -11,16 +11,18 @@ const uint32_t CScAsyncProofVerifier::BATCH_VERIFICATION_MAX_SIZE = 10;      /**
 
 
 #ifndef BITCOIN_TX
-void CScAsyncProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom)
+void CScAsyncProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom,
+                                                        const CScCertificateRef& pcert)
 {
     LOCK(cs_asyncQueue);
-    CScProofVerifier::LoadDataForCertVerification(view, scCert, pfrom);
+    CScProofVerifier::LoadDataForCertVerification(view, scCert, pfrom, pcert);
 }
 
-void CScAsyncProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom)
+void CScAsyncProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom,
+                                                       const CTransactionRef& ptx)
 {
     LOCK(cs_asyncQueue);
-    CScProofVerifier::LoadDataForCswVerification(view, scTx, pfrom);
+    CScProofVerifier::LoadDataForCswVerification(view, scTx, pfrom, ptx);
 }
 #endif
 
@@ -160,7 +162,7 @@ void CScAsyncProofVerifier::ProcessVerificationOutputs(std::map</* Tx hash */ ui
         else
         {
             LogPrint("cert", "%s():%d - Post processing certificate or transaction [%s] from node [%d], result [%s] \n",
-                    __func__, __LINE__, item.parentPtr->GetHash().ToString(), item.node->GetId(), ProofVerificationResultToString(item.result));
+                    __func__, __LINE__, item.parentPtr->GetHash().ToString(), item.node ? item.node->GetId() : -1, ProofVerificationResultToString(item.result));
 
             // CODE USED FOR UNIT TEST ONLY [Start]
             if (BOOST_UNLIKELY(Params().NetworkIDString() == "regtest"))
@@ -170,7 +172,7 @@ void CScAsyncProofVerifier::ProcessVerificationOutputs(std::map</* Tx hash */ ui
             // CODE USED FOR UNIT TEST ONLY [End]
 
             CValidationState dummyState;
-            mempoolCallback(*item.parentPtr.get(), item.node,
+            mempoolCallback(item.parentPtr, item.node,
                                             item.result == ProofVerificationResult::Passed ? BatchVerificationStateFlag::VERIFIED : BatchVerificationStateFlag::FAILED,
                                             dummyState);
 
@@ -48,8 +48,10 @@ public:
     CScAsyncProofVerifier(const CScAsyncProofVerifier&) = delete;
     CScAsyncProofVerifier& operator=(const CScAsyncProofVerifier&) = delete;
 
-    void LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom = nullptr) override;
-    void LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom = nullptr) override;
+    void LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom = nullptr,
+                                     const CScCertificateRef& pcert = nullptr) override;
+    void LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom = nullptr,
+                                    const CTransactionRef& ptx = nullptr) override;
     void RunPeriodicVerification();
 
     static const uint32_t BATCH_VERIFICATION_MAX_DELAY;   /**< The maximum delay in milliseconds between batch verification requests */
@@ -73,11 +75,13 @@ private:
     /**
      * @brief The function to be called to make the mempool process a certificate/transaction after the verification of the proof.
      */
-    std::function<void(const CTransactionBase&, CNode*, BatchVerificationStateFlag, CValidationState&)> mempoolCallback;
+    std::function<void(const std::shared_ptr<const CTransactionBase>&, CNode*, BatchVerificationStateFlag, CValidationState&)> mempoolCallback;
 
     CScAsyncProofVerifier() :
         CScProofVerifier(Verification::Strict, Priority::Low), // CScAsyncProofVerifier always executes verification with low priority
-        mempoolCallback(ProcessTxBaseAcceptToMemoryPool)
+        mempoolCallback([](const std::shared_ptr<const CTransactionBase>& pTxBase, CNode* pfrom, BatchVerificationStateFlag flag,
+                           CValidationState& state)
+                        { ProcessTxBaseAcceptToMemoryPool(pTxBase, pfrom, flag, state); })
     {
     }
 
@@ -205,7 +209,7 @@ private:
     TEST_FRIEND_CScAsyncProofVerifier()
     {
         // Disables the call to AcceptToMemory pool from the async proof verifier when performing unit tests (not python ones).
-        CScAsyncProofVerifier::GetInstance().mempoolCallback = [](const CTransactionBase&, CNode*, BatchVerificationStateFlag, CValidationState&){};
+        CScAsyncProofVerifier::GetInstance().mempoolCallback = [](const std::shared_ptr<const CTransactionBase>&, CNode*, BatchVerificationStateFlag, CValidationState&){};
     }
 
     CZendooLowPrioThreadGuard* lowPrioThreadGuard = NULL;
@@ -121,8 +121,10 @@ CCswProofVerifierInput CScProofVerifier::CswInputToVerifierItem(const CTxCeasedS
 }
 
 #ifdef BITCOIN_TX
-void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom) {return;}
-void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom) {return;}
+void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom,
+                                                   const CScCertificateRef& pcert) {return;}
+void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom,
+                                                  const CTransactionRef& ptx) {return;}
 #else
 /**
  * @brief Loads proof data of a certificate into the proof verifier.
@@ -130,8 +132,10 @@ void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, c
  * @param view The current coins view cache (it is needed to get Sidechain information)
  * @param scCert The certificate whose proof has to be verified
  * @param pfrom The node that sent the certificate
+ * @param pcert The shared copy of scCert held by the caller, if any, otherwise scCert is copied
  */
-void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom)
+void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom,
+                                                   const CScCertificateRef& pcert)
 {
     if (verificationMode == Verification::Loose)
     {
@@ -146,7 +150,7 @@ void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view,
 
     CProofVerifierItem item;
     item.txHash = scCert.GetHash();
-    item.parentPtr = std::make_shared<CScCertificate>(scCert);
+    item.parentPtr = pcert ? pcert : std::make_shared<const CScCertificate>(scCert);
     item.node = pfrom;
     item.result = ProofVerificationResult::Unknown;
     item.proofInput = CertificateToVerifierItem(scCert, sidechain.fixedParams, pfrom);
@@ -159,8 +163,10 @@ void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view,
  * @param view The current coins view cache (it is needed to get Sidechain information)
  * @param scTx The CSW transaction whose proof has to be verified
  * @param pfrom The node that sent the transaction
+ * @param ptx The shared copy of scTx held by the caller, if any, otherwise scTx is copied
  */
-void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom)
+void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom,
+                                                  const CTransactionRef& ptx)
 {
     if (verificationMode == Verification::Loose)
     {
@@ -181,7 +187,7 @@ void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, c
     {
         CProofVerifierItem item;
         item.txHash = scTx.GetHash();
-        item.parentPtr = std::make_shared<CTransaction>(scTx);
+        item.parentPtr = ptx ? ptx : std::make_shared<const CTransaction>(scTx);
         item.result = ProofVerificationResult::Unknown;
         item.node = pfrom;
         item.proofInput = cswInputProofs;
@@ -72,7 +72,7 @@ struct CCertProofVerifierInput : CBaseProofVerifierInput
 struct CProofVerifierItem
 {
     uint256 txHash;                                                                                 /**< The hash of the transaction/certificate whose proof(s) have to be verified. */
-    std::shared_ptr<CTransactionBase> parentPtr;                                                    /**< The parent (Transaction or Certificate) that owns the item (CSW input or certificate itself). */
+    std::shared_ptr<const CTransactionBase> parentPtr;                                              /**< The parent (Transaction or Certificate) that owns the item (CSW input or certificate itself). */
     CNode* node;                                                                                    /**< The node that sent the parent (Transaction or Certiticate). */
     ProofVerificationResult result;                                                                 /**< The overall result of the proof(s) verification for the transaction/certificate. */
     boost::variant<CCertProofVerifierInput, std::vector<CCswProofVerifierInput>> proofInput;        /**< The proof input data, it can be a (single) certificate input or a list of CSW inputs. */
@@ -114,9 +114,11 @@ public:
     CScProofVerifier(const CScProofVerifier&) = delete;
     CScProofVerifier& operator=(const CScProofVerifier&) = delete;
 
-    virtual void LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom = nullptr);
+    virtual void LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom = nullptr,
+                                             const CScCertificateRef& pcert = nullptr);
 
-    virtual void LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom = nullptr);
+    virtual void LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom = nullptr,
+                                            const CTransactionRef& ptx = nullptr);
     bool BatchVerify();
 
 protected:
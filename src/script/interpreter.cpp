@@ -1013,13 +1013,24 @@ private:
     const bool fAnyoneCanPay;  //! whether the hashtype has the SIGHASH_ANYONECANPAY flag set
     const bool fHashSingle;    //! whether the hashtype is SIGHASH_SINGLE
     const bool fHashNone;      //! whether the hashtype is SIGHASH_NONE
+    std::vector<size_t>* pScriptOffsets; //! if set, receives the position of each blanked input script
+
+    /** Record where a blanked input script starts; only a CDataStream knows its position */
+    template<typename S>
+    void MarkScriptOffset(S &s) const {}
+    void MarkScriptOffset(CDataStream &s) const {
+        if (pScriptOffsets)
+            pScriptOffsets->push_back(s.size());
+    }
 
 public:
-    CTransactionSignatureSerializer(const CTransactionBase &txToIn, const CScript &scriptCodeIn, unsigned int nInIn, int nHashTypeIn) :
+    CTransactionSignatureSerializer(const CTransactionBase &txToIn, const CScript &scriptCodeIn, unsigned int nInIn, int nHashTypeIn,
+                                    std::vector<size_t>* pScriptOffsetsIn = nullptr) :
         txBaseTo(txToIn), scriptCode(scriptCodeIn), nIn(nInIn),
         fAnyoneCanPay(!!(nHashTypeIn & SIGHASH_ANYONECANPAY)),
         fHashSingle((nHashTypeIn & 0x1f) == SIGHASH_SINGLE),
-        fHashNone((nHashTypeIn & 0x1f) == SIGHASH_NONE) {}
+        fHashNone((nHashTypeIn & 0x1f) == SIGHASH_NONE),
+        pScriptOffsets(pScriptOffsetsIn) {}
 
     /** Serialize the passed scriptCode */
     template<typename S>
@@ -1039,10 +1050,11 @@ public:
         ::Serialize(s, txBaseTo.GetVin()[nInput].prevout, nType, nVersion);
         // Serialize the script
         assert(nInput != NOT_AN_INPUT);
-        if (nInput != nIn)
+        if (nInput != nIn) {
             // Blank out other inputs' signatures
+            MarkScriptOffset(s);
             ::Serialize(s, CScript(), nType, nVersion);
-        else
+        } else
             SerializeScriptCode(s, nType, nVersion);
         // Serialize the nSequence
         if (nInput != nIn && (fHashSingle || fHashNone))
@@ -1079,10 +1091,11 @@ public:
         // Serialize the script
         unsigned int nTotalInIdx = nCswInput + txTo.GetVin().size();
         assert(nTotalInIdx != NOT_AN_INPUT);
-        if (nTotalInIdx != nIn)
+        if (nTotalInIdx != nIn) {
             // Blank out other inputs' signatures
+            MarkScriptOffset(s);
             ::Serialize(s, CScript(), nType, nVersion);
-        else
+        } else
             SerializeScriptCode(s, nType, nVersion);
     }
 
@@ -1216,9 +1229,80 @@ public:
     }
 };
 
+/** Minimal stream feeding a SHA256 state, to serialize directly into a copied midstate */
+class CSHA256Writer {
+private:
+    CSHA256& hasher;
+
+public:
+    explicit CSHA256Writer(CSHA256& hasherIn) : hasher(hasherIn) {}
+
+    void write(const char *pch, size_t size) {
+        hasher.Write((const unsigned char*)pch, size);
+    }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+CPrecomputedTransactionData::CPrecomputedTransactionData(const CTransactionBase& txTo): fReady(false)
+{
+    Init(txTo);
+}
+
+void CPrecomputedTransactionData::Init(const CTransactionBase& txTo)
+{
+    // With SIGHASH_ALL and no input being signed every input script is blanked out, so the preimage
+    // of input i differs from this one only by its scriptCode replacing the blank at vScriptOffsets[i]
+    CDataStream ss(SER_GETHASH, 0);
+    CTransactionSignatureSerializer txTmp(txTo, CScript(), NOT_AN_INPUT, SIGHASH_ALL, &vScriptOffsets);
+    vScriptOffsets.clear();
+    txTmp.Serialize(ss, SER_GETHASH, 0);
+    vchBlanked.assign(ss.begin(), ss.end());
+
+    // regular inputs come first and CSW inputs after them, so the offsets are increasing
+    vMidstates.clear();
+    vMidstates.reserve(vScriptOffsets.size());
+    CSHA256 hasher;
+    size_t nHashed = 0;
+    for (size_t nOffset : vScriptOffsets) {
+        assert(nOffset >= nHashed && nOffset < vchBlanked.size());
+        hasher.Write(vchBlanked.data() + nHashed, nOffset - nHashed);
+        nHashed = nOffset;
+        vMidstates.push_back(hasher);
+    }
+
+    fReady = true;
+}
+
+bool CPrecomputedTransactionData::Covers(unsigned int nIn, int nHashType)
+{
+    return nIn != NOT_AN_INPUT && !(nHashType & SIGHASH_ANYONECANPAY) &&
+           (nHashType & 0x1f) != SIGHASH_NONE && (nHashType & 0x1f) != SIGHASH_SINGLE;
+}
+
+uint256 CPrecomputedTransactionData::SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const
+{
+    assert(fReady && Covers(nIn, nHashType) && nIn < vMidstates.size());
+
+    CSHA256 hasher = vMidstates[nIn];
+    CSHA256Writer writer(hasher);
+    ::WriteCompactSize(writer, scriptCode.size());
+    writer.write((const char*)scriptCode.data(), scriptCode.size());
+    // skip the single byte of the blank script
+    size_t nResume = vScriptOffsets[nIn] + 1;
+    hasher.Write(vchBlanked.data() + nResume, vchBlanked.size() - nResume);
+    ser_writedata32(writer, nHashType);
+
+    // same double SHA256 as CHashWriter::GetHash()
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    hasher.Finalize(buf);
+    uint256 result;
+    CSHA256().Write(buf, sizeof(buf)).Finalize(result.begin());
+    return result;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType,
+                      const CPrecomputedTransactionData* txdata)
 {
     unsigned int nTotalInputs = txTo.IsScVersion() ? txTo.GetVin().size() + txTo.GetVcswCcIn().size() : txTo.GetVin().size();
     if (nIn >= nTotalInputs && nIn != NOT_AN_INPUT) {
@@ -1234,6 +1318,11 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
         }
     }
 
+    if (txdata && txdata->IsReady() && CPrecomputedTransactionData::Covers(nIn, nHashType)) {
+        assert(txdata->GetInputCount() == nTotalInputs);
+        return txdata->SignatureHash(scriptCode, nIn, nHashType);
+    }
+
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
@@ -1243,7 +1332,8 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     return ss.GetHash();
 }
 
-uint256 SignatureHash(const CScript& scriptCode, const CScCertificate& certTo, unsigned int nIn, int nHashType)
+uint256 SignatureHash(const CScript& scriptCode, const CScCertificate& certTo, unsigned int nIn, int nHashType,
+                      const CPrecomputedTransactionData* txdata)
 {
     if (nIn >= certTo.GetVin().size() && nIn != NOT_AN_INPUT) {
         //  nIn out of range
@@ -1260,6 +1350,11 @@ uint256 SignatureHash(const CScript& scriptCode, const CScCertificate& certTo, u
         }
     }
 
+    if (txdata && txdata->IsReady() && CPrecomputedTransactionData::Covers(nIn, nHashType)) {
+        assert(txdata->GetInputCount() == certTo.GetVin().size());
+        return txdata->SignatureHash(scriptCode, nIn, nHashType);
+    }
+
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer certTmp(certTo, scriptCode, nIn, nHashType);
 
@@ -1271,12 +1366,14 @@ uint256 SignatureHash(const CScript& scriptCode, const CScCertificate& certTo, u
 
 TransactionSignatureChecker::TransactionSignatureChecker(const CTransaction* txToIn,
                                                          unsigned int nInIn,
-                                                         const CChain* chainIn):
+                                                         const CChain* chainIn,
+                                                         const CPrecomputedTransactionData* txdataIn):
                                                            txTo(txToIn),
                                                            nIn(nInIn),
-                                                           chain(chainIn) {}
+                                                           chain(chainIn),
+                                                           txdata(txdataIn) {}
 
-TransactionSignatureChecker::TransactionSignatureChecker(const CChain* chainIn): txTo(nullptr), nIn(-1), chain(chainIn) {}
+TransactionSignatureChecker::TransactionSignatureChecker(const CChain* chainIn): txTo(nullptr), nIn(-1), chain(chainIn), txdata(nullptr) {}
 
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
@@ -1298,7 +1395,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
 
     uint256 sighash;
     try {
-        sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+        sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
     } catch (const logic_error& ex) {
         return false;
     }
@@ -1387,10 +1484,12 @@ bool CheckReplayProtectionData(const CChain* chain, int nHeight, const std::vect
 
 CertificateSignatureChecker::CertificateSignatureChecker(const CScCertificate* certToIn,
                                                          unsigned int nInIn,
-                                                         const CChain* chainIn):
+                                                         const CChain* chainIn,
+                                                         const CPrecomputedTransactionData* txdataIn):
                                                            certTo(certToIn),
                                                            nIn(nInIn),
-                                                           chain(chainIn) {}
+                                                           chain(chainIn),
+                                                           txdata(txdataIn) {}
 
 bool CertificateSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
@@ -1419,7 +1518,7 @@ bool CertificateSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
 
     uint256 sighash;
     try {
-        sighash = SignatureHash(scriptCode, *certTo, nIn, nHashType);
+        sighash = SignatureHash(scriptCode, *certTo, nIn, nHashType, txdata);
     } catch (const logic_error& ex) {
         return false;
     }
@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 #include "primitives/certificate.h"
 
@@ -93,8 +94,46 @@ enum
 
 static const unsigned int CONTEXTUAL_SCRIPT_VERIFY_FLAGS = SCRIPT_VERIFY_CHECKBLOCKATHEIGHT;
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
-uint256 SignatureHash(const CScript &scriptCode, const CScCertificate& certTo, unsigned int nIn, int nHashType);
+/**
+ * Parts of the signature hash preimage of a transaction or certificate that do not depend on the
+ * input being signed, computed once and shared by the script checks of all of its inputs.
+ *
+ * The SIGHASH_ALL preimage of input i is the serialization with every input script blanked out,
+ * except for the one of input i replaced by the scriptCode. The blanked serialization and the
+ * SHA256 state reached at each input script are kept, so that the digest of an input only hashes
+ * its scriptCode and the bytes following it. Other hash types are not covered.
+ */
+class CPrecomputedTransactionData
+{
+public:
+    CPrecomputedTransactionData(): fReady(false) {}
+    explicit CPrecomputedTransactionData(const CTransactionBase& txTo);
+
+    void Init(const CTransactionBase& txTo);
+    bool IsReady() const { return fReady; }
+    //! regular and CSW inputs
+    size_t GetInputCount() const { return vScriptOffsets.size(); }
+
+    //! whether the digest of input nIn with nHashType can be computed from the precomputed data
+    static bool Covers(unsigned int nIn, int nHashType);
+    //! same result as ::SignatureHash() on the transaction given to Init(), for a covered nIn and nHashType
+    uint256 SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const;
+
+private:
+    bool fReady;
+    //! preimage with all input scripts blanked out, without the trailing hash type
+    std::vector<unsigned char> vchBlanked;
+    //! position in vchBlanked of the blank script of each input, regular ones first
+    std::vector<size_t> vScriptOffsets;
+    //! state after hashing vchBlanked up to each of vScriptOffsets
+    std::vector<CSHA256> vMidstates;
+};
+
+//! txdata, if given and initialized, must have been initialized with txTo (certTo) and is used for the hash types it covers
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType,
+                      const CPrecomputedTransactionData* txdata = nullptr);
+uint256 SignatureHash(const CScript &scriptCode, const CScCertificate& certTo, unsigned int nIn, int nHashType,
+                      const CPrecomputedTransactionData* txdata = nullptr);
 
 class BaseSignatureChecker
 {
@@ -123,13 +162,15 @@ private:
     const CTransaction* txTo;
     unsigned int nIn;
     const CChain* chain;
+    const CPrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
     TransactionSignatureChecker(const CChain* chainIn);
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CChain* chainIn);
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CChain* chainIn,
+                                const CPrecomputedTransactionData* txdataIn = nullptr);
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
     bool CheckBlockHash(const int32_t nHeight, const std::vector<unsigned char>& nBlockHash) const;
@@ -150,12 +191,14 @@ private:
     const CScCertificate* certTo;
     unsigned int nIn;
     const CChain* chain;
+    const CPrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    CertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CChain* chainIn);
+    CertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CChain* chainIn,
+                                const CPrecomputedTransactionData* txdataIn = nullptr);
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     // certificate does not have it
     bool CheckLockTime(const CScriptNum& nLockTime) const { return true;}
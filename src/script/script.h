@@ -7,6 +7,8 @@
 #define BITCOIN_SCRIPT_SCRIPT_H
 
 #include "crypto/common.h"
+#include "prevector.h"
+#include "serialize.h"
 
 #include <assert.h>
 #include <climits>
@@ -375,8 +377,17 @@ private:
     int64_t m_value;
 };
 
+/**
+ * Scripts of up to this size are stored inline, without allocating: enough for the P2PKH
+ * and P2SH scripts with replay protection, 63 and 61 bytes, which are most of the outputs
+ * of the transactions and of the coins. The signature scripts of the inputs are larger.
+ */
+static const unsigned int SCRIPT_INLINE_SIZE = 64;
+
+typedef prevector<SCRIPT_INLINE_SIZE, unsigned char> CScriptBase;
+
 /** Serialized script, used inside transaction inputs and outputs */
-class CScript : public std::vector<unsigned char>
+class CScript : public CScriptBase
 {
 protected:
     CScript& push_int64(int64_t n)
@@ -397,9 +408,14 @@ protected:
     }
 public:
     CScript() { }
-    CScript(const CScript& b) : std::vector<unsigned char>(b.begin(), b.end()) { }
-    CScript(const_iterator pbegin, const_iterator pend) : std::vector<unsigned char>(pbegin, pend) { }
-    CScript(const unsigned char* pbegin, const unsigned char* pend) : std::vector<unsigned char>(pbegin, pend) { }
+    CScript(const CScript& b) : CScriptBase(b) { }
+    CScript(CScript&& b) : CScriptBase(std::move(b)) { }
+    CScript(const_iterator pbegin, const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(std::vector<unsigned char>::const_iterator pbegin, std::vector<unsigned char>::const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(const unsigned char* pbegin, const unsigned char* pend) : CScriptBase(pbegin, pend) { }
+
+    CScript& operator=(const CScript& b) { CScriptBase::operator=(b); return *this; }
+    CScript& operator=(CScript&& b) { CScriptBase::operator=(std::move(b)); return *this; }
 
     CScript& operator+=(const CScript& b)
     {
@@ -614,9 +630,27 @@ public:
     std::string ToString() const;
     void clear()
     {
-        // The default std::vector::clear() does not release memory.
-        std::vector<unsigned char>().swap(*this);
+        // CScriptBase::clear() keeps the capacity
+        CScriptBase::clear();
+        shrink_to_fit();
     }
 };
 
+inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+{
+    return GetSerializeSize((const CScriptBase&)v, nType, nVersion);
+}
+
+template<typename Stream>
+void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+{
+    Serialize(os, (const CScriptBase&)v, nType, nVersion);
+}
+
+template<typename Stream>
+void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+{
+    Unserialize(is, (CScriptBase&)v, nType, nVersion);
+}
+
 #endif // BITCOIN_SCRIPT_SCRIPT_H
@@ -10,106 +10,287 @@
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <algorithm>
+#include <string.h>
 
-namespace {
+CSignatureCache::CSignatureCache(size_t nBytes):
+    nBuckets(0), nEvictionRand(0),
+    nLookups(0), nHits(0), nInserts(0), nEvictions(0), nErasures(0)
+{
+    // the nonce fills a whole SHA256 block, which is then compressed only once for all entries
+    unsigned char nonce[64] = {};
+    GetRandBytes(nonce, 32);
+    salted_hasher.Write(nonce, sizeof(nonce));
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
-{
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+    GetRandBytes((unsigned char*)&nEvictionRand, sizeof(nEvictionRand));
+    nEvictionRand |= 1;
+
+    Resize(nBytes);
+}
+
+void CSignatureCache::Resize(size_t nBytes)
+{
+    LOCK(cs_write);
+
+    buckets.reset();
+    nBuckets = nBytes / sizeof(Bucket);
+    if (nBuckets == 0)
+        return;
+
+    // value-initialized: all entries zero, which no salted hash is expected to match
+    buckets.reset(new Bucket[nBuckets]());
+    for (size_t i = 0; i < nBuckets; i++)
+        buckets[i].nFree.store((1U << WAYS) - 1, std::memory_order_relaxed);
+}
+
+size_t CSignatureCache::BytesPerEntry()
+{
+    return sizeof(Bucket) / WAYS;
+}
+
+void CSignatureCache::ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    CSHA256 hasher = salted_hasher;
+    hasher.Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+}
+
+bool CSignatureCache::Get(const uint256& entry, bool fErase)
+{
+    if (!buckets)
+        return false;
+    nLookups.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t words[ENTRY_WORDS];
+    memcpy(words, entry.begin(), sizeof(words));
+    Bucket& bucket = BucketOf(words);
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+    // a write in progress or completed while reading makes the lookup a miss, which only costs a verification
+    uint32_t nSequence = bucket.nSequence.load(std::memory_order_acquire);
+    if (nSequence & 1)
         return false;
+
+    int nWay = -1;
+    for (int i = 0; i < WAYS && nWay < 0; i++) {
+        bool fMatch = true;
+        for (int j = 0; j < ENTRY_WORDS; j++)
+            fMatch &= (bucket.entries[i][j].load(std::memory_order_relaxed) == words[j]);
+        if (fMatch)
+            nWay = i;
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (nWay < 0 || bucket.nSequence.load(std::memory_order_relaxed) != nSequence)
+        return false;
+
+    // if a writer replaced the entry in the meantime, the new one is merely reused sooner
+    if (fErase && !(bucket.nFree.fetch_or(1U << nWay, std::memory_order_relaxed) & (1U << nWay)))
+        nErasures.fetch_add(1, std::memory_order_relaxed);
+    nHits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void CSignatureCache::Set(const uint256& entry)
+{
+    if (!buckets)
+        return;
+
+    uint64_t words[ENTRY_WORDS];
+    memcpy(words, entry.begin(), sizeof(words));
+
+    LOCK(cs_write);
+    Bucket& bucket = BucketOf(words);
+
+    // the same signature may have been checked by another thread meanwhile
+    for (int i = 0; i < WAYS; i++) {
+        bool fMatch = true;
+        for (int j = 0; j < ENTRY_WORDS; j++)
+            fMatch &= (bucket.entries[i][j].load(std::memory_order_relaxed) == words[j]);
+        if (fMatch) {
+            bucket.nFree.fetch_and(~(1U << i), std::memory_order_relaxed);
+            return;
         }
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    int nWay = 0;
+    uint32_t nFree = bucket.nFree.load(std::memory_order_relaxed);
+    if (nFree != 0) {
+        while (!(nFree & (1U << nWay)))
+            nWay++;
+    } else {
+        // evict a random entry, so that attackers cannot keep a chosen set of signatures
+        // just above the capacity of a bucket cycling through it
+        nEvictionRand ^= nEvictionRand << 13;
+        nEvictionRand ^= nEvictionRand >> 7;
+        nEvictionRand ^= nEvictionRand << 17;
+        nWay = nEvictionRand % WAYS;
+        nEvictions.fetch_add(1, std::memory_order_relaxed);
     }
-};
 
+    uint32_t nSequence = bucket.nSequence.load(std::memory_order_relaxed);
+    bucket.nSequence.store(nSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int j = 0; j < ENTRY_WORDS; j++)
+        bucket.entries[nWay][j].store(words[j], std::memory_order_relaxed);
+    bucket.nSequence.store(nSequence + 2, std::memory_order_release);
+
+    bucket.nFree.fetch_and(~(1U << nWay), std::memory_order_relaxed);
+    nInserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+CSignatureCacheStats CSignatureCache::GetStats() const
+{
+    CSignatureCacheStats stats;
+    stats.nLookups = nLookups.load(std::memory_order_relaxed);
+    stats.nHits = nHits.load(std::memory_order_relaxed);
+    stats.nInserts = nInserts.load(std::memory_order_relaxed);
+    stats.nEvictions = nEvictions.load(std::memory_order_relaxed);
+    stats.nErasures = nErasures.load(std::memory_order_relaxed);
+    stats.nCapacity = nBuckets * WAYS;
+    stats.nBytes = nBuckets * sizeof(Bucket);
+    return stats;
+}
+
+namespace {
+
+//! shared by transactions and certificates: the entries commit to the signature hash
+CSignatureCache signatureCache;
+
+}
+
+void InitSignatureCache()
+{
+    int64_t nMaxCacheSize = GetArg("-maxsigcachemem", DEFAULT_MAX_SIG_CACHE_SIZE);
+    nMaxCacheSize = std::max<int64_t>(0, std::min<int64_t>(nMaxCacheSize, MAX_MAX_SIG_CACHE_SIZE));
+    // the other half goes to the script execution cache, see InitScriptExecutionCache()
+    signatureCache.Resize((size_t)nMaxCacheSize << 19);
+
+    CSignatureCacheStats stats = signatureCache.GetStats();
+    LogPrintf("Using %u MiB for signature cache, able to store %u elements\n", stats.nBytes >> 20, stats.nCapacity);
+}
+
+CSignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
+CPubKeyCache::PubKeyHasher::PubKeyHasher()
+{
+    // as for the signature cache, the nonce fills a whole SHA256 block
+    unsigned char nonce[64] = {};
+    GetRandBytes(nonce, 32);
+    salted_hasher.Write(nonce, sizeof(nonce));
+}
+
+size_t CPubKeyCache::PubKeyHasher::operator()(const CPubKey& pubkey) const
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256 hasher = salted_hasher;
+    hasher.Write(pubkey.begin(), pubkey.size()).Finalize(hash);
+    uint64_t nHash;
+    memcpy(&nHash, hash, sizeof(nHash));
+    return nHash;
+}
+
+bool CPubKeyCache::Verify(const CPubKey& pubkey, const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    if (!pubkey.IsValid())
+        return false;
+
+    CParsedPubKey parsed;
+    Shard& shard = shards[pubkey[1] % SHARDS];
+    {
+        LOCK(shard.cs);
+        auto it = shard.keys.find(pubkey);
+        if (it == shard.keys.end()) {
+            // parsed under the lock, so that threads needing the same key do not all parse it
+            parsed.Set(pubkey);
+            shard.keys.emplace(pubkey, parsed);
+        } else {
+            parsed = it->second;
+        }
+    }
+    return parsed.Verify(hash, vchSig);
+}
+
+void CSignatureBatch::Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, const uint256* pentry)
+{
+    vSignatures.emplace_back();
+    Signature& sig = vSignatures.back();
+    sig.vchSig = vchSig;
+    sig.pubkey = pubkey;
+    sig.sighash = sighash;
+    sig.fStore = pentry != nullptr;
+    if (pentry)
+        sig.entry = *pentry;
+}
+
+bool CSignatureBatch::Verify(size_t nBegin, size_t nEnd, CPubKeyCache& pubkeyCache) const
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        const Signature& sig = vSignatures[i];
+        if (!pubkeyCache.Verify(sig.pubkey, sig.sighash, sig.vchSig))
+            return false;
+    }
+    for (size_t i = nBegin; i < nEnd; i++) {
+        if (vSignatures[i].fStore)
+            signatureCache.Set(vSignatures[i].entry);
+    }
+    return true;
 }
 
 CachingTransactionSignatureChecker::CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn,
-                                                                       const CChain* chainIn, bool storeIn):
-                                                                        TransactionSignatureChecker(txToIn, nInIn, chainIn),
-                                                                        store(storeIn) {}
+                                                                       const CChain* chainIn, bool storeIn,
+                                                                       const CPrecomputedTransactionData* txdataIn,
+                                                                       CSignatureBatch* pbatchIn):
+                                                                        TransactionSignatureChecker(txToIn, nInIn, chainIn, txdataIn),
+                                                                        store(storeIn), pbatch(pbatchIn) {}
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // signatures checked without storing them are the ones of a block being connected: they will not be seen again
+    if (signatureCache.Get(entry, !store))
         return true;
 
+    if (pbatch) {
+        pbatch->Add(vchSig, pubkey, sighash, store ? &entry : nullptr);
+        return true;
+    }
+
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
 
 CachingCertificateSignatureChecker::CachingCertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn,
-                                                                       const CChain* chainIn, bool storeIn):
-                                                                        CertificateSignatureChecker(certToIn, nInIn, chainIn),
-                                                                        store(storeIn) {}
+                                                                       const CChain* chainIn, bool storeIn,
+                                                                       const CPrecomputedTransactionData* txdataIn,
+                                                                       CSignatureBatch* pbatchIn):
+                                                                        CertificateSignatureChecker(certToIn, nInIn, chainIn, txdataIn),
+                                                                        store(storeIn), pbatch(pbatchIn) {}
 
 bool CachingCertificateSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+
+    if (signatureCache.Get(entry, !store))
+        return true;
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    if (pbatch) {
+        pbatch->Add(vchSig, pubkey, sighash, store ? &entry : nullptr);
         return true;
+    }
 
     if (!CertificateSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
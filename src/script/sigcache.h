@@ -6,19 +6,176 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "crypto/sha256.h"
+#include "pubkey.h"
 #include "script/interpreter.h"
+#include "sync.h"
 
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
-class CPubKey;
+/** Default for -maxsigcachemem, the memory budget of the signature caches in MiB */
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Largest accepted -maxsigcachemem, in MiB */
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 16384;
+
+/** Counters of a CSignatureCache, collected since startup */
+struct CSignatureCacheStats
+{
+    uint64_t nLookups;
+    uint64_t nHits;
+    uint64_t nInserts;
+    //! valid entries overwritten by an insertion because their bucket was full
+    uint64_t nEvictions;
+    //! entries found while connecting a block, and thus free to be reused
+    uint64_t nErasures;
+    size_t nCapacity;
+    size_t nBytes;
+};
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * Entries are salted hashes of (signature hash, public key, signature), kept in a
+ * preallocated set-associative table: each bucket holds WAYS entries and a sequence
+ * number. Lookups take no lock: they read the bucket between two loads of the sequence
+ * number and report a miss if a writer went through it meanwhile. Insertions are
+ * serialized by a mutex, and reuse free or erased slots before evicting a random one.
+ */
+class CSignatureCache
+{
+public:
+    static const int WAYS = 4;
+
+    //! nBytes is the memory budget of the table, 0 disables the cache
+    explicit CSignatureCache(size_t nBytes = 0);
+
+    //! reallocates an empty table; not safe while other threads use the cache
+    void Resize(size_t nBytes);
+
+    //! memory taken by each entry of the table
+    static size_t BytesPerEntry();
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+
+    //! fErase marks a hit as free to be overwritten, for signatures that are not expected to be checked again
+    bool Get(const uint256& entry, bool fErase);
+    void Set(const uint256& entry);
+
+    CSignatureCacheStats GetStats() const;
+
+private:
+    static const int ENTRY_WORDS = 4;
+
+    struct Bucket
+    {
+        //! odd while a writer is updating the entries
+        std::atomic<uint32_t> nSequence;
+        //! bit i set if entry i is empty or erased
+        std::atomic<uint32_t> nFree;
+        std::atomic<uint64_t> entries[WAYS][ENTRY_WORDS];
+    };
+
+    //! salted with a random nonce, so that the bucket of an entry cannot be predicted
+    CSHA256 salted_hasher;
+
+    std::unique_ptr<Bucket[]> buckets;
+    //! below 2^32 for any accepted budget
+    size_t nBuckets;
+
+    //! serializes writers; readers never take it
+    CCriticalSection cs_write;
+    uint64_t nEvictionRand;
+
+    std::atomic<uint64_t> nLookups;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+    std::atomic<uint64_t> nErasures;
+
+    //! maps the low 32 bits of the entry, uniformly distributed, onto [0, nBuckets) without a division
+    Bucket& BucketOf(const uint64_t (&words)[ENTRY_WORDS]) const { return buckets[((words[0] & 0xffffffff) * nBuckets) >> 32]; }
+};
+
+/** Sizes the cache shared by the caching signature checkers to half of -maxsigcachemem; call before using them */
+void InitSignatureCache();
+CSignatureCacheStats GetSignatureCacheStats();
+
+/**
+ * Public keys parsed for the signatures of a block, shared by the threads verifying them:
+ * a key spent from several times in the block is parsed, and decompressed, only once.
+ */
+class CPubKeyCache
+{
+public:
+    //! Same as pubkey.Verify(hash, vchSig)
+    bool Verify(const CPubKey& pubkey, const uint256& hash, const std::vector<unsigned char>& vchSig);
+
+private:
+    //! the keys are split by their first bytes, each part with its own lock
+    static const size_t SHARDS = 16;
+
+    struct PubKeyHasher
+    {
+        //! salted with a random nonce, so that the keys landing in the same bucket cannot be chosen
+        CSHA256 salted_hasher;
+
+        PubKeyHasher();
+        size_t operator()(const CPubKey& pubkey) const;
+    };
+
+    struct Shard
+    {
+        CCriticalSection cs;
+        std::unordered_map<CPubKey, CParsedPubKey, PubKeyHasher> keys;
+    };
+
+    Shard shards[SHARDS];
+};
+
+/**
+ * Signatures whose verification the caching signature checkers deferred, assuming them
+ * valid meanwhile, to verify them together once the scripts of a batch of checks ran.
+ */
+class CSignatureBatch
+{
+public:
+    //! pentry is the signature cache entry to store once the signature is found valid, if any
+    void Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, const uint256* pentry);
+
+    size_t size() const { return vSignatures.size(); }
+    void clear() { vSignatures.clear(); }
+
+    /** Verify the signatures [nBegin, nEnd) with the keys of pubkeyCache, and return whether they are all valid. */
+    bool Verify(size_t nBegin, size_t nEnd, CPubKeyCache& pubkeyCache) const;
+
+private:
+    struct Signature
+    {
+        std::vector<unsigned char> vchSig;
+        CPubKey pubkey;
+        uint256 sighash;
+        uint256 entry;
+        bool fStore;
+    };
+
+    std::vector<Signature> vSignatures;
+};
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    //! where the signatures not found in the cache go, instead of being verified, if set
+    CSignatureBatch* pbatch;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CChain* chainIn, bool storeIn=true);
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CChain* chainIn, bool storeIn=true,
+                                       const CPrecomputedTransactionData* txdataIn = nullptr, CSignatureBatch* pbatchIn = nullptr);
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
@@ -26,9 +183,12 @@ class CachingCertificateSignatureChecker : public CertificateSignatureChecker
 {
 private:
     bool store;
+    //! where the signatures not found in the cache go, instead of being verified, if set
+    CSignatureBatch* pbatch;
 
 public:
-    CachingCertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CChain* chainIn, bool storeIn=true);
+    CachingCertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CChain* chainIn, bool storeIn=true,
+                                       const CPrecomputedTransactionData* txdataIn = nullptr, CSignatureBatch* pbatchIn = nullptr);
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
@@ -153,7 +153,7 @@ bool ProduceSignature(const BaseSignatureCreator& creator, const CScript& fromPu
             SignStep(creator, subscript, scriptSig, subType) && subType != TX_SCRIPTHASH
             && subType != TX_SCRIPTHASH_REPLAY;
         // Append serialized subscript whether or not it is completely signed:
-        scriptSig << static_cast<valtype>(subscript);
+        scriptSig << valtype(subscript.begin(), subscript.end());
         if (!fSolved) return false;
     }
 
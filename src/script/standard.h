@@ -43,6 +43,15 @@ static const int CBH_DELTA_HEIGHT = 300;
  */
 static const unsigned int MANDATORY_SCRIPT_VERIFY_FLAGS = SCRIPT_VERIFY_P2SH;
 
+/**
+ * Script verification flags every block is checked with: CHECKBLOCKATHEIGHT is
+ * enforced since block version 4, i.e. for all the blocks. DERSIG (BIP66) is
+ * also always enforced, but does not have a flag.
+ */
+static const unsigned int BLOCK_SCRIPT_VERIFY_FLAGS = MANDATORY_SCRIPT_VERIFY_FLAGS |
+                                                      SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY |
+                                                      SCRIPT_VERIFY_CHECKBLOCKATHEIGHT;
+
 /**
  * Standard script verification flags that standard transactions will comply
  * with. However scripts violating these flags may still be present in valid
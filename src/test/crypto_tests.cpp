@@ -131,6 +131,33 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+    // the same hashes with each of the implementations supported by the CPU, including the standard one
+    const int vUse[] = {SHA256_USE_STANDARD, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_SHANI, SHA256_USE_ALL};
+    for (int nUse : vUse) {
+        SHA256AutoDetect(nUse);
+        TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        TestSHA256(std::string(1000000, 'a'),
+                   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
+
+        // enough inputs for every combination of the multi-way kernels
+        for (size_t n = 0; n <= 32; n++) {
+            std::vector<unsigned char> in(64 * n), out(32 * n), expected(32 * n);
+            for (size_t i = 0; i < in.size(); i++)
+                in[i] = insecure_rand();
+            for (size_t i = 0; i < n; i++) {
+                unsigned char hash[32];
+                CSHA256().Write(&in[64 * i], 64).Finalize(hash);
+                CSHA256().Write(hash, 32).Finalize(&expected[32 * i]);
+            }
+            SHA256D64(out.data(), in.data(), n);
+            BOOST_CHECK(out == expected);
+        }
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
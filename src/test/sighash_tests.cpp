@@ -602,6 +602,63 @@ BOOST_AUTO_TEST_CASE(sighash_from_tx)
 
 }
 
+// Goal: check that the signature hashes computed from CPrecomputedTransactionData are the ones computed from scratch,
+// for all inputs of the same transaction, with scriptCodes long enough to need a multi-byte size
+BOOST_AUTO_TEST_CASE(sighash_precomputed_test)
+{
+    seed_insecure_rand(false);
+
+    int nRandomTests = 2000;
+    for (int i=0; i<nRandomTests; i++) {
+        int nHashType = (i % 2) ? SIGHASH_ALL : insecure_rand();
+        CMutableTransaction mtx;
+        RandomTransaction(mtx, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        const CTransaction txTo(mtx);
+        const CPrecomputedTransactionData txdata(txTo);
+        BOOST_CHECK_EQUAL(txdata.GetInputCount(), txTo.GetVin().size() + txTo.GetVcswCcIn().size());
+
+        for (unsigned int nIn = 0; nIn < txdata.GetInputCount(); nIn++) {
+            CScript scriptCode;
+            if (insecure_rand() % 4 == 0)
+                scriptCode << std::vector<unsigned char>(200 + insecure_rand() % 400, insecure_rand() & 0xff);
+            else
+                RandomScript(scriptCode);
+
+            uint256 sh = SignatureHash(scriptCode, txTo, nIn, nHashType);
+            uint256 shp = SignatureHash(scriptCode, txTo, nIn, nHashType, &txdata);
+            BOOST_CHECK(sh == shp);
+            BOOST_CHECK(sh == SignatureHashOld(scriptCode, txTo, nIn, nHashType));
+            if (CPrecomputedTransactionData::Covers(nIn, nHashType))
+                BOOST_CHECK(txdata.SignatureHash(scriptCode, nIn, nHashType) == sh);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sighash_precomputed_cert_test)
+{
+    seed_insecure_rand(false);
+
+    int nRandomTests = 2000;
+    for (int i=0; i<nRandomTests; i++) {
+        int nHashType = (i % 2) ? SIGHASH_ALL : insecure_rand();
+        CMutableScCertificate mcert;
+        RandomCertificate(mcert, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        const CScCertificate certTo(mcert);
+        const CPrecomputedTransactionData txdata(certTo);
+        BOOST_CHECK_EQUAL(txdata.GetInputCount(), certTo.GetVin().size());
+
+        for (unsigned int nIn = 0; nIn < txdata.GetInputCount(); nIn++) {
+            CScript scriptCode;
+            RandomScript(scriptCode);
+
+            uint256 sh = SignatureHash(scriptCode, certTo, nIn, nHashType);
+            uint256 shp = SignatureHash(scriptCode, certTo, nIn, nHashType, &txdata);
+            BOOST_CHECK(sh == shp);
+            BOOST_CHECK(sh == SignatureHashCert(scriptCode, certTo, nIn, nHashType));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
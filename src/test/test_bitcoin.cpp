@@ -7,6 +7,8 @@
 #include "test_bitcoin.h"
 
 #include "crypto/common.h"
+#include "crypto/equihash.h"
+#include "crypto/sha256.h"
 
 #include "key.h"
 #include "main.h"
@@ -63,6 +65,8 @@ JoinSplitTestingSetup::~JoinSplitTestingSetup()
 BasicTestingSetup::BasicTestingSetup()
 {
     assert(init_and_check_sodium() != -1);
+    SHA256AutoDetect();
+    EhAutoDetect();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -94,8 +98,7 @@ TestingSetup::TestingSetup()
         RegisterValidationInterface(pwalletMain);
 #endif
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
-            threadGroup.create_thread(&ThreadScriptCheck);
+        StartValidationThreads(threadGroup, nScriptCheckThreads, false);
         RegisterNodeSignals(GetNodeSignals());
 }
 
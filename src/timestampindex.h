@@ -69,6 +69,21 @@ struct CTimestampIndexKey {
     }
 };
 
+/** Paging of a timestamp index range scan */
+struct CTimestampIndexScan {
+    //! newest entries first
+    bool fReverse;
+    //! number of matching entries to skip
+    unsigned int nOffset;
+    //! maximum number of entries to return, 0 for no limit
+    unsigned int nLimit;
+    //! continue after this entry, returned by a previous scan over the same range
+    bool fHaveCursor;
+    CTimestampIndexKey cursor;
+
+    CTimestampIndexScan() : fReverse(false), nOffset(0), nLimit(0), fHaveCursor(false) {}
+};
+
 struct CTimestampBlockIndexKey {
     uint256 blockHash;
 
@@ -13,6 +13,9 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include <boost/thread.hpp>
 #include <sc/sidechaintypes.h>
 #include "utilmoneystr.h"
@@ -501,11 +504,20 @@ bool CBlockTreeDB::UpdateMaturityHeightIndex(const std::vector<std::pair<CMaturi
 }
 
 #ifdef ENABLE_ADDRESS_INDEXING
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+CAddressIndexDB::CAddressIndexDB(const CLevelDBOptions& dbOptions, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "addressindex", dbOptions, fMemory, fWipe) {
+}
+
+CTimestampIndexDB::CTimestampIndexDB(const CLevelDBOptions& dbOptions, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "timestampindex", dbOptions, fMemory, fWipe) {
+}
+
+CSpentIndexDB::CSpentIndexDB(const CLevelDBOptions& dbOptions, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "spentindex", dbOptions, fMemory, fWipe) {
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+bool CSpentIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value, const leveldb::Snapshot* snapshot) {
+    return Read(make_pair(DB_SPENTINDEX, key), value, snapshot);
+}
+
+bool CSpentIndexDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -517,7 +529,7 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+bool CAddressIndexDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -529,10 +541,8 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
-
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+static bool ReadAddressUnspentIndexAt(leveldb::Iterator* pcursor, uint160 addressHash, int type,
+                                      std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash));
@@ -569,44 +579,9 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &vect)
-{
-    CLevelDBBatch batch;
-
-    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-    {
-        if (it->second.IsNull())
-        {
-            batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-        }
-        else
-        {
-            batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-        }
-    }
-
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >&vect) {
-    CLevelDBBatch batch;
-    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >&vect) {
-    CLevelDBBatch batch;
-    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
-                                    int start, int end) {
-
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+static bool ReadAddressIndexAt(leveldb::Iterator* pcursor, uint160 addressHash, int type,
+                               std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
+                               int start, int end) {
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     if (start > 0 && end > 0) {
@@ -651,57 +626,244 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+/**
+ * Runs reader(pcursor, addressHash, type, result) for every requested address against a single
+ * snapshot of db, filling results in the same order as addresses.
+ * Addresses are visited in LevelDB key order (type byte, then hash bytes) and handed out in contiguous
+ * chunks, so that the seeks performed by one worker tend to land on the same table blocks. Batches larger
+ * than one chunk are spread over up to MAX_ADDRESS_LOOKUP_THREADS threads, each with its own iterator.
+ */
+template <typename Result, typename Reader>
+static bool ReadAddressBatch(CLevelDBWrapper& db, const leveldb::Snapshot* callerSnapshot,
+                             const std::vector<std::pair<uint160, int> > &addresses,
+                             std::vector<Result> &results, Reader reader)
+{
+    results.assign(addresses.size(), Result());
+    if (addresses.empty())
+        return true;
+
+    std::vector<size_t> order(addresses.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&addresses](size_t a, size_t b) {
+        if (addresses[a].second != addresses[b].second)
+            return (unsigned char)addresses[a].second < (unsigned char)addresses[b].second;
+        return addresses[a].first < addresses[b].first;
+    });
+
+    const size_t nChunks = (order.size() + ADDRESS_LOOKUP_CHUNK_SIZE - 1) / ADDRESS_LOOKUP_CHUNK_SIZE;
+    std::atomic<size_t> nextChunk(0);
+    std::atomic<bool> fFailed(false);
+    std::atomic<bool> fInterrupted(false);
+
+    const leveldb::Snapshot* snapshot = callerSnapshot ? callerSnapshot : db.GetSnapshot();
+
+    auto worker = [&]() {
+        try {
+            boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(snapshot));
+            size_t chunk;
+            while (!fFailed && (chunk = nextChunk++) < nChunks) {
+                const size_t first = chunk * ADDRESS_LOOKUP_CHUNK_SIZE;
+                const size_t last = std::min(first + ADDRESS_LOOKUP_CHUNK_SIZE, order.size());
+                for (size_t i = first; i < last; ++i) {
+                    const size_t pos = order[i];
+                    if (!reader(pcursor.get(), addresses[pos].first, addresses[pos].second, results[pos])) {
+                        fFailed = true;
+                        break;
+                    }
+                }
+            }
+        } catch (const boost::thread_interrupted&) {
+            fInterrupted = true;
+            fFailed = true;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: address lookup failed: %s\n", __func__, e.what());
+            fFailed = true;
+        }
+    };
+
+    const size_t nThreads = std::min<size_t>(nChunks, MAX_ADDRESS_LOOKUP_THREADS);
+    if (nThreads <= 1) {
+        worker();
+    } else {
+        boost::thread_group workers;
+        for (size_t i = 1; i < nThreads; ++i)
+            workers.create_thread(worker);
+        // the calling thread takes its share of the chunks too
+        worker();
+        workers.join_all();
+    }
+
+    if (!callerSnapshot)
+        db.ReleaseSnapshot(snapshot);
+
+    if (fInterrupted)
+        throw boost::thread_interrupted();
+
+    return !fFailed;
+}
+
+bool CAddressIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    return ReadAddressUnspentIndexAt(pcursor.get(), addressHash, type, unspentOutputs);
+}
+
+bool CAddressIndexDB::ReadAddressUnspentIndexBatch(const std::vector<std::pair<uint160, int> > &addresses,
+                                                std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &unspentOutputs,
+                                                const leveldb::Snapshot* snapshot) {
+
+    return ReadAddressBatch(*this, snapshot, addresses, unspentOutputs, &ReadAddressUnspentIndexAt);
+}
+
+bool CAddressIndexDB::UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &vect)
+{
+    CLevelDBBatch batch;
+
+    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+    {
+        if (it->second.IsNull())
+        {
+            batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+        }
+        else
+        {
+            batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        }
+    }
+
+    return WriteBatch(batch);
+}
+
+bool CAddressIndexDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >&vect) {
     CLevelDBBatch batch;
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+bool CAddressIndexDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >&vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    return WriteBatch(batch);
+}
+
+bool CAddressIndexDB::ReadAddressIndex(uint160 addressHash, int type,
+                                    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
+                                    int start, int end) {
 
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    return ReadAddressIndexAt(pcursor.get(), addressHash, type, addressIndex, start, end);
+}
+
+bool CAddressIndexDB::ReadAddressIndexBatch(const std::vector<std::pair<uint160, int> > &addresses,
+                                         std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > &addressIndexes,
+                                         int start, int end, const leveldb::Snapshot* snapshot) {
+
+    return ReadAddressBatch(*this, snapshot, addresses, addressIndexes,
+        [start, end](leveldb::Iterator* pcursor, uint160 addressHash, int type,
+                     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex) {
+            return ReadAddressIndexAt(pcursor, addressHash, type, addressIndex, start, end);
+        });
+}
+
+bool CTimestampIndexDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex, int nHeight) {
+    CLevelDBBatch batch;
+    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), nHeight);
+    return WriteBatch(batch);
+}
+
+bool CTimestampIndexDB::ReadTimestampIndex(unsigned int high, unsigned int low, const CTimestampIndexScan &scan,
+                                           const std::function<bool(const uint256&, int)> &filter,
+                                           std::vector<std::pair<uint256, unsigned int> > &hashes, CTimestampIndexKey &lastKey, bool &fMore,
+                                           const leveldb::Snapshot* snapshot) {
+
+    fMore = false;
+    if (low >= high)
+        return true;
 
+    boost::scoped_ptr<leveldb::Iterator> pcursor(snapshot ? NewIterator(snapshot) : NewIterator());
+
+    // position on the first entry of the scan; the cursor itself is never returned again
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low));
-    pcursor->Seek(ssKeySet.str());
+    if (!scan.fReverse) {
+        if (scan.fHaveCursor && scan.cursor.timestamp >= low)
+            ssKeySet << make_pair(DB_TIMESTAMPINDEX, scan.cursor);
+        else
+            ssKeySet << make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low));
+        pcursor->Seek(ssKeySet.str());
+        if (scan.fHaveCursor && pcursor->Valid() && pcursor->key() == leveldb::Slice(ssKeySet.str()))
+            pcursor->Next();
+    } else {
+        // last entry before the cursor (or before high)
+        if (scan.fHaveCursor && scan.cursor.timestamp < high)
+            ssKeySet << make_pair(DB_TIMESTAMPINDEX, scan.cursor);
+        else
+            ssKeySet << make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(high));
+        pcursor->Seek(ssKeySet.str());
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+    }
 
+    unsigned int nSkipped = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
+        char chType;
+        CTimestampIndexKey indexKey;
+        int nHeight = 0;
         try {
             leveldb::Slice slKey = pcursor->key();
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            CTimestampIndexKey indexKey;
             ssKey >> chType;
             ssKey >> indexKey;
-            if (chType == DB_TIMESTAMPINDEX && indexKey.timestamp < high) {
-                if (fActiveOnly) {
-                    if (blockOnchainActive(indexKey.blockHash)) {
-                        hashes.push_back(std::make_pair(indexKey.blockHash, indexKey.timestamp));
-                    }
-                } else {
-                    hashes.push_back(std::make_pair(indexKey.blockHash, indexKey.timestamp));
-                }
+        } catch (const std::exception& e) {
+            break;
+        }
+        if (chType != DB_TIMESTAMPINDEX || indexKey.timestamp < low || indexKey.timestamp >= high)
+            break;
 
-                pcursor->Next();
-            } else {
+        try {
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> nHeight;
+        } catch (const std::exception& e) {
+            return error("failed to read timestamp index value");
+        }
+
+        if (!filter || filter(indexKey.blockHash, nHeight)) {
+            if (scan.nLimit > 0 && hashes.size() >= scan.nLimit) {
+                // one more matching entry after the full page
+                fMore = true;
                 break;
             }
-        } catch (const std::exception& e) {
-            break;
+            if (nSkipped < scan.nOffset) {
+                ++nSkipped;
+            } else {
+                hashes.push_back(std::make_pair(indexKey.blockHash, indexKey.timestamp));
+                lastKey = indexKey;
+            }
         }
+
+        if (scan.fReverse)
+            pcursor->Prev();
+        else
+            pcursor->Next();
     }
 
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
+bool CTimestampIndexDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
     CLevelDBBatch batch;
     batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+bool CTimestampIndexDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
@@ -710,17 +872,6 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     ltimestamp = lts.ltimestamp;
     return true;
 }
-
-bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
-    BlockMap::iterator mi = mapBlockIndex.find(hash);
-
-    if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
-    {
-        return true;
-    }
-
-    return false;
-}
 #endif // ENABLE_ADDRESS_INDEXING
 
 bool CBlockTreeDB::WriteString(const std::string &name, std::string sValue) {
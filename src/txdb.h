@@ -10,6 +10,7 @@
 #include "coins.h"
 #include "leveldbwrapper.h"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
@@ -30,6 +31,7 @@ struct CAddressIndexValue;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
 struct CTimestampIndexKey;
+struct CTimestampIndexScan;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
@@ -46,8 +48,25 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
+#ifdef ENABLE_ADDRESS_INDEXING
+//! max number of threads used for a single batched address index lookup
+static const unsigned int MAX_ADDRESS_LOOKUP_THREADS = 4;
+//! number of (key-ordered) addresses a lookup thread takes at a time
+static const size_t ADDRESS_LOOKUP_CHUNK_SIZE = 16;
+
+//! default tuning of the explorer index databases; their caches come on top of -dbcache (MiB)
+static const int64_t DEFAULT_ADDRESSINDEX_DB_CACHE = 128;
+static const int64_t DEFAULT_ADDRESSINDEX_DB_WRITEBUFFER = 32;
+static const int64_t DEFAULT_TIMESTAMPINDEX_DB_CACHE = 8;
+static const int64_t DEFAULT_TIMESTAMPINDEX_DB_WRITEBUFFER = 2;
+static const int64_t DEFAULT_SPENTINDEX_DB_CACHE = 64;
+static const int64_t DEFAULT_SPENTINDEX_DB_WRITEBUFFER = 16;
+static const int DEFAULT_INDEX_DB_BLOOM_BITS = 10;
+#endif // ENABLE_ADDRESS_INDEXING
+
 static const std::string DEFAULT_INDEX_VERSION_STR = "0.0";
-static const std::string CURRENT_INDEX_VERSION_STR = "1.0";
+//! 2.0: explorer indexes (address, timestamp, spent) moved out of blocks/index into their own databases
+static const std::string CURRENT_INDEX_VERSION_STR = "2.0";
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -176,9 +195,23 @@ public:
     bool ReadMaturityHeightIndex(int height, std::vector<CMaturityHeightKey> &val);
     bool UpdateMaturityHeightIndex(const std::vector<std::pair<CMaturityHeightKey, CMaturityHeightValue>> &maturityHeightList);
 
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue);
+    bool WriteString(const std::string &name, std::string fValue);
+    bool ReadString(const std::string &name, std::string &fValue);
+    bool LoadBlockIndexGuts();
+};
+
 #ifdef ENABLE_ADDRESS_INDEXING
-    bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
+/** Access to the address and address unspent indexes (blocks/addressindex/) */
+class CAddressIndexDB : public CLevelDBWrapper
+{
+public:
+    CAddressIndexDB(const CLevelDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
+private:
+    CAddressIndexDB(const CAddressIndexDB&);
+    void operator=(const CAddressIndexDB&);
+public:
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
@@ -188,18 +221,53 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
                           int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
-    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
+    //! Batched lookups: one result vector per requested address, in request order, all read from the same snapshot
+    //! (the given one, or a new one taken for this call)
+    bool ReadAddressUnspentIndexBatch(const std::vector<std::pair<uint160, int> > &addresses,
+                                      std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &unspentOutputs,
+                                      const leveldb::Snapshot* snapshot = NULL);
+    bool ReadAddressIndexBatch(const std::vector<std::pair<uint160, int> > &addresses,
+                               std::vector<std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > > &addressIndexes,
+                               int start = 0, int end = 0, const leveldb::Snapshot* snapshot = NULL);
+};
+
+/** Access to the timestamp and block logical timestamp indexes (blocks/timestampindex/) */
+class CTimestampIndexDB : public CLevelDBWrapper
+{
+public:
+    CTimestampIndexDB(const CLevelDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
+private:
+    CTimestampIndexDB(const CTimestampIndexDB&);
+    void operator=(const CTimestampIndexDB&);
+public:
+    //! the height of the block is stored with the entry, so that scans can tell active blocks without a block index lookup
+    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex, int nHeight);
+    /**
+     * Block hashes and logical timestamps of the entries with low <= timestamp < high, paged by scan.
+     * Only the entries for which filter(hash, height) is true are counted and returned (all of them if filter is empty).
+     * lastKey is set to the last returned entry, to be used as cursor of the next page, and fMore tells whether
+     * further matching entries exist.
+     */
+    bool ReadTimestampIndex(unsigned int high, unsigned int low, const CTimestampIndexScan &scan,
+                            const std::function<bool(const uint256&, int)> &filter,
+                            std::vector<std::pair<uint256, unsigned int> > &vect, CTimestampIndexKey &lastKey, bool &fMore,
+                            const leveldb::Snapshot* snapshot = NULL);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
-    bool blockOnchainActive(const uint256 &hash);
-#endif // ENABLE_ADDRESS_INDEXING
+};
 
-    bool WriteFlag(const std::string &name, bool fValue);
-    bool ReadFlag(const std::string &name, bool &fValue);
-    bool WriteString(const std::string &name, std::string fValue);
-    bool ReadString(const std::string &name, std::string &fValue);
-    bool LoadBlockIndexGuts();
+/** Access to the spent index (blocks/spentindex/) */
+class CSpentIndexDB : public CLevelDBWrapper
+{
+public:
+    CSpentIndexDB(const CLevelDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
+private:
+    CSpentIndexDB(const CSpentIndexDB&);
+    void operator=(const CSpentIndexDB&);
+public:
+    bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value, const leveldb::Snapshot* snapshot = NULL);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
 };
+#endif // ENABLE_ADDRESS_INDEXING
 
 #endif // BITCOIN_TXDB_H
@@ -18,34 +18,79 @@
 #include <undo.h>
 
 CMemPoolEntry::CMemPoolEntry():
-    nFee(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0)
+    nFee(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0), nFeeDelta(0)
 {
     nHeight = MEMPOOL_HEIGHT;
+    InitPackageState(0);
 }
 
 CMemPoolEntry::CMemPoolEntry(const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) :
-    nFee(_nFee), nModSize(0), nUsageSize(0), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+    nFee(_nFee), nModSize(0), nUsageSize(0), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0)
 {
+    InitPackageState(0);
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(): nTxSize(0), hadNoDependencies(false)
+void CMemPoolEntry::InitPackageState(size_t nSize)
 {
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nSize;
+    nModFeesWithAncestors = GetModifiedFee();
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nSize;
+    nModFeesWithDescendants = GetModifiedFee();
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+void CMemPoolEntry::UpdateFeeDelta(CAmount newFeeDelta)
+{
+    nModFeesWithAncestors += newFeeDelta - nFeeDelta;
+    nModFeesWithDescendants += newFeeDelta - nFeeDelta;
+    nFeeDelta = newFeeDelta;
+}
+
+void CMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithAncestors += modifySize;
+    assert(int64_t(nSizeWithAncestors) > 0);
+    nModFeesWithAncestors += modifyFee;
+    nCountWithAncestors += modifyCount;
+    assert(int64_t(nCountWithAncestors) > 0);
+}
+
+void CMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithDescendants += modifySize;
+    assert(int64_t(nSizeWithDescendants) > 0);
+    nModFeesWithDescendants += modifyFee;
+    nCountWithDescendants += modifyCount;
+    assert(int64_t(nCountWithDescendants) > 0);
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(): tx(new CTransaction()), nTxSize(0), hadNoDependencies(false)
+{
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, double _dPriority,
                                  unsigned int _nHeight, bool poolHasNoInputsOf):
     CMemPoolEntry(_nFee, _nTime, _dPriority, _nHeight),
     tx(_tx), hadNoDependencies(poolHasNoInputsOf)
 {
-    nTxSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = tx.CalculateModifiedSize(nTxSize);
-    nUsageSize = RecursiveDynamicUsage(tx);
+    nTxSize = tx->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = tx->CalculateModifiedSize(nTxSize);
+    nUsageSize = RecursiveDynamicUsage(*tx);
+    InitPackageState(nTxSize);
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+                                 int64_t _nTime, double _dPriority,
+                                 unsigned int _nHeight, bool poolHasNoInputsOf):
+    CTxMemPoolEntry(CTransactionRef(new CTransaction(_tx)), _nFee, _nTime, _dPriority, _nHeight, poolHasNoInputsOf)
+{
 }
 
 double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = tx.GetValueOut()+nFee;
+    CAmount nValueIn = tx->GetValueOut()+nFee;
     // tx.GetValueOut() + nFee indirectly account for csw inputs amounts too.
 
     double deltaPriority = ((double)(currentHeight-nHeight)*nValueIn)/nModSize;
@@ -55,22 +100,58 @@ double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
-CCertificateMemPoolEntry::CCertificateMemPoolEntry(): nCertificateSize(0){}
+unsigned int CTxMemPoolEntry::GetHeightAllowingFree(double dPriorityDelta) const
+{
+    // the priority grows linearly with the height, as computed by GetPriority()
+    const CAmount nValueIn = tx->GetValueOut()+nFee;
+    const double dStartPriority = dPriority + dPriorityDelta;
+    auto priorityAt = [&](unsigned int currentHeight) {
+        return dStartPriority + ((double)(currentHeight-nHeight)*nValueIn)/nModSize;
+    };
+    static const unsigned int NEVER = std::numeric_limits<unsigned int>::max();
+
+    if (AllowFree(dStartPriority))
+        return 0;
+    if (nValueIn <= 0 || nModSize == 0)
+        return NEVER;
+
+    double dBlocks = std::floor((AllowFreeThreshold() - dStartPriority) * nModSize / nValueIn) + 1;
+    if (dBlocks >= (double)(NEVER - nHeight))
+        return NEVER;
+
+    // correct the rounding errors of the estimate
+    unsigned int nFreeHeight = nHeight + (unsigned int)dBlocks;
+    while (nFreeHeight > nHeight + 1 && AllowFree(priorityAt(nFreeHeight - 1)))
+        nFreeHeight--;
+    while (nFreeHeight < NEVER && !AllowFree(priorityAt(nFreeHeight)))
+        nFreeHeight++;
+    return nFreeHeight;
+}
+
+CCertificateMemPoolEntry::CCertificateMemPoolEntry(): cert(new CScCertificate()), nCertificateSize(0){}
+
+CCertificateMemPoolEntry::CCertificateMemPoolEntry(const CScCertificateRef& _cert, const CAmount& _nFee,
+                                 int64_t _nTime, double _dPriority,
+                                 unsigned int _nHeight):
+    CMemPoolEntry(_nFee, _nTime, _dPriority, _nHeight),
+    cert(_cert)
+{
+    nCertificateSize = cert->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = cert->CalculateModifiedSize(nCertificateSize);
+    nUsageSize = RecursiveDynamicUsage(*cert);
+    InitPackageState(nCertificateSize);
+}
 
 CCertificateMemPoolEntry::CCertificateMemPoolEntry(const CScCertificate& _cert, const CAmount& _nFee,
                                  int64_t _nTime, double _dPriority,
                                  unsigned int _nHeight):
-    CMemPoolEntry(_nFee, _nTime, _dPriority, _nHeight),
-    cert(_cert) 
+    CCertificateMemPoolEntry(CScCertificateRef(new CScCertificate(_cert)), _nFee, _nTime, _dPriority, _nHeight)
 {
-    nCertificateSize = cert.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = cert.CalculateModifiedSize(nCertificateSize);
-    nUsageSize = RecursiveDynamicUsage(cert);
 }
 
 double CCertificateMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = cert.GetValueOfChange()+nFee;
+    CAmount nValueIn = cert->GetValueOfChange()+nFee;
     double deltaPriority = ((double)(currentHeight-nHeight)*nValueIn)/nModSize;
     double dResult = dPriority + deltaPriority;
     LogPrint("mempool", "%s():%d - prioIn[%22.8f] + delta[%22.8f] = prioOut[%22.8f]\n",
@@ -111,7 +192,8 @@ bool CSidechainMemPoolEntry::HasCert(const uint256& hash) const
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0), nCertificatesUpdated(0), cachedInnerUsage(0)
+    nTransactionsUpdated(0), nCertificatesUpdated(0), cachedInnerUsage(0),
+    lastRollingFeeUpdate(GetTime()), blockSinceLastRollingFeeBump(false), rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -149,6 +231,50 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 {
     LOCK(cs);
     nTransactionsUpdated += n;
+    notifyUpdate();
+}
+
+void CTxMemPool::notifyUpdate()
+{
+    AssertLockHeld(cs);
+    boost::unique_lock<boost::mutex> lock(csUpdateWait);
+    nUpdatesNotified = nTransactionsUpdated + nCertificatesUpdated;
+    cvUpdate.notify_all();
+}
+
+bool CTxMemPool::WaitForUpdate(unsigned int nKnown, const boost::system_time& deadline) const
+{
+    // csUpdateWait is always taken after cs, never the other way round
+    boost::unique_lock<boost::mutex> lock(csUpdateWait);
+    while (nUpdatesNotified == nKnown && !fWaitsInterrupted)
+    {
+        if (!cvUpdate.timed_wait(lock, deadline))
+            break;
+    }
+    return nUpdatesNotified != nKnown;
+}
+
+void CTxMemPool::InterruptWaits()
+{
+    boost::unique_lock<boost::mutex> lock(csUpdateWait);
+    fWaitsInterrupted = true;
+    cvUpdate.notify_all();
+}
+
+uint64_t CTxMemPool::GetAddedSequence() const
+{
+    LOCK(cs);
+    return nAddedSequence;
+}
+
+bool CTxMemPool::GetAddedSince(uint64_t nSequence, std::vector<uint256>& vHashes) const
+{
+    LOCK(cs);
+    if (nSequence > nAddedSequence || nAddedSequence - nSequence > addedJournal.size())
+        return false;
+
+    vHashes.insert(vHashes.end(), addedJournal.end() - (nAddedSequence - nSequence), addedJournal.end());
+    return true;
 }
 
 
@@ -161,9 +287,14 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     mapTx[hash] = entry;
     const CTransaction& tx = mapTx[hash].GetTx();
 
-    mapRecentlyAddedTxBase[tx.GetHash()] = std::shared_ptr<CTransactionBase>(new CTransaction(tx));
+    mapRecentlyAddedTxBase[tx.GetHash()] = mapTx[hash].GetSharedTx();
     nRecentlyAddedSequence += 1;
 
+    addedJournal.push_back(hash);
+    if (addedJournal.size() > MAX_ADDED_JOURNAL_SIZE)
+        addedJournal.pop_front();
+    ++nAddedSequence;
+
     for (unsigned int i = 0; i < tx.GetVin().size(); i++)
         mapNextTx[tx.GetVin()[i].prevout] = CInPoint(&tx, i);
 
@@ -177,8 +308,9 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         if (mapSidechains.count(csw.scId) == 0)
             LogPrint("mempool", "%s():%d - adding tx [%s] in mapSidechain [%s], cswNullifiers\n",
                      __func__, __LINE__, hash.ToString(), csw.scId.ToString());
-        mapSidechains[csw.scId].cswNullifiers[csw.nullifier] = tx.GetHash();
-        mapSidechains[csw.scId].cswTotalAmount += csw.nValue;
+        CSidechainMemPoolEntry& scEntry = mapSidechains[csw.scId];
+        scEntry.cswNullifiers[csw.nullifier] = tx.GetHash();
+        scEntry.cswTotalAmount += csw.nValue;
     }
 
     for(const auto& sc: tx.GetVscCcOut()) {
@@ -198,7 +330,15 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         mapSidechains[btr.scId].mcBtrsTxHashes.insert(hash);
     }
 
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+    if (pos != mapDeltas.end())
+        mapTx[hash].UpdateFeeDelta(pos->second.second);
+    applyLoadedTime(hash, mapTx[hash]);
+    updateForAdd(hash);
+    indexTx(hash);
+
     nTransactionsUpdated++;
+    notifyUpdate();
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
@@ -212,9 +352,14 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntr
     mapCertificate[hash] = entry;
     const CScCertificate& cert = mapCertificate[hash].GetCertificate();
 
-    mapRecentlyAddedTxBase[cert.GetHash()] = std::shared_ptr<CTransactionBase>(new CScCertificate(cert));
+    mapRecentlyAddedTxBase[cert.GetHash()] = mapCertificate[hash].GetSharedCertificate();
     nRecentlyAddedSequence += 1;
 
+    addedJournal.push_back(hash);
+    if (addedJournal.size() > MAX_ADDED_JOURNAL_SIZE)
+        addedJournal.pop_front();
+    ++nAddedSequence;
+
     for (unsigned int i = 0; i < cert.GetVin().size(); i++)
         mapNextTx[cert.GetVin()[i].prevout] = CInPoint(&cert, i);
 
@@ -224,8 +369,15 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntr
     if (mapSidechains.count(cert.GetScId())!= 0)
         assert(mapSidechains.at(cert.GetScId()).mBackwardCertificates.count(cert.quality) == 0);
     mapSidechains[cert.GetScId()].mBackwardCertificates[cert.quality] = hash;
-           
+
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+    if (pos != mapDeltas.end())
+        mapCertificate[hash].UpdateFeeDelta(pos->second.second);
+    applyLoadedTime(hash, mapCertificate[hash]);
+    updateForAdd(hash);
+
     nCertificatesUpdated++;
+    notifyUpdate();
     totalCertificateSize += entry.GetCertificateSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
     // TODO cert: for the time being skip the part on policy estimator, certificates currently have maximum priority
@@ -479,9 +631,13 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesFrom(const CTransactionBase&
     // it's Breath-First-Search on txes/certs Direct Acyclic Graph, having originTx as root.
 
     AssertLockHeld(cs);
-    std::vector<uint256> res = mempoolDirectDependenciesFrom(originTx);
-    std::deque<uint256> toVisit{res.begin(), res.end()};
-    res.clear();
+    std::vector<uint256> res;
+    std::deque<uint256> toVisit;
+    std::set<uint256> seen; // either visited or waiting to be
+    for(const uint256& ancestor : mempoolDirectDependenciesFrom(originTx)) {
+        if (seen.insert(ancestor).second)
+            toVisit.push_back(ancestor);
+    }
 
     while(!toVisit.empty())
     {
@@ -495,13 +651,11 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesFrom(const CTransactionBase&
             assert(pCurrentNode);
 
         toVisit.pop_back();
-        if (std::find(res.begin(), res.end(), pCurrentNode->GetHash()) == res.end())
-            res.push_back(pCurrentNode->GetHash());
+        res.push_back(pCurrentNode->GetHash());
 
         std::vector<uint256> directAncestors = mempoolDirectDependenciesFrom(*pCurrentNode);
         for(const uint256& ancestor : directAncestors) {
-            if ( (std::find(toVisit.begin(), toVisit.end(), ancestor) == toVisit.end()) &&
-                 (std::find(res.begin(), res.end(), ancestor) == res.end()))
+            if (seen.insert(ancestor).second)
                 toVisit.push_front(ancestor);
         }
     }
@@ -553,9 +707,13 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesOf(const CTransactionBase& o
     // it's Depth-First-Search on txes/certs Direct Acyclic Graph, having originTx as root.
 
     AssertLockHeld(cs);
-    std::vector<uint256> res = mempoolDirectDependenciesOf(origTx);
-    std::deque<uint256> toVisit{res.begin(), res.end()};
-    res.clear();
+    std::vector<uint256> res;
+    std::deque<uint256> toVisit;
+    std::set<uint256> seen; // either visited or waiting to be
+    for(const uint256& dep : mempoolDirectDependenciesOf(origTx)) {
+        if (seen.insert(dep).second)
+            toVisit.push_back(dep);
+    }
 
     while(!toVisit.empty())
     {
@@ -569,19 +727,159 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesOf(const CTransactionBase& o
             assert(pCurrentRoot);
 
         toVisit.pop_front();
-        if (std::find(res.begin(), res.end(), pCurrentRoot->GetHash()) == res.end())
-            res.push_back(pCurrentRoot->GetHash());
+        res.push_back(pCurrentRoot->GetHash());
 
         std::vector<uint256> directDescendants = mempoolDirectDependenciesOf(*pCurrentRoot);
         for(const uint256& dep : directDescendants)
-            if ((std::find(toVisit.begin(), toVisit.end(),dep) == toVisit.end()) &&
-                (std::find(res.begin(), res.end(),dep) == res.end()))
+            if (seen.insert(dep).second)
                 toVisit.push_front(dep);
     }
 
     return res;
 }
 
+const CMemPoolEntry* CTxMemPool::getEntry(const uint256& hash) const
+{
+    AssertLockHeld(cs);
+    std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+    if (itTx != mapTx.end())
+        return &itTx->second;
+    std::map<uint256, CCertificateMemPoolEntry>::const_iterator itCert = mapCertificate.find(hash);
+    if (itCert != mapCertificate.end())
+        return &itCert->second;
+    return nullptr;
+}
+
+CMemPoolEntry* CTxMemPool::getEntry(const uint256& hash)
+{
+    return const_cast<CMemPoolEntry*>(static_cast<const CTxMemPool*>(this)->getEntry(hash));
+}
+
+void CTxMemPool::calculatePackageState(const CMemPoolEntry& entry, uint64_t& nCountWithAncestors, uint64_t& nSizeWithAncestors,
+                                       CAmount& nModFeesWithAncestors, uint64_t& nCountWithDescendants,
+                                       uint64_t& nSizeWithDescendants, CAmount& nModFeesWithDescendants) const
+{
+    AssertLockHeld(cs);
+    nCountWithAncestors = nCountWithDescendants = 1;
+    nSizeWithAncestors = nSizeWithDescendants = entry.GetSize();
+    nModFeesWithAncestors = nModFeesWithDescendants = entry.GetModifiedFee();
+
+    for(const uint256& hash : mempoolDependenciesFrom(entry.GetTxBase()))
+    {
+        const CMemPoolEntry* pAncestor = getEntry(hash);
+        nCountWithAncestors++;
+        nSizeWithAncestors += pAncestor->GetSize();
+        nModFeesWithAncestors += pAncestor->GetModifiedFee();
+    }
+
+    for(const uint256& hash : mempoolDependenciesOf(entry.GetTxBase()))
+    {
+        const CMemPoolEntry* pDescendant = getEntry(hash);
+        nCountWithDescendants++;
+        nSizeWithDescendants += pDescendant->GetSize();
+        nModFeesWithDescendants += pDescendant->GetModifiedFee();
+    }
+}
+
+void CTxMemPool::recalculatePackageState(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    CMemPoolEntry& entry = *getEntry(hash);
+    uint64_t nCountWithAncestors, nSizeWithAncestors, nCountWithDescendants, nSizeWithDescendants;
+    CAmount nModFeesWithAncestors, nModFeesWithDescendants;
+    calculatePackageState(entry, nCountWithAncestors, nSizeWithAncestors, nModFeesWithAncestors,
+                          nCountWithDescendants, nSizeWithDescendants, nModFeesWithDescendants);
+
+    unindexTx(hash);
+    entry.UpdateAncestorState(nSizeWithAncestors - entry.GetSizeWithAncestors(),
+                              nModFeesWithAncestors - entry.GetModFeesWithAncestors(),
+                              nCountWithAncestors - entry.GetCountWithAncestors());
+    entry.UpdateDescendantState(nSizeWithDescendants - entry.GetSizeWithDescendants(),
+                                nModFeesWithDescendants - entry.GetModFeesWithDescendants(),
+                                nCountWithDescendants - entry.GetCountWithDescendants());
+    indexTx(hash);
+}
+
+void CTxMemPool::updateForAdd(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    CMemPoolEntry& entry = *getEntry(hash);
+    const std::vector<uint256> ancestors = mempoolDependenciesFrom(entry.GetTxBase());
+    const std::vector<uint256> descendants = mempoolDependenciesOf(entry.GetTxBase());
+
+    if (descendants.empty())
+    {
+        // the usual case: the new entry just extends the packages of its ancestors
+        for(const uint256& ancestorHash : ancestors)
+        {
+            CMemPoolEntry& ancestor = *getEntry(ancestorHash);
+            entry.UpdateAncestorState(ancestor.GetSize(), ancestor.GetModifiedFee(), 1);
+            unindexTx(ancestorHash);
+            ancestor.UpdateDescendantState(entry.GetSize(), entry.GetModifiedFee(), 1);
+            indexTx(ancestorHash);
+        }
+        return;
+    }
+
+    // The entry is being put back below entries already in the mempool (e.g. a transaction of a disconnected block),
+    // so that its descendants may gain further ancestors and its ancestors further descendants: recompute them all.
+    recalculatePackageState(hash);
+    for(const uint256& ancestorHash : ancestors)
+        recalculatePackageState(ancestorHash);
+    for(const uint256& descendantHash : descendants)
+        recalculatePackageState(descendantHash);
+}
+
+void CTxMemPool::updateForRemove(const std::vector<uint256>& objToRemove, std::set<uint256>& toRecalculate)
+{
+    AssertLockHeld(cs);
+    const std::set<uint256> setToRemove(objToRemove.begin(), objToRemove.end());
+
+    for(const uint256& hash : objToRemove)
+    {
+        const CMemPoolEntry* pEntry = getEntry(hash);
+        if (pEntry == nullptr)
+            continue;
+
+        std::vector<uint256> remainingAncestors;
+        for(const uint256& ancestorHash : mempoolDependenciesFrom(pEntry->GetTxBase()))
+        {
+            if (setToRemove.count(ancestorHash) == 0)
+                remainingAncestors.push_back(ancestorHash);
+        }
+        std::vector<uint256> remainingDescendants;
+        for(const uint256& descendantHash : mempoolDependenciesOf(pEntry->GetTxBase()))
+        {
+            if (setToRemove.count(descendantHash) == 0)
+                remainingDescendants.push_back(descendantHash);
+        }
+
+        if (!remainingAncestors.empty() && !remainingDescendants.empty())
+        {
+            // Removing an entry from the middle of a package may disconnect its ancestors from its descendants,
+            // which is only known once it is gone from the dependency maps.
+            toRecalculate.insert(remainingAncestors.begin(), remainingAncestors.end());
+            toRecalculate.insert(remainingDescendants.begin(), remainingDescendants.end());
+            continue;
+        }
+
+        const int64_t nSize = pEntry->GetSize();
+        const CAmount nModFee = pEntry->GetModifiedFee();
+        for(const uint256& ancestorHash : remainingAncestors)
+        {
+            unindexTx(ancestorHash);
+            getEntry(ancestorHash)->UpdateDescendantState(-nSize, -nModFee, -1);
+            indexTx(ancestorHash);
+        }
+        for(const uint256& descendantHash : remainingDescendants)
+        {
+            unindexTx(descendantHash);
+            getEntry(descendantHash)->UpdateAncestorState(-nSize, -nModFee, -1);
+            indexTx(descendantHash);
+        }
+    }
+}
+
 void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -593,12 +891,16 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
 
     objToRemove.insert(objToRemove.begin(), origTx.GetHash());
 
+    std::set<uint256> toRecalculate;
+    updateForRemove(objToRemove, toRecalculate);
+
     for(const uint256& hash : objToRemove)
     {
         if (mapTx.count(hash))
         {
             const CTransaction& tx = mapTx[hash].GetTx();
             mapRecentlyAddedTxBase.erase(hash);
+            unindexTx(hash);
 
             for(const CTxIn& txin: tx.GetVin())
                 mapNextTx.erase(txin.prevout);
@@ -609,13 +911,15 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
             }
 
             for(const CTxCeasedSidechainWithdrawalInput& csw: tx.GetVcswCcIn()) {
-                mapSidechains.at(csw.scId).cswNullifiers.erase(csw.nullifier);
-                mapSidechains.at(csw.scId).cswTotalAmount -= csw.nValue;
+                auto scIt = mapSidechains.find(csw.scId);
+                assert(scIt != mapSidechains.end());
+                scIt->second.cswNullifiers.erase(csw.nullifier);
+                scIt->second.cswTotalAmount -= csw.nValue;
 
-                if (mapSidechains.at(csw.scId).IsNull())
+                if (scIt->second.IsNull())
                 {
                     LogPrint("mempool", "%s():%d - erasing [%s] from mapSidechain\n", __func__, __LINE__, csw.scId.ToString() );
-                    mapSidechains.erase(csw.scId);
+                    mapSidechains.erase(scIt);
                 }
             }
 
@@ -662,6 +966,7 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
             mapTx.erase(hash);
 
             nTransactionsUpdated++;
+            notifyUpdate();
             minerPolicyEstimator->removeTx(hash);
 
 #ifdef ENABLE_ADDRESS_INDEXING
@@ -704,6 +1009,7 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
             LogPrint("mempool", "%s():%d - removing cert [%s] from mempool\n", __func__, __LINE__, hash.ToString() );
             mapCertificate.erase(hash);
             nCertificatesUpdated++;
+            notifyUpdate();
 
 #ifdef ENABLE_ADDRESS_INDEXING
             if (fAddressIndex)
@@ -721,6 +1027,9 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
 #endif // ENABLE_ADDRESS_INDEXING
         }
     }
+
+    for(const uint256& hash : toRecalculate)
+        recalculatePackageState(hash);
 }
 
 inline bool CTxMemPool::checkTxImmatureExpenditures(const CTransaction& tx, const CCoinsViewCache * const pcoins)
@@ -867,18 +1176,26 @@ void CTxMemPool::removeStaleCertificates(const CCoinsViewCache * const pCoinsVie
 
 
 void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot)
+{
+    removeWithAnchors(std::set<uint256>{invalidRoot});
+}
+
+void CTxMemPool::removeWithAnchors(const std::set<uint256>& invalidRoots)
 {
     // If a block is disconnected from the tip, and the root changed,
     // we must invalidate transactions from the mempool which spend
     // from that root -- almost as though they were spending coinbases
     // which are no longer valid to spend due to coinbase maturity.
+    if (invalidRoots.empty())
+        return;
+
     LOCK(cs);
     std::list<CTransaction> transactionsToRemove;
 
     for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         const CTransaction& tx = it->second.GetTx();
         BOOST_FOREACH(const JSDescription& joinsplit, tx.GetVjoinsplit()) {
-            if (joinsplit.anchor == invalidRoot) {
+            if (invalidRoots.count(joinsplit.anchor)) {
                 transactionsToRemove.push_back(tx);
                 break;
             }
@@ -897,7 +1214,7 @@ void CTxMemPool::removeOutOfScBalanceCsw(const CCoinsViewCache * const pCoinsVie
     // Remove CSWs that try to withdraw more coins than belongs to the sidechain.
     // Note: if there is a CSW values conflict (may occur only if CSW circuit is broken or malicious) -> remove all CSWs for given sidechain.
     std::set<uint256> txesToRemove;
-    for (std::map<uint256, CSidechainMemPoolEntry>::const_iterator sIt = mapSidechains.begin(); sIt != mapSidechains.end(); sIt++)
+    for (auto sIt = mapSidechains.begin(); sIt != mapSidechains.end(); sIt++)
     {
         const CSidechainMemPoolEntry &sidechainEntry = sIt->second;
         if (sidechainEntry.cswTotalAmount == 0) //how about < 0?
@@ -930,7 +1247,13 @@ void CTxMemPool::removeOutOfScBalanceCsw(const CCoinsViewCache * const pCoinsVie
 void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts)
 {
     LOCK(cs);
+    removeSpendConflicts(tx, removedTxs, removedCerts);
+    removeOutOfScBalanceCsw(pcoinsTip, removedTxs, removedCerts);
+}
 
+void CTxMemPool::removeSpendConflicts(const CTransaction &tx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts)
+{
+    AssertLockHeld(cs);
     for(const CTxIn &txin: tx.GetVin())
     {
         std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
@@ -959,11 +1282,12 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
     for(const CTxCeasedSidechainWithdrawalInput& csw: tx.GetVcswCcIn())
     {
-        if (mapSidechains.count(csw.scId) == 0)
+        auto scIt = mapSidechains.find(csw.scId);
+        if (scIt == mapSidechains.end())
             continue;
 
-        const auto& cswNullifierTx = mapSidechains.at(csw.scId).cswNullifiers.find(csw.nullifier);
-        if(cswNullifierTx == mapSidechains.at(csw.scId).cswNullifiers.end())
+        const auto& cswNullifierTx = scIt->second.cswNullifiers.find(csw.nullifier);
+        if(cswNullifierTx == scIt->second.cswNullifiers.end())
             continue;
 
         const uint256& txHash = cswNullifierTx->second;
@@ -975,8 +1299,6 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
         if (txConflict != tx)
             remove(txConflict, removedTxs, removedCerts, true);
     }
-
-    removeOutOfScBalanceCsw(pcoinsTip, removedTxs, removedCerts);
 }
 
 void CTxMemPool::removeStaleTransactions(const CCoinsViewCache * const pCoinsView,
@@ -1068,11 +1390,16 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         std::list<CTransaction> dummyTxs;
         std::list<CScCertificate> dummyCerts;
         remove(tx, dummyTxs, dummyCerts, /*fRecursive*/false);
-        removeConflicts(tx, conflictingTxs, conflictingCerts);
+        removeSpendConflicts(tx, conflictingTxs, conflictingCerts);
         ClearPrioritisation(tx.GetHash());
     }
+    // the sidechain balances only depend on the block as a whole
+    removeOutOfScBalanceCsw(pcoinsTip, conflictingTxs, conflictingCerts);
+
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 void CTxMemPool::removeConflicts(const CScCertificate &cert, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts) {
@@ -1145,10 +1472,14 @@ void CTxMemPool::clear()
     mapTx.clear();
     mapCertificate.clear();
     mapDeltas.clear();
+    setTxByAncestorScore.clear();
+    setTxByHeightAllowingFree.clear();
+    setTxByDescendantScore.clear();
     mapNextTx.clear();
     mapSidechains.clear();
     mapNullifiers.clear();
     mapRecentlyAddedTxBase.clear();
+    mapLoadedTimes.clear();
 
 #ifdef ENABLE_ADDRESS_INDEXING
     mapAddress.clear();
@@ -1160,8 +1491,12 @@ void CTxMemPool::clear()
     totalTxSize = 0;
     totalCertificateSize = 0;
     cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
     ++nCertificatesUpdated;
+    notifyUpdate();
 }
 
 void CTxMemPool::check(const CCoinsViewCache *pcoins) const
@@ -1465,6 +1800,40 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    std::vector<const CMemPoolEntry*> allEntries;
+    for (const auto& entry : mapTx)
+        allEntries.push_back(&entry.second);
+    for (const auto& entry : mapCertificate)
+        allEntries.push_back(&entry.second);
+    for (const CMemPoolEntry* pEntry : allEntries)
+    {
+        // cached ancestor/descendant statistics must match the current dependency graph
+        uint64_t nCountWithAncestors, nSizeWithAncestors, nCountWithDescendants, nSizeWithDescendants;
+        CAmount nModFeesWithAncestors, nModFeesWithDescendants;
+        calculatePackageState(*pEntry, nCountWithAncestors, nSizeWithAncestors, nModFeesWithAncestors,
+                              nCountWithDescendants, nSizeWithDescendants, nModFeesWithDescendants);
+        assert(pEntry->GetCountWithAncestors() == nCountWithAncestors);
+        assert(pEntry->GetSizeWithAncestors() == nSizeWithAncestors);
+        assert(pEntry->GetModFeesWithAncestors() == nModFeesWithAncestors);
+        assert(pEntry->GetCountWithDescendants() == nCountWithDescendants);
+        assert(pEntry->GetSizeWithDescendants() == nSizeWithDescendants);
+        assert(pEntry->GetModFeesWithDescendants() == nModFeesWithDescendants);
+    }
+
+    // the sorted indices hold exactly the transactions, with up to date keys
+    assert(setTxByAncestorScore.size() == mapTx.size());
+    assert(setTxByHeightAllowingFree.size() == mapTx.size());
+    assert(setTxByDescendantScore.size() == mapTx.size());
+    for (const auto& entry : mapTx)
+    {
+        double dPriorityDelta = 0;
+        CAmount nFeeDelta = 0;
+        ApplyDeltas(entry.first, dPriorityDelta, nFeeDelta);
+        assert(setTxByAncestorScore.count(CAncestorScoreKey(entry.second)) == 1);
+        assert(setTxByHeightAllowingFree.count(std::make_pair(entry.second.GetHeightAllowingFree(dPriorityDelta), entry.first)) == 1);
+        assert(setTxByDescendantScore.count(CDescendantScoreKey(entry.second)) == 1);
+    }
+
     assert((totalTxSize+totalCertificateSize) == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
@@ -1621,8 +1990,9 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid) const
 int CTxMemPool::getNumOfCswInputs(const uint256& scId) const
 {
     LOCK(cs);
-    if (mapSidechains.count(scId) != 0)
-        return mapSidechains.at(scId).cswNullifiers.size();
+    auto it = mapSidechains.find(scId);
+    if (it != mapSidechains.end())
+        return it->second.cswNullifiers.size();
     return 0;
 }
 
@@ -1645,6 +2015,18 @@ bool CTxMemPool::lookup(const uint256& hash, CScCertificate& result) const
     return true;
 }
 
+std::shared_ptr<const CTransactionBase> CTxMemPool::get(const uint256& hash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+    if (itTx != mapTx.end())
+        return itTx->second.GetSharedTx();
+    std::map<uint256, CCertificateMemPoolEntry>::const_iterator itCert = mapCertificate.find(hash);
+    if (itCert != mapCertificate.end())
+        return itCert->second.GetSharedCertificate();
+    return std::shared_ptr<const CTransactionBase>();
+}
+
 void CTxMemPool::CertQualityStatusString(const CScCertificate& cert, std::string& statusString) const
 {
     const uint256& scid = cert.GetScId();
@@ -1716,16 +2098,19 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const std::string& s
     {
         LOCK(cs);
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
+        unindexTx(hash);
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        updateFeeDelta(hash, deltas.second);
+        indexTx(hash);
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
 
-void CTxMemPool::ApplyDeltas(const uint256& hash, double &dPriorityDelta, CAmount &nFeeDelta)
+void CTxMemPool::ApplyDeltas(const uint256& hash, double &dPriorityDelta, CAmount &nFeeDelta) const
 {
     LOCK(cs);
-    std::map<uint256, std::pair<double, CAmount> >::iterator pos = mapDeltas.find(hash);
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
     if (pos == mapDeltas.end())
         return;
     const std::pair<double, CAmount> &deltas = pos->second;
@@ -1736,7 +2121,87 @@ void CTxMemPool::ApplyDeltas(const uint256& hash, double &dPriorityDelta, CAmoun
 void CTxMemPool::ClearPrioritisation(const uint256& hash)
 {
     LOCK(cs);
+    unindexTx(hash);
     mapDeltas.erase(hash);
+    updateFeeDelta(hash, 0);
+    indexTx(hash);
+}
+
+void CTxMemPool::SetLoadedTime(const uint256& hash, int64_t nTime)
+{
+    LOCK(cs);
+    mapLoadedTimes[hash] = nTime;
+}
+
+void CTxMemPool::EraseLoadedTime(const uint256& hash)
+{
+    LOCK(cs);
+    mapLoadedTimes.erase(hash);
+}
+
+void CTxMemPool::applyLoadedTime(const uint256& hash, CMemPoolEntry& entry)
+{
+    std::map<uint256, int64_t>::iterator it = mapLoadedTimes.find(hash);
+    if (it == mapLoadedTimes.end())
+        return;
+    entry.UpdateTime(it->second);
+    mapLoadedTimes.erase(it);
+}
+
+void CTxMemPool::updateFeeDelta(const uint256& hash, CAmount nNewFeeDelta)
+{
+    AssertLockHeld(cs);
+    CMemPoolEntry* pEntry = getEntry(hash);
+    if (pEntry == nullptr)
+        return;
+
+    const CAmount nChange = nNewFeeDelta - (pEntry->GetModifiedFee() - pEntry->GetFee());
+    if (nChange == 0)
+        return;
+
+    pEntry->UpdateFeeDelta(nNewFeeDelta);
+    for(const uint256& ancestorHash : mempoolDependenciesFrom(pEntry->GetTxBase()))
+    {
+        unindexTx(ancestorHash);
+        getEntry(ancestorHash)->UpdateDescendantState(0, nChange, 0);
+        indexTx(ancestorHash);
+    }
+    for(const uint256& descendantHash : mempoolDependenciesOf(pEntry->GetTxBase()))
+    {
+        unindexTx(descendantHash);
+        getEntry(descendantHash)->UpdateAncestorState(0, nChange, 0);
+        indexTx(descendantHash);
+    }
+}
+
+void CTxMemPool::unindexTx(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+    setTxByAncestorScore.erase(CAncestorScoreKey(it->second));
+    setTxByHeightAllowingFree.erase(std::make_pair(it->second.GetHeightAllowingFree(dPriorityDelta), hash));
+    setTxByDescendantScore.erase(CDescendantScoreKey(it->second));
+}
+
+void CTxMemPool::indexTx(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+    setTxByAncestorScore.insert(CAncestorScoreKey(it->second));
+    setTxByHeightAllowingFree.insert(std::make_pair(it->second.GetHeightAllowingFree(dPriorityDelta), hash));
+    setTxByDescendantScore.insert(CDescendantScoreKey(it->second));
 }
 
 bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
@@ -1751,7 +2216,7 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 void CTxMemPool::NotifyRecentlyAdded()
 {
     uint64_t recentlyAddedSequence;
-    std::vector<std::shared_ptr<CTransactionBase> > vTxBase;
+    std::vector<std::shared_ptr<const CTransactionBase> > vTxBase;
     {
         LOCK(cs);
         recentlyAddedSequence = nRecentlyAddedSequence;
@@ -1896,11 +2361,140 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
         ( memusage::DynamicUsage(mapTx) +
           memusage::DynamicUsage(mapNextTx) +
           memusage::DynamicUsage(mapDeltas) +
+          memusage::DynamicUsage(setTxByAncestorScore) +
+          memusage::DynamicUsage(setTxByHeightAllowingFree) +
+          memusage::DynamicUsage(setTxByDescendantScore) +
           memusage::DynamicUsage(mapCertificate) +
           memusage::DynamicUsage(mapSidechains) +
           cachedInnerUsage);
 }
 
+void CTxMemPool::TrimToSize(size_t sizelimit, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts)
+{
+    LOCK(cs);
+
+    if (DynamicMemoryUsage() <= sizelimit)
+        return;
+
+    // The sidechain transactions in the mempool rely on its top quality certificate being mined, which must therefore
+    // outlive them; lower quality certificates are superseded by the top quality one and must not outlive it.
+    // Certificates are not in the descendant score index, they are few: their keys are set here, with the top quality
+    // ones ranked after any entry of the same score and the lower quality ones scored no higher than them.
+    std::set<CDescendantScoreKey> setCertCandidates;
+    for (const auto& sc : mapSidechains)
+    {
+        if (sc.second.mBackwardCertificates.empty())
+            continue;
+
+        const uint256& topQualityCertHash = sc.second.GetTopQualityCert()->second;
+        const CFeeRate topQualityScore = CDescendantScoreKey(mapCertificate.at(topQualityCertHash)).score;
+        for (const auto& cert : sc.second.mBackwardCertificates)
+        {
+            CDescendantScoreKey candidate(mapCertificate.at(cert.second));
+            if (cert.second == topQualityCertHash)
+                candidate.rank = 2;
+            else
+                candidate.score = std::min(candidate.score, topQualityScore);
+            setCertCandidates.insert(candidate);
+        }
+    }
+
+    unsigned int nRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (DynamicMemoryUsage() > sizelimit)
+    {
+        while (!setCertCandidates.empty() && mapCertificate.count(setCertCandidates.begin()->hash) == 0)
+            setCertCandidates.erase(setCertCandidates.begin()); // already removed as descendant of a previous candidate
+
+        // the lowest of the transaction and certificate candidates
+        bool fCert = !setCertCandidates.empty() &&
+                     (setTxByDescendantScore.empty() || *setCertCandidates.begin() < *setTxByDescendantScore.begin());
+        if (!fCert && setTxByDescendantScore.empty())
+            break;
+        const CDescendantScoreKey candidate = fCert ? *setCertCandidates.begin() : *setTxByDescendantScore.begin();
+
+        const CTransactionBase* pTxBase = nullptr;
+        if (fCert)
+        {
+            setCertCandidates.erase(setCertCandidates.begin());
+            const CScCertificate& cert = mapCertificate.at(candidate.hash).GetCertificate();
+            const CSidechainMemPoolEntry& sc = mapSidechains.at(cert.GetScId());
+            if (candidate.rank == 2 && (sc.mBackwardCertificates.size() > 1 || !sc.fwdTxHashes.empty() ||
+                                        !sc.mcBtrsTxHashes.empty() || !sc.cswNullifiers.empty()))
+            {
+                // the top quality certificate comes up before the rest of its sidechain: rank it again after them
+                CDescendantScoreKey requeued(candidate);
+                for (const uint256& fwdTxHash : sc.fwdTxHashes)
+                    requeued.score = std::max(requeued.score, CDescendantScoreKey(mapTx.at(fwdTxHash)).score);
+                for (const uint256& mcBtrTxHash : sc.mcBtrsTxHashes)
+                    requeued.score = std::max(requeued.score, CDescendantScoreKey(mapTx.at(mcBtrTxHash)).score);
+                for (const auto& cswNullifier : sc.cswNullifiers)
+                    requeued.score = std::max(requeued.score, CDescendantScoreKey(mapTx.at(cswNullifier.second)).score);
+                for (const auto& lowerCert : sc.mBackwardCertificates)
+                    if (lowerCert.second != candidate.hash)
+                        requeued.score = std::max(requeued.score, CDescendantScoreKey(mapCertificate.at(lowerCert.second)).score);
+                setCertCandidates.insert(requeued);
+                continue;
+            }
+            pTxBase = &cert;
+        } else
+            pTxBase = &mapTx.at(candidate.hash).GetTx();
+
+        // Raise the mempool minimum fee to the fee rate of the removed package plus the minimum relay fee, so that
+        // entries paying the same fee rate as the removed ones do not get in again until a block is found.
+        CFeeRate removed(candidate.packageFeeRate.GetFeePerK() + ::minRelayTxFee.GetFeePerK());
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        size_t nRemovedBefore = removedTxs.size() + removedCerts.size();
+        LogPrint("mempool", "%s():%d - evicting [%s] and its descendants, package fee rate %s\n",
+            __func__, __LINE__, candidate.hash.ToString(), candidate.packageFeeRate.ToString());
+        remove(*pTxBase, removedTxs, removedCerts, /*fRecursive*/true);
+        nRemoved += removedTxs.size() + removedCerts.size() - nRemovedBefore;
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "%s():%d - removed %u txes/certs, rolling minimum fee bumped to %s\n",
+            __func__, __LINE__, nRemoved, maxFeeRateRemoved.ToString());
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10)
+    {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < ::minRelayTxFee.GetFeePerK() / 2)
+        {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(rollingMinimumFeeRate), ::minRelayTxFee);
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate)
+    {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
 std::pair<uint256, CAmount> CTxMemPool::FindCertWithQuality(const uint256& scId, int64_t certQuality)
 {
     LOCK(cs);
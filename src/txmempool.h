@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <deque>
 #include <list>
 
 #if defined(HAVE_CONFIG_H)
@@ -52,15 +53,47 @@ protected:
     int64_t nTime; //! Local time when entering the mempool
     double dPriority; //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta; //! Fee delta set by PrioritiseTransaction
+
+    // Statistics of the entry together with all its in-mempool ancestors (resp. descendants), including
+    // the entry itself. They are kept up to date by CTxMemPool as entries are added and removed.
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+
+    //! reset the statistics to the entry alone, called by the derived constructors once the size is known
+    void InitPackageState(size_t nSize);
+
 public:
     CMemPoolEntry();
     CMemPoolEntry(const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
     virtual ~CMemPoolEntry() = default;
     virtual double GetPriority(unsigned int currentHeight) const = 0;
+    virtual const CTransactionBase& GetTxBase() const = 0;
+    //! serialized size
+    virtual size_t GetSize() const = 0;
     CAmount GetFee() const { return nFee; }
+    //! fee including the delta set by PrioritiseTransaction
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
+
+    void UpdateFeeDelta(CAmount newFeeDelta);
+    //! used to restore the time of an entry reloaded from disk
+    void UpdateTime(int64_t newTime) { nTime = newTime; }
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
 };
 
 /**
@@ -69,34 +102,110 @@ public:
 class CTxMemPoolEntry : public CMemPoolEntry
 {
 private:
-    CTransaction tx;
+    //! shared with the relay and the notifications rather than copied
+    CTransactionRef tx;
     size_t nTxSize; //! ... and avoid recomputing tx size
     bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
 
 public:
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, bool poolHasNoInputsOf = false);
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, bool poolHasNoInputsOf = false);
     CTxMemPoolEntry();
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    const CTransactionRef& GetSharedTx() const { return this->tx; }
+    const CTransactionBase& GetTxBase() const override { return *this->tx; }
     double GetPriority(unsigned int currentHeight) const override;
+    //! lowest chain height at which the priority, increased by dPriorityDelta, is enough to be mined for free
+    unsigned int GetHeightAllowingFree(double dPriorityDelta) const;
     size_t GetTxSize() const { return nTxSize; }
+    size_t GetSize() const override { return nTxSize; }
     bool WasClearAtEntry() const { return hadNoDependencies; }
 };
 
 class CCertificateMemPoolEntry : public CMemPoolEntry
 {
 private:
-    CScCertificate cert;
+    //! shared with the relay and the notifications rather than copied
+    CScCertificateRef cert;
     size_t nCertificateSize; //! ... and avoid recomputing tx size
 
 public:
+    CCertificateMemPoolEntry(
+        const CScCertificateRef& _cert, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
     CCertificateMemPoolEntry(
         const CScCertificate& _cert, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
     CCertificateMemPoolEntry();
 
-    const CScCertificate& GetCertificate() const { return this->cert; }
+    const CScCertificate& GetCertificate() const { return *this->cert; }
+    const CScCertificateRef& GetSharedCertificate() const { return this->cert; }
+    const CTransactionBase& GetTxBase() const override { return *this->cert; }
     double GetPriority(unsigned int currentHeight) const override;
     size_t GetCertificateSize() const { return nCertificateSize; }
+    size_t GetSize() const override { return nCertificateSize; }
+};
+
+/**
+ * Sort key of the mempool transactions by ancestor score, i.e. by the fee rate of each transaction together with its
+ * in-mempool ancestors, which must be mined before it. Keys compare lower the higher the score.
+ */
+struct CAncestorScoreKey
+{
+    CAmount nModFeesWithAncestors;
+    uint64_t nSizeWithAncestors;
+    uint256 hash;
+
+    CAncestorScoreKey(const uint256& hashIn, CAmount nModFeesIn, uint64_t nSizeIn):
+        nModFeesWithAncestors(nModFeesIn), nSizeWithAncestors(nSizeIn), hash(hashIn) {}
+    explicit CAncestorScoreKey(const CMemPoolEntry& entry):
+        nModFeesWithAncestors(entry.GetModFeesWithAncestors()), nSizeWithAncestors(entry.GetSizeWithAncestors()),
+        hash(entry.GetTxBase().GetHash()) {}
+
+    CFeeRate GetFeeRate() const { return CFeeRate(nModFeesWithAncestors, nSizeWithAncestors); }
+
+    bool operator<(const CAncestorScoreKey& other) const
+    {
+        // compare fee/size by cross multiplication, which does not fit 64 bits
+        double f1 = (double)nModFeesWithAncestors * other.nSizeWithAncestors;
+        double f2 = (double)other.nModFeesWithAncestors * nSizeWithAncestors;
+        if (f1 != f2)
+            return f1 > f2;
+        // the smaller package first, it is more likely to fit
+        if (nSizeWithAncestors != other.nSizeWithAncestors)
+            return nSizeWithAncestors < other.nSizeWithAncestors;
+        return hash < other.hash;
+    }
+};
+
+/**
+ * Sort key of the mempool entries by descendant score, i.e. by the higher of the fee rate of each entry and of the fee
+ * rate of the entry together with its in-mempool descendants, which are evicted with it. Keys compare lower the lower
+ * the score: the first ones are evicted first when the mempool is full.
+ */
+struct CDescendantScoreKey
+{
+    //! fee rate of the entry together with all its in-mempool descendants
+    CFeeRate packageFeeRate;
+    //! the higher of its own and of the package fee rate, so that a parent paid for by its descendants is kept
+    CFeeRate score;
+    //! tie-breaker among equal scores: 0 for transactions, 1 for certificates. CTxMemPool::TrimToSize sets it to 2 on
+    //! its own keys of the top quality certificates, which are not in any index
+    int rank;
+    uint256 hash;
+
+    explicit CDescendantScoreKey(const CMemPoolEntry& entry):
+        packageFeeRate(entry.GetModFeesWithDescendants(), entry.GetSizeWithDescendants()),
+        score(std::max(CFeeRate(entry.GetModifiedFee(), entry.GetSize()), packageFeeRate)),
+        rank(entry.GetTxBase().IsCertificate() ? 1 : 0), hash(entry.GetTxBase().GetHash()) {}
+
+    bool operator<(const CDescendantScoreKey& other) const
+    {
+        if (score != other.score)
+            return score < other.score;
+        if (rank != other.rank)
+            return rank < other.rank;
+        return hash < other.hash;
+    }
 };
 
 class CBlockPolicyEstimator;
@@ -121,7 +230,7 @@ struct CSidechainMemPoolEntry
     std::set<uint256> fwdTxHashes; 
     std::map<int64_t, uint256> mBackwardCertificates; //quality -> certHash
     std::set<uint256> mcBtrsTxHashes;
-    std::map<CFieldElement, uint256> cswNullifiers; // csw nullifier -> containing Tx hash
+    boost::unordered_map<CFieldElement, uint256, CFieldElementKeyHasher> cswNullifiers; // csw nullifier -> containing Tx hash, its size is the number of csw inputs
     CAmount cswTotalAmount;
 
     // Note: in fwdTxHashes and mcBtrsTxHashes, a tx is registered only once,
@@ -165,13 +274,55 @@ private:
     uint64_t totalCertificateSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
+    void trackPackageRemoved(const CFeeRate& rate);
+
+    //! set the ancestor/descendant statistics of a newly added entry and of its in-mempool relatives
+    void updateForAdd(const uint256& hash);
+    //! remove the entries about to be erased from the statistics of their relatives that stay in the mempool; the
+    //! relatives whose statistics can only be computed once the entries are gone are returned in toRecalculate
+    void updateForRemove(const std::vector<uint256>& objToRemove, std::set<uint256>& toRecalculate);
+    void recalculatePackageState(const uint256& hash);
+    //! recompute from scratch the ancestor/descendant statistics of an entry
+    void calculatePackageState(const CMemPoolEntry& entry, uint64_t& nCountWithAncestors, uint64_t& nSizeWithAncestors,
+                               CAmount& nModFeesWithAncestors, uint64_t& nCountWithDescendants,
+                               uint64_t& nSizeWithDescendants, CAmount& nModFeesWithDescendants) const;
+    void updateFeeDelta(const uint256& hash, CAmount nNewFeeDelta);
+
+    //! Take a transaction out of, or put it back into, the sorted indices below: the keys depend on its ancestor and
+    //! descendant statistics and prioritisation, which can only change while it is out of them.
+    void unindexTx(const uint256& hash);
+    void indexTx(const uint256& hash);
+
     bool checkTxImmatureExpenditures(const CTransaction& tx, const CCoinsViewCache * const pcoins);
     bool checkCertImmatureExpenditures(const CScCertificate& cert, const CCoinsViewCache * const pcoins);
 
-    std::map<uint256, std::shared_ptr<CTransactionBase> > mapRecentlyAddedTxBase;
+    std::map<uint256, std::shared_ptr<const CTransactionBase> > mapRecentlyAddedTxBase;
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
 
+    //! hashes of the last MAX_ADDED_JOURNAL_SIZE transactions and certificates added, oldest first, for the consumers
+    //! tracking the mempool changes (e.g. the block template); nAddedSequence counts all those ever added
+    std::deque<uint256> addedJournal;
+    uint64_t nAddedSequence = 0;
+
+    //! value of GetTransactionsUpdated() as last published to the threads in WaitForUpdate()
+    mutable CWaitableCriticalSection csUpdateWait;
+    mutable CConditionVariable cvUpdate;
+    unsigned int nUpdatesNotified = 0;
+    bool fWaitsInterrupted = false;
+    void notifyUpdate();
+
+    //! entry times read from mempool.dat, given back to the entries when they are accepted again
+    std::map<uint256, int64_t> mapLoadedTimes;
+    void applyLoadedTime(const uint256& hash, CMemPoolEntry& entry);
+
+    //! removeConflicts() without the CSW balance check, run once per block by removeForBlock()
+    void removeSpendConflicts(const CTransaction &tx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts);
+
 #ifdef ENABLE_ADDRESS_INDEXING
     typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
     addressDeltaMap mapAddress;
@@ -187,14 +338,25 @@ private:
 #endif // ENABLE_ADDRESS_INDEXING
 
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<uint256, CCertificateMemPoolEntry> mapCertificate;
     std::map<COutPoint, CInPoint> mapNextTx;
-    std::map<uint256, CSidechainMemPoolEntry> mapSidechains;
+    boost::unordered_map<uint256, CSidechainMemPoolEntry, CCoinsKeyHasher> mapSidechains;
     std::map<uint256, const CTransaction*> mapNullifiers;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+    // Sorted indices of mapTx, maintained along with it so that the block assembler can go through the best candidates
+    // only. Certificates are not indexed, they are few and always have the highest priority.
+    //! transactions by ancestor score, best first
+    std::set<CAncestorScoreKey> setTxByAncestorScore;
+    //! transactions by the chain height from which their priority allows them in the high-priority area of a block
+    std::set<std::pair<unsigned int, uint256> > setTxByHeightAllowingFree;
+    //! transactions by descendant score, the first to evict first
+    std::set<CDescendantScoreKey> setTxByDescendantScore;
+
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -234,6 +396,10 @@ public:
     bool removeSpentIndex(const uint256& txBaseHash);
 #endif // ENABLE_ADDRESS_INDEXING
 
+    //! entry of a transaction or certificate in the mempool, nullptr if there is none
+    const CMemPoolEntry* getEntry(const uint256& hash) const;
+    CMemPoolEntry* getEntry(const uint256& hash);
+
     std::vector<uint256> mempoolDirectDependenciesFrom(const CTransactionBase& root) const;
     std::vector<uint256> mempoolDirectDependenciesOf(const CTransactionBase& root) const;
 
@@ -243,6 +409,8 @@ public:
     void remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive = false);
 
     void removeWithAnchor(const uint256 &invalidRoot);
+    //! same as removeWithAnchor() for several roots at once, with a single pass over the mempool
+    void removeWithAnchors(const std::set<uint256>& invalidRoots);
 
     // UNCONFIRMED TRANSACTIONS CLEANUP METHODS
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
@@ -264,11 +432,41 @@ public:
                                  std::list<CScCertificate>& outdatedCerts);
     // END OF UNCONFIRMED CERTIFICATES CLEANUP METHODS
 
+    /**
+     * Remove the entries with the lowest fee rate (counting their in-mempool descendants, which are removed with them)
+     * until the dynamic memory usage is not above sizelimit. The top quality certificate of a sidechain is removed only
+     * after the forward transfers, backward transfer requests and CSWs of that sidechain, and after its lower quality
+     * certificates.
+     */
+    void TrimToSize(size_t sizelimit, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts);
+
+    /**
+     * The minimum fee rate to get into the mempool, which may itself not be enough for larger-sized transactions.
+     * It is raised by TrimToSize() and then decays back to zero, faster the emptier the mempool is.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
     void clear();
     void queryHashes(std::vector<uint256>& vtxid) const;
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    /**
+     * Block until GetTransactionsUpdated() is different from nKnown, the deadline is reached or InterruptWaits() is
+     * called. Returns whether the mempool has been updated. Must not be called holding cs.
+     */
+    bool WaitForUpdate(unsigned int nKnown, const boost::system_time& deadline) const;
+    //! wake up all threads in WaitForUpdate(), e.g. on shutdown
+    void InterruptWaits();
+
+    static const size_t MAX_ADDED_JOURNAL_SIZE = 10000;
+    //! number of transactions and certificates added to the mempool so far
+    uint64_t GetAddedSequence() const;
+    /**
+     * Append to vHashes the transactions and certificates added after GetAddedSequence() returned nSequence, oldest
+     * first. Some of them may have been removed since. Returns false if the journal does not go that far back.
+     */
+    bool GetAddedSince(uint64_t nSequence, std::vector<uint256>& vHashes) const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -277,9 +475,14 @@ public:
 
     /** Affect CreateNewBlock prioritisation of transactions */
     void PrioritiseTransaction(const uint256& hash, const std::string& strHash, double dPriorityDelta, const CAmount& nFeeDelta);
-    void ApplyDeltas(const uint256& hash, double &dPriorityDelta, CAmount &nFeeDelta);
+    void ApplyDeltas(const uint256& hash, double &dPriorityDelta, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256& hash);
 
+    /** Entry time to give to the transaction or certificate with the given hash when it is next added, if ever */
+    void SetLoadedTime(const uint256& hash, int64_t nTime);
+    /** Forgets the time set by SetLoadedTime(), once the transaction or certificate is known not to be added */
+    void EraseLoadedTime(const uint256& hash);
+
     void NotifyRecentlyAdded();
     bool IsFullyNotified();
 
@@ -339,37 +542,44 @@ public:
     bool hasSidechainCertificate(const uint256& scId) const
     {
         LOCK(cs);
-        return (mapSidechains.count(scId) != 0) && (!mapSidechains.at(scId).mBackwardCertificates.empty());
+        auto it = mapSidechains.find(scId);
+        return (it != mapSidechains.end()) && (!it->second.mBackwardCertificates.empty());
     }
 
     bool hasSidechainCreationTx(const uint256& scId) const
     {
         LOCK(cs);
-        return (mapSidechains.count(scId) != 0) && (!mapSidechains.at(scId).scCreationTxHash.IsNull());
+        auto it = mapSidechains.find(scId);
+        return (it != mapSidechains.end()) && (!it->second.scCreationTxHash.IsNull());
     }
 
     bool HaveCswNullifier(const uint256& scId, const CFieldElement &nullifier) const
     {
         LOCK(cs);
-        return mapSidechains.count(scId) != 0 && mapSidechains.at(scId).cswNullifiers.count(nullifier) != 0;
+        auto it = mapSidechains.find(scId);
+        return (it != mapSidechains.end()) && (it->second.cswNullifiers.count(nullifier) != 0);
     }
 
     bool hasSidechainBwtRequest(const uint256& scId) const
     {
         LOCK(cs);
-        return (mapSidechains.count(scId) != 0) && (!mapSidechains.at(scId).mcBtrsTxHashes.empty());
+        auto it = mapSidechains.find(scId);
+        return (it != mapSidechains.end()) && (!it->second.mcBtrsTxHashes.empty());
     }
 
     bool hasSidechainFwt(const uint256& scId) const
     {
         LOCK(cs);
-        return (mapSidechains.count(scId) != 0) && (!mapSidechains.at(scId).fwdTxHashes.empty());
+        auto it = mapSidechains.find(scId);
+        return (it != mapSidechains.end()) && (!it->second.fwdTxHashes.empty());
     }
 
     int getNumOfCswInputs(const uint256& scId) const;
 
     bool lookup(const uint256& hash, CTransaction& result) const;
     bool lookup(const uint256& hash, CScCertificate& result) const;
+    //! the transaction or certificate itself, shared rather than copied; empty if not in the mempool
+    std::shared_ptr<const CTransactionBase> get(const uint256& hash) const;
 
     void CertQualityStatusString(const CScCertificate& cert, std::string& statusString) const;
 
@@ -6,6 +6,7 @@
 #include "amount.h"
 #include "base58.h"
 #include "core_io.h"
+#include "crypto/sha256.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
@@ -4112,6 +4113,182 @@ UniValue zc_sample_joinsplit(const UniValue& params, bool fHelp)
     return HexStr(ss.begin(), ss.end());
 }
 
+static UniValue BenchmarkResultsToJSON(const std::vector<double>& sample_times)
+{
+    UniValue results(UniValue::VARR);
+    for (auto time : sample_times) {
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("runningtime", time);
+        results.push_back(result);
+    }
+    return results;
+}
+
+/**
+ * The optional numeric argument of a benchmark at position nPos, nDefault when omitted.
+ * Values out of [1, nMax] are rejected as an invalid number of what.
+ */
+static int GetBenchmarkArg(const UniValue& params, size_t nPos, int nDefault, const std::string& what,
+                           int nMax = std::numeric_limits<int>::max())
+{
+    int nValue = params.size() > nPos ? params[nPos].get_int() : nDefault;
+    if (nValue <= 0 || nValue > nMax)
+        throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of " + what);
+    return nValue;
+}
+
+/** Append one result object with the given fields, evaluated in order, to results */
+static void PushBenchmarkResult(UniValue& results, const std::vector<std::pair<std::string, UniValue> >& fields)
+{
+    UniValue result(UniValue::VOBJ);
+    for (const std::pair<std::string, UniValue>& field : fields)
+        result.pushKV(field.first, field.second);
+    results.push_back(result);
+}
+
+/** Runs one sample of a benchmark, appending its results */
+typedef void (*BenchmarkSampleFn)(const UniValue& params, UniValue& results);
+
+// time spent by tip updates waiting for cs_main while RPC readers run: cannot be run holding cs_main
+static void BenchmarkTipUpdateLatency(const UniValue& params, UniValue& results)
+{
+    int nThreads = GetBenchmarkArg(params, 2, 4, "threads");
+    PushBenchmarkResult(results, {{"runningtime", benchmark_tip_update_latency(nThreads)}});
+}
+
+// total fees of the block templates built by both transaction selection algorithms
+static void BenchmarkBlockTemplateFees(const UniValue& params, UniValue& results)
+{
+    CAmount nFees = 0;
+    CAmount nLegacyFees = 0;
+    double runningTime = benchmark_create_new_block(true, nFees);
+    double legacyTime = benchmark_create_new_block(false, nLegacyFees);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"legacyrunningtime", legacyTime},
+                                  {"fees", ValueFromAmount(nFees)}, {"legacyfees", ValueFromAmount(nLegacyFees)}});
+}
+
+// acceptance of a flood of transactions, checked inline and on worker threads
+static void BenchmarkMempoolFlood(const UniValue& params, UniValue& results)
+{
+    int nTxs = GetBenchmarkArg(params, 2, 1000, "transactions");
+    int nThreads = GetBenchmarkArg(params, 3, 4, "threads");
+    double serialTime = 0;
+    double runningTime = benchmark_mempool_flood(nTxs, nThreads, serialTime);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"serialrunningtime", serialTime}});
+}
+
+// chain reorganization, including the update of the mempool: cannot be run holding cs_main
+static void BenchmarkReorg(const UniValue& params, UniValue& results)
+{
+    if (Params().NetworkIDString() != "regtest") {
+        throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+    }
+    int nDepth = GetBenchmarkArg(params, 2, 10, "blocks");
+    double reconnectTime = 0;
+    double runningTime = benchmark_reorg(nDepth, reconnectTime);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"reconnectrunningtime", reconnectTime}});
+}
+
+// lookups and insertions from concurrent script check threads, compared with the legacy cache
+static void BenchmarkSigCache(const UniValue& params, UniValue& results)
+{
+    int nThreads = GetBenchmarkArg(params, 2, 16, "threads");
+    int nSigs = GetBenchmarkArg(params, 3, 20000, "signatures");
+    double legacyTime = 0;
+    double runningTime = benchmark_sigcache(nThreads, nSigs, legacyTime);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"legacyrunningtime", legacyTime}});
+}
+
+// scaling of the executor running the script checks with the number of threads
+static void BenchmarkCheckQueue(const UniValue& params, UniValue& results)
+{
+    int nMaxThreads = GetBenchmarkArg(params, 2, GetNumCores(), "threads", MAX_SCRIPTCHECK_THREADS);
+    int nSigs = GetBenchmarkArg(params, 3, 20000, "signatures");
+    for (int nThreads = 1; nThreads <= nMaxThreads; nThreads++)
+        PushBenchmarkResult(results, {{"threads", nThreads}, {"runningtime", benchmark_checkqueue(nThreads, nSigs)}});
+}
+
+// script checks verifying their signatures together per task, with the keys parsed once per block
+static void BenchmarkSigBatch(const UniValue& params, UniValue& results)
+{
+    int nTxs = GetBenchmarkArg(params, 2, 10000, "transactions");
+    int nKeys = GetBenchmarkArg(params, 3, 1000, "keys");
+    int nThreads = GetBenchmarkArg(params, 4, GetNumCores(), "threads", MAX_SCRIPTCHECK_THREADS);
+    double unbatchedTime = 0;
+    double runningTime = benchmark_sigbatch(nThreads, nTxs, nKeys, unbatchedTime);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"unbatchedrunningtime", unbatchedTime}});
+}
+
+// the SHA-256 implementations selected at startup, against each other and the standard one
+static void BenchmarkSHA256(const UniValue& params, UniValue& results)
+{
+    int nInputs = GetBenchmarkArg(params, 2, 100000, "inputs");
+    const int vUse[] = {SHA256_USE_STANDARD, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_SHANI, SHA256_USE_ALL};
+    for (int nUse : vUse) {
+        std::string implementation;
+        double streamTime = 0;
+        double runningTime = benchmark_sha256(nUse, nInputs, implementation, streamTime);
+        PushBenchmarkResult(results, {{"runningtime", runningTime}, {"streamrunningtime", streamTime},
+                                      {"implementation", implementation}});
+    }
+}
+
+// merkle roots of maximum-size blocks, computed level by level and node by node
+static void BenchmarkMerkleRoot(const UniValue& params, UniValue& results)
+{
+    int nLeaves = GetBenchmarkArg(params, 2, MAX_BLOCK_SIZE / 200, "leaves");
+    int nThreads = GetBenchmarkArg(params, 3, GetNumCores(), "threads", MAX_SCRIPTCHECK_THREADS);
+    double serialTime = 0, legacyTime = 0;
+    double runningTime = benchmark_merkle_root(nLeaves, nThreads, serialTime, legacyTime);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"serialrunningtime", serialTime},
+                                  {"legacyrunningtime", legacyTime}});
+}
+
+// the Equihash solutions of a headers message, with the batch and specialised verifiers
+static void BenchmarkEquihashHeaders(const UniValue& params, UniValue& results)
+{
+    int nHeaders = GetBenchmarkArg(params, 2, MAX_HEADERS_RESULTS, "headers");
+    int nThreads = GetBenchmarkArg(params, 3, GetNumCores(), "threads", MAX_SCRIPTCHECK_THREADS);
+    double serialTime = 0, genericTime = 0;
+    double runningTime = benchmark_verify_equihash_headers(nHeaders, nThreads, serialTime, genericTime);
+    PushBenchmarkResult(results, {{"runningtime", runningTime}, {"serialrunningtime", serialTime},
+                                  {"genericrunningtime", genericTime}});
+}
+
+#ifdef ENABLE_MINING
+// solutions per second of each Equihash solver, with one solver per thread
+static void BenchmarkEquihashSolvers(const UniValue& params, UniValue& results)
+{
+    int nMaxThreads = GetBenchmarkArg(params, 2, GetNumCores(), "threads");
+    int nNonces = GetBenchmarkArg(params, 3, 1, "nonces");
+    const char* vSolvers[] = {"default", "tromp"};
+    for (const char* solver : vSolvers) {
+        for (int nThreads = 1; nThreads <= nMaxThreads; nThreads++) {
+            size_t nSolutions = 0;
+            double duration = benchmark_equihash_solver(solver, nThreads, nNonces, nSolutions);
+            PushBenchmarkResult(results, {{"solver", solver}, {"threads", nThreads}, {"runningtime", duration},
+                                          {"solutions", (uint64_t)nSolutions}, {"solutionspersecond", nSolutions / duration}});
+        }
+    }
+}
+#endif
+
+static const std::map<std::string, BenchmarkSampleFn> mapUnlockedBenchmarks = {
+    {"tipupdatelatency", BenchmarkTipUpdateLatency},
+    {"blocktemplatefees", BenchmarkBlockTemplateFees},
+    {"mempoolflood", BenchmarkMempoolFlood},
+    {"reorg", BenchmarkReorg},
+    {"sigcache", BenchmarkSigCache},
+    {"checkqueue", BenchmarkCheckQueue},
+    {"sigbatch", BenchmarkSigBatch},
+    {"sha256", BenchmarkSHA256},
+    {"merkleroot", BenchmarkMerkleRoot},
+    {"equihashheaders", BenchmarkEquihashHeaders},
+#ifdef ENABLE_MINING
+    {"equihashsolvers", BenchmarkEquihashSolvers},
+#endif
+};
+
 UniValue zc_benchmark(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp)) {
@@ -4144,6 +4321,49 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             "sendtoaddress\n"
             "loadwallet\n"
             "listunspent\n"
+            "tipupdatelatency    (optional third argument: number of RPC reader threads, default 4)\n"
+            "blocktemplatefees   (templates built from the current mempool with ancestor score and with legacy\n"
+            "                     selection: running times as runningtime/legacyrunningtime, fees as fees/legacyfees)\n"
+            "mempoolflood        (synthetic transactions checked under a single lock and with the checks on worker\n"
+            "                     threads: running times as serialrunningtime/runningtime; optional third argument:\n"
+            "                     number of transactions, default 1000, fourth: number of threads, default 4)\n"
+            "reorg               (regtest only, disconnects the last blocks and connects them again: running times as\n"
+            "                     runningtime/reconnectrunningtime; optional third argument: number of blocks, default 10)\n"
+            "cswconflicts        (conflict checks of incoming CSWs against the ones of the same sidechain in the mempool;\n"
+            "                     optional third argument: number of CSWs, default 10000)\n"
+            "sigcache            (signatures inserted by mempool acceptance then found by block connection, on\n"
+            "                     concurrent threads, with the signature cache and with the legacy std::set one: running\n"
+            "                     times as runningtime/legacyrunningtime; optional third argument: number of threads,\n"
+            "                     default 16, fourth: number of signatures, default 20000)\n"
+            "checkqueue          (signature verifications added to the validation check executor transaction by\n"
+            "                     transaction, from 1 up to the given number of threads: one result per sample and\n"
+            "                     number of threads, with the number as threads; optional third argument: largest\n"
+            "                     number of threads, default the number of cores, fourth: number of signatures,\n"
+            "                     default 20000)\n"
+            "sigbatch            (script checks of two-input P2PKH transactions run on the validation check executor,\n"
+            "                     with their signatures verified after the scripts of each task and one by one: running\n"
+            "                     times as runningtime/unbatchedrunningtime; optional third argument: number of\n"
+            "                     transactions, default 10000, fourth: number of distinct keys, default 1000, fifth:\n"
+            "                     number of threads, default the number of cores)\n"
+            "sha256              (double SHA-256 of 64-byte inputs, as for merkle tree nodes, and SHA-256 of the same\n"
+            "                     data in one stream, with each implementation supported by the CPU, the process\n"
+            "                     switching to it meanwhile: one result per sample and implementation, described as\n"
+            "                     implementation, running times as runningtime/streamrunningtime; optional third\n"
+            "                     argument: number of inputs, default 100000)\n"
+            "merkleroot          (merkle tree of random leaves, with its levels split across threads, on one thread,\n"
+            "                     and hashed node by node: running times as runningtime/serialrunningtime/\n"
+            "                     legacyrunningtime; optional third argument: number of leaves, default 20000, about\n"
+            "                     a maximum-size block of small transactions, fourth: number of threads, default the\n"
+            "                     number of cores)\n"
+            "equihashheaders     (Equihash solutions of headers checked all at once across threads, one by one, and\n"
+            "                     one by one with the generic verifier: running times as runningtime/serialrunningtime/\n"
+            "                     genericrunningtime; optional third argument: number of headers, default 160, a full\n"
+            "                     headers message, fourth: number of threads, default the number of cores)\n"
+            "equihashsolvers     (Equihash<200,9> solved for random nonces by each solver, from 1 up to the given number\n"
+            "                     of threads, each with its own solver: one result per sample, solver and number of\n"
+            "                     threads, with the solutions found and solutions per second; optional third argument:\n"
+            "                     largest number of threads, default the number of cores, fourth: number of nonces per\n"
+            "                     thread, default 1)\n"
             
             "\nResult:\n"
             "[\n"
@@ -4167,8 +4387,6 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
 
 
 
-    LOCK(cs_main);
-
     std::string benchmarktype = params[0].get_str();
     int samplecount = params[1].get_int();
 
@@ -4178,6 +4396,17 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
 
     std::vector<double> sample_times;
 
+    // benchmarks run without cs_main, each taking it as it needs
+    std::map<std::string, BenchmarkSampleFn>::const_iterator itBenchmark = mapUnlockedBenchmarks.find(benchmarktype);
+    if (itBenchmark != mapUnlockedBenchmarks.end()) {
+        UniValue results(UniValue::VARR);
+        for (int i = 0; i < samplecount; i++)
+            itBenchmark->second(params, results);
+        return results;
+    }
+
+    LOCK(cs_main);
+
     JSDescription samplejoinsplit = JSDescription::getNewInstance(shieldedTxVersion == GROTH_TX_VERSION);
 
     if (benchmarktype == "verifyjoinsplit") {
@@ -4241,19 +4470,19 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             sample_times.push_back(benchmark_loadwallet());
         } else if (benchmarktype == "listunspent") {
             sample_times.push_back(benchmark_listunspent());
+        } else if (benchmarktype == "cswconflicts") {
+            int nCsws = 10000;
+            if (params.size() > 2)
+                nCsws = params[2].get_int();
+            if (nCsws <= 0)
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of CSWs");
+            sample_times.push_back(benchmark_mempool_csw_conflicts(nCsws));
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
     }
 
-    UniValue results(UniValue::VARR);
-    for (auto time : sample_times) {
-        UniValue result(UniValue::VOBJ);
-        result.pushKV("runningtime", time);
-        results.push_back(result);
-    }
-
-    return results;
+    return BenchmarkResultsToJSON(sample_times);
 }
 
 UniValue zc_raw_receive(const UniValue& params, bool fHelp)
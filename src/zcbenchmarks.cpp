@@ -1,9 +1,13 @@
+#include <atomic>
 #include <cstdio>
 #include <future>
 #include <map>
+#include <set>
 #include <thread>
 #include <unistd.h>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
 
 #include "coins.h"
 #include "util.h"
@@ -13,11 +17,14 @@
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "main.h"
 #include "miner.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
@@ -478,3 +485,625 @@ double benchmark_listunspent()
     auto unspent = listunspent(params, false);
     return timer_stop(tv_start);
 }
+
+double benchmark_tip_update_latency(size_t nReaderThreads)
+{
+    std::string strTipHash;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() == NULL)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "No active chain");
+        strTipHash = chainActive.Tip()->GetBlockHash().GetHex();
+    }
+
+    // block explorer like load: the read-only calls issued most often
+    std::atomic<bool> fStop(false);
+    boost::thread_group readers;
+    for (size_t i = 0; i < nReaderThreads; i++) {
+        readers.create_thread([&fStop, &strTipHash]() {
+            UniValue noParams(UniValue::VARR);
+            UniValue blockParams(UniValue::VARR);
+            blockParams.push_back(strTipHash);
+            blockParams.push_back(2);
+            UniValue headerParams(UniValue::VARR);
+            headerParams.push_back(strTipHash);
+            UniValue mempoolParams(UniValue::VARR);
+            mempoolParams.push_back(true);
+            while (!fStop) {
+                try {
+                    getblock(blockParams, false);
+                    getblockheader(headerParams, false);
+                    getrawmempool(mempoolParams, false);
+                    getblockcount(noParams, false);
+                } catch (const UniValue& objError) {
+                    LogPrintf("%s: %s\n", __func__, find_value(objError, "message").get_str());
+                    return;
+                }
+            }
+        });
+    }
+
+    // a tip update starts by acquiring cs_main: measure how long it waits for the readers
+    static const int TIP_UPDATES = 100;
+    double waited = 0;
+    for (int i = 0; i < TIP_UPDATES; i++) {
+        struct timeval tv_start;
+        timer_start(tv_start);
+        {
+            LOCK(cs_main);
+            waited += timer_stop(tv_start);
+        }
+        MilliSleep(1);
+    }
+
+    fStop = true;
+    readers.join_all();
+
+    return waited;
+}
+
+double benchmark_create_new_block(bool fAncestorScore, CAmount& nFees)
+{
+    // CreateNewBlock reads the selection algorithm from the command line arguments
+    bool fWasSet = mapArgs.count("-blockancestorscore") != 0;
+    std::string strPrevious = GetArg("-blockancestorscore", "");
+    mapArgs["-blockancestorscore"] = fAncestorScore ? "1" : "0";
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(CScript() << OP_TRUE));
+    double duration = timer_stop(tv_start);
+
+    if (fWasSet)
+        mapArgs["-blockancestorscore"] = strPrevious;
+    else
+        mapArgs.erase("-blockancestorscore");
+
+    nFees = -pblocktemplate->vTxFees[0];
+    return duration;
+}
+
+double benchmark_mempool_flood(size_t nTxs, size_t nThreads, double& serialTime)
+{
+    CKey priv;
+    priv.MakeNewKey(false);
+    CBasicKeyStore tempKeystore;
+    tempKeystore.AddKey(priv);
+
+    // a funding transaction with one output per spending transaction; the two runs spend
+    // different outputs so that the second one does not find the signatures in the sigcache
+    CCoinsView dummy;
+    CCoinsViewCache inputs(&dummy);
+    std::vector<CTransaction> vSerialTxs;
+    std::vector<CTransaction> vParallelTxs;
+    CBlockIndex* pindexTip = NULL;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() == NULL)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "No active chain");
+        pindexTip = chainActive.Tip();
+
+        CScript prevPubKey = GetScriptForDestination(priv.GetPubKey().GetID());
+        CMutableTransaction m_funding_tx;
+        for (size_t i = 0; i < 2 * nTxs; i++)
+            m_funding_tx.addOut(CTxOut(1000000, prevPubKey));
+        CTransaction funding_tx(m_funding_tx);
+        inputs.ModifyCoins(funding_tx.GetHash())->From(funding_tx, pindexTip->nHeight);
+
+        for (size_t i = 0; i < 2 * nTxs; i++) {
+            CMutableTransaction spending_tx;
+            spending_tx.vin.emplace_back(funding_tx.GetHash(), i);
+            spending_tx.addOut(CTxOut(990000, prevPubKey));
+            SignSignature(tempKeystore, prevPubKey, spending_tx, 0, SIGHASH_ALL);
+            (i < nTxs ? vSerialTxs : vParallelTxs).push_back(CTransaction(spending_tx));
+        }
+    }
+    CTipChain chain(pindexTip);
+
+    // what mempool acceptance does per transaction outside of the mempool bookkeeping
+    auto check = [&inputs, &chain](const CTransaction& tx) {
+        CValidationState state;
+        auto verifier = libzcash::ProofVerifier::Strict();
+        bool fValid = CheckTransaction(tx, state, verifier) && CheckTxBaseInputScripts(tx, state, inputs, chain);
+        assert(fValid);
+    };
+
+    // cs stands in for cs_main: held for the whole acceptance in the serial run, only while
+    // adding to the pool in the two-phase one
+    CCriticalSection cs;
+    struct timeval tv_start;
+
+    CTxMemPool serialPool(::minRelayTxFee);
+    timer_start(tv_start);
+    for (const CTransaction& tx : vSerialTxs) {
+        LOCK(cs);
+        check(tx);
+        serialPool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 10000, GetTime(), 0, pindexTip->nHeight));
+    }
+    serialTime = timer_stop(tv_start);
+
+    CTxMemPool parallelPool(::minRelayTxFee);
+    std::atomic<size_t> nNext(0);
+    timer_start(tv_start);
+    boost::thread_group workers;
+    for (size_t i = 0; i < nThreads; i++) {
+        workers.create_thread([&]() {
+            for (size_t n = nNext++; n < vParallelTxs.size(); n = nNext++) {
+                const CTransaction& tx = vParallelTxs[n];
+                check(tx);
+                LOCK(cs);
+                parallelPool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 10000, GetTime(), 0, pindexTip->nHeight));
+            }
+        });
+    }
+    workers.join_all();
+    double parallelTime = timer_stop(tv_start);
+
+    assert(serialPool.size() == nTxs && parallelPool.size() == nTxs);
+    return parallelTime;
+}
+
+double benchmark_reorg(int nDepth, double& reconnectTime)
+{
+    CValidationState state;
+    CBlockIndex* pindexFork = NULL;
+    struct timeval tv_start;
+
+    // disconnecting the blocks gives their transactions back to the mempool
+    timer_start(tv_start);
+    {
+        LOCK(cs_main);
+        if (chainActive.Height() < nDepth)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Active chain is not long enough");
+        pindexFork = chainActive[chainActive.Height() - nDepth + 1];
+        InvalidateBlock(state, pindexFork);
+    }
+    if (state.IsValid())
+        ActivateBestChain(state);
+    double disconnectTime = timer_stop(tv_start);
+
+    // back to the original chain, whose blocks take the transactions from the mempool again
+    timer_start(tv_start);
+    {
+        LOCK(cs_main);
+        ReconsiderBlock(state, pindexFork);
+    }
+    if (state.IsValid())
+        ActivateBestChain(state);
+    reconnectTime = timer_stop(tv_start);
+
+    if (!state.IsValid())
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
+    return disconnectTime;
+}
+
+static CFieldElement RandomCswNullifier()
+{
+    std::vector<unsigned char> bytes(CFieldElement::ByteSize());
+    GetRandBytes(bytes.data(), bytes.size() - 1); // the last byte is left at zero to stay in the field
+    return CFieldElement(bytes);
+}
+
+static CTransaction CreateCswTx(const uint256& scId)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = SC_TX_VERSION;
+    CTxCeasedSidechainWithdrawalInput csw;
+    csw.scId = scId;
+    csw.nValue = 1;
+    csw.nullifier = RandomCswNullifier();
+    mtx.vcsw_ccin.push_back(csw);
+    mtx.addOut(CTxOut(1, CScript() << OP_TRUE));
+    return CTransaction(mtx);
+}
+
+double benchmark_mempool_csw_conflicts(size_t nCsws)
+{
+    // a ceased sidechain with nCsws withdrawals in the mempool, then as many incoming ones
+    // checked against them: the time per check must not grow with nCsws
+    CTxMemPool pool(::minRelayTxFee);
+    uint256 scId = GetRandHash();
+    for (size_t i = 0; i < nCsws; i++) {
+        CTransaction tx = CreateCswTx(scId);
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, 0));
+    }
+
+    std::vector<CTransaction> vIncoming;
+    for (size_t i = 0; i < nCsws; i++)
+        vIncoming.push_back(CreateCswTx(scId));
+
+    size_t nConflicts = 0;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (const CTransaction& tx : vIncoming) {
+        if (!pool.checkIncomingTxConflicts(tx))
+            nConflicts++;
+        pool.checkCswInputsPerScLimit(tx);
+    }
+    double duration = timer_stop(tv_start);
+
+    assert(nConflicts == 0 && pool.getNumOfCswInputs(scId) == static_cast<int>(nCsws));
+    return duration;
+}
+
+namespace {
+
+//! the signature cache before it was made a fixed-size table, kept as a reference for benchmark_sigcache
+class CLegacySignatureCache
+{
+private:
+    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
+    std::set<sigdata_type> setValid;
+    boost::shared_mutex cs_sigcache;
+
+public:
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.count(sigdata_type(hash, vchSig, pubKey)) != 0;
+    }
+
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    {
+        // the former default of -maxsigcachesize, in entries
+        const size_t nMaxCacheSize = 50000;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        while (setValid.size() > nMaxCacheSize) {
+            std::vector<unsigned char> unused;
+            std::set<sigdata_type>::iterator it = setValid.lower_bound(sigdata_type(GetRandHash(), unused, unused));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(*it);
+        }
+        setValid.insert(sigdata_type(hash, vchSig, pubKey));
+    }
+};
+
+struct CSignatureSample
+{
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    CPubKey pubkey;
+};
+
+// runs fn(i) for every i in [0, nItems) over nThreads threads, like the script check queue workers
+template <typename F>
+void RunOnThreads(size_t nThreads, size_t nItems, F fn)
+{
+    std::atomic<size_t> nNext(0);
+    boost::thread_group workers;
+    for (size_t i = 0; i < nThreads; i++) {
+        workers.create_thread([&]() {
+            for (size_t n = nNext++; n < nItems; n = nNext++)
+                fn(n);
+        });
+    }
+    workers.join_all();
+}
+
+}
+
+double benchmark_sigcache(size_t nThreads, size_t nSigs, double& legacyTime)
+{
+    // signatures with the sizes of real ones; the caches never verify them
+    std::vector<CSignatureSample> vSamples(nSigs);
+    for (CSignatureSample& sample : vSamples) {
+        sample.hash = GetRandHash();
+        sample.vchSig.resize(72);
+        GetRandBytes(sample.vchSig.data(), sample.vchSig.size());
+        std::vector<unsigned char> vchPubKey(COMPRESSED_PUBLIC_KEY_SIZE);
+        GetRandBytes(vchPubKey.data(), vchPubKey.size());
+        vchPubKey[0] = 0x02;
+        sample.pubkey.Set(vchPubKey.begin(), vchPubKey.end());
+    }
+
+    // each run does what happens to a signature in the mempool and then in a block: a missed
+    // lookup and an insertion on acceptance, a hit when the block is connected
+    struct timeval tv_start;
+
+    CLegacySignatureCache legacyCache;
+    timer_start(tv_start);
+    RunOnThreads(nThreads, nSigs, [&](size_t n) {
+        const CSignatureSample& s = vSamples[n];
+        if (!legacyCache.Get(s.hash, s.vchSig, s.pubkey))
+            legacyCache.Set(s.hash, s.vchSig, s.pubkey);
+    });
+    std::atomic<size_t> nLegacyHits(0);
+    RunOnThreads(nThreads, nSigs, [&](size_t n) {
+        const CSignatureSample& s = vSamples[n];
+        if (legacyCache.Get(s.hash, s.vchSig, s.pubkey))
+            nLegacyHits++;
+    });
+    legacyTime = timer_stop(tv_start);
+
+    CSignatureCache cache(DEFAULT_MAX_SIG_CACHE_SIZE << 20);
+    timer_start(tv_start);
+    RunOnThreads(nThreads, nSigs, [&](size_t n) {
+        const CSignatureSample& s = vSamples[n];
+        uint256 entry;
+        cache.ComputeEntry(entry, s.hash, s.vchSig, s.pubkey);
+        if (!cache.Get(entry, false))
+            cache.Set(entry);
+    });
+    std::atomic<size_t> nHits(0);
+    RunOnThreads(nThreads, nSigs, [&](size_t n) {
+        const CSignatureSample& s = vSamples[n];
+        uint256 entry;
+        cache.ComputeEntry(entry, s.hash, s.vchSig, s.pubkey);
+        if (cache.Get(entry, true))
+            nHits++;
+    });
+    double duration = timer_stop(tv_start);
+
+    LogPrintf("%s: %u signatures, %u hits, %u hits with the legacy cache\n", __func__, nSigs, (size_t)nHits, (size_t)nLegacyHits);
+    return duration;
+}
+
+namespace {
+
+//! ECDSA verification standing for a script check, which it dominates
+struct CSignatureVerification
+{
+    const CSignatureSample* psample;
+
+    CSignatureVerification(): psample(nullptr) {}
+    explicit CSignatureVerification(const CSignatureSample* psampleIn): psample(psampleIn) {}
+
+    bool operator()() { return psample->pubkey.Verify(psample->hash, psample->vchSig); }
+    void swap(CSignatureVerification& check) { std::swap(psample, check.psample); }
+};
+
+}
+
+double benchmark_checkqueue(size_t nThreads, size_t nSigs)
+{
+    std::vector<CSignatureSample> vSamples(nSigs);
+    for (CSignatureSample& sample : vSamples) {
+        CKey key;
+        key.MakeNewKey(true);
+        sample.hash = GetRandHash();
+        key.Sign(sample.hash, sample.vchSig);
+        sample.pubkey = key.GetPubKey();
+    }
+
+    // a dedicated executor, the thread connecting blocks being the nThreads-th worker
+    boost::thread_group workers;
+    CCheckExecutor executor;
+    executor.Start(workers, nThreads - 1, false);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    bool fOk;
+    {
+        CCheckGroup<CSignatureVerification> group(nThreads > 1 ? &executor : NULL, SCRIPT_CHECK_BATCH_SIZE);
+        // added transaction by transaction as ConnectBlock() does, with two inputs each
+        for (size_t n = 0; n < nSigs; n += 2) {
+            std::vector<CSignatureVerification> vChecks;
+            for (size_t i = n; i < std::min(n + 2, nSigs); i++)
+                vChecks.push_back(CSignatureVerification(&vSamples[i]));
+            group.Add(vChecks);
+        }
+        fOk = group.Wait();
+    }
+    double duration = timer_stop(tv_start);
+
+    workers.interrupt_all();
+    workers.join_all();
+
+    assert(fOk);
+    return duration;
+}
+
+double benchmark_sigbatch(size_t nThreads, size_t nTxs, size_t nKeys, double& unbatchedTime)
+{
+    // transactions with two P2PKH inputs each, as in ConnectBlock(), spending from nKeys keys
+    // so that a key is reused by several inputs of the block as with real addresses
+    CBasicKeyStore tempKeystore;
+    std::vector<CScript> vPrevPubKeys;
+    for (size_t i = 0; i < nKeys; i++) {
+        CKey priv;
+        priv.MakeNewKey(true);
+        tempKeystore.AddKey(priv);
+        vPrevPubKeys.push_back(GetScriptForDestination(priv.GetPubKey().GetID()));
+    }
+
+    CMutableTransaction m_funding_tx;
+    for (size_t i = 0; i < 2 * nTxs; i++)
+        m_funding_tx.addOut(CTxOut(1000000, vPrevPubKeys[i % nKeys]));
+    CTransaction funding_tx(m_funding_tx);
+
+    std::vector<CTransaction> vTxs;
+    for (size_t n = 0; n < nTxs; n++) {
+        CMutableTransaction spending_tx;
+        for (size_t i = 2 * n; i < 2 * n + 2; i++)
+            spending_tx.vin.emplace_back(funding_tx.GetHash(), i);
+        spending_tx.addOut(CTxOut(1990000, vPrevPubKeys[n % nKeys]));
+        for (unsigned int nIn = 0; nIn < 2; nIn++)
+            SignSignature(tempKeystore, funding_tx, spending_tx, nIn, SIGHASH_ALL);
+        vTxs.push_back(CTransaction(spending_tx));
+    }
+    std::vector<CPrecomputedTransactionData> vTxData;
+    for (const CTransaction& tx : vTxs)
+        vTxData.emplace_back(tx);
+
+    // a dedicated executor, the thread connecting blocks being the nThreads-th worker
+    boost::thread_group workers;
+    CCheckExecutor executor;
+    executor.Start(workers, nThreads - 1, false);
+
+    // the signatures are not stored in the cache, so that the second run does not find them
+    auto run = [&](bool fBatch) {
+        CPubKeyCache pubkeyCache;
+        CCheckGroup<CScriptCheck> group(nThreads > 1 ? &executor : NULL, SCRIPT_CHECK_BATCH_SIZE);
+        for (size_t n = 0; n < nTxs; n++) {
+            std::vector<CScriptCheck> vChecks;
+            for (unsigned int nIn = 0; nIn < 2; nIn++) {
+                vChecks.push_back(CScriptCheck(vPrevPubKeys[(2 * n + nIn) % nKeys], vTxs[n], nIn, nullptr,
+                                               STANDARD_NONCONTEXTUAL_SCRIPT_VERIFY_FLAGS, false, &vTxData[n]));
+                if (fBatch)
+                    vChecks.back().EnableBatchVerification(&pubkeyCache);
+            }
+            group.Add(vChecks);
+        }
+        bool fOk = group.Wait();
+        assert(fOk);
+    };
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    run(false);
+    unbatchedTime = timer_stop(tv_start);
+
+    timer_start(tv_start);
+    run(true);
+    double duration = timer_stop(tv_start);
+
+    workers.interrupt_all();
+    workers.join_all();
+    return duration;
+}
+
+double benchmark_sha256(int nUse, size_t nInputs, std::string& implementation, double& streamTime)
+{
+    std::vector<unsigned char> in(64 * nInputs), out(32 * nInputs);
+    GetRandBytes(in.data(), in.size());
+    implementation = SHA256AutoDetect(nUse);
+
+    // the inner nodes of a merkle tree with nInputs leaves on its bottom level
+    struct timeval tv_start;
+    timer_start(tv_start);
+    SHA256D64(out.data(), in.data(), nInputs);
+    double duration = timer_stop(tv_start);
+
+    // the same amount of data in one stream, as when hashing a transaction
+    timer_start(tv_start);
+    CSHA256().Write(in.data(), in.size()).Finalize(out.data());
+    streamTime = timer_stop(tv_start);
+
+    SHA256AutoDetect();
+    return duration;
+}
+
+double benchmark_merkle_root(size_t nLeaves, size_t nThreads, double& serialTime, double& legacyTime)
+{
+    std::vector<uint256> vLeaves(nLeaves);
+    for (uint256& leaf : vLeaves)
+        leaf = GetRandHash();
+
+    // a dedicated executor, the thread building the tree being the nThreads-th worker
+    boost::thread_group workers;
+    CCheckExecutor executor;
+    executor.Start(workers, nThreads - 1, false);
+
+    std::vector<uint256> vTree(vLeaves);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    uint256 root = CBlock::BuildMerkleTree(vTree, nLeaves, NULL, &executor);
+    double duration = timer_stop(tv_start);
+
+    workers.interrupt_all();
+    workers.join_all();
+
+    vTree = vLeaves;
+    timer_start(tv_start);
+    uint256 serialRoot = CBlock::BuildMerkleTree(vTree, nLeaves);
+    serialTime = timer_stop(tv_start);
+
+    // the nodes hashed one by one, as before
+    vTree = vLeaves;
+    timer_start(tv_start);
+    size_t j = 0;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2) {
+        for (size_t i = 0; i < nSize; i += 2) {
+            size_t i2 = std::min(i + 1, nSize - 1);
+            vTree.push_back(Hash(BEGIN(vTree[j + i]), END(vTree[j + i]), BEGIN(vTree[j + i2]), END(vTree[j + i2])));
+        }
+        j += nSize;
+    }
+    legacyTime = timer_stop(tv_start);
+
+    assert(root == serialRoot && root == vTree.back());
+    return duration;
+}
+
+double benchmark_verify_equihash_headers(size_t nHeaders, size_t nThreads, double& serialTime, double& genericTime)
+{
+    const CChainParams& params = Params(CBaseChainParams::MAIN);
+    std::vector<CBlockHeader> headers(nHeaders, params.GenesisBlock().GetBlockHeader());
+
+    // a dedicated executor, the thread checking the headers being the nThreads-th worker
+    boost::thread_group workers;
+    CCheckExecutor executor;
+    executor.Start(workers, nThreads - 1, false);
+
+    std::vector<unsigned char> vChecked;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    bool fValid = CheckEquihashSolutions(headers, params, &executor, vChecked);
+    double duration = timer_stop(tv_start);
+
+    workers.interrupt_all();
+    workers.join_all();
+    assert(fValid);
+
+    timer_start(tv_start);
+    for (const CBlockHeader& header : headers)
+        assert(CheckEquihashSolution(&header, params));
+    serialTime = timer_stop(tv_start);
+
+    // the generic verifier, from the hash state of the input
+    timer_start(tv_start);
+    for (const CBlockHeader& header : headers) {
+        eh_HashState state;
+        Eh200_9.InitialiseState(state);
+        CEquihashInput I{header};
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << I;
+        ss << header.nNonce;
+        crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+        assert(Eh200_9.IsValidSolution(state, header.nSolution));
+    }
+    genericTime = timer_stop(tv_start);
+
+    return duration;
+}
+
+#ifdef ENABLE_MINING
+double benchmark_equihash_solver(const std::string& strSolver, size_t nThreads, size_t nNonces, size_t& nSolutions)
+{
+    CBlock block;
+    CEquihashInput I{block};
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+    const std::vector<unsigned char> vInput(ss.begin(), ss.end());
+
+    unsigned int n = Params(CBaseChainParams::MAIN).EquihashN();
+    unsigned int k = Params(CBaseChainParams::MAIN).EquihashK();
+
+    // as the mining threads, each thread owns a solver and tries its own nonces
+    std::atomic<size_t> nFound(0);
+    std::vector<std::thread> threads;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t t = 0; t < nThreads; t++) {
+        threads.emplace_back([&]() {
+            CEquihashSolver solver(strSolver);
+            std::vector<unsigned char> vNonceInput(vInput);
+            vNonceInput.resize(vInput.size() + 32);
+            for (size_t i = 0; i < nNonces; i++) {
+                randombytes_buf(&vNonceInput[vInput.size()], 32);
+                solver.Solve(n, k, &vNonceInput[0], vNonceInput.size(),
+                             [&nFound](std::vector<unsigned char> soln) { nFound++; return false; },
+                             [](EhSolverCancelCheck pos) { return false; });
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    double duration = timer_stop(tv_start);
+
+    nSolutions = nFound.load();
+    return duration;
+}
+#endif // ENABLE_MINING
@@ -19,5 +19,17 @@ extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();
+extern double benchmark_tip_update_latency(size_t nReaderThreads);
+extern double benchmark_create_new_block(bool fAncestorScore, CAmount& nFees);
+extern double benchmark_mempool_flood(size_t nTxs, size_t nThreads, double& serialTime);
+extern double benchmark_reorg(int nDepth, double& reconnectTime);
+extern double benchmark_mempool_csw_conflicts(size_t nCsws);
+extern double benchmark_sigcache(size_t nThreads, size_t nSigs, double& legacyTime);
+extern double benchmark_checkqueue(size_t nThreads, size_t nSigs);
+extern double benchmark_sigbatch(size_t nThreads, size_t nTxs, size_t nKeys, double& unbatchedTime);
+extern double benchmark_sha256(int nUse, size_t nInputs, std::string& implementation, double& streamTime);
+extern double benchmark_merkle_root(size_t nLeaves, size_t nThreads, double& serialTime, double& legacyTime);
+extern double benchmark_verify_equihash_headers(size_t nHeaders, size_t nThreads, double& serialTime, double& genericTime);
+extern double benchmark_equihash_solver(const std::string& strSolver, size_t nThreads, size_t nNonces, size_t& nSolutions);
 
 #endif